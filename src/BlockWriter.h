@@ -0,0 +1,60 @@
+/*******************************************************************************
+ *
+ * Copyright (C) 2009, Alexander Stigsen, e-texteditor.com
+ *
+ * This software is licensed under the Open Company License as described
+ * in the file license.txt, which you should have received as part of this
+ * distribution. The terms are also available at http://opencompany.org/license.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ******************************************************************************/
+
+#ifndef __BLOCKWRITER_H__
+#define __BLOCKWRITER_H__
+
+#include <wx/ffile.h>
+#include <vector>
+#include <cstring>
+
+// Collects many small writes into large sequential blocks.
+// Nothing is written on destruction, so buffered data can be
+// abandoned if the caller runs into an error.
+class BlockWriter {
+public:
+	BlockWriter(wxFFile& file, size_t blockSize=1024*1024)
+		: m_file(file), m_buffer(blockSize), m_used(0), m_isOk(true) {};
+
+	void Write(const char* data, size_t len) {
+		if (m_used + len > m_buffer.size()) {
+			Flush();
+
+			// Large blocks are written directly
+			if (len >= m_buffer.size()) {
+				if (m_file.Write(data, len) != len) m_isOk = false;
+				return;
+			}
+		}
+		memcpy(&m_buffer[m_used], data, len);
+		m_used += len;
+	};
+
+	bool Flush() {
+		if (m_used) {
+			if (m_file.Write(&m_buffer[0], m_used) != m_used) m_isOk = false;
+			m_used = 0;
+		}
+		return m_isOk;
+	};
+
+	bool IsOk() const {return m_isOk;};
+
+private:
+	wxFFile& m_file;
+	std::vector<char> m_buffer;
+	size_t m_used;
+	bool m_isOk;
+};
+
+#endif // __BLOCKWRITER_H__
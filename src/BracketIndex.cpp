@@ -0,0 +1,399 @@
+/*******************************************************************************
+ *
+ * Copyright (C) 2009, Alexander Stigsen, e-texteditor.com
+ *
+ * This software is licensed under the Open Company License as described
+ * in the file license.txt, which you should have received as part of this
+ * distribution. The terms are also available at http://opencompany.org/license.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ******************************************************************************/
+
+
+#include "BracketIndex.h"
+#include "Document.h"
+
+#include "wx/wxprec.h"
+#ifndef WX_PRECOMP
+   #include <wx/wx.h>
+#endif
+
+// Initializing static constants
+const unsigned int BracketIndex::MAXCHUNK = 512;
+
+BracketIndex::BracketIndex(char open, char close, bool escapes)
+: m_open(open), m_close(close), m_escapes(escapes), m_count(0), m_length(0) {
+	wxASSERT(open != close);
+}
+
+BracketIndex::~BracketIndex() {
+	Clear();
+}
+
+void BracketIndex::Clear(unsigned int length) {
+	for (std::vector<Chunk*>::iterator p = m_chunks.begin(); p != m_chunks.end(); ++p) delete *p;
+	m_chunks.clear();
+	m_count = 0;
+	m_length = length;
+}
+
+void BracketIndex::GetPositions(std::vector<unsigned int>& positions) const {
+	positions.reserve(positions.size() + m_count);
+	for (std::vector<Chunk*>::const_iterator p = m_chunks.begin(); p != m_chunks.end(); ++p) {
+		const Chunk& chunk = **p;
+		for (std::vector<Bracket>::const_iterator b = chunk.brackets.begin(); b != chunk.brackets.end(); ++b) {
+			positions.push_back(chunk.offset + b->pos);
+		}
+	}
+}
+
+unsigned int BracketIndex::Locate(unsigned int pos, unsigned int& index) const {
+	// Find the first chunk ending at or after pos
+	unsigned int first = 0;
+	unsigned int last = m_chunks.size();
+	while (first < last) {
+		const unsigned int mid = (first + last) / 2;
+		const Chunk& chunk = *m_chunks[mid];
+		if (chunk.offset + chunk.brackets.back().pos < pos) first = mid + 1;
+		else last = mid;
+	}
+
+	index = 0;
+	if (first == m_chunks.size()) return first;
+
+	// Find the first bracket in it at or after pos
+	const Chunk& chunk = *m_chunks[first];
+	unsigned int end = chunk.brackets.size();
+	while (index < end) {
+		const unsigned int mid = (index + end) / 2;
+		if (chunk.offset + chunk.brackets[mid].pos < pos) index = mid + 1;
+		else end = mid;
+	}
+	return first;
+}
+
+bool BracketIndex::FindMatching(unsigned int pos, unsigned int& match, IBracketFilter* filter) {
+	unsigned int i;
+	const unsigned int c = Locate(pos, i);
+	if (c == m_chunks.size()) return false;
+
+	Chunk& start = *m_chunks[c];
+	if (start.offset + start.brackets[i].pos != pos) return false;
+
+	// Brackets in code only match other brackets in code
+	if (filter && !start.isFiltered) Filter(start, *filter);
+	const bool codeOnly = filter && !start.brackets[i].isIgnored;
+
+	int count = 1;
+	if (start.brackets[i].isOpen) {
+		// Search forward, skipping chunks that never get back to our depth
+		for (unsigned int n = c; n < m_chunks.size(); ++n) {
+			Chunk& chunk = *m_chunks[n];
+			if (codeOnly && !chunk.isFiltered) Filter(chunk, *filter);
+			const int depth = codeOnly ? chunk.codeDepth : chunk.depth;
+			const int minDepth = codeOnly ? chunk.codeMinDepth : chunk.minDepth;
+			if (n != c && count + minDepth > 0) {
+				count += depth;
+				continue;
+			}
+
+			for (unsigned int j = (n == c) ? i+1 : 0; j < chunk.brackets.size(); ++j) {
+				const Bracket& b = chunk.brackets[j];
+				if (codeOnly && b.isIgnored) continue;
+				count += b.isOpen ? 1 : -1;
+				if (count == 0) {
+					match = chunk.offset + b.pos;
+					return true;
+				}
+			}
+		}
+	}
+	else {
+		// Search backward (the lowest depth of a chunk, relative to
+		// where it ends, is minDepth - depth)
+		for (unsigned int n = c+1; n > 0; --n) {
+			Chunk& chunk = *m_chunks[n-1];
+			if (codeOnly && !chunk.isFiltered) Filter(chunk, *filter);
+			const int depth = codeOnly ? chunk.codeDepth : chunk.depth;
+			const int minDepth = codeOnly ? chunk.codeMinDepth : chunk.minDepth;
+			if (n-1 != c && count + minDepth - depth > 0) {
+				count -= depth;
+				continue;
+			}
+
+			for (unsigned int j = (n-1 == c) ? i : chunk.brackets.size(); j > 0; --j) {
+				const Bracket& b = chunk.brackets[j-1];
+				if (codeOnly && b.isIgnored) continue;
+				count += b.isOpen ? -1 : 1;
+				if (count == 0) {
+					match = chunk.offset + b.pos;
+					return true;
+				}
+			}
+		}
+	}
+
+	return false;
+}
+
+void BracketIndex::Filter(Chunk& chunk, IBracketFilter& filter) {
+	std::vector<unsigned int> positions;
+	positions.reserve(chunk.brackets.size());
+	for (std::vector<Bracket>::const_iterator b = chunk.brackets.begin(); b != chunk.brackets.end(); ++b) {
+		positions.push_back(chunk.offset + b->pos);
+	}
+
+	std::vector<bool> ignored(positions.size(), false);
+	filter.GetIgnored(positions, ignored);
+	for (unsigned int i = 0; i < chunk.brackets.size(); ++i) {
+		chunk.brackets[i].isIgnored = ignored[i];
+	}
+
+	chunk.isFiltered = true;
+	UpdateDepth(chunk);
+}
+
+void BracketIndex::ClearFilter(unsigned int c) {
+	// An edit can change the scopes of all the text after it
+	for (; c < m_chunks.size(); ++c) m_chunks[c]->isFiltered = false;
+}
+
+void BracketIndex::Insert(unsigned int pos, unsigned int length) {
+	m_length += length;
+
+	unsigned int i;
+	unsigned int c = Locate(pos, i);
+	if (c == m_chunks.size()) return;
+	ClearFilter(c);
+
+	// Move the brackets after pos
+	Chunk& chunk = *m_chunks[c];
+	if (i == 0) chunk.offset += length;
+	else {
+		for (std::vector<Bracket>::iterator b = chunk.brackets.begin() + i; b != chunk.brackets.end(); ++b) {
+			b->pos += length;
+		}
+	}
+	for (++c; c < m_chunks.size(); ++c) m_chunks[c]->offset += length;
+}
+
+unsigned int BracketIndex::Delete(unsigned int start, unsigned int end) {
+	wxASSERT(start <= end && end <= m_length);
+	const unsigned int removed = Remove(start, end);
+	const unsigned int length = end - start;
+	m_length -= length;
+
+	unsigned int i;
+	unsigned int c = Locate(start, i);
+	ClearFilter(c);
+	for (; c < m_chunks.size(); ++c, i = 0) {
+		Chunk& chunk = *m_chunks[c];
+		if (i == 0 && chunk.offset >= length) {
+			chunk.offset -= length;
+			continue;
+		}
+
+		// Move the brackets after the deletion (and the offset
+		// to zero if it would otherwise be past the first of them)
+		unsigned int diff = length;
+		if (i == 0) {
+			diff -= chunk.offset;
+			chunk.offset = 0;
+		}
+		for (std::vector<Bracket>::iterator b = chunk.brackets.begin() + i; b != chunk.brackets.end(); ++b) {
+			b->pos -= diff;
+		}
+	}
+
+	return removed;
+}
+
+unsigned int BracketIndex::Remove(unsigned int start, unsigned int end) {
+	unsigned int i;
+	unsigned int c = Locate(start, i);
+	unsigned int removed = 0;
+
+	while (c < m_chunks.size()) {
+		Chunk& chunk = *m_chunks[c];
+		unsigned int j = i;
+		while (j < chunk.brackets.size() && chunk.offset + chunk.brackets[j].pos < end) ++j;
+		if (j == i) break;
+
+		const bool toEnd = (j == chunk.brackets.size());
+		chunk.brackets.erase(chunk.brackets.begin() + i, chunk.brackets.begin() + j);
+		removed += j - i;
+
+		if (chunk.brackets.empty()) {
+			delete m_chunks[c];
+			m_chunks.erase(m_chunks.begin() + c);
+		}
+		else {
+			UpdateDepth(chunk);
+			++c;
+		}
+		if (!toEnd) break;
+		i = 0;
+	}
+
+	m_count -= removed;
+	return removed;
+}
+
+void BracketIndex::Add(unsigned int start, const std::vector<Bracket>& brackets) {
+	if (brackets.empty()) return;
+
+	// New brackets go at the end of the chunk before, if there is one
+	unsigned int i;
+	unsigned int c = Locate(start, i);
+	if (i == 0 && c > 0) {
+		--c;
+		i = m_chunks[c]->brackets.size();
+	}
+	else if (c == m_chunks.size()) {
+		m_chunks.push_back(new Chunk(brackets[0].pos));
+	}
+
+	Chunk& chunk = *m_chunks[c];
+	if (brackets[0].pos < chunk.offset) {
+		// Positions are relative to the offset, so it can't be past them
+		const unsigned int diff = chunk.offset - brackets[0].pos;
+		for (std::vector<Bracket>::iterator b = chunk.brackets.begin(); b != chunk.brackets.end(); ++b) {
+			b->pos += diff;
+		}
+		chunk.offset = brackets[0].pos;
+	}
+
+	const size_t at = i;
+	chunk.brackets.insert(chunk.brackets.begin() + at, brackets.begin(), brackets.end());
+	for (size_t b = at; b < at + brackets.size(); ++b) {
+		chunk.brackets[b].pos -= chunk.offset;
+	}
+	m_count += brackets.size();
+
+	ClearFilter(c);
+	UpdateDepth(chunk);
+	Split(c);
+}
+
+void BracketIndex::UpdateDepth(Chunk& chunk) {
+	int depth = 0;
+	int minDepth = 0;
+	int codeDepth = 0;
+	int codeMinDepth = 0;
+	for (std::vector<Bracket>::const_iterator b = chunk.brackets.begin(); b != chunk.brackets.end(); ++b) {
+		if (b->isOpen) ++depth;
+		else if (--depth < minDepth) minDepth = depth;
+
+		if (b->isIgnored) continue;
+		if (b->isOpen) ++codeDepth;
+		else if (--codeDepth < codeMinDepth) codeMinDepth = codeDepth;
+	}
+	chunk.depth = depth;
+	chunk.minDepth = minDepth;
+	chunk.codeDepth = codeDepth;
+	chunk.codeMinDepth = codeMinDepth;
+}
+
+void BracketIndex::Split(unsigned int c) {
+	Chunk& chunk = *m_chunks[c];
+	const unsigned int size = chunk.brackets.size();
+	if (size <= MAXCHUNK) return;
+
+	// Split into half-full chunks, so the following inserts don't split again
+	const unsigned int half = MAXCHUNK / 2;
+	std::vector<Chunk*> pieces;
+	for (unsigned int start = half; start < size; start += half) {
+		Chunk* piece = new Chunk(chunk.offset);
+		piece->isFiltered = chunk.isFiltered;
+		piece->brackets.assign(chunk.brackets.begin() + start, chunk.brackets.begin() + wxMin(start + half, size));
+		UpdateDepth(*piece);
+		pieces.push_back(piece);
+	}
+	chunk.brackets.resize(half);
+	UpdateDepth(chunk);
+
+	m_chunks.insert(m_chunks.begin() + c + 1, pieces.begin(), pieces.end());
+}
+
+bool BracketIndex::Scan(unsigned int start, const char* text, unsigned int len, bool escaped) {
+	Remove(start, start + len);
+
+	std::vector<Bracket> brackets;
+	for (unsigned int i = 0; i < len; ++i) {
+		const char c = text[i];
+		if (escaped) escaped = false;
+		else if (c == '\\') escaped = m_escapes;
+		else if (c == m_open || c == m_close) {
+			const Bracket b = {start + i, c == m_open, false};
+			brackets.push_back(b);
+		}
+	}
+
+	Add(start, brackets);
+	return escaped;
+}
+
+unsigned int BracketIndex::Scan(const Document& doc, unsigned int start, unsigned int end) {
+	const unsigned int len = doc.GetLength();
+	wxASSERT(start <= end && end <= len);
+
+	const unsigned int BLOCKSIZE = 64 * 1024;
+	std::vector<char> text;
+	bool escaped = false;
+
+	if (m_escapes) {
+		// The chars after the range are escaped by backslashes ending in it,
+		// so we have to include those up to the first other char
+		while (end < len) {
+			const unsigned int blockEnd = wxMin(end + 64, len);
+			text.resize(blockEnd - end);
+			doc.GetTextPart(end, blockEnd, (unsigned char*)&*text.begin());
+
+			unsigned int i = 0;
+			while (i < text.size() && text[i] == '\\') ++i;
+			end += i;
+			if (i < text.size()) {
+				++end;
+				break;
+			}
+		}
+
+		// Count the backslashes before start
+		for (unsigned int pos = start; pos > 0; ) {
+			const unsigned int blockStart = pos > 64 ? pos - 64 : 0;
+			text.resize(pos - blockStart);
+			doc.GetTextPart(blockStart, pos, (unsigned char*)&*text.begin());
+
+			unsigned int i = text.size();
+			while (i > 0 && text[i-1] == '\\') {
+				escaped = !escaped;
+				--i;
+			}
+			if (i > 0) break;
+			pos = blockStart;
+		}
+	}
+
+	Remove(start, end);
+	const unsigned int count = m_count;
+
+	// Read the text in blocks
+	for (unsigned int pos = start; pos < end; ) {
+		const unsigned int blockEnd = (end - pos > BLOCKSIZE) ? pos + BLOCKSIZE : end;
+		text.resize(blockEnd - pos);
+		doc.GetTextPart(pos, blockEnd, (unsigned char*)&*text.begin());
+
+		escaped = Scan(pos, &*text.begin(), text.size(), escaped);
+		pos = blockEnd;
+	}
+
+	return m_count - count;
+}
+
+void BracketIndex::Build(const Document& doc) {
+	const unsigned int len = doc.GetLength();
+	Clear(len);
+	Scan(doc, 0, len);
+}
@@ -0,0 +1,117 @@
+/*******************************************************************************
+ *
+ * Copyright (C) 2009, Alexander Stigsen, e-texteditor.com
+ *
+ * This software is licensed under the Open Company License as described
+ * in the file license.txt, which you should have received as part of this
+ * distribution. The terms are also available at http://opencompany.org/license.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ******************************************************************************/
+
+
+#ifndef __BRACKETINDEX_H__
+#define __BRACKETINDEX_H__
+
+#include <vector>
+#include <cstddef>
+
+class Document;
+
+// Tells which brackets are not code (like the ones in strings and comments)
+class IBracketFilter {
+public:
+	virtual ~IBracketFilter() {};
+
+	// Positions are sorted. Sets ignored[i] for the ones to leave out.
+	virtual void GetIgnored(const std::vector<unsigned int>& positions, std::vector<bool>& ignored) = 0;
+};
+
+// Positions of the brackets of one kind of pair (like '(' and ')') in a
+// document. Each chunk of brackets knows how it changes the nesting depth,
+// so the matching bracket is found by skipping whole chunks rather than
+// going through the text (or each bracket) in between. Brackets preceded
+// by an odd number of backslashes are escaped and left out, unless escapes
+// are disabled.
+//
+// The positions in a chunk are relative to an offset, so an edit only
+// changes the positions in one chunk and the offsets of the following.
+//
+// With a filter, the brackets of each chunk are classified the first time
+// the search passes it (edits clear it for the chunks from the edit on,
+// as the scopes after it may have changed). Brackets in code then only
+// match each other, while one left out matches counting all brackets.
+class BracketIndex {
+public:
+	BracketIndex(char open, char close, bool escapes=true);
+	~BracketIndex();
+
+	char GetOpen() const {return m_open;};
+	char GetClose() const {return m_close;};
+	bool HasEscapes() const {return m_escapes;};
+
+	unsigned int GetCount() const {return m_count;};
+	unsigned int GetLength() const {return m_length;}; // of the indexed text
+	void GetPositions(std::vector<unsigned int>& positions) const;
+
+	// Position of the bracket matching the one at pos
+	// (false if there is no indexed bracket at pos, or no match)
+	bool FindMatching(unsigned int pos, unsigned int& match, IBracketFilter* filter=NULL);
+
+	// Text changes (brackets in deleted text are removed, and the following
+	// ones moved). The changed text has to be scanned again after.
+	void Insert(unsigned int pos, unsigned int length);
+	unsigned int Delete(unsigned int start, unsigned int end); // returns count removed
+
+	// Replaces the brackets in the range of text starting at start. Escaped
+	// tells if the first char is escaped, returns if the char after text is.
+	bool Scan(unsigned int start, const char* text, unsigned int len, bool escaped=false);
+
+	// Scans [start, end) of the document again (with the following chars
+	// whose escaping may have changed). Returns the number of brackets found.
+	unsigned int Scan(const Document& doc, unsigned int start, unsigned int end);
+	void Build(const Document& doc);
+	void Clear(unsigned int length=0);
+
+private:
+	struct Bracket {
+		unsigned int pos; // relative to chunk offset
+		bool isOpen;
+		bool isIgnored; // by filter
+	};
+	struct Chunk {
+		Chunk(unsigned int o) : offset(o), depth(0), minDepth(0), codeDepth(0), codeMinDepth(0), isFiltered(false) {};
+		unsigned int offset;
+		std::vector<Bracket> brackets;
+		int depth;    // opened minus closed
+		int minDepth; // lowest depth after any of the brackets (relative to start)
+		int codeDepth; // same for the brackets not ignored
+		int codeMinDepth;
+		bool isFiltered;
+	};
+
+	unsigned int Locate(unsigned int pos, unsigned int& index) const;
+	unsigned int Remove(unsigned int start, unsigned int end);
+	void Add(unsigned int start, const std::vector<Bracket>& brackets);
+	void UpdateDepth(Chunk& chunk);
+	void Split(unsigned int c);
+	void Filter(Chunk& chunk, IBracketFilter& filter);
+	void ClearFilter(unsigned int c);
+
+	static const unsigned int MAXCHUNK;
+
+	const char m_open;
+	const char m_close;
+	const bool m_escapes;
+	std::vector<Chunk*> m_chunks; // never empty ones
+	unsigned int m_count;
+	unsigned int m_length;
+
+private:
+	BracketIndex(const BracketIndex&);
+	BracketIndex& operator=(const BracketIndex&);
+};
+
+#endif // __BRACKETINDEX_H__
@@ -18,6 +18,64 @@
 #include "tm_syntaxhandler.h"
 #include "tmStyle.h"
 
+// ---- DiffThread ------------------------------
+
+// Diffs copies of the documents in the background
+class DiffThread : public wxThread {
+public:
+	DiffThread(std::vector<char>& text1, std::vector<char>& text2);
+	virtual void* Entry();
+
+	void Diff();
+	void Cancel() {m_diff.Cancel();};
+	bool IsDone();
+	const std::vector<LineDiff::Match>& GetMatches() const {return m_matches;};
+
+private:
+	std::vector<char> m_text1;
+	std::vector<char> m_text2;
+	LineDiff m_diff;
+	std::vector<LineDiff::Match> m_matches;
+	wxCriticalSection m_crit;
+	bool m_isDone;
+};
+
+DiffThread::DiffThread(std::vector<char>& text1, std::vector<char>& text2)
+: wxThread(wxTHREAD_JOINABLE), m_isDone(false) {
+	// Takes over the texts
+	m_text1.swap(text1);
+	m_text2.swap(text2);
+}
+
+void* DiffThread::Entry() {
+	Diff();
+	wxWakeUpIdle(); // the result is applied on idle
+	return NULL;
+}
+
+void DiffThread::Diff() {
+	const char* text1 = m_text1.empty() ? NULL : &*m_text1.begin();
+	const char* text2 = m_text2.empty() ? NULL : &*m_text2.begin();
+	m_diff.Diff(text1, m_text1.size(), text2, m_text2.size(), m_matches);
+
+	wxCriticalSectionLocker lock(m_crit);
+	m_isDone = true;
+}
+
+bool DiffThread::IsDone() {
+	wxCriticalSectionLocker lock(m_crit);
+	return m_isDone;
+}
+
+namespace {
+	void GetDocText(const Document& doc, unsigned int start, unsigned int end, std::vector<char>& text) {
+		text.resize(end - start);
+		if (start < end) doc.GetTextPart(start, end, (unsigned char*)&*text.begin());
+	}
+}
+
+// ---- DiffBar ------------------------------
+
 BEGIN_EVENT_TABLE(DiffBar, wxControl)
 	EVT_PAINT(DiffBar::OnPaint)
 	EVT_SIZE(DiffBar::OnSize)
@@ -25,19 +83,26 @@ BEGIN_EVENT_TABLE(DiffBar, wxControl)
 	EVT_LEFT_UP(DiffBar::OnMouseLeftUp)
 	EVT_MOTION(DiffBar::OnMouseMotion)
 	EVT_LEAVE_WINDOW(DiffBar::OnMouseLeave)
+	EVT_IDLE(DiffBar::OnIdle)
 END_EVENT_TABLE()
 
 const unsigned int DiffBar::s_bracketWidth = 5;
+const unsigned int DiffBar::s_syncDiffSize = 256 * 1024; // smaller documents are diffed right away
+const unsigned int DiffBar::s_maxRefineSize = 1024 * 1024;
 
 DiffBar::DiffBar(wxWindow* parent, CatalystWrapper& cw, EditorCtrl* leftEditor, EditorCtrl* rightEditor, TmSyntaxHandler& syntax_handler):
 	wxControl(parent, wxID_ANY, wxPoint(-100,-100), wxSize(40,100), wxNO_BORDER|wxWANTS_CHARS|wxCLIP_CHILDREN|wxNO_FULL_REPAINT_ON_RESIZE),
 	m_catalyst(cw), m_leftEditor(leftEditor), m_rightEditor(rightEditor), m_leftStyler(m_diffs, true, syntax_handler), m_rightStyler(m_diffs, false, syntax_handler),
-	m_needRedraw(false), m_needTransform(false), m_highlight(-1) 
+	m_needRedraw(false), m_needTransform(false), m_highlight(-1), m_diffThread(NULL)
 {
 	SetMinSize(wxSize(40, -1));
 	SetMaxSize(wxSize(40, -1));
 }
 
+DiffBar::~DiffBar() {
+	StopDiff();
+}
+
 void DiffBar::Init() {
 	// Register stylers
 	m_leftEditor->AddStyler(m_leftStyler);
@@ -57,22 +122,151 @@ void DiffBar::SetCallbacks() {
 
 void DiffBar::SetDiff() {
 	// Clean up
+	StopDiff();
 	m_matchlist.clear();
+	m_leftDirty.Clear();
+	m_rightDirty.Clear();
 
-	// Get the diff
+	// Copy the texts, so they can be diffed in the background
+	std::vector<char> text1;
+	std::vector<char> text2;
 	DocumentWrapper& doc1 = m_leftEditor->GetDocument();
 	DocumentWrapper& doc2 = m_rightEditor->GetDocument();
 	cxLOCK_WRITE(m_catalyst)
 		Document& d1 = doc1.GetDoc();
 		Document& d2 = doc2.GetDoc();
-		catalyst.GetDiff(d1, d2, m_matchlist);
+		GetDocText(d1, 0, d1.GetLength(), text1);
+		GetDocText(d2, 0, d2.GetLength(), text2);
 
 		// Set callbacks
 		d1.SetChangeCallback(OnLeftDocumentChanged, this);
 		d2.SetChangeCallback(OnRightDocumentChanged, this);
 	cxENDLOCK
 
+	// Get the diff
+	const bool inBackground = text1.size() + text2.size() > s_syncDiffSize;
+	m_diffThread = new DiffThread(text1, text2);
+	if (!inBackground || m_diffThread->Create() != wxTHREAD_NO_ERROR || m_diffThread->Run() != wxTHREAD_NO_ERROR) {
+		m_diffThread->Diff();
+		ApplyDiff();
+	}
+
+	m_needTransform = true;
+}
+
+void DiffBar::StopDiff() {
+	if (!m_diffThread) return;
+
+	m_diffThread->Cancel();
+	m_diffThread->Wait();
+	delete m_diffThread;
+	m_diffThread = NULL;
+	m_editLog.clear();
+}
+
+void DiffBar::ApplyDiff() {
+	SetMatches(m_diffThread->GetMatches());
+	delete m_diffThread;
+	m_diffThread = NULL;
+
+	// Bring the matches up to date with the edits made while diffing
+	for (std::vector<Edit>::const_iterator e = m_editLog.begin(); e != m_editLog.end(); ++e) {
+		if (e->isLeft) AdjustLeftMatches(e->type, e->pos, e->len);
+		else AdjustRightMatches(e->type, e->pos, e->len);
+	}
+	m_editLog.clear();
+
 	m_needTransform = true;
+	m_needRedraw = true;
+}
+
+void DiffBar::SetMatches(const std::vector<LineDiff::Match>& matches) {
+	m_matchlist.clear();
+	for (std::vector<LineDiff::Match>::const_iterator p = matches.begin(); p != matches.end(); ++p) {
+		m_matchlist.push_back(cxMatch(p->start1, p->start2, p->len));
+	}
+}
+
+bool DiffBar::RefineDirty() {
+	if (!m_leftDirty.isSet && !m_rightDirty.isSet) return false;
+	if (m_diffThread) return false; // done when the running diff is applied
+
+	// Find the matches around the edited text
+	unsigned int start1 = 0;
+	unsigned int start2 = 0;
+	list<cxMatch>::iterator p = m_matchlist.begin();
+	for (; p != m_matchlist.end(); ++p) {
+		if (m_leftDirty.isSet && p->end1() > m_leftDirty.start) break;
+		if (m_rightDirty.isSet && p->end2() > m_rightDirty.start) break;
+		start1 = p->end1();
+		start2 = p->end2();
+	}
+	const list<cxMatch>::iterator first = p;
+	for (; p != m_matchlist.end(); ++p) {
+		if ((!m_leftDirty.isSet || p->start1() >= m_leftDirty.end) && (!m_rightDirty.isSet || p->start2() >= m_rightDirty.end)) break;
+	}
+
+	m_leftDirty.Clear();
+	m_rightDirty.Clear();
+
+	// Diff the text between them again
+	std::vector<char> text1;
+	std::vector<char> text2;
+	DocumentWrapper& doc1 = m_leftEditor->GetDocument();
+	DocumentWrapper& doc2 = m_rightEditor->GetDocument();
+	cxLOCK_READ(m_catalyst)
+		const Document& d1 = doc1.GetDoc();
+		const Document& d2 = doc2.GetDoc();
+		const unsigned int end1 = (p == m_matchlist.end()) ? d1.GetLength() : p->start1();
+		const unsigned int end2 = (p == m_matchlist.end()) ? d2.GetLength() : p->start2();
+
+		// Big hunks are left as adjusted by the edits
+		if ((end1 - start1) + (end2 - start2) > s_maxRefineSize) return false;
+
+		GetDocText(d1, start1, end1, text1);
+		GetDocText(d2, start2, end2, text2);
+	cxENDLOCK
+
+	std::vector<LineDiff::Match> matches;
+	LineDiff diff;
+	diff.Diff(text1.empty() ? NULL : &*text1.begin(), text1.size(), text2.empty() ? NULL : &*text2.begin(), text2.size(), matches, start1, start2);
+
+	p = m_matchlist.erase(first, p);
+	for (std::vector<LineDiff::Match>::const_iterator m = matches.begin(); m != matches.end(); ++m) {
+		m_matchlist.insert(p, cxMatch(m->start1, m->start2, m->len));
+	}
+
+	return true;
+}
+
+void DiffBar::DirtyRange::Insert(unsigned int pos, unsigned int len) {
+	if (!isSet) {
+		isSet = true;
+		start = pos;
+		end = pos + len;
+		return;
+	}
+
+	if (start >= pos) start += len;
+	if (end >= pos) end += len;
+	start = wxMin(start, pos);
+	end = wxMax(end, pos + len);
+}
+
+void DiffBar::DirtyRange::Delete(unsigned int pos, unsigned int len) {
+	if (!isSet) {
+		isSet = true;
+		start = end = pos;
+		return;
+	}
+
+	const unsigned int del_end = pos + len;
+	if (start >= del_end) start -= len;
+	else if (start > pos) start = pos;
+	if (end >= del_end) end -= len;
+	else if (end > pos) end = pos;
+	start = wxMin(start, pos);
+	end = wxMax(end, pos);
 }
 
 void DiffBar::TransformMatchlist() {
@@ -161,6 +355,10 @@ void DiffBar::Swap() {
 	m_leftStyler.SwapSide();
 	m_rightStyler.SwapSide();
 
+	const DirtyRange tempDirty = m_leftDirty;
+	m_leftDirty = m_rightDirty;
+	m_rightDirty = tempDirty;
+
 	// Re-set the editor callbacks
 	SetCallbacks();
 
@@ -173,6 +371,9 @@ void DiffBar::Swap() {
 		d2.SetChangeCallback(OnRightDocumentChanged, this);
 	cxENDLOCK
 
+	// A running diff is of the old sides
+	if (m_diffThread) SetDiff();
+
 	TransformMatchlist();
 	m_needRedraw = true;
 }
@@ -341,8 +542,9 @@ void DiffBar::OnMouseLeftUp(wxMouseEvent& evt) {
 		}
 		m_rightEditor->Freeze();
 
-		// Adjust matches
-		SetDiff();
+		// Diff the copied hunk again
+		RefineDirty();
+		m_needTransform = true;
 		m_needRedraw = true;
 
 		// Redraw all
@@ -370,8 +572,9 @@ void DiffBar::OnMouseLeftUp(wxMouseEvent& evt) {
 		}
 		m_leftEditor->Freeze();
 
-		// Adjust matches
-		SetDiff();
+		// Diff the copied hunk again
+		RefineDirty();
+		m_needTransform = true;
 		m_needRedraw = true;
 
 		// Redraw all
@@ -380,6 +583,24 @@ void DiffBar::OnMouseLeftUp(wxMouseEvent& evt) {
 	}
 }
 
+void DiffBar::OnIdle(wxIdleEvent& WXUNUSED(event)) {
+	bool changed = false;
+
+	if (m_diffThread) {
+		if (!m_diffThread->IsDone()) return;
+		m_diffThread->Wait();
+		ApplyDiff();
+		changed = true;
+	}
+
+	if (RefineDirty()) changed = true;
+	if (!changed) return;
+
+	m_needTransform = true;
+	m_needRedraw = true;
+	m_leftEditor->ReDraw(); // redraws the right one and the bar after
+}
+
 void DiffBar::OnPaint(wxPaintEvent& WXUNUSED(event)) {
 	wxPaintDC dc(this);
 	DrawLayout(dc);
@@ -518,14 +739,26 @@ void DiffBar::OnLeftDocumentChanged(cxChangeType type, unsigned int pos, unsigne
 		return;
 	}
 
-	if (self->m_matchlist.empty()) return;
-	if (pos >= self->m_matchlist.back().end1()) return;
+	self->AdjustLeftMatches(type, pos, len);
+
+	// Edited hunks are diffed again on idle
+	if (type == cxINSERTION) self->m_leftDirty.Insert(pos, len);
+	else self->m_leftDirty.Delete(pos, len);
+	if (self->m_diffThread) self->m_editLog.push_back(Edit(true, type, pos, len));
 
-	list<cxMatch>::iterator p = self->m_matchlist.begin();
+	self->m_needTransform = true;
+	self->m_needRedraw = true;
+}
+
+void DiffBar::AdjustLeftMatches(cxChangeType type, unsigned int pos, unsigned int len) {
+	if (m_matchlist.empty()) return;
+	if (pos >= m_matchlist.back().end1()) return;
+
+	list<cxMatch>::iterator p = m_matchlist.begin();
 
 	if (type == cxINSERTION) {
 		// Find position
-		while (p != self->m_matchlist.end()) {
+		while (p != m_matchlist.end()) {
 			if (pos <= p->end1()) break;
 			++p;
 		}
@@ -535,13 +768,13 @@ void DiffBar::OnLeftDocumentChanged(cxChangeType type, unsigned int pos, unsigne
 			cxMatch& m = *(p++);
 			const size_t newlen = pos - m.start1();
 			const size_t rest = m.length() - newlen;
-			self->m_matchlist.insert(p, cxMatch(pos + len, m.start2()+newlen, rest));
+			m_matchlist.insert(p, cxMatch(pos + len, m.start2()+newlen, rest));
 			m.len = newlen;
 		}
-		else if (pos == p->end2()) ++p;
+		else if (pos == p->end1()) ++p;
 
 		// Adjust following matches
-		while (p != self->m_matchlist.end()) {
+		while (p != m_matchlist.end()) {
 			p->offset1 += len;
 			++p;
 		}
@@ -550,9 +783,9 @@ void DiffBar::OnLeftDocumentChanged(cxChangeType type, unsigned int pos, unsigne
 		const size_t del_end = pos + len;
 
 		// Find position
-		while (p != self->m_matchlist.end()) {
+		while (p != m_matchlist.end()) {
 			if (pos <= p->start1() && del_end >= p->end1()) { // fully enclosed
-				p = self->m_matchlist.erase(p);
+				p = m_matchlist.erase(p);
 				continue;
 			}
 			if (del_end > p->start1() && pos < p->end1()) { // overlap
@@ -570,7 +803,7 @@ void DiffBar::OnLeftDocumentChanged(cxChangeType type, unsigned int pos, unsigne
 					cxMatch& m = *(p++);
 					const size_t newlen = pos - m.start1();
 					const size_t rest = (m.length() - newlen) - len;
-					self->m_matchlist.insert(p, cxMatch(pos, m.start2()+newlen+len, rest));
+					m_matchlist.insert(p, cxMatch(pos, m.start2()+newlen+len, rest));
 					m.len = newlen;
 					break;
 				}
@@ -580,14 +813,11 @@ void DiffBar::OnLeftDocumentChanged(cxChangeType type, unsigned int pos, unsigne
 		}
 
 		// Adjust following matches
-		while (p != self->m_matchlist.end()) {
+		while (p != m_matchlist.end()) {
 			p->offset1 -= len;
 			++p;
 		}
 	}
-
-	self->m_needTransform = true;
-	self->m_needRedraw = true;
 }
 
 void DiffBar::OnRightDocumentChanged(cxChangeType type, unsigned int pos, unsigned int len, void* data) { // static
@@ -600,14 +830,26 @@ void DiffBar::OnRightDocumentChanged(cxChangeType type, unsigned int pos, unsign
 		return;
 	}
 
-	if (self->m_matchlist.empty()) return;
-	if (pos >= self->m_matchlist.back().end2()) return;
+	self->AdjustRightMatches(type, pos, len);
+
+	// Edited hunks are diffed again on idle
+	if (type == cxINSERTION) self->m_rightDirty.Insert(pos, len);
+	else self->m_rightDirty.Delete(pos, len);
+	if (self->m_diffThread) self->m_editLog.push_back(Edit(false, type, pos, len));
+
+	self->m_needTransform = true;
+	self->m_needRedraw = true;
+}
+
+void DiffBar::AdjustRightMatches(cxChangeType type, unsigned int pos, unsigned int len) {
+	if (m_matchlist.empty()) return;
+	if (pos >= m_matchlist.back().end2()) return;
 
-	list<cxMatch>::iterator p = self->m_matchlist.begin();
+	list<cxMatch>::iterator p = m_matchlist.begin();
 
 	if (type == cxINSERTION) {
 		// Find position
-		while (p != self->m_matchlist.end()) {
+		while (p != m_matchlist.end()) {
 			if (pos <= p->end2()) break;
 			++p;
 		}
@@ -617,13 +859,13 @@ void DiffBar::OnRightDocumentChanged(cxChangeType type, unsigned int pos, unsign
 			cxMatch& m = *(p++);
 			const size_t newlen = pos - m.start2();
 			const size_t rest = m.length() - newlen;
-			self->m_matchlist.insert(p, cxMatch(m.start1()+newlen, pos + len, rest));
+			m_matchlist.insert(p, cxMatch(m.start1()+newlen, pos + len, rest));
 			m.len = newlen;
 		}
 		else if (pos == p->end2()) ++p;
 
 		// Adjust following matches
-		while (p != self->m_matchlist.end()) {
+		while (p != m_matchlist.end()) {
 			p->offset2 += len;
 			++p;
 		}
@@ -632,9 +874,9 @@ void DiffBar::OnRightDocumentChanged(cxChangeType type, unsigned int pos, unsign
 		const size_t del_end = pos + len;
 
 		// Find position
-		while (p != self->m_matchlist.end()) {
+		while (p != m_matchlist.end()) {
 			if (pos <= p->start2() && del_end >= p->end2()) { // fully enclosed
-				p = self->m_matchlist.erase(p);
+				p = m_matchlist.erase(p);
 				continue;
 			}
 			if (del_end > p->start2() && pos < p->end2()) { // overlap
@@ -652,7 +894,7 @@ void DiffBar::OnRightDocumentChanged(cxChangeType type, unsigned int pos, unsign
 					cxMatch& m = *(p++);
 					const size_t newlen = pos - m.start2();
 					const size_t rest = (m.length() - newlen) - len;
-					self->m_matchlist.insert(p, cxMatch(m.start1()+newlen+len, pos, rest));
+					m_matchlist.insert(p, cxMatch(m.start1()+newlen+len, pos, rest));
 					m.len = newlen;
 					break;
 				}
@@ -662,14 +904,11 @@ void DiffBar::OnRightDocumentChanged(cxChangeType type, unsigned int pos, unsign
 		}
 
 		// Adjust following matches
-		while (p != self->m_matchlist.end()) {
+		while (p != m_matchlist.end()) {
 			p->offset2 -= len;
 			++p;
 		}
 	}
-
-	self->m_needTransform = true;
-	self->m_needRedraw = true;
 }
 
 void GetDiffColor(wxString scope, TmSyntaxHandler& syntax_handler, wxColour& color) {
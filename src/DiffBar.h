@@ -21,6 +21,7 @@
 
 #include "Catalyst.h"
 #include "styler.h"
+#include "LineDiff.h"
 
 #include <vector>
 
@@ -28,10 +29,12 @@
 class EditorFrame;
 class EditorCtrl;
 class TmSyntaxHandler;
+class DiffThread;
 
 class DiffBar : public wxControl {
 public:
 	DiffBar(wxWindow* parent, CatalystWrapper& cw, EditorCtrl* leftEditor, EditorCtrl* rightEditor, TmSyntaxHandler& syntax_handler);
+	~DiffBar();
 	void Init();
 	void SetCallbacks();
 
@@ -73,6 +76,36 @@ private:
 		wxColor m_insColor;
 	};
 
+	// Text edited since it was last diffed (in current positions)
+	class DirtyRange {
+	public:
+		DirtyRange() : isSet(false), start(0), end(0) {};
+		void Insert(unsigned int pos, unsigned int len);
+		void Delete(unsigned int pos, unsigned int len);
+		void Clear() {isSet = false;};
+		bool isSet;
+		unsigned int start;
+		unsigned int end;
+	};
+
+	// Edit made while a diff was running in the background
+	class Edit {
+	public:
+		Edit(bool isLeft, cxChangeType type, unsigned int pos, unsigned int len)
+			: isLeft(isLeft), type(type), pos(pos), len(len) {};
+		bool isLeft;
+		cxChangeType type;
+		unsigned int pos;
+		unsigned int len;
+	};
+
+	void StopDiff();
+	void ApplyDiff();
+	bool RefineDirty();
+	void SetMatches(const std::vector<LineDiff::Match>& matches);
+	void AdjustLeftMatches(cxChangeType type, unsigned int pos, unsigned int len);
+	void AdjustRightMatches(cxChangeType type, unsigned int pos, unsigned int len);
+
 	void TransformMatchlist();
 	void DrawLayout(wxDC& dc);
 
@@ -86,6 +119,7 @@ private:
 	void OnMouseLeftUp(wxMouseEvent& event);
 	void OnMouseMotion(wxMouseEvent& event);
 	void OnMouseLeave(wxMouseEvent& event);
+	void OnIdle(wxIdleEvent& event);
 	DECLARE_EVENT_TABLE();
 
 	// Callback handlers
@@ -110,7 +144,17 @@ private:
 	bool m_needTransform;
 	int m_highlight;
 
+	// Large documents are diffed in a worker thread (on copies of the
+	// text), while edits to them are logged, to be replayed on the
+	// result. Edited hunks are diffed again on idle.
+	DiffThread* m_diffThread;
+	std::vector<Edit> m_editLog;
+	DirtyRange m_leftDirty;
+	DirtyRange m_rightDirty;
+
 	static const unsigned int s_bracketWidth;
+	static const unsigned int s_syncDiffSize;
+	static const unsigned int s_maxRefineSize;
 };
 
 #endif // __DIFFBAR_H__
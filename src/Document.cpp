@@ -15,12 +15,17 @@
 #include "DataList.h"
 #include <wx/fontmap.h>
 #include <wx/wfstream.h>
+#include <wx/thread.h>
 #include "doc_byte_iter.h"
 #include "cx_pcre.h"
+#include "RegexCache.h"
 #include "Utf.h"
 #include "eSettings.h"
 #include "Strings.h"
 #include "eDocumentPath.h"
+#include "SimdScan.h"
+#include "BlockWriter.h"
+#include "TextWriterThread.h"
 
 
 Document::Document(const doc_id& di, CatalystWrapper cw):
@@ -31,7 +36,7 @@ Document::Document(const doc_id& di, CatalystWrapper cw):
 	change_level(0),
 	do_notify(true),
 	do_notify_top(0),
-	m_re(NULL),
+	m_search_matchcase_cache(false),
 	m_trackChanges(NULL)
 {
 	SetDocument(di);
@@ -49,7 +54,7 @@ Document::Document(CatalystWrapper cw):
 	change_level(0),
 	do_notify(true),
 	do_notify_top(0),
-	m_re(NULL),
+	m_search_matchcase_cache(false),
 	m_trackChanges(NULL)
 {
 	// Make sure we get notified if the document gets deleted
@@ -61,12 +66,73 @@ Document::~Document() {
 
 	// Do standard clean-up
 	if (IsOk()) Close();
-
-	// Clean up stuff not handled by Close()
-	if (m_re) free(m_re); // check if we have a cached regex
 }
 
 
+// - Support classes ---
+
+// Scans a single chunk of a file being loaded
+class EolScanThread : public wxThread {
+public:
+	EolScanThread(const char* data, size_t len, EolScanResult& result)
+		: wxThread(wxTHREAD_JOINABLE), m_data(data), m_len(len), m_result(result) {};
+
+	virtual void* Entry() {
+		ScanUtf8Lines(m_data, m_len, m_result);
+		return NULL;
+	};
+
+private:
+	const char* m_data;
+	const size_t m_len;
+	EolScanResult& m_result;
+};
+
+// Splits the text into chunks (always right after a '\n', so that no chunk
+// starts inside a multibyte char or a "\r\n" pair) and scans them in parallel.
+static void ScanUtf8Chunks(const char* data, size_t len, vector<interval>& chunks, vector<EolScanResult>& results) {
+	const size_t minChunkSize = 4 * 1024 * 1024;
+	const size_t maxThreads = 16;
+
+	int cpuCount = wxThread::GetCPUCount();
+	size_t chunkCount = (cpuCount > 1) ? wxMin((size_t)cpuCount, maxThreads) : 1;
+	chunkCount = wxMin(chunkCount, (len / minChunkSize) + 1);
+
+	size_t start = 0;
+	for (size_t i = 1; i < chunkCount; ++i) {
+		const size_t target = (len / chunkCount) * i;
+		if (target <= start) continue;
+
+		const char* nl = (const char*)memchr(data + target, '\n', len - target);
+		if (!nl) break;
+
+		const size_t end = (nl - data) + 1;
+		if (end >= len) break;
+		chunks.push_back(interval(start, end));
+		start = end;
+	}
+	chunks.push_back(interval(start, len));
+	results.resize(chunks.size());
+
+	// Start workers for all but the first chunk
+	vector<EolScanThread*> threads;
+	for (size_t i = 1; i < chunks.size(); ++i) {
+		EolScanThread* thread = new EolScanThread(data + chunks[i].start, chunks[i].end - chunks[i].start, results[i]);
+		if (thread->Create() == wxTHREAD_NO_ERROR && thread->Run() == wxTHREAD_NO_ERROR) threads.push_back(thread);
+		else {
+			delete thread;
+			ScanUtf8Lines(data + chunks[i].start, chunks[i].end - chunks[i].start, results[i]);
+		}
+	}
+
+	ScanUtf8Lines(data + chunks[0].start, chunks[0].end - chunks[0].start, results[0]);
+
+	for (vector<EolScanThread*>::iterator t = threads.begin(); t != threads.end(); ++t) {
+		(*t)->Wait();
+		delete *t;
+	}
+}
+
 // - Public API ---
 
 void Document::CreateNew(const ISettings& settings) {
@@ -549,71 +615,66 @@ cxFileResult Document::LoadText(const wxFileName& path, vector<unsigned int>& of
 	bufferfile.SeekEnd();
 	wxFileOffset buff_offset = bufferfile.Tell();
 
-	// Pre-reserve entries to avoid unneeded allocs in vector
-	offsets.reserve(len/35);
-
+	BlockWriter writer(bufferfile);
 	unsigned int pos = 0;
 	unsigned int nl_count_dos = 0;
 	unsigned int nl_count_mac = 0;
 	unsigned int nl_count_unix = 0;
 
 	if (enc == wxFONTENCODING_UTF8) {
-		// Convert and save one line at a time while counting newlines
-		char nl = '\n';
-		bool prev_r = false;
-		int linestart = 0;
-		int utf_bytes = 0;
-
-		for (off_t i = 0; i < len; ++i) {
-			const char c = bufptr[i];
+		// Validate and find newlines in parallel chunks
+		vector<interval> chunks;
+		vector<EolScanResult> results;
+		ScanUtf8Chunks(bufptr, (size_t)len, chunks, results);
+
+		size_t line_count = 0;
+		for (vector<EolScanResult>::const_iterator r = results.begin(); r != results.end(); ++r) {
+			if (!r->isValid) goto decode_error;
+			line_count += r->lineEnds.size();
+			nl_count_dos += r->nlDos;
+			nl_count_mac += r->nlMac;
+			nl_count_unix += r->nlUnix;
+		}
 
-			// Detect invalid UTF-8 sequences
-			if (utf_bytes == 0) {
-				if ((c & 0xC0) == 0x80 || c == 0) goto decode_error;
-				else {
-					utf_bytes = utf8_len(c) - 1;
-					if (utf_bytes > 3) goto decode_error;
-				}
+		// Merge line offsets
+		offsets.reserve(line_count + 1);
+		for (vector<EolScanResult>::const_iterator r = results.begin(); r != results.end(); ++r) {
+			for (vector<unsigned int>::const_iterator e = r->lineEnds.begin(); e != r->lineEnds.end(); ++e) {
+				offsets.push_back(pos + *e);
 			}
-			else if ((c & 0xC0) == 0x80) --utf_bytes;
-			else goto decode_error;
+			pos += r->outLen;
+		}
 
-			switch (c) {
-			case '\r':
-				if (prev_r) ++nl_count_mac;
-				bufferfile.Write(&bufptr[linestart], i - linestart);
-				pos += i - linestart;
-				bufferfile.Write(&nl, 1); ++pos;
-				offsets.push_back(pos);
-				linestart = i+1;
-				prev_r = true;
-				break;
+		// Add text after last newline
+		if (pos && (offsets.empty() || offsets.back() != pos)) offsets.push_back(pos);
 
-			case '\n':
-				if (!prev_r) {
-					++nl_count_unix;
-					bufferfile.Write(&bufptr[linestart], (i - linestart)+1);
-					pos += (i - linestart)+1;
-					offsets.push_back(pos);
-				} else ++nl_count_dos;
-				linestart = i+1;
-				prev_r = false;
-				break;
+		// Copy the text to the buffer file, converting "\r\n" and "\r" to "\n"
+		for (size_t i = 0; i < chunks.size(); ++i) {
+			const char* p = bufptr + chunks[i].start;
+			const char* const end = bufptr + chunks[i].end;
 
-			default:
-				if (prev_r) ++nl_count_mac;
-				prev_r = false;
+			if (results[i].crCount == 0) {
+				writer.Write(p, end - p);
+				continue;
 			}
-		}
 
-		// Add text after last newline
-		if (linestart < len) {
-			bufferfile.Write(&bufptr[linestart], len - linestart);
-			pos += len - linestart;
-			offsets.push_back(pos);
+			while (p < end) {
+				const char* cr = (const char*)memchr(p, '\r', end - p);
+				if (!cr) {
+					writer.Write(p, end - p);
+					break;
+				}
+				writer.Write(p, cr - p);
+				writer.Write("\n", 1);
+				p = cr + 1;
+				if (p < end && *p == '\n') ++p;
+			}
 		}
 	}
 	else {
+		// Pre-reserve entries to avoid unneeded allocs in vector
+		offsets.reserve(len/35);
+
 		// Allocate buffers
 		size_t temp_buff_len = 128;
 		wxCharBuffer temp_buff(temp_buff_len);
@@ -664,10 +725,10 @@ cxFileResult Document::LoadText(const wxFileName& path, vector<unsigned int>& of
 				if (i - linestart > 0) {
 					size_t convlen = ConvertToUTF8(&bufptr[linestart], i - linestart, conv, temp_buff, temp_buff_len, wchar_buff, wchar_buff_len, utf8_buff, utf8_buff_len, char_len);
 					if (convlen == (size_t)-1) goto decode_error; // conversion failed
-					bufferfile.Write(utf8_buff, convlen);
+					writer.Write(utf8_buff, convlen);
 					pos += convlen;
 				}
-				bufferfile.Write("\n", 1); pos += 1;
+				writer.Write("\n", 1); pos += 1;
 				offsets.push_back(pos);
 				linestart = i+char_len;
 				prev_r = true;
@@ -677,7 +738,7 @@ cxFileResult Document::LoadText(const wxFileName& path, vector<unsigned int>& of
 					++nl_count_unix;
 					size_t convlen = ConvertToUTF8(&bufptr[linestart], (i - linestart)+char_len, conv, temp_buff, temp_buff_len, wchar_buff, wchar_buff_len, utf8_buff, utf8_buff_len, char_len);
 					if (convlen == (size_t)-1) goto decode_error; // conversion failed
-					bufferfile.Write(utf8_buff, convlen);
+					writer.Write(utf8_buff, convlen);
 					pos += convlen;
 					offsets.push_back(pos);
 				} else ++nl_count_dos;
@@ -688,10 +749,10 @@ cxFileResult Document::LoadText(const wxFileName& path, vector<unsigned int>& of
 				if (i - linestart > 0) {
 					size_t convlen = ConvertToUTF8(&bufptr[linestart], i - linestart, conv, temp_buff, temp_buff_len, wchar_buff, wchar_buff_len, utf8_buff, utf8_buff_len, char_len);
 					if (convlen == (size_t)-1) goto decode_error; // conversion failed
-					bufferfile.Write(utf8_buff, convlen);
+					writer.Write(utf8_buff, convlen);
 					pos += convlen;
 				}
-				bufferfile.Write("\xEF\xA3\xBF", 3); pos += 3; // Private use character as stand-in for null
+				writer.Write("\xEF\xA3\xBF", 3); pos += 3; // Private use character as stand-in for null
 				linestart = i+char_len;
 				prev_r = false;
 			}
@@ -705,7 +766,7 @@ cxFileResult Document::LoadText(const wxFileName& path, vector<unsigned int>& of
 		if (linestart < len) {
 			size_t convlen = ConvertToUTF8(&bufptr[linestart], len - linestart, conv, temp_buff, temp_buff_len, wchar_buff, wchar_buff_len, utf8_buff, utf8_buff_len, char_len);
 			if (convlen == (size_t)-1) goto decode_error; // conversion failed
-			bufferfile.Write(utf8_buff, convlen);
+			writer.Write(utf8_buff, convlen);
 			pos += convlen;
 			offsets.push_back(pos);
 		}
@@ -713,6 +774,7 @@ cxFileResult Document::LoadText(const wxFileName& path, vector<unsigned int>& of
 		// With null bytes in the text the end offset might not have been set yet.
 		if (pos && (offsets.empty() || offsets.back() != pos)) offsets.push_back(pos);
 	}
+	if (!writer.Flush()) goto decode_error;
 	if (buff_offset + pos != bufferfile.Length()) goto decode_error;
 
 	// Close buffer file to ensure changes af flushed to disk
@@ -799,7 +861,47 @@ decode_error:
 }
 
 cxFileResult Document::SaveText(const wxFileName& path, bool forceNativeEOL, const wxString& realpath, bool keepMirrorDate, bool noAtomic) {
+	cxSaveData data;
+	PrepareSave(forceNativeEOL, data);
+
+	const cxFileResult result = WriteSaveData(path, data, noAtomic);
+	if (result != cxFILE_OK) return result;
+
+	FinishSave(path, data, realpath, keepMirrorDate);
+	return cxFILE_OK;
+}
+
+void Document::PrepareSave(bool forceNativeEOL, cxSaveData& data) {
 	wxASSERT(IsOk());
+
+	// We need to freeze current version so that we can mark it as saved
+	// (edits made while it is written go in a new revision)
+	Freeze();
+	data.docId = m_docId;
+	if (IsDocument()) data.date = GetDate();
+
+	// Set end-of-line type
+	data.eol = GetPropertyEOL();
+	if (data.eol == wxTextFileType_None || forceNativeEOL) data.eol = wxTextBuffer::typeDefault;
+	data.encoding = GetPropertyEncoding();
+	data.hasBOM = GetPropertyBOM();
+
+	// Copy the text in large blocks (they have to end on char boundaries)
+	const unsigned int len = GetLength();
+	const unsigned int blockSize = 1024 * 1024;
+	data.blocks.clear();
+	data.blocks.reserve(len / blockSize + 1);
+	for (unsigned int start = 0; start < len; ) {
+		unsigned int end = start + blockSize;
+		end = (end >= len) ? len : GetValidCharPos(end);
+
+		data.blocks.push_back(vector<char>());
+		GetTextPart(start, end, data.blocks.back());
+		start = end;
+	}
+}
+
+cxFileResult Document::WriteSaveData(const wxFileName& path, cxSaveData& data, bool noAtomic, void(*progress)(unsigned int, unsigned int, void*), void* progressData) { // static
 	wxASSERT(path.IsOk());
 	wxASSERT(path.IsAbsolute());
 
@@ -811,6 +913,8 @@ cxFileResult Document::SaveText(const wxFileName& path, bool forceNativeEOL, con
 		return cxFILE_WRITABLE_ERROR;
 	}
 
+	cxFileResult failResult = cxFILE_CONV_ERROR;
+
 	// Do the actual saving
 	{
 		// Open the file
@@ -821,65 +925,60 @@ cxFileResult Document::SaveText(const wxFileName& path, bool forceNativeEOL, con
 			return cxFILE_OPEN_ERROR;
 		}
 
-		// Set end-of-line type
-		wxTextFileType eol = GetPropertyEOL();
-		if (eol == wxTextFileType_None || forceNativeEOL) eol = wxTextBuffer::typeDefault;
-		wxFontEncoding propEncoding = GetPropertyEncoding();
 		const char* nl = "";
-		const char* nulls = "\0\0\0\0";
 		unsigned int nl_len = 0;
 		unsigned int char_len = 0;
-		switch (propEncoding) {
+		switch (data.encoding) {
 		case wxFONTENCODING_UTF32BE:
-			if (eol == wxTextFileType_Mac) {
+			if (data.eol == wxTextFileType_Mac) {
 				nl = "\x00\x00\x00\x0D";
 				nl_len = 4;
 			}
-			else if (eol == wxTextFileType_Dos) {
+			else if (data.eol == wxTextFileType_Dos) {
 				nl = "\x00\x00\x00\x0D\x00\x00\x00\x0A";
 				nl_len = 8;
 			}
 			char_len = 4;
 			break;
 		case wxFONTENCODING_UTF32LE:
-			if (eol == wxTextFileType_Mac) {
+			if (data.eol == wxTextFileType_Mac) {
 				nl = "\x0D\x00\x00\x00";
 				nl_len = 4;
 			}
-			else if (eol == wxTextFileType_Dos) {
+			else if (data.eol == wxTextFileType_Dos) {
 				nl = "\x0D\x00\x00\x00\x0A\x00\x00\x00";
 				nl_len = 8;
 			}
 			char_len = 4;
 			break;
 		case wxFONTENCODING_UTF16BE:
-			if (eol == wxTextFileType_Mac) {
+			if (data.eol == wxTextFileType_Mac) {
 				nl = "\x00\x0D";
 				nl_len = 2;
 			}
-			else if (eol == wxTextFileType_Dos) {
+			else if (data.eol == wxTextFileType_Dos) {
 				nl = "\x00\x0D\x00\x0A";
 				nl_len = 4;
 			}
 			char_len = 2;
 			break;
 		case wxFONTENCODING_UTF16LE:
-			if (eol == wxTextFileType_Mac) {
+			if (data.eol == wxTextFileType_Mac) {
 				nl = "\x0D\x00";
 				nl_len = 2;
 			}
-			else if (eol == wxTextFileType_Dos) {
+			else if (data.eol == wxTextFileType_Dos) {
 				nl = "\x0D\x00\x0A\x00";
 				nl_len = 4;
 			}
 			char_len = 2;
 			break;
 		default:
-			if (eol == wxTextFileType_Mac) {
+			if (data.eol == wxTextFileType_Mac) {
 				nl = "\x0D";
 				nl_len = 1;
 			}
-			else if (eol == wxTextFileType_Dos) {
+			else if (data.eol == wxTextFileType_Dos) {
 				nl = "\x0D\x0A";
 				nl_len = 2;
 			}
@@ -887,8 +986,8 @@ cxFileResult Document::SaveText(const wxFileName& path, bool forceNativeEOL, con
 		}
 
 		// Write Byte-Order-Marker
-		if (GetPropertyBOM()) {
-			switch (propEncoding) {
+		if (data.hasBOM) {
+			switch (data.encoding) {
 			case wxFONTENCODING_UTF32BE:
 				file.Write("\x00\x00\xFE\xFF", 4);
 				break;
@@ -912,99 +1011,23 @@ cxFileResult Document::SaveText(const wxFileName& path, bool forceNativeEOL, con
 			}
 		}
 
-		// Prepare converter & buffers
-		wxFontEncoding enc = propEncoding == wxFONTENCODING_DEFAULT ? wxFONTENCODING_SYSTEM : propEncoding;
-		wxCSConv conv(enc);
-		size_t utf8_buff_len = 128;
-		wxCharBuffer utf8_buff(utf8_buff_len);
-		size_t wchar_buff_len = 128;
-		wxWCharBuffer wchar_buff(wchar_buff_len);
-		size_t out_buff_len = 128;
-		wxCharBuffer out_buff(out_buff_len);
-
-		// Convert and save one line at a time
-		int len = GetLength();
-		unsigned int line_start = 0;
-		for(doc_byte_iter dbi(*this); dbi.GetIndex() < len; ++dbi) {
-			if (*dbi == '\n') {
-				// Define the line
-				unsigned int line_end = dbi.GetIndex();
-				if (eol == wxTextFileType_Unix) ++line_end; // Only include newline in conversion when same as internal
-				unsigned int line_len = line_end - line_start;
-
-				if (line_len) {
-					// Copy line into temp buffer
-					if (utf8_buff_len < line_len+1) {
-						utf8_buff_len = line_len+1;
-						utf8_buff = wxCharBuffer(utf8_buff_len);
-					}
-					m_textData.GetNodeTextPart((unsigned char*)utf8_buff.data(), GetHeadnode(), line_start, line_end);
-					utf8_buff.data()[line_len] = '\0';
-
-					// Write line to file
-					if (enc == wxFONTENCODING_UTF8) file.Write(utf8_buff.data(), line_len);
-					else {
-						size_t out_len = ConvertFromUTF8(utf8_buff, conv, wchar_buff, wchar_buff_len, out_buff, out_buff_len, char_len);
-						if (out_len == (size_t)-1) {
-							goto conv_failed; // Conversion failed
-						}
-						if (out_len) file.Write(out_buff.data(), out_len);
-					}
-				}
-				if (eol != wxTextFileType_Unix) file.Write(nl, nl_len);
+		// Encoding & writing is done on a separate thread
+		// while we hand it the blocks
+		const wxFontEncoding enc = data.encoding == wxFONTENCODING_DEFAULT ? wxFONTENCODING_SYSTEM : data.encoding;
+		TextWriterThread writer(file, enc, data.eol == wxTextFileType_Unix, nl, nl_len, char_len, !noAtomic);
 
-				line_start = dbi.GetIndex() + 1;
-			}
-			else if ((char)*dbi == '\xEF' && dbi.GetIndex()+2 < len) { // Check for null stand-in & conv to real nulls if needed
-				if ((char)dbi[1] == '\xA3' && (char)dbi[2] == '\xBF') {
-					// Define the line
-					unsigned int line_end = dbi.GetIndex();
-					unsigned int line_len = line_end - line_start;
-
-					if (line_len) {
-						// Copy line into temp buffer
-						if (utf8_buff_len < line_len+1) {
-							utf8_buff_len = line_len+1;
-							utf8_buff = wxCharBuffer(utf8_buff_len);
-						}
-						m_textData.GetNodeTextPart((unsigned char*)utf8_buff.data(), GetHeadnode(), line_start, line_end);
-						utf8_buff.data()[line_len] = '\0';
-
-						// Write line to file
-						if (enc == wxFONTENCODING_UTF8) file.Write(utf8_buff.data(), line_len);
-						else {
-							size_t out_len = ConvertFromUTF8(utf8_buff, conv, wchar_buff, wchar_buff_len, out_buff, out_buff_len, char_len);
-							if (out_len == (size_t)-1) {
-								goto conv_failed; // Conversion failed
-							}
-							if (out_len) file.Write(out_buff.data(), out_len);
-						}
-					}
-					file.Write(nulls, char_len);
-
-					line_start = dbi.GetIndex() + 3;
-					dbi += 2;
-				}
-			}
-		}
-		if ((int)line_start < len) { // Save rest after last newline
-			unsigned int line_len = len - line_start;
+		const unsigned int count = data.blocks.size();
+		for (unsigned int i = 0; i < count; ++i) {
+			writer.AddBlock(data.blocks[i]);
+			if (!writer.IsOk()) break;
 
-			// Copy line into temp buffer
-			if (utf8_buff_len < line_len+1) {
-				utf8_buff_len = line_len+1;
-				utf8_buff = wxCharBuffer(utf8_buff_len);
-			}
-			m_textData.GetNodeTextPart((unsigned char*)utf8_buff.data(), GetHeadnode(), line_start, len);
-			utf8_buff.data()[line_len] = '\0';
+			if (progress) progress(i+1, count, progressData);
+		}
 
-			// Write line to file
-			if (enc == wxFONTENCODING_UTF8) file.Write(utf8_buff.data(), line_len);
-			else {
-				size_t out_len = ConvertFromUTF8(utf8_buff, conv, wchar_buff, wchar_buff_len, out_buff, out_buff_len, char_len);
-				if (out_len == (size_t)-1) goto conv_failed; // Conversion failed
-				if (out_len) file.Write(out_buff.data(), out_len);
-			}
+		const cxFileResult result = writer.Finish();
+		if (result != cxFILE_OK) {
+			failResult = result;
+			goto save_failed;
 		}
 	}
 
@@ -1024,7 +1047,21 @@ cxFileResult Document::SaveText(const wxFileName& path, bool forceNativeEOL, con
 			eDocumentPath::SetPermissions(fullPath, permissions);
 	}
 
-	{
+	return cxFILE_OK;
+
+save_failed:
+	// clean up atomic save attempt
+	if (wxFileExists(tmpPath)) wxRemoveFile(tmpPath);
+	return failResult;
+}
+
+void Document::FinishSave(const wxFileName& path, const cxSaveData& data, const wxString& realpath, bool keepMirrorDate) {
+	wxASSERT(IsOk());
+
+	// If the document was edited while it was written, it is the
+	// saved revision that gets marked as saved (and keeps its name)
+	const bool isCurrent = (m_docId == data.docId);
+	if (isCurrent) {
 		// If filename has changed we have to update it
 		const wxString oldName = GetPropertyName();
 		const wxString realname = realpath.AfterLast(wxT('/'));
@@ -1034,45 +1071,38 @@ cxFileResult Document::SaveText(const wxFileName& path, bool forceNativeEOL, con
 			do_notify = false; // we don't want any notification from name change
 				SetPropertyName(newName);
 			do_notify = notifyCache;
+			Freeze();
 		}
+	}
+	const doc_id savedId = isCurrent ? m_docId : data.docId;
 
-		// We need to freeze current version so that we can mark it as saved.
-		Freeze();
-
-		if (keepMirrorDate) {
-			wxASSERT(!realpath.empty());
+	if (keepMirrorDate) {
+		wxASSERT(!realpath.empty());
 
-			doc_id di;
-			wxDateTime modDate;
-			if (m_catalyst.GetFileMirror(realpath, di, modDate))
-				wxFileName(path).SetTimes(NULL, &modDate, NULL);
-			else wxASSERT(false);
+		doc_id di;
+		wxDateTime modDate;
+		if (m_catalyst.GetFileMirror(realpath, di, modDate))
+			wxFileName(path).SetTimes(NULL, &modDate, NULL);
+		else wxASSERT(false);
+	}
+	else {
+		// Set the dates
+		const bool isDocument = savedId.IsDocument();
+		const wxDateTime modDate = isDocument ? (isCurrent ? GetDate() : data.date) : path.GetModificationTime();
+		if (isDocument) {
+			// Documents get modification date set to the commit date
+			wxFileName(path).SetTimes(NULL, &modDate, NULL);
 		}
-		else {
-			// Set the dates
-			const wxDateTime modDate = IsDocument() ? GetDate() : path.GetModificationTime();
-			if (IsDocument()) {
-				// Documents get modification date set to the commit date
-				wxFileName(path).SetTimes(NULL, &modDate, NULL);
-			}
 
-			// Set file mirror
-			m_catalyst.SetFileMirror(realpath.empty() ? path.GetFullPath() : realpath, m_docId, modDate);
+		// Set file mirror
+		m_catalyst.SetFileMirror(realpath.empty() ? path.GetFullPath() : realpath, savedId, modDate);
 
-			// Notify that document mirror info has changed
-			const doc_id di = m_docId;
-			m_catalyst.UnLock();
-				dispatcher.Notify(wxT("DOC_UPDATED"), (void*)&di, 0);
-			m_catalyst.ReLock();
-		}
+		// Notify that document mirror info has changed
+		const doc_id di = savedId;
+		m_catalyst.UnLock();
+			dispatcher.Notify(wxT("DOC_UPDATED"), (void*)&di, 0);
+		m_catalyst.ReLock();
 	}
-
-	return cxFILE_OK;
-
-conv_failed:
-	// clean up atomic save attempt
-	if (wxFileExists(tmpPath)) wxRemoveFile(tmpPath);
-	return cxFILE_CONV_ERROR;
 }
 
 void Document::GetLines(vector<unsigned int>& list) const {
@@ -1377,50 +1407,19 @@ search_result Document::RegExFind(const wxString& searchtext, int start_pos, boo
 	int options = PCRE_UTF8|PCRE_MULTILINE;
 	if (!matchcase) options |= PCRE_CASELESS;
 
-	// Check if we have the regex cached
-	if (m_re) {
-		if (searchtext == m_regex_cache && options == m_options_cache) {
-			// We might want the study the regex the first time we end here
-		}
-		else {
-			free(m_re);
-			m_re = NULL;
-		}
-	}
-
-	// Compile the pattern
-	if (!m_re) {
-		const char *error;
-		int erroffset;
-
-		m_re = pcre_compile(
-			searchtext.mb_str(wxConvUTF8),   // the pattern
-			options,              // options
-			&error,               // for error message
-			&erroffset,           // for error offset
-			NULL);                // use default character tables
-
-		if (m_re == 0) {
-			search_result sr;
-			sr.error_code = -4; // invalid pattern
-			return sr;
-		}
-		else {
-			// The compiled regex (m_re) is cached for possible reuse in next search
-			// it is finally free'd in destructor
-			m_options_cache = options;
-			m_regex_cache = searchtext;
-		}
+	// Get the compiled pattern (cached for possible reuse in next search)
+	const RegexCache::Pattern re = RegexCache::Get().Lookup(searchtext, options);
+	if (!re.IsOk()) {
+		search_result sr;
+		sr.error_code = -4; // invalid pattern
+		return sr;
 	}
 
 	// Do the search
-	return RegExFind(m_re, NULL, start_pos, captures, end_pos);
+	return RegExFind(re.GetRegex(), re.GetStudy(), start_pos, captures, end_pos);
 }
 
 search_result Document::RegExFindBackwards(const wxString& searchtext, int start_pos, bool matchcase) const {
-	pcre *re;
-	const char *error;
-	int erroffset;
 	const int OVECCOUNT = 30;
 	int ovector[OVECCOUNT];
 	search_result sr;
@@ -1428,14 +1427,9 @@ search_result Document::RegExFindBackwards(const wxString& searchtext, int start
 	int options = PCRE_UTF8|PCRE_MULTILINE;
 	if (!matchcase) options = options | PCRE_CASELESS;
 
-	re = pcre_compile(
-		searchtext.mb_str(wxConvUTF8),   // the pattern
-		options,              // options
-		&error,               // for error message
-		&erroffset,           // for error offset
-		NULL);                // use default character tables
-
-	if (re == 0) {
+	// Anchored search is retried at every position, so we want it studied
+	const RegexCache::Pattern re = RegexCache::Get().Lookup(searchtext, options, true);
+	if (!re.IsOk()) {
 		sr.error_code = -4; // invalid pattern
 		return sr;
 	}
@@ -1445,8 +1439,8 @@ search_result Document::RegExFindBackwards(const wxString& searchtext, int start
 	for (int offset = start_pos-1; offset >= 0; --offset) {
 	//const char *pSubject = (const char *)subject.operator*();
 		rc = cx_pcre_exec(
-			re,                   // the compiled pattern
-			NULL,                 // no extra data - we didn't study the pattern
+			re.GetRegex(),        // the compiled pattern
+			re.GetStudy(),        // extra data - if we study the pattern
 			subject,              // the subject string
 			start_pos - subject.GetIndex(),  // the length of the subject
 			offset,                    // start at offset in the subject
@@ -1456,9 +1450,6 @@ search_result Document::RegExFindBackwards(const wxString& searchtext, int start
 		if (rc >= 0) break; // Match found!
 	}
 
-	// Clean up
-	free(re);
-
 	// Copy match info from ovector to result struct
 	sr.error_code = rc;
 	if (rc >= 0) {
@@ -1471,6 +1462,109 @@ search_result Document::RegExFindBackwards(const wxString& searchtext, int start
 	return sr;
 }
 
+const LiteralMatcher& Document::GetSearchPlan(const wxString& searchtext, bool matchcase) const {
+	if (searchtext == m_search_cache && matchcase == m_search_matchcase_cache && (!m_search_plan.IsEmpty() || !m_search_fold.IsEmpty())) {
+		return m_search_plan;
+	}
+	m_search_fold.Clear();
+
+	// Convert the searchtext to UTF8
+	// We need both upper- & lowercase versions for caseless search
+	wxCharBuffer UTF8buffer;
+	if (matchcase) {
+		UTF8buffer = wxConvUTF8.cWC2MB(searchtext);
+		m_search_plan.Set(UTF8buffer.data(), strlen(UTF8buffer));
+	}
+	else {
+		wxString text = searchtext;
+		wxString textUpper = searchtext;
+		text.MakeLower();
+		textUpper.MakeUpper();
+
+		UTF8buffer = wxConvUTF8.cWC2MB(text);
+		const wxCharBuffer UTF8bufferUpper = wxConvUTF8.cWC2MB(textUpper);
+		const unsigned int byte_len = strlen(UTF8buffer);
+
+		// Per byte matching assumes that upper- & lowercase chars have same byte width
+		if (byte_len == strlen(UTF8bufferUpper)) m_search_plan.Set(UTF8buffer.data(), UTF8bufferUpper.data(), byte_len);
+		else {
+			// Otherwise each char matches either of its forms
+			m_search_plan.Clear();
+			for (size_t i = 0; i < text.size(); ++i) {
+				size_t charLen = 1;
+				if (sizeof(wxChar) == 2 && text[i] >= 0xD800 && text[i] < 0xDC00 && i+1 < text.size()) charLen = 2; // surrogate pair
+
+				const wxCharBuffer lower = wxConvUTF8.cWC2MB(text.substr(i, charLen));
+				const wxCharBuffer upper = wxConvUTF8.cWC2MB(textUpper.substr(i, charLen));
+				m_search_fold.AddChar(lower.data(), strlen(lower), upper.data(), strlen(upper));
+				i += charLen - 1;
+			}
+		}
+	}
+
+	m_search_cache = searchtext;
+	m_search_matchcase_cache = matchcase;
+	return m_search_plan;
+}
+
+search_result Document::FindFolded(int start_pos, int end_pos) const {
+	search_result sr = {-1, 0, 0};
+	const int maxLen = m_search_fold.GetMaxLength();
+
+	// Search in blocks overlapping with the longest possible match
+	const int blockSize = 64 * 1024;
+	vector<char> block;
+	int start = start_pos;
+	while (start < end_pos) {
+		const int end = wxMin(start + blockSize, end_pos);
+		GetTextPart(start, end, block);
+
+		size_t matchLen;
+		const char* match = m_search_fold.Find(&*block.begin(), block.size(), matchLen);
+		if (match) {
+			sr.error_code = 0;
+			sr.start = start + (match - &*block.begin());
+			sr.end = sr.start + matchLen;
+			return sr; // text found!
+		}
+
+		if (end == end_pos) break;
+		start = wxMax(start + 1, end - maxLen + 1);
+	}
+
+	return sr; // reached end without finding text
+}
+
+search_result Document::FindFoldedBackwards(int start_pos) const {
+	search_result sr = {-1, 0, 0};
+	const int maxLen = m_search_fold.GetMaxLength();
+	const int length = GetLength();
+
+	// Matches have to start before startEnd (but may extend beyond it)
+	const int blockSize = 64 * 1024;
+	vector<char> block;
+	int startEnd = start_pos;
+	for (;;) {
+		const int start = wxMax(0, startEnd - blockSize);
+		const int end = wxMin(startEnd + maxLen - 1, length);
+		GetTextPart(start, end, block);
+
+		size_t matchLen;
+		const char* match = m_search_fold.FindBackwards(&*block.begin(), block.size(), startEnd - start, matchLen);
+		if (match) {
+			sr.error_code = 0;
+			sr.start = start + (match - &*block.begin());
+			sr.end = sr.start + matchLen;
+			return sr; // text found!
+		}
+
+		if (start == 0) break;
+		startEnd = start;
+	}
+
+	return sr; // reached end without finding text
+}
+
 search_result Document::Find(const wxString& searchtext, int start_pos, bool matchcase, int end_pos) const {
 	wxASSERT(IsOk());
 	wxASSERT(start_pos >= 0);
@@ -1483,79 +1577,50 @@ search_result Document::Find(const wxString& searchtext, int start_pos, bool mat
 	if (start_pos == (int)GetLength() || GetLength() == 0) return sr;
 	wxASSERT(start_pos < (int)GetLength());
 
-	// We need both upper- & lowercase versions for caseless search
-	wxString text = searchtext;
-	wxString textUpper;
-	if (!matchcase) {
-		text.MakeLower();
-		textUpper = searchtext;
-		textUpper.MakeUpper();
-	}
+	const LiteralMatcher& plan = GetSearchPlan(searchtext, matchcase);
+	if (!m_search_fold.IsEmpty()) return FindFolded(start_pos, end_pos);
+	const int byte_len = plan.GetLength();
+	if (byte_len == 0) return sr;
 
-	// Convert the searchtext to UTF8
-	wxCharBuffer UTF8buffer = wxConvUTF8.cWC2MB(text);
-	unsigned int byte_len = strlen(UTF8buffer);
-	wxCharBuffer UTF8bufferUpper;
-	if (!matchcase) {
-		UTF8bufferUpper = wxConvUTF8.cWC2MB(textUpper);
-		wxASSERT(byte_len == strlen(UTF8bufferUpper));
-	}
-
-	int maxsearch = GetLength() - byte_len;
+	const int maxsearch = end_pos - byte_len;
 	if (start_pos > maxsearch) return sr;
 
-	unsigned int last_char_pos = byte_len-1;
-
-	// Build a dictionary of char-to-last distances in the search string
-	map<char, int> charmap;
-	map<char, int> charmap_upper;
-	for (unsigned int i = 0; i < byte_len-1; ++i) {
-		charmap[UTF8buffer[i]] = last_char_pos-i;
-		if (!matchcase) charmap_upper[UTF8bufferUpper[i]] = last_char_pos-i;
-	}
-
-	// Prepare vars to avoid lookups in loop
-	char lastChar = UTF8buffer[last_char_pos];
-	char lastCharUpper = '\0';
-	if (!matchcase) lastCharUpper = UTF8bufferUpper[last_char_pos];
-
-	// Search
-	doc_byte_iter subject(*this, start_pos + last_char_pos); // start from last char in search string
-
-	// WARNING: This algorithm assumes that UTF8 upper- & lowercase chars have same byte width
-	while (subject < end_pos) {
-		const char c = *subject; // Get candidate for last char
-
-		if (c == lastChar || (!matchcase && c == lastCharUpper)) {
-			// Match indiviual chars
-			doc_byte_iter byte_ptr = subject-1;
-			int first_byte_pos = subject.GetIndex() - last_char_pos;
-			unsigned int char_pos = last_char_pos-1;
-			while (byte_ptr.GetIndex() >= first_byte_pos) {
-				const char c2 = *byte_ptr;
-				if (c2 != UTF8buffer[char_pos]) {
-					if (matchcase || c2 != UTF8bufferUpper[char_pos]) break;
-				}
-				--byte_ptr; --char_pos;
-			}
-
-			if (byte_ptr.GetIndex() < first_byte_pos) {
+	// Search the contiguous segments of the document directly
+	doc_byte_iter dbi(*this, start_pos);
+	vector<char> border;
+	int pos = start_pos;
+	while (pos <= maxsearch) {
+		dbi.SetIndex(pos);
+		const int seg_end = wxMin((int)dbi.GetSegEnd(), end_pos);
+
+		const char* seg = (const char*)&*dbi;
+		const char* match = plan.Find(seg, seg_end - pos);
+		if (match) {
+			sr.error_code = 0;
+			sr.start = pos + (match - seg);
+			sr.end = sr.start + byte_len;
+			return sr; // text found!
+		}
+		if (seg_end >= end_pos) break;
+
+		// Check for matches crossing into the next segment
+		if (byte_len > 1) {
+			const int border_start = wxMax(pos, seg_end - byte_len + 1);
+			const int border_end = wxMin(seg_end + byte_len - 1, end_pos);
+			border.resize(border_end - border_start);
+			doc_byte_iter b(*this, border_start);
+			for (unsigned int i = 0; i < border.size(); ++i, ++b) border[i] = *b;
+
+			match = plan.Find(&*border.begin(), border.size());
+			if (match) {
 				sr.error_code = 0;
-				sr.start = first_byte_pos;
+				sr.start = border_start + (match - &*border.begin());
 				sr.end = sr.start + byte_len;
 				return sr; // text found!
 			}
 		}
 
-		// If we don't have a match, see how far we can move char_pos
-		map<char, int>::iterator result = charmap.find(c);
-		map<char, int>::iterator result_upper = charmap_upper.find(c);
-		if (result != charmap.end()) subject += result->second;
-		else if (!matchcase && result_upper != charmap_upper.end()) subject += result_upper->second;
-		else subject += byte_len;
-
-		// Make sure that we end on a valid UTF8 char
-		//while ((*subject & 0xC0) == 0x80) ++subject;
+		pos = seg_end;
 	}
 
 	return sr; // reached end without finding text
@@ -1571,64 +1636,34 @@ search_result Document::FindBackwards(const wxString& searchtext, int start_pos,
 	wxASSERT(start_pos <= (int)GetLength());
 	if (searchtext.empty()) return sr;
 
-	// We need both upper- & lowercase versions for caseless search
-	wxString text = searchtext;
-	wxString textUpper;
-	if (!matchcase) {
-		text.MakeLower();
-		textUpper = searchtext;
-		textUpper.MakeUpper();
-	}
-
-	// Convert the searchtext to UTF8
-	wxCharBuffer UTF8buffer = wxConvUTF8.cWC2MB(text);
-	unsigned int byte_len = strlen(UTF8buffer);
-	wxCharBuffer UTF8bufferUpper;
-	if (!matchcase) {
-		UTF8bufferUpper = wxConvUTF8.cWC2MB(textUpper);
-		wxASSERT(byte_len == strlen(UTF8bufferUpper));
-	}
-
-	// Build a dictionary of char-to-first distances in the search string
-	map<char, int> charmap;
-	for (unsigned int i = byte_len-1; i > 0; --i) {
-		charmap[UTF8buffer[i]] = i;
-	}
-
-	// Prepare vars to avoid lookups in loop
-	char firstChar = UTF8buffer[(unsigned int)0];
-	char firstCharUpper = '\0';
-	if (!matchcase) firstCharUpper = UTF8bufferUpper[(unsigned int)0];
+	const LiteralMatcher& plan = GetSearchPlan(searchtext, matchcase);
+	if (!m_search_fold.IsEmpty()) return FindFoldedBackwards(start_pos);
+	const int byte_len = plan.GetLength();
+	if (byte_len == 0) return sr;
 
-	// Search
+	// Matches have to start before start_pos
 	const int lastPossible = GetLength()-byte_len;
-	doc_byte_iter subject(*this, wxMin(start_pos-1, lastPossible)); // start from char before start_pos
-
-	// WARNING: This algorithm assumes that UTF8 upper- & lowercase chars have same byte width
-	while (subject.GetIndex() >= 0) {
-		char c = *subject; // Get candidate for last char
-
-		if (c == firstChar || (!matchcase && c == firstCharUpper)) {
-			// TODO: optimize by matching individual chars
-			wxString subtext = GetTextPart(subject.GetIndex(), subject.GetIndex()+byte_len);
-
-			// Check if the found text matches
-			if (!matchcase) subtext.MakeLower();
-			if (text == subtext) {
-				sr.error_code = 0;
-				sr.start = subject.GetIndex();
-				sr.end = sr.start + byte_len;
-				return sr; // text found!
-			}
+	const int lastStart = wxMin(start_pos-1, lastPossible);
+	if (lastStart < 0) return sr;
+
+	// Search backwards in blocks overlapping with the length of the text
+	const int blockSize = 64 * 1024;
+	vector<char> block;
+	int end = lastStart + byte_len;
+	for (;;) {
+		const int start = wxMax(0, end - blockSize);
+		GetTextPart(start, end, block);
+
+		const char* match = plan.FindBackwards(&*block.begin(), block.size());
+		if (match) {
+			sr.error_code = 0;
+			sr.start = start + (match - &*block.begin());
+			sr.end = sr.start + byte_len;
+			return sr; // text found!
 		}
 
-		// If we don't have a match, see how far we can move char_pos
-		map<char, int>::iterator result = charmap.find(c);
-		if (result != charmap.end()) subject -= result->second;
-		else subject -= byte_len;
-
-		// Make sure that we end on a valid UTF8 char
-		while ((*subject & 0xC0) == 0x80) --subject;
+		if (start == 0) break;
+		end = start + byte_len - 1;
 	}
 
 	return sr; // reached end without finding text
@@ -1860,6 +1895,75 @@ unsigned int Document::Replace(unsigned int start_pos, unsigned int end_pos, con
 	return byte_len; // return number of bytes inserted
 }
 
+void Document::ReplaceAll(const vector<interval>& ranges, const vector<char>& texts, const vector<unsigned int>& textEnds, vector<cxChange>& changes) {
+	wxASSERT(IsOk());
+	wxASSERT(ranges.size() == textEnds.size());
+	if (ranges.empty()) return;
+
+	const unsigned int span_start = ranges.front().start;
+	const unsigned int span_end = ranges.back().end;
+	wxASSERT(span_end <= (unsigned int)pLength(vHistory[m_docId.version_id]));
+
+	// Get the original text covered by the replacements
+	vector<char> source;
+	GetTextPart(span_start, span_end, source);
+
+	// Build the new text as one stream
+	vector<char> target;
+	target.reserve(source.size() + texts.size());
+	const unsigned int first_change = changes.size();
+	changes.reserve(first_change + 2 * ranges.size());
+	unsigned int text_start = 0;
+	unsigned int pos = span_start;
+	for (unsigned int i = 0; i < ranges.size(); ++i) {
+		const interval& r = ranges[i];
+		wxASSERT(r.start >= pos && r.end >= r.start);
+
+		// Copy unchanged text up to the match
+		target.insert(target.end(), source.begin() + (pos - span_start), source.begin() + (r.start - span_start));
+		const unsigned int newpos = span_start + target.size();
+
+		if (r.start < r.end) {
+			const cxChange change = {cxDELETION, newpos, r.start, r.end, 0};
+			changes.push_back(change);
+		}
+		if (text_start < textEnds[i]) {
+			target.insert(target.end(), texts.begin() + text_start, texts.begin() + textEnds[i]);
+			const cxChange change = {cxINSERTION, r.start, newpos, newpos + (textEnds[i] - text_start), 0};
+			changes.push_back(change);
+		}
+
+		text_start = textEnds[i];
+		pos = r.end;
+	}
+	target.insert(target.end(), source.begin() + (pos - span_start), source.end());
+	target.push_back('\0');
+
+	PrepareForChange();
+
+	// Replace the whole span in one operation
+	if (span_start < span_end) m_textData.Delete(span_start, span_end);
+	if (target[0] != '\0') m_textData.Insert(span_start, &*target.begin());
+	UpdateHeadnode(); // Check if the headnode has been updated
+
+	// Adjust the length
+	pLength(vHistory[m_docId.version_id]) = m_textData.GetLength();
+
+	// Notify subscribers that the revision has changed
+	if (do_notify || m_trackChanges) {
+		m_catalyst.UnLock();
+			if (m_trackChanges) {
+				// Report the individual replacements (in order)
+				for (vector<cxChange>::const_iterator c = changes.begin() + first_change; c != changes.end(); ++c) {
+					if (c->type == cxDELETION) m_trackChanges(cxDELETION, c->pos, c->end - c->start, m_trackChangesData);
+					else m_trackChanges(cxINSERTION, c->start, c->end - c->start, m_trackChangesData);
+				}
+			}
+			if (do_notify) dispatcher.Notify(wxT("DOC_UPDATEREVISION"), &m_docId, 0);
+		m_catalyst.ReLock();
+	}
+}
+
 void Document::Freeze() {
 	wxASSERT(IsOk());
 	if (in_change) return; // Don't freeze during grouped changes
@@ -21,6 +21,7 @@
 
 #include "Catalyst.h"
 #include "DataText.h"
+#include "LiteralMatcher.h"
 
 
 class doc_byte_iter;
@@ -29,6 +30,17 @@ typedef struct real_pcre pcre;    // because of the way it is defined in pcre.h
 struct pcre_extra;
 class ISettings;
 
+// A frozen revision copied out of the document for saving, so that it
+// can be written to disk without holding the document lock
+struct cxSaveData {
+	doc_id docId;
+	wxDateTime date; // only valid if docId is a document
+	wxTextFileType eol;
+	wxFontEncoding encoding;
+	bool hasBOM;
+	vector<vector<char> > blocks; // utf-8, split on char boundaries
+};
+
 class Document {
 public:
 	Document(const doc_id& di, CatalystWrapper cw);
@@ -80,6 +92,13 @@ public:
 	cxFileResult SaveText(const wxFileName& path, bool forceNativeEOL=false, const wxString& realpath=wxEmptyString, bool keepMirrorDate=false, bool noAtomic=false);
 	void GetLines(vector<unsigned int>& list) const;
 
+	// Saving in steps (SaveText does all three), so that only the first
+	// and last have to hold the lock. WriteSaveData takes the blocks (leaving
+	// them empty) and reports progress by block.
+	void PrepareSave(bool forceNativeEOL, cxSaveData& data);
+	static cxFileResult WriteSaveData(const wxFileName& path, cxSaveData& data, bool noAtomic, void(*progress)(unsigned int, unsigned int, void*)=NULL, void* progressData=NULL);
+	void FinishSave(const wxFileName& path, const cxSaveData& data, const wxString& realpath, bool keepMirrorDate);
+
 	// Modification
 	unsigned int Insert(int pos, const wxString& text);
 	unsigned int Insert(int pos, const char* text);
@@ -88,6 +107,9 @@ public:
 	void DeleteAll();
 	void Move(int source_startpos, int source_endpos, int dest_pos);
 	unsigned int Replace(unsigned int start_pos, unsigned int end_pos, const wxString& text);
+	// Replaces sorted, non-overlapping ranges in one operation. Replacement i is the
+	// utf8 text ending at textEnds[i] in texts. Changes are added in GetChanges() format.
+	void ReplaceAll(const vector<interval>& ranges, const vector<char>& texts, const vector<unsigned int>& textEnds, vector<cxChange>& changes);
 	void Freeze();
 
 	// Searching
@@ -172,10 +194,11 @@ private:
 	bool do_notify;
 	DataText m_textData;
 
-	// Cache of last compiled regex
-	mutable wxString m_regex_cache;
-	mutable int m_options_cache;
-	mutable pcre *m_re;
+	// Cache of last compiled search text
+	mutable wxString m_search_cache;
+	mutable bool m_search_matchcase_cache;
+	mutable LiteralMatcher m_search_plan;
+	mutable CharFoldMatcher m_search_fold; // used instead for caseless text with chars of differing width
 
 	// Change Tracking Callback
 	void(*m_trackChanges)(cxChangeType, unsigned int, unsigned int, void*);
@@ -187,6 +210,9 @@ private:
 
 	// Support functions
 	void PrepareForChange();
+	const LiteralMatcher& GetSearchPlan(const wxString& searchtext, bool matchcase) const;
+	search_result FindFolded(int start_pos, int end_pos) const;
+	search_result FindFoldedBackwards(int start_pos) const;
 	node_ref GetHeadnode() const;
 	node_ref GetHeadnode(const doc_id& di) const;
 	node_ref GetPropnode() const;
@@ -17,11 +17,14 @@
 #include <wx/filename.h>
 #include <wx/tipwin.h>
 #include <wx/file.h>
+#include <wx/progdlg.h>
 
 #include <set>
 #include <algorithm>
+#include <memory>
 
 #include "pcre.h"
+#include "RegexCache.h"
 
 #include "doc_byte_iter.h"
 #include "tm_syntaxhandler.h"
@@ -87,6 +90,47 @@ private:
 	 const vector<const tmAction*>& m_list;
 };
 
+// Embedded class: Leaves out brackets in strings and comments (by scope)
+class ScopeBracketFilter : public IBracketFilter {
+public:
+	ScopeBracketFilter(Styler_Syntax& syntaxstyler)
+	: m_syntaxstyler(syntaxstyler), m_stringAtom(ScopeAtoms::Get().GetAtom(wxT("string"))),
+	  m_commentAtom(ScopeAtoms::Get().GetAtom(wxT("comment"))) {};
+
+	void GetIgnored(const vector<unsigned int>& positions, vector<bool>& ignored) {
+		m_syntaxstyler.GetScopeStackIds(positions, m_stackIds);
+		for (unsigned int i = 0; i < positions.size(); ++i) {
+			ignored[i] = IsIgnored(m_stackIds[i]);
+		}
+	};
+
+private:
+	bool IsIgnored(unsigned int stackId) {
+		const map<unsigned int, bool>::const_iterator p = m_ignoredStacks.find(stackId);
+		if (p != m_ignoredStacks.end()) return p->second;
+
+		ScopeAtoms::ScopeList scopes;
+		ScopeAtoms::Get().GetStackScopes(stackId, scopes);
+		bool isIgnored = false;
+		for (ScopeAtoms::ScopeList::const_iterator s = scopes.begin(); s != scopes.end(); ++s) {
+			const ScopeAtoms::AtomList& atoms = **s;
+			if (!atoms.empty() && (atoms[0] == m_stringAtom || atoms[0] == m_commentAtom)) {
+				isIgnored = true;
+				break;
+			}
+		}
+
+		m_ignoredStacks[stackId] = isIgnored;
+		return isIgnored;
+	};
+
+	Styler_Syntax& m_syntaxstyler;
+	const unsigned int m_stringAtom;
+	const unsigned int m_commentAtom;
+	vector<unsigned int> m_stackIds;
+	map<unsigned int, bool> m_ignoredStacks;
+};
+
 class DragDropTarget : public wxDropTarget {
 public:
 	DragDropTarget(EditorCtrl& parent);
@@ -141,6 +185,7 @@ END_EVENT_TABLE()
 const unsigned int EditorCtrl::m_caretWidth = 2;
 unsigned long EditorCtrl::s_ctrlDownTime = 0;
 bool EditorCtrl::s_altGrDown = false;
+const EditorCtrl* EditorCtrl::s_frameOwner = NULL;
 
 /// Open a page saved from a previous session
 EditorCtrl::EditorCtrl(const int page_id, CatalystWrapper& cw, wxBitmap& bitmap, wxWindow* parent, EditorFrame& parentFrame) : 
@@ -179,8 +224,6 @@ EditorCtrl::EditorCtrl(const int page_id, CatalystWrapper& cw, wxBitmap& bitmap,
 	lastpos(0), 
 	m_currentSel(-1), 
 	do_freeze(true), 
-	m_options_cache(0), 
-	m_re(NULL), 
 	m_symbolCacheToken(0),
 
 	m_tabSettingsFromSyntax(false),
@@ -238,8 +281,6 @@ EditorCtrl::EditorCtrl(const doc_id di, const wxString& mirrorPath, CatalystWrap
 	lastpos(0),
 	m_currentSel(-1), 
 	do_freeze(true),
-	m_options_cache(0),
-	m_re(NULL),
 	m_symbolCacheToken(0),
 
 	m_tabSettingsFromSyntax(false),
@@ -312,8 +353,6 @@ EditorCtrl::EditorCtrl(CatalystWrapper& cw, wxBitmap& bitmap, wxWindow* parent,
 	lastpos(0), 
 	m_currentSel(-1), 
 	do_freeze(true), 
-	m_options_cache(0), 
-	m_re(NULL), 
 	m_symbolCacheToken(0),
 
 	m_tabSettingsFromSyntax(false),
@@ -430,6 +469,13 @@ void EditorCtrl::Init() {
 	m_lastScopePos = -1; // scope selection
 	if (!doShowMargin) m_wrapAtMargin = false;
 
+	// Drawing
+	m_drawDamagedOnly = false;
+	m_frameCount = 0;
+	m_partialFrameCount = 0;
+	m_lastFrameTime = 0;
+	m_totalFrameTime = 0;
+
 	// Initialize gutter (line numbers)
 	m_gutterCtrl = new GutterCtrl(*this, wxID_ANY);
 	m_gutterCtrl->Hide();
@@ -510,6 +556,9 @@ EditorCtrl::~EditorCtrl() {
 
 	NotifyParentMate();
 	ClearRemoteInfo();
+
+	// Make sure another editor at same address will not reuse our frame
+	if (s_frameOwner == this) s_frameOwner = NULL;
 }
 
 // Notify mate that we have finished editing document
@@ -706,6 +755,11 @@ void EditorCtrl::ClearSearchHighlight() {
 	DrawLayout();
 }
 
+bool EditorCtrl::GetMatchCount(unsigned int& index, unsigned int& count) {
+	const unsigned int pos = m_lines.IsSelected() ? m_lines.GetSelections().back().start : m_lines.GetPos();
+	return m_search_hl_styler.GetMatchCount(pos, index, count);
+}
+
 bool EditorCtrl::IsOk() const {
 	wxSize size = GetClientSize();
 
@@ -957,11 +1011,13 @@ void EditorCtrl::DrawLayout(bool isScrolling) {
 	DrawLayout(dc, isScrolling);
 }
 
-void EditorCtrl::DrawLayout(wxDC& dc, bool WXUNUSED(isScrolling)) {
+void EditorCtrl::DrawLayout(wxDC& dc, bool isScrolling) {
 	if (!IsShown() || !m_enableDrawing) return; // No need to draw
 	wxLogDebug(wxT("DrawLayout() : %d (%d,%d)"), GetId(), m_enableDrawing, IsShown());
 	//wxLogDebug(wxT("DrawLayout() : %s"), GetName());
 
+	wxStopWatch frameTimer;
+
 	if (m_beforeRedrawCallback) m_beforeRedrawCallback(m_callbackData);
 
 	wxASSERT(m_scrollPosX >= 0);
@@ -999,6 +1055,7 @@ void EditorCtrl::DrawLayout(wxDC& dc, bool WXUNUSED(isScrolling)) {
 		// Resize bitmap
 		bitmap = wxBitmap(size.x, size.y);
 		mdc.SelectObject(bitmap);
+		s_frameOwner = NULL;
 	}
 
 	// We always have to reselect the bitmap if it has been resized
@@ -1049,46 +1106,45 @@ void EditorCtrl::DrawLayout(wxDC& dc, bool WXUNUSED(isScrolling)) {
 	if (!(m_parentFrame.IsSearching() || m_commandHandler.IsSearching()))
 		m_search_hl_styler.Clear(); // Only highlight search terms during search
 
-	// When scrolling, we can just draw the new parts
-	wxRect rect(0, scrollPos, editorSizeX, size.y);
-	/*if (isScrolling && scrollPos != old_scrollPos && this == FindFocus()) {
-		// If there is overlap, then move the image
-		if (scrollPos + size.y > old_scrollPos && scrollPos < old_scrollPos + size.y) {
-			const int top = wxMax(scrollPos, old_scrollPos);
-			const int bottom = wxMin(scrollPos, old_scrollPos) + size.y;
-			const int overlap_height = bottom - top;
-#ifdef __WXMSW__
-			::BitBlt(GetHdcOf(mdc), 0, (top - old_scrollPos) + (old_scrollPos - scrollPos),  editorSizeX, overlap_height, GetHdcOf(mdc), 0, top - old_scrollPos, SRCCOPY);
-#else
-			mdc.Blit(0, (top - old_scrollPos) + (old_scrollPos - scrollPos),  editorSizeX, overlap_height, &mdc, 0, top - old_scrollPos);
-#endif
-			// Calculate rect of newly revealed part
-			const int new_height = size.y - overlap_height;
-			const int newtop = (top == scrollPos ? bottom : scrollPos);
-			rect = wxRect(0,newtop,editorSizeX,new_height);
-			wxASSERT(newtop <= m_lines.GetHeight());
-		}
-	}*/
-
 	// Highlight matching brackets
 	MatchBrackets();
 
+	// If the bitmap still holds our last frame, we only have to draw
+	// the lines that have changed (and those revealed by scrolling)
+	vector<wxRect> rects;
+	const bool isPartial = ReuseLastFrame(editorSizeX, size.y, isScrolling, rects);
+	if (!isPartial) rects.push_back(wxRect(0, scrollPos, editorSizeX, size.y));
+
 	// Set the theme colors
 	mdc.SetTextForeground(m_theme.foregroundColor);
-	mdc.SetBrush(wxBrush(m_theme.backgroundColor));
-	mdc.SetPen(wxPen(m_theme.backgroundColor));
 
-	// Clear the background
-	mdc.DrawRectangle(rect.x, rect.y - scrollPos, rect.width, rect.height);
+	bool redrawAll = !isPartial;
+	for (unsigned int i = 0; i < rects.size(); ++i) {
+		wxRect& rect = rects[i];
+
+		// Clear the background
+		mdc.SetBrush(wxBrush(m_theme.backgroundColor));
+		mdc.SetPen(wxPen(m_theme.backgroundColor));
+		mdc.DrawRectangle(rect.x, rect.y - scrollPos, rect.width, rect.height);
+
+		// Draw the layout to MemoryDC
+		m_lines.Draw(-m_scrollPosX, -scrollPos, rect);
+
+		// If drawing changed the height of any lines (or they have been
+		// re-measured since last frame), the lines below have moved
+		if (!redrawAll && m_lines.GetHeight() != m_frame.height) {
+			rects.erase(rects.begin() + i + 1, rects.end());
+			rects.push_back(wxRect(0, scrollPos, editorSizeX, size.y));
+			redrawAll = true;
+		}
+	}
 
-	// Draw the layout to MemoryDC
-	m_lines.Draw(-m_scrollPosX, -scrollPos, rect);
-	
 	// During the draw we may have corrected some approximated
 	// line dimensions causing the dimesions of the entire document
 	// to have changed. So we have to check if the scrollbars should
 	// be updated again.
 	if (UpdateScrollbars(editorSizeX, size.y)) return; // adding/removing scrollbars send size event
+	SaveFrame(editorSizeX, size.y);
 
 	// avoid leaving a caret trace
 	if (caret->IsVisible()) caret->Hide();
@@ -1122,6 +1178,176 @@ void EditorCtrl::DrawLayout(wxDC& dc, bool WXUNUSED(isScrolling)) {
 	if (m_afterRedrawCallback) m_afterRedrawCallback(m_callbackData);
 
 	m_isResizing = false;
+
+	// Update statistics
+	m_lastFrameTime = frameTimer.Time();
+	m_totalFrameTime += m_lastFrameTime;
+	++m_frameCount;
+	if (!redrawAll) ++m_partialFrameCount;
+}
+
+// Maps a position in the last frame to the current text
+// (everything changed since is inside the changed range)
+static unsigned int AdjustFramePos(unsigned int pos, const interval& changed, int lenDiff) {
+	if (pos <= changed.start) return pos;
+	if ((int)pos >= (int)changed.end - lenDiff) return pos + lenDiff;
+	return changed.start;
+}
+
+bool EditorCtrl::ReuseLastFrame(unsigned int width, unsigned int height, bool isScrolling, vector<wxRect>& rects) {
+	// Changes are tracked from frame to frame
+	interval changed;
+	const bool hasChanges = m_lines.PopChangedRange(changed);
+	const bool isRestyled = m_syntaxstyler.ChangedBeyondEdit();
+	const bool damagedOnly = m_drawDamagedOnly;
+	m_drawDamagedOnly = false;
+
+	// All editors in the frame share the bitmap, so we only
+	// have our last frame if no one else has drawn since
+	const bool isOwner = (s_frameOwner == this);
+	s_frameOwner = NULL; // until this frame is done
+
+	if (!isOwner || !(isScrolling || damagedOnly) || m_isResizing) return false;
+	if (m_frame.size != wxSize(width, height) || m_frame.scrollPosX != m_scrollPosX) return false;
+	if (m_beforeRedrawCallback) return false; // others may style us (diffs)
+	if (m_lines.IsEmpty()) return false;
+
+	// Changes we have no ranges for
+	if (m_changeToken != m_frame.changeToken && !hasChanges) return false;
+	if (m_lines.GetLength() != m_frame.length && !hasChanges) return false;
+	if (isRestyled && !hasChanges) return false;
+
+	// Map old positions to the current text
+	const int lenDiff = (int)m_lines.GetLength() - (int)m_frame.length;
+	if (!hasChanges) changed.Set(m_frame.length, m_frame.length);
+	const unsigned int pos = m_lines.GetPos();
+	const unsigned int oldPos = AdjustFramePos(m_frame.pos, changed, lenDiff);
+
+	// Some highlights depend on the caret position in the entire view
+	if (hasChanges || pos != oldPos) {
+		if (m_parentFrame.IsSearching() || m_commandHandler.IsSearching()) return false;
+		if (m_html_hl_styler.ShouldStyle() || m_selectionsStyler.IsNavigating()) return false;
+		if (m_snippetHandler.IsActive()) return false;
+	}
+
+	// Find the lines that have to be redrawn
+	vector<interval> lines;
+	bool toBottom = false;
+	if (hasChanges) {
+		AddDamagedLines(changed.start, changed.end, lines);
+		toBottom = isRestyled; // styles after the change may have changed
+	}
+	if (pos != oldPos) {
+		// Current line highlight (and word at caret)
+		AddDamagedLines(oldPos, oldPos, lines);
+		AddDamagedLines(pos, pos, lines);
+	}
+
+	const interval& brackets = m_bracketHighlight.GetInterval();
+	const bool hasBrackets = m_bracketHighlight.HasInterval();
+	const bool hadBrackets = (m_frame.brackets.start != m_frame.brackets.end);
+	interval oldBrackets;
+	if (hadBrackets) oldBrackets.Set(AdjustFramePos(m_frame.brackets.start, changed, lenDiff), AdjustFramePos(m_frame.brackets.end, changed, lenDiff));
+	if (hasBrackets != hadBrackets || (hasBrackets && (brackets.start != oldBrackets.start || brackets.end != oldBrackets.end))) {
+		if (hadBrackets) {
+			AddDamagedLines(oldBrackets.start, oldBrackets.start, lines);
+			AddDamagedLines(oldBrackets.end, oldBrackets.end, lines);
+		}
+		if (hasBrackets) {
+			AddDamagedLines(brackets.start, brackets.start, lines);
+			AddDamagedLines(brackets.end, brackets.end, lines);
+		}
+	}
+
+	const vector<interval>& selections = m_lines.GetSelections();
+	const vector<interval>& oldSelections = m_frame.selections;
+	if (m_lines.IsSelectionShadow() != m_frame.isSelShadow || selections.size() != oldSelections.size()) {
+		for (vector<interval>::const_iterator p = oldSelections.begin(); p != oldSelections.end(); ++p) {
+			AddDamagedLines(AdjustFramePos(p->start, changed, lenDiff), AdjustFramePos(p->end, changed, lenDiff), lines);
+		}
+		for (vector<interval>::const_iterator p = selections.begin(); p != selections.end(); ++p) {
+			AddDamagedLines(p->start, p->end, lines);
+		}
+	}
+	else {
+		// Usually only one end of a selection moves
+		for (unsigned int i = 0; i < selections.size(); ++i) {
+			const interval& sel = selections[i];
+			const unsigned int start = AdjustFramePos(oldSelections[i].start, changed, lenDiff);
+			const unsigned int end = AdjustFramePos(oldSelections[i].end, changed, lenDiff);
+
+			if (sel.start == start) {
+				if (sel.end != end) AddDamagedLines(wxMin(sel.end, end), wxMax(sel.end, end), lines);
+			}
+			else if (sel.end == end) AddDamagedLines(wxMin(sel.start, start), wxMax(sel.start, start), lines);
+			else {
+				AddDamagedLines(start, end, lines);
+				AddDamagedLines(sel.start, sel.end, lines);
+			}
+		}
+	}
+
+	// We can't place lines hidden in folds
+	if (!lines.empty() && HasFoldedFolds()) return false;
+
+	// When scrolling, we can move the part still visible
+	const int scrollDiff = scrollPos - m_frame.scrollPos;
+	if (scrollDiff) {
+		if (abs(scrollDiff) >= (int)height) return false;
+
+		const int keepHeight = height - abs(scrollDiff);
+		const int srcTop = (scrollDiff > 0) ? scrollDiff : 0;
+		const int destTop = (scrollDiff > 0) ? 0 : -scrollDiff;
+#ifdef __WXMSW__
+		::BitBlt(GetHdcOf(mdc), 0, destTop, (int)width, keepHeight, GetHdcOf(mdc), 0, srcTop, SRCCOPY);
+#else
+		mdc.Blit(0, destTop, width, keepHeight, &mdc, 0, srcTop);
+#endif
+
+		// Redraw the newly revealed part (extended to whole lines)
+		int top = (scrollDiff > 0) ? scrollPos + keepHeight : scrollPos;
+		int bottom = top + abs(scrollDiff);
+		const int docHeight = m_lines.GetHeight();
+		if (top < docHeight) {
+			const unsigned int firstLine = m_lines.GetLineFromYPos(top);
+			const unsigned int lastLine = m_lines.GetLineFromYPos(wxMin(bottom, docHeight) - 1);
+			top = wxMin(top, m_lines.GetYPosFromLine(firstLine));
+			bottom = wxMax(bottom, m_lines.GetBottomYPosFromLine(lastLine));
+		}
+		rects.push_back(wxRect(0, top, width, bottom - top));
+	}
+
+	// Add the bands of changed lines
+	const int viewBottom = scrollPos + height;
+	for (vector<interval>::const_iterator p = lines.begin(); p != lines.end(); ++p) {
+		const int top = wxMax(scrollPos, m_lines.GetYPosFromLine(p->start));
+		const int bottom = (toBottom && p == lines.begin()) ? viewBottom : wxMin(viewBottom, m_lines.GetBottomYPosFromLine(p->end));
+		if (top < bottom) rects.push_back(wxRect(0, top, width, bottom - top));
+	}
+
+	return true;
+}
+
+void EditorCtrl::AddDamagedLines(unsigned int start, unsigned int end, vector<interval>& lines) const {
+	const unsigned int len = m_lines.GetLength();
+	const unsigned int lastLine = m_lines.GetLineCount() - 1;
+	const unsigned int firstLine = wxMin((unsigned int)m_lines.GetLineFromCharPos(wxMin(start, len)), lastLine);
+	lines.push_back(interval(firstLine, wxMin((unsigned int)m_lines.GetLineFromCharPos(wxMin(end, len)), lastLine)));
+}
+
+void EditorCtrl::SaveFrame(unsigned int width, unsigned int height) {
+	s_frameOwner = this;
+
+	m_frame.size = wxSize(width, height);
+	m_frame.scrollPos = scrollPos;
+	m_frame.scrollPosX = m_scrollPosX;
+	m_frame.height = m_lines.GetHeight();
+	m_frame.length = m_lines.GetLength();
+	m_frame.changeToken = m_changeToken;
+	m_frame.pos = m_lines.GetPos();
+	m_frame.brackets = m_bracketHighlight.GetInterval();
+	m_frame.selections = m_lines.GetSelections();
+	m_frame.isSelShadow = m_lines.IsSelectionShadow();
 }
 
 unsigned int EditorCtrl::ClientWidthToEditor(unsigned int width) const {
@@ -2135,7 +2361,6 @@ bool EditorCtrl::FindMatchingBracket(unsigned int pos, unsigned int& pos2) {
 	cxENDLOCK
 
 	bool searchForward = true;
-	int limit = m_lines.GetLength();
 	char start_bracket = '\0';
 	char end_bracket = '\0';
 
@@ -2201,62 +2426,41 @@ bool EditorCtrl::FindMatchingBracket(unsigned int pos, unsigned int& pos2) {
 				end_bracket = p2->first.mb_str(wxConvUTF8).data()[0];
 				searchForward = false;
 				bracketFound = true;
-				limit = 0;
 				break;
 			}
 		}
 		if (!bracketFound) return false; // no bracket at pos
 	}
 
-	if (searchForward) {
-		cxLOCKDOC_READ(m_doc)
-			doc_byte_iter dbi(doc, pos+1);
-			bool escaped = false;
-			unsigned int count = 1;
-			while (dbi.GetIndex() < limit) {
-				if (escaped) escaped = false;
-				else {
-					if (*dbi == '\\') escaped = true;
-					else if (*dbi == start_bracket) ++count;
-					else if (*dbi == end_bracket) {
-						--count;
-						if (count == 0) {
-							pos2 = dbi.GetIndex();
-							return true;
-						}
-					}
-				}
-				++dbi;
-			}
-		cxENDLOCK
+	// Distinct pairs are matched in the bracket index, so we don't
+	// have to go through all the text in between. Brackets in strings
+	// and comments are left out (unless we start in one).
+	ScopeBracketFilter filter(m_syntaxstyler);
+	if (searchForward) return GetBracketIndex(start_bracket, end_bracket).FindMatching(pos, pos2, &filter);
+	else return GetBracketIndex(end_bracket, start_bracket).FindMatching(pos, pos2, &filter);
+}
+
+BracketIndex& EditorCtrl::GetBracketIndex(char open, char close) {
+	BracketIndex* index = NULL;
+	for (auto_vector<BracketIndex>::iterator p = m_bracketIndexes.begin(); p != m_bracketIndexes.end(); ++p) {
+		if ((*p)->GetOpen() == open && (*p)->GetClose() == close) {
+			index = *p;
+			break;
+		}
+	}
+	if (!index) {
+		index = new BracketIndex(open, close);
+		m_bracketIndexes.push_back(auto_ptr<BracketIndex>(index));
 	}
-	else {
-		cxLOCKDOC_READ(m_doc)
-			doc_byte_iter dbi(doc, pos-1);
-			unsigned int count = 1;
-			while (dbi.GetIndex() >= limit) {
-				if (*dbi == start_bracket) {
-					unsigned int esc_count = 0;
-					for (doc_byte_iter dbi2 = dbi-1; dbi2.GetIndex() >= limit && *dbi2 == '\\'; --dbi2) ++esc_count;
-					if (!(esc_count & 1)) ++count;
-				}
-				else if (*dbi == end_bracket) {
-					unsigned int esc_count = 0;
-					for (doc_byte_iter dbi2 = dbi-1; dbi2.GetIndex() >= limit && *dbi2 == '\\'; --dbi2) ++esc_count;
-					if (!(esc_count & 1)) {
-						--count;
-						if (count == 0) {
-							pos2 = dbi.GetIndex();
-							return true;
-						}
-					}
-				}
 
-				--dbi;
-			}
+	// New indexes (or ones out of step with the document) are built from the text
+	if (index->GetLength() != m_lines.GetLength()) {
+		cxLOCKDOC_READ(m_doc)
+			index->Build(doc);
 		cxENDLOCK
 	}
-	return false;
+
+	return *index;
 }
 
 void EditorCtrl::MatchBrackets() {
@@ -2874,6 +3078,8 @@ void EditorCtrl::Clear() {
 		doc.Clear();
 	cxENDLOCK
 	m_lines.Clear();
+	m_bracketIndexes.clear();
+	m_wordIndex.reset();
 	scrollPos = 0;
 	topline = -1;
 	m_currentSel = -1;
@@ -3036,13 +3242,30 @@ bool EditorCtrl::SaveText(bool askforpath) {
 	settings.GetSettingBool(wxT("force_native_eol"), forceNativeEOL);
 	settings.GetSettingBool(wxT("disable_atomic_save"), noAtomic);
 
-	// Save the text
-	cxFileResult savedResult;
-	const wxString realname = m_remotePath.empty() ? wxT("") : docName;
+	// Copy the text to be saved, so that we don't hold the lock
+	// (and block the document) while it is written
+	cxSaveData saveData;
 	cxLOCKDOC_WRITE(m_doc)
-		savedResult = doc.SaveText(filepath, forceNativeEOL, realname, false, noAtomic);
+		doc.PrepareSave(forceNativeEOL, saveData);
 	cxENDLOCK
 
+	// Show progress when saving large files
+	auto_ptr<wxProgressDialog> progressDlg;
+	if (saveData.blocks.size() > 16) {
+		progressDlg.reset(new wxProgressDialog(_("Saving..."), filepath.GetFullName(), 1000, this, wxPD_AUTO_HIDE|wxPD_APP_MODAL));
+	}
+
+	// Save the text
+	const wxString realname = m_remotePath.empty() ? wxT("") : docName;
+	const cxFileResult savedResult = Document::WriteSaveData(filepath, saveData, noAtomic, progressDlg.get() ? OnSaveProgress : NULL, progressDlg.get());
+	progressDlg.reset();
+
+	if (savedResult == cxFILE_OK) {
+		cxLOCKDOC_WRITE(m_doc)
+			doc.FinishSave(filepath, saveData, realname, false);
+		cxENDLOCK
+	}
+
 	const wxString pathStr = filepath.GetFullPath();
 
 	switch (savedResult) {
@@ -3085,6 +3308,11 @@ bool EditorCtrl::SaveText(bool askforpath) {
 	return true;
 }
 
+void EditorCtrl::OnSaveProgress(unsigned int done, unsigned int total, void* data) { // static
+	wxProgressDialog* dlg = (wxProgressDialog*)data;
+	dlg->Update((int)(((wxULongLong_t)done * 1000) / total));
+}
+
 void EditorCtrl::SetPath(const wxString& newpath) {
 	wxASSERT(!eDocumentPath::IsRemotePath(newpath)); // just to catch a bug
 
@@ -3339,7 +3567,11 @@ void EditorCtrl::ApplyDiff(const doc_id& oldDoc, bool moveToFirstChange) {
 		const doc_id di = doc.GetDocument();
 		changes = doc.GetChanges(oldDoc, di);
 	cxENDLOCK
-	
+
+	ApplyChanges(changes, moveToFirstChange);
+}
+
+void EditorCtrl::ApplyChanges(vector<cxChange>& changes, bool moveToFirstChange) {
 	// Lines has to be made valid first
 	m_lines.ApplyDiff(changes);
 	
@@ -3409,27 +3641,85 @@ interval EditorCtrl::UndoSelection(const cxDiffEntry& de) {
 void EditorCtrl::StylersClear() {
 	m_lines.StylersClear();
 	FoldingClear();
+	m_bracketIndexes.clear();
+	m_wordIndex.reset();
 }
 
 void EditorCtrl::StylersInvalidate() {
 	m_lines.StylersInvalidate();
 	FoldingClear();
+	m_bracketIndexes.clear();
+	m_wordIndex.reset();
 }
 
 void EditorCtrl::StylersInsert(unsigned int pos, unsigned int length) {
 	m_lines.StylersInsert(pos, length);
 	FoldingInsert(pos, length);
 	bookmarks.InsertChars(pos, length);
+
+	cxLOCKDOC_READ(m_doc)
+		for (auto_vector<BracketIndex>::iterator p = m_bracketIndexes.begin(); p != m_bracketIndexes.end(); ++p) {
+			(*p)->Insert(pos, length);
+			(*p)->Scan(doc, pos, pos+length);
+		}
+		if (m_wordIndex.get()) {
+			m_wordIndex->Insert(pos, length);
+			m_wordIndex->Scan(doc, pos, pos+length);
+		}
+	cxENDLOCK
 }
 
 void EditorCtrl::StylersDelete(unsigned int start, unsigned int end) {
 	m_lines.StylersDelete(start, end);
 	FoldingDelete(start, end);
 	bookmarks.DeleteChars(start, end);
+
+	cxLOCKDOC_READ(m_doc)
+		for (auto_vector<BracketIndex>::iterator p = m_bracketIndexes.begin(); p != m_bracketIndexes.end(); ++p) {
+			(*p)->Delete(start, end);
+			(*p)->Scan(doc, start, start);
+		}
+		if (m_wordIndex.get()) {
+			m_wordIndex->Delete(start, end);
+			m_wordIndex->Scan(doc, start, start);
+		}
+	cxENDLOCK
 }
 
 void EditorCtrl::StylersApplyDiff(vector<cxChange>& changes) {
 	m_lines.StylersApplyDiff(changes);
+	m_bracketIndexes.clear(); // rebuilt on next use
+
+	if (m_wordIndex.get()) {
+		// Move the words first, as the text is only valid in its final state
+		int offset = 0;
+		for (vector<cxChange>::const_iterator p = changes.begin(); p != changes.end(); ++p) {
+			const unsigned int len = p->end - p->start;
+			if (p->type == cxINSERTION) {
+				m_wordIndex->Insert(p->start, len);
+				offset += len;
+			}
+			else {
+				m_wordIndex->Delete(p->start + offset, p->end + offset);
+				offset -= len;
+			}
+		}
+
+		cxLOCKDOC_READ(m_doc)
+			offset = 0;
+			for (vector<cxChange>::const_iterator p = changes.begin(); p != changes.end(); ++p) {
+				const unsigned int len = p->end - p->start;
+				if (p->type == cxINSERTION) {
+					m_wordIndex->Scan(doc, p->start, p->end);
+					offset += len;
+				}
+				else {
+					m_wordIndex->Scan(doc, p->start + offset, p->start + offset);
+					offset -= len;
+				}
+			}
+		cxENDLOCK
+	}
 }
 
 unsigned int EditorCtrl::GetChangePos(const doc_id& old_version_id) const {
@@ -4653,9 +4943,10 @@ void EditorCtrl::SetSyntax(const wxString& syntaxName, bool isManual) {
 	m_syntaxstyler.SetSyntax(syntaxName, ext);
 	wxEndBusyCursor();
 
-	// We also have to reparse the foldings
+	// We also have to reparse the foldings (and the scopes of brackets)
 	SetTabWidthFromSyntax();
 	FoldingClear();
+	m_bracketIndexes.clear();
 
 	MarkAsModified(); // flush symbol cache
 
@@ -5186,77 +5477,52 @@ void EditorCtrl::SelectParentTag() {
 	m_html_hl_styler.SelectParentTag();
 }
 
-void EditorCtrl::GetCompletionMatches(interval wordIv, wxArrayString& result, bool precharbase) const {
+void EditorCtrl::GetCompletionMatches(interval wordIv, wxArrayString& result, bool precharbase) {
 	wxASSERT(wordIv.start <= wordIv.end && wordIv.end <= GetLength());
 	wxASSERT(!precharbase || wordIv.end - wordIv.start == 1);
 
-	map<wxString,unsigned int> completions;
-
-	// Get target word
-	cxLOCKDOC_READ(m_doc)
-		const unsigned int doclen = doc.GetLength();
-		const wxString target = doc.GetTextPart(wordIv.start, wordIv.end);
-
-		unsigned int pos = 0;
-		while (pos < doclen) {
-			const search_result sr = doc.Find(target, pos, true);
-			if (sr.error_code != 0) break;
-
-			// Ignore current word
-			if (sr.start == wordIv.start && sr.end == wordIv.end) {
-				pos = sr.end;
-				continue;
-			}
-
-			// Check if it is the start of a word
-			if (sr.start) {
-				const unsigned int prevpos = doc.GetPrevCharPos(sr.start);
-				const wxChar c = doc.GetChar(prevpos);
-				if (Isalnum(c) || c == '_') {
-					pos = doc.GetNextCharPos(sr.start);
-					continue;
-				}
-			}
-
-			// Get the rest of the word
-			unsigned int wordend = sr.end;
-			while (wordend < doclen) {
-				const unsigned int nextpos = doc.GetNextCharPos(wordend);
-				const wxChar c = doc.GetChar(wordend);
-				if (!Isalnum(c) && c != '_') break;
-				wordend = nextpos;
-			}
+	// Get target word (a single base char is left out of the matches)
+	const wxString target = GetText(wordIv.start, wordIv.end);
+	const wxCharBuffer buf = target.mb_str(wxConvUTF8);
+	const string prefix = buf.data();
 
-			if (wordend > sr.end) {
-				// Add to completion list
-				const unsigned int wordstart = precharbase ? sr.start+1 : sr.start; // remove base char
-				const wxString word = doc.GetTextPart(wordstart, wordend);
-				const unsigned int dist = sr.start < wordIv.start ? wordIv.start - sr.start : sr.start - wordIv.start;
+	// Words in the document, sorted by distance
+	vector<string> words;
+	GetWordIndex().GetCompletions(prefix, wordIv.start, words);
 
-				map<wxString,unsigned int>::const_iterator p = completions.find(word);
-				if (p == completions.end() || p->second < dist)
-					completions[word] = dist;
-			}
-
-			pos = wordend;
+	// Words in the other open documents
+	bool allTabs = false;
+	eGetSettings().GetSettingBool(wxT("completeFromAllTabs"), allTabs);
+	if (allTabs) {
+		vector<EditorCtrl*> editors;
+		m_parentFrame.GetEditorCtrls(editors);
+		for (vector<EditorCtrl*>::const_iterator p = editors.begin(); p != editors.end(); ++p) {
+			if (*p != this) (*p)->GetWordIndex().GetWords(prefix, words);
 		}
-	cxENDLOCK
+	}
 
 	// remove entries that already are in list
-	for (unsigned int i = 0; i < result.GetCount(); ++i) {
-		map<wxString,unsigned int>::iterator p = completions.find(result[i]);
-		if (p != completions.end()) completions.erase(p);
+	set<wxString> added;
+	for (unsigned int i = 0; i < result.GetCount(); ++i) added.insert(result[i]);
+
+	result.Alloc(result.GetCount() + words.size());
+	for (vector<string>::const_iterator p = words.begin(); p != words.end(); ++p) {
+		const wxString word(p->c_str(), wxConvUTF8);
+		if (added.insert(word).second) result.Add(word);
 	}
+}
 
-	// reverse map to be indexed by distance
-	map<unsigned int, wxString> sorted;
-	for (map<wxString,unsigned int>::const_iterator p = completions.begin(); p != completions.end(); ++p)
-		sorted[p->second] = p->first;
+WordIndex& EditorCtrl::GetWordIndex() {
+	if (!m_wordIndex.get()) m_wordIndex.reset(new WordIndex());
+
+	// New indexes (or ones out of step with the document) are built from the text
+	if (m_wordIndex->GetLength() != m_lines.GetLength()) {
+		cxLOCKDOC_READ(m_doc)
+			m_wordIndex->Build(doc);
+		cxENDLOCK
+	}
 
-	// return list of completions, sorted by distance
-	result.Alloc(result.GetCount() + sorted.size());
-	for (map<unsigned int,wxString>::const_iterator p2 = sorted.begin(); p2 != sorted.end(); ++p2)
-		result.Add(p2->second);
+	return *m_wordIndex;
 }
 
 wxArrayString EditorCtrl::GetCompletionList() {
@@ -5782,42 +6048,16 @@ search_result EditorCtrl::RegExFind(const wxString& searchtext, unsigned int sta
 	int options = PCRE_UTF8;
 	if (!matchcase) options |= PCRE_CASELESS;
 
-	// Check if we have the regex cached
-	if (m_re) {
-		// We might want to study the regex the first time we end here
-		if (searchtext == m_regex_cache && options == m_options_cache) {}
-		else {
-			free(m_re);
-			m_re = NULL;
-		}
-	}
-
-	// Compile the pattern
-	if (!m_re) {
-		const char *error;
-		int erroffset;
-
-		m_re = pcre_compile(
-			searchtext.mb_str(wxConvUTF8),   // the pattern
-			options,              // options
-			&error,               // for error message
-			&erroffset,           // for error offset
-			NULL);                // use default character tables
-		if (m_re == 0) {
-			search_result sr;
-			sr.error_code = -4; // invalid pattern
-			return sr;
-		}
-		else {
-			// The compiled regex (m_re) is cached for possible reuse in next search
-			// it is finally free'd in destructor
-			m_options_cache = options;
-			m_regex_cache = searchtext;
-		}
+	// Get the compiled pattern (cached for possible reuse in next search)
+	const RegexCache::Pattern re = RegexCache::Get().Lookup(searchtext, options);
+	if (!re.IsOk()) {
+		search_result sr;
+		sr.error_code = -4; // invalid pattern
+		return sr;
 	}
 
 	// Do the search
-	return RegExFind(m_re, NULL, start_pos, captures, end_pos);
+	return RegExFind(re.GetRegex(), re.GetStudy(), start_pos, captures, end_pos);
 }
 
 search_result EditorCtrl::RawRegexSearch(const char* regex, unsigned int subjectStart, unsigned int subjectEnd, unsigned int pos, map<unsigned int,interval> *captures) const {
@@ -5958,39 +6198,12 @@ search_result EditorCtrl::RegExFindBackwards(const wxString& searchtext, unsigne
 	int options = PCRE_UTF8;
 	if (!matchcase) options |= PCRE_CASELESS;
 
-	// Check if we have the regex cached
-	if (m_re) {
-		// We might want to study the regex the first time we end here
-		if (searchtext == m_regex_cache && options == m_options_cache) {}
-		else {
-			free(m_re);
-			m_re = NULL;
-		}
-	}
-
-	// Compile the pattern
-	if (!m_re) {
-		const char *error;
-		int erroffset;
-
-		m_re = pcre_compile(
-			searchtext.mb_str(wxConvUTF8),   // the pattern
-			options,              // options
-			&error,               // for error message
-			&erroffset,           // for error offset
-			NULL);                // use default character tables
-
-		if (m_re == 0) {
-			search_result sr;
-			sr.error_code = -4; // invalid pattern
-			return sr;
-		}
-		else {
-			// The compiled regex (m_re) is cached for possible reuse in next search
-			// it is finally free'd in destructor
-			m_options_cache = options;
-			m_regex_cache = searchtext;
-		}
+	// Get the compiled pattern (it is run once per line, so we want it studied)
+	const RegexCache::Pattern re = RegexCache::Get().Lookup(searchtext, options, true);
+	if (!re.IsOk()) {
+		search_result sr;
+		sr.error_code = -4; // invalid pattern
+		return sr;
 	}
 
 	// Do the search
@@ -6016,8 +6229,8 @@ search_result EditorCtrl::RegExFindBackwards(const wxString& searchtext, unsigne
 	// Do the search (one line at a time)
 	for (;;) {
 		rc = pcre_exec(
-			m_re,                   // the compiled pattern
-			NULL,                // extra data - if we study the pattern
+			re.GetRegex(),        // the compiled pattern
+			re.GetStudy(),        // extra data - if we study the pattern
 			&*line.begin(),         // the subject string
 			lineLen,              // the length of the subject
 			pos - lineStart,      // start at offset in the subject
@@ -6127,116 +6340,116 @@ int EditorCtrl::ReplaceAll(const wxString& searchtext, const wxString& replacete
 	if (m_lines.GetLength() == 0 || searchtext.empty()) return false;
 	const wxBusyCursor busy; // show busy cursor
 
-	// Prepare before searching
-	doc_id oldDoc;
-	cxLOCKDOC_WRITE(m_doc)
-		doc.Freeze();
-		oldDoc = doc.GetDocument();
-	cxENDLOCK
-	m_lines.RemoveAllSelections();
-
 	// Set if we should highlight afterwards
 	if (options & FIND_HIGHLIGHT) m_search_hl_styler.SetSearch(searchtext, options);
 	else m_search_hl_styler.Clear();
 
-	search_result lastresult = {-1, 0, 0};
-	search_result result = {-1, 0, 0};
+	// Plain replacement text only has to be converted once
+	const wxCharBuffer plainText = replacetext.mb_str(wxConvUTF8);
+	const size_t plainLen = strlen(plainText);
+
+	// Collect all matches and their replacements in a single scan
+	// (positions are in the original text, replacements as utf8)
+	vector<interval> matches;
+	vector<char> replacements;
+	vector<unsigned int> replacementEnds;
 	unsigned int start_pos = m_searchRanges.empty() ? 0 : m_searchRanges[0].start;
-	vector<interval>::iterator p = m_searchRanges.begin();
+	vector<interval>::const_iterator p = m_searchRanges.begin();
 	map<unsigned int,interval> captures;
-	unsigned int byte_len = 0;
+	unsigned int len;
 
-	unsigned int replacements = 0;
+	cxLOCKDOC_READ(m_doc)
+		len = doc.GetLength();
+		search_result result = {-1, 0, 0};
 
-	// Replace and continue search
-	cxLOCKDOC_WRITE(m_doc)
-		doc.StartChange();
-	cxENDLOCK
-	while(1) {
-		captures.clear();
+		while(1) {
+			captures.clear();
 
-		// Find match
-		if (m_searchRanges.empty()) {
-			cxLOCKDOC_READ(m_doc)
+			// Find match
+			if (m_searchRanges.empty()) {
 				if (options & FIND_USE_REGEX) result = doc.RegExFind(searchtext, start_pos, matchcase, &captures);
 				else result = doc.Find(searchtext, start_pos, matchcase);
-			cxENDLOCK
-		}
-		else {
-			for (; p != m_searchRanges.end(); ++p) {
-				if (start_pos < p->start) start_pos = p->start;
+			}
+			else {
+				for (; p != m_searchRanges.end(); ++p) {
+					if (start_pos < p->start) start_pos = p->start;
 
-				cxLOCKDOC_READ(m_doc)
 					if (options & FIND_USE_REGEX) result = doc.RegExFind(searchtext, start_pos, matchcase, &captures, p->end);
 					else result = doc.Find(searchtext, start_pos, matchcase, p->end);
-				cxENDLOCK
-				if (result.error_code >= 0) break; // match found or error
+					if (result.error_code >= 0) break; // match found or error
+				}
+				if (p == m_searchRanges.end()) break; // outside ranges
 			}
-			if (p == m_searchRanges.end()) break; // outside ranges
-		}
-
-		// Handle result
-		if (result.error_code < 0) break; // no match found
-		lastresult = result;
-
-		// Get the replacement string
-		wxString textNew;
-		if (!replacetext.empty()) {
-			textNew = (options & FIND_USE_REGEX) ? ParseReplaceString(replacetext, captures) : replacetext;
-		}
-
-		// Delete original
-		if (result.start != result.end) {
-			cxLOCKDOC_WRITE(m_doc)
-				doc.Delete(result.start, result.end);
-			cxENDLOCK
-		}
 
-		// Insert replacement
-		if (!textNew.empty()) {
-			cxLOCKDOC_WRITE(m_doc)
-				byte_len = doc.Insert(result.start, textNew);
-			cxENDLOCK
-		}
-		else byte_len = 0;
+			// Handle result
+			if (result.error_code < 0) break; // no match found
+			matches.push_back(interval(result.start, result.end));
 
-		// Adjust searchranges
-		if (!m_searchRanges.empty()) {
-			const int diff = byte_len - (result.end - result.start);
-			for (vector<interval>::iterator p2 = p; p2 != m_searchRanges.end(); ++p2) {
-				if (p2->start > result.start) p2->start += diff;
-				if (p2->end > result.start) p2->end += diff;
+			// Get the replacement string
+			if (options & FIND_USE_REGEX) {
+				if (!replacetext.empty()) {
+					const wxCharBuffer textNew = ParseReplaceString(replacetext, captures).mb_str(wxConvUTF8);
+					replacements.insert(replacements.end(), textNew.data(), textNew.data() + strlen(textNew));
+				}
 			}
-		}
-
-		replacements++;
+			else replacements.insert(replacements.end(), plainText.data(), plainText.data() + plainLen);
+			replacementEnds.push_back(replacements.size());
 
-		// If we have replaced upto end-of-line, move to next
-		// line to avoid infinite replace of ($).
-		start_pos = result.start+byte_len;
-		cxLOCKDOC_READ(m_doc)
-			if (start_pos == doc.GetLength()) break;
+			// If we have replaced upto end-of-line, move to next
+			// line to avoid infinite replace of ($).
+			start_pos = result.end;
+			if (start_pos == len) break;
 			if (doc.GetChar(start_pos) == wxT('\n')) {
 				++start_pos;
-				if (start_pos == doc.GetLength()) break;
+				if (start_pos == len) break;
 			}
-		cxENDLOCK
 
-		// We also want to avoid infinite loop when replacing a possible
-		// zero-len match with nothing
-		if (result.start == result.end && byte_len == 0) ++start_pos;
+			// We also want to avoid infinite loop on zero-len matches
+			else if (result.start == result.end) start_pos = doc.GetNextCharPos(start_pos);
+		}
+	cxENDLOCK
 
+	if (matches.empty()) {
+		DrawLayout();
+		return 0;
 	}
+
+	m_lines.RemoveAllSelections();
+
+	// Replace all matches as a single change
+	vector<cxChange> changes;
 	cxLOCKDOC_WRITE(m_doc)
+		doc.Freeze();
+		doc.StartChange();
+		doc.ReplaceAll(matches, replacements, replacementEnds, changes);
 		doc.EndChange();
 	cxENDLOCK
 
+	// Adjust searchranges
+	if (!m_searchRanges.empty()) {
+		int diff = 0;
+		unsigned int m = 0;
+		unsigned int text_start = 0;
+		for (vector<interval>::iterator r = m_searchRanges.begin(); r != m_searchRanges.end(); ++r) {
+			const unsigned int start = r->start;
+			for (; m < matches.size() && matches[m].start < start; ++m) {
+				diff += (int)(replacementEnds[m] - text_start) - (int)(matches[m].end - matches[m].start);
+				text_start = replacementEnds[m];
+			}
+			r->start += diff;
+			for (; m < matches.size() && matches[m].start < r->end; ++m) {
+				diff += (int)(replacementEnds[m] - text_start) - (int)(matches[m].end - matches[m].start);
+				text_start = replacementEnds[m];
+			}
+			r->end += diff;
+		}
+	}
+
 	// Update lines and stylers
-	ApplyDiff(oldDoc);
+	ApplyChanges(changes);
 
-	// Update the caret position
-	if (lastresult.error_code >= 0) m_lines.SetPos(lastresult.start + byte_len);
-	// else no change
+	// Update the caret position (end of last replacement)
+	m_lines.SetPos(m_lines.GetLength() - (len - matches.back().end));
 
 	MarkAsModified();
 
@@ -6244,7 +6457,7 @@ int EditorCtrl::ReplaceAll(const wxString& searchtext, const wxString& replacete
 	MakeCaretVisible();
 	DrawLayout();
 
-	return replacements;
+	return matches.size();
 }
 /*
 bool EditorCtrl::ReplaceAllRegex(const wxString& regex, const wxString& replacetext, int options) {
@@ -6368,7 +6581,10 @@ void EditorCtrl::OnChar(wxKeyEvent& event) {
 	const wxChar c = event.GetUnicodeKey();
 // FIXME - is this needed (or it's just for speed?)
 #ifdef __WXMSW__
-	if ((unsigned int)c > 127) InsertChar(c);
+	if ((unsigned int)c > 127) {
+		InsertChar(c);
+		m_drawDamagedOnly = true;
+	}
 	else 
 #endif
 	{
@@ -6573,21 +6789,25 @@ void EditorCtrl::OnChar(wxKeyEvent& event) {
 			case WXK_LEFT:
 			case WXK_NUMPAD_LEFT:
 				CursorLeft(doSelect);
+				m_drawDamagedOnly = true;
 				break;
 
 			case WXK_RIGHT:
 			case WXK_NUMPAD_RIGHT:
 				CursorRight(doSelect);
+				m_drawDamagedOnly = true;
 				break;
 
 			case WXK_UP:
 			case WXK_NUMPAD_UP:
 				CursorUp(doSelect);
+				m_drawDamagedOnly = true;
 				break;
 
 			case WXK_DOWN:
 			case WXK_NUMPAD_DOWN:
 				CursorDown(doSelect);
+				m_drawDamagedOnly = true;
 				break;
 
 			case WXK_HOME:
@@ -6595,12 +6815,14 @@ void EditorCtrl::OnChar(wxKeyEvent& event) {
 			case WXK_NUMPAD_BEGIN:
 				CursorToSoftLineStart(event.ShiftDown() ? SEL_SELECT : SEL_REMOVE);
 				lastaction = ACTION_NONE;
+				m_drawDamagedOnly = true;
 				break;
 
 			case WXK_END:
 			case WXK_NUMPAD_END:
 				CursorToLineEnd(event.ShiftDown() ? SEL_SELECT : SEL_REMOVE);
 				lastaction = ACTION_NONE;
+				m_drawDamagedOnly = true;
 				break;
 
 			case WXK_PAGEUP:
@@ -6626,6 +6848,7 @@ void EditorCtrl::OnChar(wxKeyEvent& event) {
 				else {
 					const bool delWord = event.ControlDown();
 					Delete(delWord);
+					m_drawDamagedOnly = true;
 				}
 				break;
 
@@ -6633,6 +6856,7 @@ void EditorCtrl::OnChar(wxKeyEvent& event) {
 				{
 					const bool delWord = event.ControlDown();
 					Backspace(delWord);
+					m_drawDamagedOnly = true;
 				}
 				break;
 
@@ -6648,6 +6872,7 @@ void EditorCtrl::OnChar(wxKeyEvent& event) {
 				}
 
 				InsertChar(wxChar('\n'));
+				m_drawDamagedOnly = true;
 				break;
 
 			case WXK_TAB:
@@ -6673,8 +6898,10 @@ void EditorCtrl::OnChar(wxKeyEvent& event) {
 				//if (key >= WXK_SPECIAL1 && key <= WXK_SPECIAL20) break;
 
 				//if (wxIsprint(c)) { // Normal chars (does not work with 'ae', 'oslash', 'a-circle', etc.??)
-				if ((unsigned int)c > 31) // Normal chars
+				if ((unsigned int)c > 31) { // Normal chars
 					InsertChar(c);
+					m_drawDamagedOnly = true;
+				}
 				else {
 					event.Skip();
 					return; // do nothing if we don't know the char
@@ -8955,6 +9182,9 @@ void EditorCtrl::OnIdle(wxIdleEvent& event) {
 	// Update syntax and variable stylers
 	bool syntaxNeedIdle = m_lines.StylersOnIdle();
 
+	// Redraw if the background parser has reached text shown unstyled
+	if (m_syntaxstyler.NeedRedraw()) DrawLayout();
+
 	// Update foldings
 	ParseFoldMarkers();
 
@@ -9067,6 +9297,7 @@ void EditorCtrl::OnBundlesReloaded(EditorCtrl* self, void* WXUNUSED(data), int W
 	// (we have to do this before updating in lines to avoid refs to invalid styles)
 	const wxString syntaxName = self->m_syntaxstyler.GetName();
 	self->m_syntaxstyler.SetSyntax(syntaxName);
+	self->m_bracketIndexes.clear(); // scopes may have changed
 
 	// Update theme settings
 	if (self->mdc.GetFont() != self->m_theme.font) {
@@ -9539,6 +9770,16 @@ void EditorCtrl::FoldingClear() {
 	m_foldLineCount = 0;
 }
 
+// Fold marker of a line (starter and ender on same line cancels out)
+static bool GetLineFold(const TmSyntaxHandler::cxFoldRule& rule, const char* line, unsigned int len, bool& isStart) {
+	const bool matchStartMarker = rule.IsStart(line, len);
+	const bool matchEndMarker = rule.IsEnd(line, len);
+	if (matchStartMarker == matchEndMarker) return false;
+
+	isStart = matchStartMarker;
+	return true;
+}
+
 void EditorCtrl::ParseFoldMarkers() {
 	if (!m_syntaxstyler.IsOk()) return; // no syntax
 
@@ -9550,33 +9791,60 @@ void EditorCtrl::ParseFoldMarkers() {
 	if (m_foldedLines == lineCount) return;
 
 	unsigned int i = m_foldedLines;
-	unsigned int lineStart = m_lines.GetLineStartpos(i);
 	const unsigned int lastSyntaxedLine = m_lines.GetLineFromCharPos(m_syntaxstyler.GetLastParsedPos());
+	const unsigned int lastLine = wxMin(lineCount, lastSyntaxedLine);
+
+	// The text is read in blocks of whole lines, and the
+	// fold rule is only looked up again when the scope changes
+	const unsigned int BLOCKSIZE = 64 * 1024;
+	vector<char> text;
+	vector<unsigned int> lineStarts;
+	vector<unsigned int> stackIds;
+	unsigned int ruleStackId = 0;
+	const TmSyntaxHandler::cxFoldRule* rule = NULL;
+	bool hasRule = false;
+
+	while (i < lastLine) {
+		const unsigned int blockStart = m_lines.GetLineStartpos(i);
+		unsigned int blockLast = i;
+		unsigned int blockEnd = m_lines.GetLineEndpos(i, false);
+		while (blockLast+1 < lastLine && blockEnd - blockStart < BLOCKSIZE) {
+			++blockLast;
+			blockEnd = m_lines.GetLineEndpos(blockLast, false);
+		}
+
+		text.resize(blockEnd - blockStart);
+		if (!text.empty()) {
+			cxLOCKDOC_READ(m_doc)
+				doc.GetTextPart(blockStart, blockEnd, (unsigned char*)&*text.begin());
+			cxENDLOCK
+		}
+		const char* const block = text.empty() ? "" : &*text.begin();
 
-	while (i < lineCount && i < lastSyntaxedLine) {
-		const unsigned int lineEnd = m_lines.GetLineEndpos(i, false);
-
-		// Check if we have a fold rule
-		const deque<const wxString*> scope = m_syntaxstyler.GetScope(lineStart);
-		if (const TmSyntaxHandler::cxFoldRule* rule = m_syntaxHandler.GetFoldRule(scope)) {
-			// Do we match fold starter
-			const search_result sr = RawRegexSearch(&*rule->foldingStartMarker.begin(), lineStart, lineEnd, lineStart);
-			const bool matchStartMarker = (sr.error_code > 0);
+		// Get the scopes of all the lines in the block in one go
+		lineStarts.clear();
+		for (unsigned int n = i; n <= blockLast; ++n) lineStarts.push_back(m_lines.GetLineStartpos(n));
+		m_syntaxstyler.GetScopeStackIds(lineStarts, stackIds);
 
-			// Do we match fold ender
-			const search_result sr2 = RawRegexSearch(&*rule->foldingEndMarker.begin(), lineStart, lineEnd, lineStart);
-			const bool matchEndMarker = (sr2.error_code > 0);
+		unsigned int lineStart = blockStart;
+		for (unsigned int n = 0; i <= blockLast; ++i, ++n) {
+			const unsigned int lineEnd = m_lines.GetLineEndpos(i, false);
 
-			if (matchStartMarker) {
-				if (!matchEndMarker) // starter and ender on same line cancels out
-					m_folds.push_back(cxFold(i, cxFOLD_START, m_lines.GetLineIndentLevel(i)));
+			// Check if we have a fold rule
+			if (!hasRule || stackIds[n] != ruleStackId) {
+				deque<const wxString*> scope;
+				ScopeAtoms::Get().GetStackNames(stackIds[n], scope);
+				rule = m_syntaxHandler.GetFoldRule(scope);
+				ruleStackId = stackIds[n];
+				hasRule = true;
 			}
-			else if (matchEndMarker)
-				m_folds.push_back(cxFold(i, cxFOLD_END, m_lines.GetLineIndentLevel(i)));
-		}
 
-		lineStart = lineEnd;
-		++i;
+			bool isStart;
+			if (rule && GetLineFold(*rule, block + (lineStart - blockStart), lineEnd - lineStart, isStart))
+				m_folds.push_back(cxFold(i, (isStart ? cxFOLD_START : cxFOLD_END), m_lines.GetLineIndentLevel(i)));
+
+			lineStart = lineEnd;
+		}
 	}
 
 	m_foldedLines = i;
@@ -9592,29 +9860,17 @@ vector<cxFold>::iterator EditorCtrl::ParseFoldLine(unsigned int line_id, vector<
 	if (const TmSyntaxHandler::cxFoldRule* rule = m_syntaxHandler.GetFoldRule(scope)) {
 		const unsigned int lineEnd = m_lines.GetLineEndpos(line_id, false);
 
-		// Do we match fold starter
-		const char* const startMarker = &*rule->foldingStartMarker.begin();
-		const search_result sr = RawRegexSearch(startMarker, lineStart, lineEnd, lineStart);
-		const bool matchStartMarker = (sr.error_code > 0);
-
-		// Do we match fold ender
-		const char* const endMarker = &*rule->foldingEndMarker.begin();
-		const search_result sr2 = RawRegexSearch(endMarker, lineStart, lineEnd, lineStart);
-		const bool matchEndMarker = (sr2.error_code > 0);
-
-		if (matchStartMarker) {
-			if (!matchEndMarker) { // starter and ender on same line cancels out
-				return m_folds.insert(
-						insertPos, 
-						cxFold(line_id, (doFold ? cxFOLD_START_FOLDED : cxFOLD_START), m_lines.GetLineIndentLevel(line_id))
-					) + 1;
-			}
-		}
-		else if (matchEndMarker) {
-			return m_folds.insert(
-					insertPos, 
-					cxFold(line_id, cxFOLD_END, m_lines.GetLineIndentLevel(line_id))
-				) + 1;
+		vector<char> line(lineEnd - lineStart);
+		if (!line.empty()) {
+			cxLOCKDOC_READ(m_doc)
+				doc.GetTextPart(lineStart, lineEnd, (unsigned char*)&*line.begin());
+			cxENDLOCK
+		}
+
+		bool isStart;
+		if (GetLineFold(*rule, (line.empty() ? "" : &*line.begin()), line.size(), isStart)) {
+			const cxFoldType type = isStart ? (doFold ? cxFOLD_START_FOLDED : cxFOLD_START) : cxFOLD_END;
+			return m_folds.insert(insertPos, cxFold(line_id, type, m_lines.GetLineIndentLevel(line_id))) + 1;
 		}
 	}
 
@@ -32,6 +32,8 @@
 #include "FindFlags.h"
 #include "BundleItemType.h"
 #include "BracketHighlight.h"
+#include "BracketIndex.h"
+#include "WordIndex.h"
 #include "DetectTripleClicks.h"
 #include "AutoPairs.h"
 #include "Bookmarks.h"
@@ -191,7 +193,7 @@ public:
 	doc_id GetDocID() const;
 	doc_id GetLastStableDocID() const;
 	virtual wxString GetName() const;
-	virtual const vector<unsigned int>& GetOffsets() const {return m_lines.GetOffsets();};
+	virtual void GetOffsets(vector<unsigned int>& offsets) const {m_lines.GetOffsets(offsets);};
 
 	// TabPage interface
 	virtual EditorCtrl* GetActiveEditor();
@@ -307,6 +309,7 @@ public:
 	virtual int ReplaceAll(const wxString& searchtext, const wxString& replacetext, int options=0);
 	virtual void SetSearchHighlight(const wxString& pattern, int options=0);
 	virtual void ClearSearchHighlight();
+	virtual bool GetMatchCount(unsigned int& index, unsigned int& count);
 
 	// SnippetHandler and EditorFrame use 3 of the following methods; may need some more refactoring here to capture that
 	search_result SearchDirect(const wxString& pattern, int options, size_t startpos, size_t endpos=0) const;
@@ -408,6 +411,7 @@ public:
 	// Completion
 	void DoCompletion();
 	wxArrayString GetCompletionList();
+	WordIndex& GetWordIndex();
 	void ShowCompletionPopup(const wxArrayString& completions);
 
 	// Symbols
@@ -529,6 +533,9 @@ private:
 	static void OnBundlesReloaded(EditorCtrl* self, void* data, int filter);
 	static void OnSettingsChanged(EditorCtrl* self, void* data, int filter);
 
+	// Save progress callback
+	static void OnSaveProgress(unsigned int done, unsigned int total, void* data);
+
 	void SetMate(const wxString& mate) {m_mate = mate;}
 	void NotifyParentMate();
 	void ClearRemoteInfo();
@@ -536,12 +543,21 @@ private:
 	bool ProcessCommandModeKey(wxKeyEvent& event);
 
 public:
+	// Drawing statistics (times in ms)
+	unsigned int GetFrameCount() const {return m_frameCount;};
+	unsigned int GetPartialFrameCount() const {return m_partialFrameCount;};
+	long GetLastFrameTime() const {return m_lastFrameTime;};
+	long GetTotalFrameTime() const {return m_totalFrameTime;};
+
 	// Used by GutterControl
 	void DrawLayout(bool isScrolling=false);
 
 protected:
 	// Drawing
 	void DrawLayout(wxDC& dc, bool isScrolling=false);
+	bool ReuseLastFrame(unsigned int width, unsigned int height, bool isScrolling, vector<wxRect>& rects);
+	void AddDamagedLines(unsigned int start, unsigned int end, vector<interval>& lines) const;
+	void SaveFrame(unsigned int width, unsigned int height);
 	bool UpdateScrollbars(unsigned int x, unsigned int y);
 	void HandleScroll(int orientation, int position, wxEventType eventType);
 
@@ -587,7 +603,7 @@ protected:
 
 	bool DoFind(const wxString& text, unsigned int start_pos, int options=0, bool dir_forward = true);
 
-	void GetCompletionMatches(interval wordIv, wxArrayString& result, bool precharbase) const;
+	void GetCompletionMatches(interval wordIv, wxArrayString& result, bool precharbase);
 
 	void DoCommand(int c);
 	void EndCommand();
@@ -600,6 +616,7 @@ protected:
 	wxString AutoPair(unsigned int pos, const wxString& text, bool addToStack=true);
 	void MatchBrackets();
 	bool FindMatchingBracket(unsigned int pos, unsigned int& pos2);
+	BracketIndex& GetBracketIndex(char open, char close);
 
 	// Indentation
 	wxString GetRealIndent(unsigned int lineid, bool newline=false, bool skipWhitespaceOnlyLines=false);
@@ -609,6 +626,7 @@ protected:
 	unsigned int CountMatchingChars(wxChar match, unsigned int start, unsigned int end) const;
 
 	void ApplyDiff(const doc_id& oldDoc, bool moveToFirstChange=false);
+	void ApplyChanges(vector<cxChange>& changes, bool moveToFirstChange=false);
 
 	// Styler Managment
 	void StylersClear();
@@ -673,8 +691,6 @@ protected:
 	unsigned int lastpos;
 	int m_currentSel;
 	bool do_freeze;
-	mutable int m_options_cache; // for compiled regex
-	mutable pcre *m_re; // for last compiled regex
 	mutable unsigned int m_symbolCacheToken;
 	int m_markCopyStart;
 
@@ -767,6 +783,37 @@ protected:
 
 	BracketHighlight m_bracketHighlight;
 
+	// Indexes of the bracket pairs that have been matched (built on first
+	// use and kept updated by the Stylers* functions)
+	auto_vector<BracketIndex> m_bracketIndexes;
+
+	// Words for completion (built on first use, like the bracket indexes)
+	auto_ptr<WordIndex> m_wordIndex;
+
+	// The last frame drawn to the (shared) bitmap, so that redraws
+	// can be limited to what has changed since
+	struct FrameState {
+		wxSize size;
+		int scrollPos;
+		int scrollPosX;
+		int height;
+		unsigned int length;
+		unsigned int changeToken;
+		unsigned int pos;
+		interval brackets;
+		vector<interval> selections;
+		bool isSelShadow;
+	};
+	FrameState m_frame;
+	bool m_drawDamagedOnly; // set by simple keys for next redraw
+	static const EditorCtrl* s_frameOwner;
+
+	// Drawing statistics
+	unsigned int m_frameCount;
+	unsigned int m_partialFrameCount;
+	long m_lastFrameTime;
+	long m_totalFrameTime;
+
 	int m_lastScopePos;
 
 	// Cached env variables
@@ -776,9 +823,6 @@ protected:
 	// Symbol cache
 	mutable vector<SymbolRef> m_symbolCache;
 
-	// Cache of last compiled regex
-	mutable wxString m_regex_cache;
-
 	// Key state
 	static unsigned long s_ctrlDownTime;
 	static bool s_altGrDown;
@@ -1516,6 +1516,13 @@ EditorCtrl* EditorFrame::GetEditorCtrl(int winId) const {
 	return (EditorCtrl*)editor;
 }
 
+void EditorFrame::GetEditorCtrls(vector<EditorCtrl*>& editors) {
+	for (unsigned int i = 0; i < m_tabBar->GetPageCount(); ++i) {
+		EditorCtrl* page = GetEditorCtrlFromPage(i);
+		if (page) editors.push_back(page);
+	}
+}
+
 // May be NULL, always check in reciever. Downcast.
 IEditorSearch* EditorFrame::GetSearch() { return editorCtrl; }
 
@@ -2882,7 +2889,7 @@ void EditorFrame::OnMenuFind(wxCommandEvent& WXUNUSED(event)) {
 }
 
 void EditorFrame::OnMenuFindInProject(wxCommandEvent& WXUNUSED(event)) {
-	if (!m_findInProjectDlg) m_findInProjectDlg = new FindInProjectDlg(*this, m_projectPane->GetInfoHandler());
+	if (!m_findInProjectDlg) m_findInProjectDlg = new FindInProjectDlg(*this, m_projectPane->GetInfoHandler(), m_projectPane->GetSearchIndex());
 	m_findInProjectDlg->Show();
 	m_findInProjectDlg->SetFocus();
 
@@ -3247,7 +3254,7 @@ void EditorFrame::OnMenuGotoLine(wxCommandEvent& WXUNUSED(event)) {
 void EditorFrame::OnMenuGotoFile(wxCommandEvent& WXUNUSED(event)) {
 	if (!m_projectPane->HasProject()) return;
 
-	GotoFileDlg dlg(this, m_projectPane->GetInfoHandler());
+	GotoFileDlg dlg(this, m_projectPane->GetInfoHandler(), m_projectPane->GetPathIndex());
 	if (dlg.ShowModal() == wxID_OK) OpenFile(dlg.GetSelection());
 }
 
@@ -217,6 +217,7 @@ public:
 	bool CloseTab(unsigned int tab_id, bool removetab=true);
 	EditorCtrl* GetEditorCtrl() const; // Gets currently active
 	EditorCtrl* GetEditorCtrl(int winId) const;
+	void GetEditorCtrls(vector<EditorCtrl*>& editors); // active editor in each tab
 	virtual IEditorSearch* GetSearch();
 
 	// Editor Service methods.
@@ -58,7 +58,9 @@ void EditorPrintout::OnPreparePrinting() {
 	m_line->Init();
 	m_line->SetWordWrap(cxWRAP_SMART);
 	m_lineList = new LineListWrap(*m_line, m_printDoc.GetDocument());
-	m_lineList->SetOffsets(m_printDoc.GetOffsets());
+	vector<unsigned int> offsets;
+	m_printDoc.GetOffsets(offsets);
+	m_lineList->SetOffsets(offsets);
 
 	// Calc gutter width
 	const wxSize digit_ext = dc.GetTextExtent(wxT("0"));
@@ -0,0 +1,148 @@
+/*******************************************************************************
+ *
+ * Copyright (C) 2009, Alexander Stigsen, e-texteditor.com
+ *
+ * This software is licensed under the Open Company License as described
+ * in the file license.txt, which you should have received as part of this
+ * distribution. The terms are also available at http://opencompany.org/license.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ******************************************************************************/
+
+#include "ExtentCache.h"
+#include <cstring>
+
+ExtentCache& ExtentCache::Get() {
+	static ExtentCache cache;
+	return cache;
+}
+
+ExtentCache::ExtentCache(size_t maxBytes) : m_maxBytes(maxBytes), m_bytes(0), m_hits(0), m_misses(0) {
+}
+
+unsigned int ExtentCache::GetFontId(const wxFont& font, const wxSize& ppi) {
+	const wxString key = wxString::Format(wxT("%s %d %d"), font.GetNativeFontInfoDesc().c_str(), ppi.x, ppi.y);
+
+	std::map<wxString, unsigned int>::const_iterator p = m_fontIds.find(key);
+	if (p != m_fontIds.end()) return p->second;
+
+	const unsigned int fontId = (unsigned int)m_fontIds.size() + 1;
+	m_fontIds[key] = fontId;
+	return fontId;
+}
+
+unsigned int ExtentCache::Hash(unsigned int fontId, unsigned int tabWidth, const char* text, unsigned int len, const std::vector<unsigned int>& runs) {
+	// FNV-1a
+	unsigned int hash = 2166136261u;
+	for (unsigned int i = 0; i < len; ++i) {
+		hash = (hash ^ (unsigned char)text[i]) * 16777619u;
+	}
+	for (std::vector<unsigned int>::const_iterator r = runs.begin(); r != runs.end(); ++r) {
+		hash = (hash ^ *r) * 16777619u;
+	}
+	hash = (hash ^ tabWidth) * 16777619u;
+	return (hash ^ fontId) * 16777619u;
+}
+
+bool ExtentCache::IsMatch(const Entry& entry, unsigned int fontId, unsigned int tabWidth, const char* text, unsigned int len, const std::vector<unsigned int>& runs) {
+	return entry.fontId == fontId && entry.tabWidth == tabWidth && entry.text.size() == len && entry.runs == runs
+		&& (len == 0 || memcmp(&*entry.text.begin(), text, len) == 0);
+}
+
+const std::vector<unsigned int>* ExtentCache::Find(unsigned int fontId, unsigned int tabWidth, const char* text, unsigned int len, const std::vector<unsigned int>& runs) {
+	const unsigned int hash = Hash(fontId, tabWidth, text, len, runs);
+
+	std::pair<EntryMap::iterator, EntryMap::iterator> range = m_index.equal_range(hash);
+	for (EntryMap::iterator p = range.first; p != range.second; ++p) {
+		EntryList::iterator entry = p->second;
+		if (!IsMatch(*entry, fontId, tabWidth, text, len, runs)) continue;
+
+		// Move to front (list iterators stay valid)
+		m_entries.splice(m_entries.begin(), m_entries, entry);
+		++m_hits;
+		return &entry->extents;
+	}
+
+	++m_misses;
+	return NULL;
+}
+
+void ExtentCache::Add(unsigned int fontId, unsigned int tabWidth, const char* text, unsigned int len, const std::vector<unsigned int>& runs, const std::vector<unsigned int>& extents) {
+	wxASSERT(extents.size() == len);
+	if (len == 0) return;
+
+	m_entries.push_front(Entry());
+	Entry& entry = m_entries.front();
+	entry.hash = Hash(fontId, tabWidth, text, len, runs);
+	entry.fontId = fontId;
+	entry.tabWidth = tabWidth;
+	entry.text.assign(text, text + len);
+	entry.runs = runs;
+	entry.extents = extents;
+
+	m_index.insert(EntryMap::value_type(entry.hash, m_entries.begin()));
+	m_bytes += len * (1 + sizeof(unsigned int)) + runs.size() * sizeof(unsigned int);
+
+	while (m_bytes > m_maxBytes && m_entries.size() > 1) Evict();
+}
+
+void ExtentCache::Evict() {
+	EntryList::iterator entry = m_entries.end();
+	--entry;
+
+	std::pair<EntryMap::iterator, EntryMap::iterator> range = m_index.equal_range(entry->hash);
+	for (EntryMap::iterator p = range.first; p != range.second; ++p) {
+		if (p->second == entry) {
+			m_index.erase(p);
+			break;
+		}
+	}
+
+	m_bytes -= entry->text.size() * (1 + sizeof(unsigned int)) + entry->runs.size() * sizeof(unsigned int);
+	m_entries.erase(entry);
+}
+
+void ExtentCache::Clear() {
+	m_entries.clear();
+	m_index.clear();
+	m_bytes = 0;
+}
+
+bool ExtentCache::GetFixedExtents(const char* text, unsigned int len, const std::vector<unsigned int>& runs, unsigned int tabWidth,
+                                  unsigned int charWidth, unsigned int nlWidth, const bool fixedStyles[4], std::vector<unsigned int>& extents) { // static
+	for (size_t r = 1; r < runs.size(); r += 2) {
+		const int fontStyle = runs[r];
+		if (!fixedStyles[((fontStyle & wxFONTFLAG_BOLD) ? 1 : 0) | ((fontStyle & wxFONTFLAG_ITALIC) ? 2 : 0)]) return false;
+	}
+
+	extents.clear();
+	extents.reserve(len);
+	unsigned int xpos = 0;
+	unsigned int runStart = 0;
+
+	for (size_t r = 0; r < runs.size(); r += 2) {
+		const unsigned int runEnd = runs[r];
+
+		for (unsigned int i = runStart; i < runEnd; ++i) {
+			const unsigned char c = text[i];
+			if (c == '\t') xpos = ((xpos / tabWidth)+1) * tabWidth;
+			else if (c == '\n') xpos += nlWidth;
+			else if (c >= 0x20 && c < 0x80) xpos += charWidth;
+			else return false; // control or multibyte chars have to be measured
+
+			extents.push_back(xpos);
+		}
+
+		// Same italics hack as for measured text
+		if (runEnd < len && (runs[r+1] & wxFONTFLAG_ITALIC)) {
+			extents.back() += 2;
+			xpos = extents.back();
+		}
+
+		runStart = runEnd;
+	}
+
+	return true;
+}
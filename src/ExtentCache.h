@@ -0,0 +1,86 @@
+/*******************************************************************************
+ *
+ * Copyright (C) 2009, Alexander Stigsen, e-texteditor.com
+ *
+ * This software is licensed under the Open Company License as described
+ * in the file license.txt, which you should have received as part of this
+ * distribution. The terms are also available at http://opencompany.org/license.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ******************************************************************************/
+
+#ifndef __EXTENTCACHE_H__
+#define __EXTENTCACHE_H__
+
+#include "wx/wxprec.h"
+#ifndef WX_PRECOMP
+   #include <wx/wx.h>
+#endif
+
+#include <vector>
+#include <list>
+#include <map>
+
+// Bounded LRU cache of measured text extents for lines, shared by all
+// FixedLines (editors, gutters and printouts). Lines are keyed by their
+// (UTF-8) text, the font style runs, the tab width and the font, so a line
+// that is scrolled back into view does not have to be measured again.
+//
+// It should only be used from the main thread.
+class ExtentCache {
+public:
+	explicit ExtentCache(size_t maxBytes=s_maxBytes);
+	static ExtentCache& Get();
+
+	// Fonts (including dc resolution) are identified by small ids
+	unsigned int GetFontId(const wxFont& font, const wxSize& ppi);
+
+	// Runs are pairs of run end and font style.
+	// Returns NULL if the line has not been measured.
+	const std::vector<unsigned int>* Find(unsigned int fontId, unsigned int tabWidth, const char* text, unsigned int len, const std::vector<unsigned int>& runs);
+	void Add(unsigned int fontId, unsigned int tabWidth, const char* text, unsigned int len, const std::vector<unsigned int>& runs, const std::vector<unsigned int>& extents);
+	void Clear();
+
+	// With monospace fonts, lines of printable ascii (and tabs) are laid
+	// out without measuring. fixedStyles tells which font styles (indexed
+	// by bold|italic<<1) keep the fixed width. Returns false if the line
+	// has to be measured.
+	static bool GetFixedExtents(const char* text, unsigned int len, const std::vector<unsigned int>& runs, unsigned int tabWidth,
+	                            unsigned int charWidth, unsigned int nlWidth, const bool fixedStyles[4], std::vector<unsigned int>& extents);
+
+	// Statistics
+	unsigned int GetHits() const {return m_hits;};
+	unsigned int GetMisses() const {return m_misses;};
+	unsigned int GetSize() const {return (unsigned int)m_entries.size();};
+
+private:
+	class Entry {
+	public:
+		unsigned int hash;
+		unsigned int fontId;
+		unsigned int tabWidth;
+		std::vector<char> text;
+		std::vector<unsigned int> runs;
+		std::vector<unsigned int> extents;
+	};
+	typedef std::list<Entry> EntryList;
+	typedef std::multimap<unsigned int, EntryList::iterator> EntryMap;
+
+	static unsigned int Hash(unsigned int fontId, unsigned int tabWidth, const char* text, unsigned int len, const std::vector<unsigned int>& runs);
+	static bool IsMatch(const Entry& entry, unsigned int fontId, unsigned int tabWidth, const char* text, unsigned int len, const std::vector<unsigned int>& runs);
+	void Evict();
+
+	static const size_t s_maxBytes = 8 * 1024 * 1024;
+
+	EntryList m_entries; // most recently used first
+	EntryMap m_index;    // by hash
+	const size_t m_maxBytes;
+	size_t m_bytes;
+	std::map<wxString, unsigned int> m_fontIds;
+	unsigned int m_hits;
+	unsigned int m_misses;
+};
+
+#endif // __EXTENTCACHE_H__
@@ -15,14 +15,24 @@
 #include "MMapBuffer.h"
 #include "EditorFrame.h"
 #include "ProjectInfoHandler.h"
+#include "TrigramIndex.h"
+#include "Trigrams.h"
 #include "Strings.h"
+#include "LiteralMatcher.h"
+#include "SimdScan.h"
+#include "LockFreeQueue.h"
+#include "eSettings.h"
 #include "pcre.h"
+#include <deque>
+#include <map>
 
 #include "eBrowser.h"
 
+class SearchWorker;
+
 class SearchThread : public wxThread {
 public:
-	SearchThread();
+	SearchThread(TrigramIndex& searchIndex);
 	virtual void* Entry();
 	void DeleteThread();
 
@@ -32,9 +42,30 @@ public:
 	bool LastError() const {return m_lastError;};
 
 	bool GetCurrentPath(wxString& currentPath);
-	bool UpdateOutput(wxString& output);
+
+	// A match with the text of its line split around it
+	struct MatchRecord {
+		unsigned int line;
+		unsigned int column;
+		unsigned int selLen;
+		wxString lineStart;
+		wxString match;
+		wxString lineEnd;
+	};
+
+	// All matches in a file
+	struct FileResult {
+		wxString path;
+		vector<MatchRecord> matches;
+	};
+
+	// Results are handed to the ui as they come in (caller takes ownership)
+	FileResult* PopResult();
+	void ClearResults();
 
 private:
+	friend class SearchWorker;
+
 	struct FileMatch {
 		unsigned int line;
 		unsigned int column;
@@ -46,20 +77,41 @@ private:
 		wxString pattern;
 		wxString patternUpper;
 		wxCharBuffer UTF8buffer;
-		wxCharBuffer UTF8bufferUpper;
-		size_t byte_len;
-		char charmap[256];
-		char lastChar;
+		LiteralMatcher matcher;
+		CharFoldMatcher foldMatcher; // caseless search with chars of differing width
+		LiteralMatcher binaryMatcher;
 		bool matchCase;
 		pcre* regex;
 		pcre* fileMatchRegex;
 		wxString output;
 	};
 
+	// A file to be searched. Jobs are numbered in the order the tree
+	// is walked, so results can be shown in the same order.
+	struct SearchJob {
+		unsigned int seq;
+		wxString path;
+	};
+
+	class JobQueue {
+	public:
+		wxCriticalSection crit;
+		deque<SearchJob> jobs;
+	};
+
 	void SearchDir(const wxString& path, const SearchInfo& si, ProjectInfoHandler& infoHandler);
 	void DoSearch(const MMapBuffer& buf, const SearchInfo& si, vector<FileMatch>& matches) const;
-	void WriteResult(const MMapBuffer& buf, const wxFileName& filepath, vector<FileMatch>& matches);
+	void MakeResult(const MMapBuffer& buf, const wxFileName& filepath, const vector<FileMatch>& matches, FileResult& result) const;
 	bool PrepareSearchInfo(SearchInfo& si, const wxString& pattern, bool matchCase, bool regex, const wxString& fileMatch);
+	bool PrepareIndexQuery(const SearchInfo& si);
+
+	// Worker pool
+	void StartWorkers();
+	void FinishWorkers();
+	void AddJob(const wxString& path);
+	bool GetJob(unsigned int queueId, SearchJob& job);
+	void SearchFile(const SearchJob& job, MMapBuffer& buf, vector<FileMatch>& matches);
+	void AddResult(unsigned int seq, FileResult* result);
 
 	// Member variables
 	bool m_isSearching;
@@ -71,15 +123,82 @@ private:
 	bool m_regex;
 	bool m_lastError;
 	wxString m_currentPath;
-	wxString m_output;
 	wxString m_searchDirectory;
 	wxString m_fileMatch;
 	wxCriticalSection m_outputCrit;
 
+	// Index of project files (can only rule out files)
+	TrigramIndex& m_searchIndex;
+	TrigramIndex::Query m_indexQuery;
+	bool m_useIndex;
+
 	wxMutex m_condMutex;
 	wxCondition m_startSearchCond;
+
+	// Worker pool (only valid during search)
+	unsigned int m_threadCount;
+	const SearchInfo* m_searchInfo;
+	vector<SearchWorker*> m_workers;
+	vector<JobQueue*> m_queues;
+	wxSemaphore* m_jobsReady;
+	unsigned int m_jobCount;
+	unsigned int m_nextResult;
+	map<unsigned int, FileResult*> m_pendingResults; // protected by m_outputCrit
+
+	// Only pushed to with m_outputCrit held, so there is just one producer
+	LockFreeQueue<FileResult*> m_results;
 };
 
+// Searches files from the job queues of the SearchThread. Each worker
+// has its own queue but takes jobs from the others when it runs dry.
+class SearchWorker : public wxThread {
+public:
+	SearchWorker(SearchThread& searchThread, unsigned int id)
+		: wxThread(wxTHREAD_JOINABLE), m_searchThread(searchThread), m_id(id) {};
+	virtual void* Entry();
+
+private:
+	SearchThread& m_searchThread;
+	const unsigned int m_id;
+	MMapBuffer m_buf;
+	vector<SearchThread::FileMatch> m_matches;
+};
+
+
+// Writes the html rows for the matches in a file
+static void WriteResult(const SearchThread::FileResult& result, wxString& output) {
+	// Header
+	const size_t matchCount = result.matches.size();
+	const wxString format = (matchCount == 1) ? _("<span class=\"fileName\">%s - %d match</span>") : _("<span class=\"fileName\">%s - %d matches</span>");
+	output += wxString::Format(format, result.path.c_str(), matchCount);
+	output += wxT("<br><table cellspacing=0 width=\"100%\">");
+
+	bool even = true;
+	for (vector<SearchThread::MatchRecord>::const_iterator m = result.matches.begin(); m != result.matches.end(); ++m) {
+		// Write linenumber with link
+		output += wxString::Format(wxT("<tr class=\"%s\"><td class=\"lineNumber\"><a href=\"txmt://open/?url=file://%s&line=%d&column=%d&sel=%d\">%d</a></td><td class=\"result\" width=\"%s\"> "),
+			(even ? wxT("even") : wxT("odd")), result.path.c_str(), m->line, m->column, m->selLen, m->line, wxT("100%"));
+		even = !even;
+
+		// Line with match highlighted
+		wxString text = m->lineStart;
+		SimpleHtmlEncode(text);
+		output += text;
+
+		output += wxT("<span class=\"match\">");
+		text = m->match;
+		SimpleHtmlEncode(text);
+		output += text;
+		output += wxT("</span>");
+
+		text = m->lineEnd;
+		SimpleHtmlEncode(text);
+		output += text;
+		output += wxT("</td></tr>");
+	}
+
+	output += wxT("</table><p>");
+}
 
 // Ctrl id's
 enum {
@@ -100,14 +219,14 @@ BEGIN_EVENT_TABLE(FindInProjectDlg, wxDialog)
 	EVT_HTMLWND_BEFORE_LOAD(CTRL_BROWSER, FindInProjectDlg::OnBeforeLoad)
 END_EVENT_TABLE()
 
-FindInProjectDlg::FindInProjectDlg(EditorFrame& parentFrame, const ProjectInfoHandler& projectPane):
+FindInProjectDlg::FindInProjectDlg(EditorFrame& parentFrame, const ProjectInfoHandler& projectPane, TrigramIndex& searchIndex):
 	wxDialog (&parentFrame, -1, wxEmptyString, wxDefaultPosition, wxDefaultSize, wxDEFAULT_DIALOG_STYLE|wxRESIZE_BORDER),
 	m_parentFrame(parentFrame), m_projectPane(projectPane), m_searchThread(NULL), m_inSearch(false)
 {
 	SetTitle (_("Find In Project"));
 
 	// Create the search thread
-	m_searchThread = new SearchThread();
+	m_searchThread = new SearchThread(searchIndex);
 	
 	// Create ctrls
 	m_searchCtrl = new wxTextCtrl(this, CTRL_SEARCH, wxEmptyString, wxDefaultPosition, wxDefaultSize, wxTE_PROCESS_ENTER);
@@ -149,6 +268,7 @@ FindInProjectDlg::FindInProjectDlg(EditorFrame& parentFrame, const ProjectInfoHa
 
 FindInProjectDlg::~FindInProjectDlg() {
 	if (m_searchThread->IsSearching()) m_searchThread->CancelSearch();
+	m_searchThread->ClearResults();
 	m_searchThread->DeleteThread();
 }
 	
@@ -167,18 +287,29 @@ void FindInProjectDlg::OnSearch(wxCommandEvent& WXUNUSED(event)) {
 		return;
 	}
 
-	// Clear old results
-	m_output.clear();
-	m_browser->LoadString(wxT(""));
-
 	const wxString searchtext = m_searchCtrl->GetValue();
-	if (searchtext.empty()) return;
+	if (searchtext.empty()) {
+		m_browser->LoadString(wxT(""));
+		return;
+	}
 
 	const wxFileName& projectDir = m_projectPane.GetRoot();
 
 	// There might be a running search that we have to cancel first
 	m_searchThread->CancelSearch();
 
+	// Clear old results (rows are appended as they come in)
+	m_searchThread->ClearResults();
+	m_browser->LoadString(wxT(" \
+		<head><style type=\"text/css\"> \
+			.fileName {font-family: Consolas;font-size: 14px;font-weight: bold;} \
+			.lineNumber {background-color: #f6f6ef;padding: 2px;text-align: right;vertical-align: top;} \
+			.result, .lineNumber {font-family: Consolas;font-size: 13px;} \
+			.odd {background-color: #eee;} \
+			.odd .lineNumber {background-color: #d9d9d9;} \
+			.match {background-color: yellow;font-style: italic;} \
+		</style></head><body></body>"));
+
 	wxLogDebug(wxT("Searching:"));
 	const wxString path = projectDir.GetPath() + wxFILE_SEP_PATH;
 	m_searchThread->StartSearch(path, searchtext, m_caseCheck->GetValue(), m_regexCheck->GetValue(), m_directoryCtrl->GetValue(), m_fileMatchCtrl->GetValue());
@@ -188,6 +319,19 @@ void FindInProjectDlg::OnSearch(wxCommandEvent& WXUNUSED(event)) {
 }
 
 void FindInProjectDlg::OnIdle(wxIdleEvent& event) {
+	// Append rows for new results (there may still be some after search is done)
+	wxString rows;
+	unsigned int fileCount = 0;
+	for (; fileCount < 100; ++fileCount) {
+		SearchThread::FileResult* const result = m_searchThread->PopResult();
+		if (!result) break;
+
+		WriteResult(*result, rows);
+		delete result;
+	}
+	if (!rows.empty()) m_browser->AppendString(rows);
+	if (fileCount == 100) event.RequestMore();
+
 	if (!m_searchThread->IsSearching()) {
 		if (m_inSearch) {
 			if (m_searchThread->LastError()) {
@@ -206,10 +350,6 @@ void FindInProjectDlg::OnIdle(wxIdleEvent& event) {
 	wxString currentPath = m_pathStatic->GetLabel();
 	if (m_searchThread->GetCurrentPath(currentPath)) m_pathStatic->SetLabel(currentPath);
 
-	if (m_searchThread->UpdateOutput(m_output)) {
-		m_browser->LoadString(m_output);
-	}
-
 	event.RequestMore(); // we don't want the search to look slow :-)
 }
 
@@ -233,8 +373,10 @@ void FindInProjectDlg::OnBeforeLoad(IHtmlWndBeforeLoadEvent& event) {
 
 // ---- SearchThread ---------------------------------------------------------------------------------------
 
-SearchThread::SearchThread():
-	m_isSearching(false), m_isWaiting(false), m_stopSearch(false), m_lastError(false), m_startSearchCond(m_condMutex) 
+SearchThread::SearchThread(TrigramIndex& searchIndex):
+	m_isSearching(false), m_isWaiting(false), m_stopSearch(false), m_lastError(false),
+	m_searchIndex(searchIndex), m_useIndex(false), m_startSearchCond(m_condMutex),
+	m_threadCount(1), m_searchInfo(NULL), m_jobsReady(NULL), m_jobCount(0), m_nextResult(0)
 {
 	// Create and run the thread
 	Create();
@@ -258,25 +400,13 @@ void* SearchThread::Entry() {
 
 		SearchInfo si;
 		if (!PrepareSearchInfo(si, m_pattern, m_matchCase, m_regex, m_fileMatch)) continue;
+		m_useIndex = PrepareIndexQuery(si);
 
 		m_isSearching = true;
 		
 		ProjectInfoHandler infoHandler;
 		infoHandler.SetRoot(m_path);
 
-		// Write the html header for output
-		m_outputCrit.Enter();
-		m_output = wxT(" \
-			<head><style type=\"text/css\"> \
-				.fileName {font-family: Consolas;font-size: 14px;font-weight: bold;} \
-				.lineNumber {background-color: #f6f6ef;padding: 2px;text-align: right;vertical-align: top;} \
-				.result, .lineNumber {font-family: Consolas;font-size: 13px;} \
-				.odd {background-color: #eee;} \
-				.odd .lineNumber {background-color: #d9d9d9;} \
-				.match {background-color: yellow;font-style: italic;} \
-			</style></head>");
-		m_outputCrit.Leave();
-
 		wxString path = m_path;
 		if(m_searchDirectory.length() > 0) {
 			wxString dir = m_searchDirectory;
@@ -295,7 +425,13 @@ void* SearchThread::Entry() {
 				path = path + dir + wxFILE_SEP_PATH;
 			}
 		}
+		// The tree is walked here while the workers search the files
+		m_searchInfo = &si;
+		StartWorkers();
 		SearchDir(path, si, infoHandler);
+		FinishWorkers();
+		m_searchInfo = NULL;
+
 		m_isSearching = false;
 
 		// Clean up
@@ -325,6 +461,13 @@ void SearchThread::StartSearch(const wxString& path, const wxString& pattern, bo
 	m_regex = regex;
 	m_lastError = false;
 
+	// Number of files to search in parallel
+	int threadCount = 0;
+	if (!eGetSettings().GetSettingInt(wxT("findInProjectThreads"), threadCount) || threadCount <= 0) {
+		threadCount = wxThread::GetCPUCount();
+	}
+	m_threadCount = wxMax(1, wxMin(threadCount, 16));
+
 	// Signal thread that we should start search
 	wxMutexLocker lock(m_condMutex);
 	m_startSearchCond.Signal();
@@ -334,7 +477,7 @@ void SearchThread::CancelSearch() {
 	m_isSearching = false;
 
 	// Wait for the search to actually cancel
-	while (!m_isWaiting) wxSleep(1);
+	while (!m_isWaiting) wxMilliSleep(10);
 }
 
 bool SearchThread::GetCurrentPath(wxString& currentPath) {
@@ -346,13 +489,15 @@ bool SearchThread::GetCurrentPath(wxString& currentPath) {
 	return true;
 }
 
-bool SearchThread::UpdateOutput(wxString& output) {
-	wxCriticalSectionLocker locker(m_outputCrit);
-
-	if (m_output.length() <= output.length()) return false;
+SearchThread::FileResult* SearchThread::PopResult() {
+	FileResult* result = NULL;
+	m_results.Pop(result);
+	return result;
+}
 
-	output = m_output.c_str(); // wxString is not threadsafe, so we have to force copy
-	return true;
+void SearchThread::ClearResults() {
+	FileResult* result;
+	while (m_results.Pop(result)) delete result;
 }
 
 bool SearchThread::PrepareSearchInfo(SearchInfo& si, const wxString& pattern, bool matchCase, bool regex, const wxString& fileMatch) {
@@ -402,23 +547,34 @@ bool SearchThread::PrepareSearchInfo(SearchInfo& si, const wxString& pattern, bo
 		}
 	}
 	else {
-		si.byte_len = strlen(si.UTF8buffer);
-		if (!matchCase) {
-			si.UTF8bufferUpper = wxConvUTF8.cWC2MB(si.patternUpper);
-
-			// This algorithm assumes that UTF8 upper- & lowercase chars have same byte width
-			wxASSERT(si.byte_len == strlen(si.UTF8bufferUpper));
-		}
+		const size_t byte_len = strlen(si.UTF8buffer);
+		if (matchCase) si.matcher.Set(si.UTF8buffer.data(), byte_len);
+		else {
+			// Get lower- and uppercase form of each char. If they have
+			// same byte width, we can match them byte by byte.
+			bool sameWidth = true;
+			for (size_t i = 0; i < si.pattern.size(); ++i) {
+				size_t charLen = 1;
+				if (sizeof(wxChar) == 2 && si.pattern[i] >= 0xD800 && si.pattern[i] < 0xDC00 && i+1 < si.pattern.size()) charLen = 2; // surrogate pair
+
+				const wxCharBuffer lower = wxConvUTF8.cWC2MB(si.pattern.substr(i, charLen));
+				const wxCharBuffer upper = wxConvUTF8.cWC2MB(si.patternUpper.substr(i, charLen));
+				const size_t lowerLen = strlen(lower);
+				const size_t upperLen = strlen(upper);
+				if (lowerLen != upperLen) sameWidth = false;
+
+				si.foldMatcher.AddChar(lower.data(), lowerLen, upper.data(), upperLen);
+				i += charLen - 1;
+			}
 
-		// Build a dictionary of char-to-last distances in the search string
-		// since this is a char, distances in the searchstring can not be longer than 256
-		memset(si.charmap, si.byte_len, 256);
-		const size_t last_char_pos = si.byte_len-1;
-		for (size_t i = 0; i < last_char_pos; ++i) {
-			si.charmap[si.UTF8buffer[i]] = last_char_pos-i;
-			if (!matchCase) si.charmap[si.UTF8bufferUpper[i]] = last_char_pos-i;
+			if (sameWidth) {
+				const wxCharBuffer UTF8bufferUpper = wxConvUTF8.cWC2MB(si.patternUpper);
+				si.matcher.Set(si.UTF8buffer.data(), UTF8bufferUpper.data(), byte_len);
+				si.foldMatcher.Clear();
+			}
 		}
 	}
+	si.binaryMatcher.Set("\0", 1);
 	
 	if(fileMatch.Length() > 0) {
 		// Compile the pattern
@@ -441,6 +597,19 @@ bool SearchThread::PrepareSearchInfo(SearchInfo& si, const wxString& pattern, bo
 	return true;
 }
 
+bool SearchThread::PrepareIndexQuery(const SearchInfo& si) {
+	if (!m_searchIndex.IsReady()) return false;
+
+	// Get the literal text that all matches have to contain
+	vector<string> literals;
+	if (si.regex) {
+		if (!GetRequiredLiterals(si.UTF8buffer.data(), literals)) return false;
+	}
+	else literals.push_back(si.UTF8buffer.data());
+
+	return m_searchIndex.PrepareQuery(literals, si.matchCase, m_indexQuery);
+}
+
 bool ShouldSearchFile(const wxString& filename, const pcre* regex) {
 	if(!regex) return true;
 	
@@ -461,43 +630,143 @@ bool ShouldSearchFile(const wxString& filename, const pcre* regex) {
 }
 
 void SearchThread::SearchDir(const wxString& path, const SearchInfo& si, ProjectInfoHandler& infoHandler) {
-	MMapBuffer buf;
-	wxFileName filepath;
-	vector<FileMatch> matches;
-
 	wxArrayString dirs;
 	wxArrayString filenames;
 	infoHandler.GetDirAndFileLists(path, dirs, filenames);
 
 	for (size_t f = 0; f < filenames.size(); ++f) {
 		if (!m_isSearching) return;
-		
+		if(!ShouldSearchFile(filenames[f], si.fileMatchRegex)) continue;
+
+		const wxString filepath = path + filenames[f];
+		if (m_useIndex && !m_searchIndex.IsCandidate(m_indexQuery, filepath)) continue;
+
+		AddJob(filepath);
+	}
+
+	for (size_t d = 0; d < dirs.size(); ++d) {
+		if (!m_isSearching) return;
+		const wxString dirpath = path + dirs[d] + wxFILE_SEP_PATH;
+		SearchDir(dirpath, si, infoHandler);
+	}
+}
+
+void SearchThread::StartWorkers() {
+	m_jobCount = 0;
+	m_nextResult = 0;
+	m_pendingResults.clear();
+	m_jobsReady = new wxSemaphore();
+
+	for (unsigned int i = 0; i < m_threadCount; ++i) {
+		m_queues.push_back(new JobQueue());
+
+		SearchWorker* worker = new SearchWorker(*this, i);
+		if (worker->Create() == wxTHREAD_NO_ERROR && worker->Run() == wxTHREAD_NO_ERROR) {
+			m_workers.push_back(worker);
+		}
+		else delete worker;
+	}
+}
+
+void SearchThread::FinishWorkers() {
+	// Signal each worker to stop when there are no jobs left
+	for (unsigned int i = 0; i < m_workers.size(); ++i) m_jobsReady->Post();
+
+	for (vector<SearchWorker*>::iterator p = m_workers.begin(); p != m_workers.end(); ++p) {
+		(*p)->Wait();
+		delete *p;
+	}
+	m_workers.clear();
+
+	// If no workers could be started we have to do the search ourselves
+	if (m_isSearching) {
+		MMapBuffer buf;
+		vector<FileMatch> matches;
+		SearchJob job;
+		while (GetJob(0, job)) SearchFile(job, buf, matches);
+	}
+
+	for (vector<JobQueue*>::iterator q = m_queues.begin(); q != m_queues.end(); ++q) delete *q;
+	m_queues.clear();
+	delete m_jobsReady;
+	m_jobsReady = NULL;
+}
+
+void SearchThread::AddJob(const wxString& path) {
+	SearchJob job;
+	job.seq = m_jobCount++;
+	job.path = path.c_str(); // wxString is not threadsafe, so we have to force copy
+
+	JobQueue& queue = *m_queues[job.seq % m_queues.size()];
+	{
+		wxCriticalSectionLocker lock(queue.crit);
+		queue.jobs.push_back(job);
+	}
+	m_jobsReady->Post();
+}
+
+bool SearchThread::GetJob(unsigned int queueId, SearchJob& job) {
+	// Take from own queue first, then from the others. We always take
+	// the oldest job, so that results can be shown as soon as possible.
+	for (unsigned int i = 0; i < m_queues.size(); ++i) {
+		JobQueue& queue = *m_queues[(queueId + i) % m_queues.size()];
+		wxCriticalSectionLocker lock(queue.crit);
+
+		if (!queue.jobs.empty()) {
+			job.seq = queue.jobs.front().seq;
+			job.path = queue.jobs.front().path.c_str(); // force copy
+			queue.jobs.pop_front();
+			return true;
+		}
+	}
+	return false;
+}
+
+void SearchThread::SearchFile(const SearchJob& job, MMapBuffer& buf, vector<FileMatch>& matches) {
+	FileResult* result = NULL;
+
+	// After cancel we just drain the queues
+	if (m_isSearching) {
 		m_outputCrit.Enter();
-			m_currentPath = path + filenames[f];
+			m_currentPath = job.path.c_str(); // force copy
 		m_outputCrit.Leave();
-		filepath = m_currentPath;
-	
-		if(!ShouldSearchFile(filenames[f], si.fileMatchRegex)) continue;
+		const wxFileName filepath(job.path);
 
 		// Map the file to memory
 		buf.Open(filepath);
-		if (!buf.IsMapped()) {
-			wxLogDebug(wxT(" Mapping failed!"));
-			continue;
+		if (buf.IsMapped()) {
+			// Search the file
+			DoSearch(buf, *m_searchInfo, matches);
+			if (!matches.empty()) {
+				result = new FileResult();
+				MakeResult(buf, filepath, matches, *result);
+				matches.clear();
+			}
+			buf.Close();
 		}
+		else wxLogDebug(wxT(" Mapping failed!"));
+	}
 
-		// Search the file
-		DoSearch(buf, si, matches);
-		if (matches.empty()) continue; 
+	AddResult(job.seq, result);
+}
+
+void SearchThread::AddResult(unsigned int seq, FileResult* result) {
+	wxCriticalSectionLocker locker(m_outputCrit);
 
-		// Show matches
-		WriteResult(buf, filepath, matches);
-		matches.clear();
+	if (seq != m_nextResult) {
+		m_pendingResults[seq] = result;
+		return;
 	}
 
-	for (size_t d = 0; d < dirs.size(); ++d) {
-		const wxString dirpath = path + dirs[d] + wxFILE_SEP_PATH;
-		SearchDir(dirpath, si, infoHandler);
+	// Pass on results in the order the files were found
+	if (result) m_results.Push(result);
+	++m_nextResult;
+
+	map<unsigned int, FileResult*>::iterator p = m_pendingResults.begin();
+	while (p != m_pendingResults.end() && p->first == m_nextResult) {
+		if (p->second) m_results.Push(p->second);
+		m_pendingResults.erase(p++);
+		++m_nextResult;
 	}
 }
 
@@ -505,11 +774,7 @@ void SearchThread::DoSearch(const MMapBuffer& buf, const SearchInfo& si, vector<
 	// Ignore binary files (we just check for zero bytes in the first
 	// 100 bytes of the file)
 	const wxFileOffset len = buf.Length();
-	const char* subject = buf.data();
-	const char* end_pos = buf.data() + wxMin(100,len);
-	for (; subject < end_pos; ++subject) {
-		if (*subject == '\0') return;
-	}
+	if (si.binaryMatcher.Find(buf.data(), wxMin(100,len))) return;
 
 	if (si.regex) {
 		const int OVECCOUNT = 30;
@@ -535,121 +800,77 @@ void SearchThread::DoSearch(const MMapBuffer& buf, const SearchInfo& si, vector<
 		}
 	}
 	else {
-		// Prepare vars to avoid lookups in loop
-		const size_t last_char_pos = si.byte_len-1;
-		const char lastChar = si.UTF8buffer[last_char_pos];
-		const char lastCharUpper = si.matchCase ? '\0' : si.UTF8bufferUpper[last_char_pos];
-
-		subject = buf.data() + last_char_pos;
-		end_pos = buf.data() + len;
-
-		while (subject < end_pos) {
-			const char c = *subject; // Get candidate for last char
-
-			if (c == lastChar || (!si.matchCase && c == lastCharUpper)) {
-				// Match indiviual chars
-				const char* byte_ptr = subject-1;
-				const char* const first_byte_pos = subject - last_char_pos;
-				unsigned int char_pos = last_char_pos-1;
-				while (byte_ptr >= first_byte_pos) {
-					const char c2 = *byte_ptr;
-					if (c2 != si.UTF8buffer[char_pos]) {
-						if (si.matchCase || c2 != si.UTF8bufferUpper[char_pos]) break;
-					}
-					--byte_ptr; --char_pos;
-				}
-
-				if (byte_ptr < first_byte_pos) {
-					// We got a match
-					const wxFileOffset matchStart = first_byte_pos - buf.data();
-					const FileMatch m = {0, 0, matchStart, matchStart + si.byte_len};
-					matches.push_back(m);
-
-					subject += si.byte_len;
-					continue;
-				}
+		const char* const start = buf.data();
+		const char* subject = start;
+		const char* const end = start + len;
+
+		if (!si.foldMatcher.IsEmpty()) {
+			size_t matchLen;
+			while ((subject = si.foldMatcher.Find(subject, end - subject, matchLen)) != NULL) {
+				const FileMatch m = {0, 0, subject - start, (subject - start) + matchLen};
+				matches.push_back(m);
+				subject += matchLen;
 			}
+			return;
+		}
 
-			// If we don't have a match, see how far we can move char_pos
-			subject += si.charmap[(unsigned char)c];
+		const size_t byte_len = si.matcher.GetLength();
+		while ((subject = si.matcher.Find(subject, end - subject)) != NULL) {
+			const FileMatch m = {0, 0, subject - start, (subject - start) + byte_len};
+			matches.push_back(m);
+			subject += byte_len;
 		}
 	}
 }
 
-void SearchThread::WriteResult(const MMapBuffer& buf, const wxFileName& filepath, vector<FileMatch>& matches) {
-	if (matches.empty()) return;
-
-	// Header
-	const wxString path = filepath.GetFullPath();
-	const wxString format = (matches.size() == 1) ? _("<span class=\"fileName\">%s - %d match</span>") : _("<span class=\"fileName\">%s - %d matches</span>");
-	wxString output = wxString::Format(format, path.c_str(), matches.size());
-	output += wxT("<br><table cellspacing=0 width=\"100%\">");
+void SearchThread::MakeResult(const MMapBuffer& buf, const wxFileName& filepath, const vector<FileMatch>& matches, FileResult& result) const {
+	result.path = filepath.GetFullPath();
+	result.matches.resize(matches.size());
 
+	const char* const start = buf.data();
+	const char* const end = start + buf.Length();
+	const char* counted = start; // lines are counted up to here
+	const char* linestart = start;
 	unsigned int linecount = 1;
-	const char* subject = buf.data();
-	const char* end = subject + buf.Length();
-	const char* linestart = subject;
-	vector<FileMatch>::iterator m = matches.begin();
-	const char* matchstart = subject + m->start;
-	bool even = true;
 
-	// Count lines
-	while (subject < end) {
-		if (subject == matchstart) {
-			const size_t column = 1 + (matchstart - linestart); // column ndx starts from 1
-			const size_t sel_len = m->end - m->start;
+	for (unsigned int i = 0; i < matches.size(); ++i) {
+		const char* const matchstart = start + matches[i].start;
+		const char* const matchend = start + matches[i].end;
 
-			// Write linenumber with link
-			wxString line = wxString::Format(wxT("<tr class=\"%s\"><td class=\"lineNumber\"><a href=\"txmt://open/?url=file://%s&line=%d&column=%d&sel=%d\">%d</a></td><td class=\"result\" width=\"%s\"> "), 
-				(even ? wxT("even") : wxT("odd")), path.c_str(), linecount, column, sel_len, linecount, wxT("100%"));
-			even = !even;
-			
-			// Start of line
-			{
-				wxString result = wxString(linestart, wxConvUTF8, matchstart-linestart);
-				SimpleHtmlEncode(result);
-				line += result;
-			}
+		// Count lines since previous match
+		const size_t newlines = CountByte(counted, matchstart, '\n');
+		if (newlines) {
+			linecount += newlines;
+			linestart = matchstart;
+			while (linestart[-1] != '\n') --linestart;
+		}
+		counted = matchstart;
+
+		const char* lineend = (const char*)memchr(matchend, '\n', end - matchend);
+		if (!lineend) lineend = end;
+
+		MatchRecord& m = result.matches[i];
+		m.line = linecount;
+		m.column = 1 + (matchstart - linestart); // column ndx starts from 1
+		m.selLen = matchend - matchstart;
+		m.lineStart = wxString(linestart, wxConvUTF8, matchstart - linestart);
+		m.match = wxString(matchstart, wxConvUTF8, matchend - matchstart);
+		m.lineEnd = wxString(matchend, wxConvUTF8, lineend - matchend);
+	}
+}
 
+// ---- SearchWorker ---------------------------------------------------------------------------------------
 
-			// Match
-			line += wxT("<span class=\"match\">");
-			const size_t match_len = m->end - m->start;
-			{
-				wxString result = wxString(matchstart, wxConvUTF8, match_len);
-				SimpleHtmlEncode(result);
-				line += result;
-			}
-			line += wxT("</span>");
-
-			// End of line
-			const char* const matchend = subject + match_len;
-			const char* lineend = matchend;
-			while (lineend < end && *lineend != '\n') ++lineend;
-			{
-				wxString result = wxString(matchend, wxConvUTF8, lineend - matchend);
-				SimpleHtmlEncode(result);
-				line += result;
-			}
-			line += wxT("</td></tr>");
-			output += line;
-			
-			++m;
-			if (m == matches.end()) break;
-			matchstart = buf.data() + m->start;
-		}
+void* SearchWorker::Entry() {
+	SearchThread::SearchJob job;
 
-		if (*subject == '\n') {
-			++linecount;
-			linestart = subject+1;
-		}
+	for (;;) {
+		m_searchThread.m_jobsReady->Wait();
 
-		++subject;
+		// No jobs after the stop signal means we are done
+		if (!m_searchThread.GetJob(m_id, job)) break;
+		m_searchThread.SearchFile(job, m_buf, m_matches);
 	}
 
-	output += wxT("</table><p>");
-
-	m_outputCrit.Enter();
-		m_output += output;
-	m_outputCrit.Leave();
+	return NULL;
 }
@@ -28,10 +28,11 @@ class ProjectInfoHandler;
 class wxFileName;
 class ProjectInfoHandler;
 class SearchThread;
+class TrigramIndex;
 
 class FindInProjectDlg : public wxDialog {
 public:
-	FindInProjectDlg(EditorFrame& parentFrame, const ProjectInfoHandler& projectPane);
+	FindInProjectDlg(EditorFrame& parentFrame, const ProjectInfoHandler& projectPane, TrigramIndex& searchIndex);
 	~FindInProjectDlg();
 
 	void SetPattern(const wxString& pattern);
@@ -57,7 +58,6 @@ private:
 	EditorFrame& m_parentFrame;
 	const ProjectInfoHandler& m_projectPane;
 	SearchThread* m_searchThread;
-	wxString m_output;
 	bool m_inSearch;
 };
 
@@ -12,6 +12,7 @@
  ******************************************************************************/
 
 #include "FixedLine.h"
+#include "ExtentCache.h"
 #include "FastDC.h"
 #include <algorithm>
 #include "Document.h"
@@ -71,6 +72,23 @@ void FixedLine::UpdateFont() {
 	dc.GetTextExtent(wxT('X'), &w, &h);
 	m_nlwidth = w;
 
+	// Check which font styles keep the fixed width (so ascii
+	// text can be laid out without measuring it)
+	m_fontId = ExtentCache::Get().GetFontId(dc.GetFont(), dc.GetPPI());
+	if (m_isFontFixedWidth) {
+		const int styles[] = {wxFONTFLAG_DEFAULT, wxFONTFLAG_BOLD, wxFONTFLAG_ITALIC, wxFONTFLAG_BOLD|wxFONTFLAG_ITALIC};
+		for (unsigned int i = 0; i < 4; ++i) {
+			m_sr.ApplyFontStyle(styles[i]);
+			dc.GetTextExtent(wxT('X'), &w, &h);
+			m_fixedStyles[i] = (w == charwidth);
+		}
+		m_sr.ApplyFontStyle(wxFONTFLAG_DEFAULT);
+
+		wxArrayInt widths;
+		dc.GetPartialTextExtents(wxT("X\n"), widths);
+		m_fixedNlWidth = widths[1] - widths[0];
+	}
+
 	// Create images of hidden chars
 	// Draw hidden newline
 	wxMemoryDC mdc;
@@ -182,17 +200,11 @@ unsigned int FixedLine::SetLine(unsigned int startpos, unsigned int endpos, bool
 			(*si)->Style(m_sr);
 		}
 
-		m_extents.clear();
-		m_extents.reserve(m_lineLen);
-		unsigned int xpos = 0;
-		unsigned int lastpos = 0;
+		// Get the runs of text with same font style
+		m_fontRuns.clear();
+		unsigned int runStart = 0;
 		unsigned int style_start = 0;
 		int fontStyle = m_sr.GetFontStyle(0);
-		char* dbi = m_lineBuffer.data();
-
-		// Build list of text extends (totalling) compensating for tabs and styles
-		// There is one extent per byte in the text. In utf8 chars composed out of multiple
-		// bytes, they will all have same value.
 		for (unsigned int style_id = 0; style_id < m_sr.GetStyleCount(); ++style_id) {
 			const unsigned int style_end = m_sr.GetStyleEnd(style_id) - textstart;
 
@@ -201,77 +213,54 @@ unsigned int FixedLine::SetLine(unsigned int startpos, unsigned int endpos, bool
 
 			// Check for style change
 			if (m_sr.GetFontStyle(style_id) != fontStyle) {
-				if (style_start > lastpos) {
-					m_sr.ApplyFontStyle(fontStyle);
-
-					// Get extends for current segment
-					m_extsBuf.clear();
-					const unsigned int seg_len = style_start-lastpos;
-					ConvertFromUTF8toString(dbi+lastpos, seg_len, m_textBuf);
-					dc.GetPartialTextExtents(m_textBuf, m_extsBuf);
-					wxASSERT(!m_textBuf.empty() && m_extsBuf.size() == m_textBuf.size());
-
-					// Add to main list adjusted for offset
-					unsigned int extpos = 0;
-					unsigned int offset = xpos;
-					for (unsigned int i = lastpos; i < style_start; ++i) {
-						if ((dbi[i] & 0xC0) == 0x80) m_extents.push_back(xpos); // Only count first byte of UTF-8 multibyte chars
-						else if (dbi[i] == '\t') {
-							// Add tab extend
-							xpos = ((xpos / tabwidth)+1) * tabwidth; // GetTabPoint(xpos);
-							offset += xpos - (m_extsBuf[extpos] + offset);
-							m_extents.push_back(xpos);
-							++extpos;
-						}
-						else {
-							xpos = m_extsBuf[extpos] + offset;
-							m_extents.push_back(xpos);
-							++extpos;
-						}
-					}
-
-					// Small hack to make lines that end with italics not cut off the edge of the last character
-					if (fontStyle &= wxFONTFLAG_ITALIC) {
-						m_extents.back() += 2;
-						xpos = m_extents.back();
-					}
+				if (style_start > runStart) {
+					m_fontRuns.push_back(style_start);
+					m_fontRuns.push_back(fontStyle);
 				}
 
-				lastpos = style_start;
+				runStart = style_start;
 				fontStyle = m_sr.GetFontStyle(style_id);
 			}
 
 			style_start = style_end;
 		}
+		if (runStart < m_lineLen) {
+			m_fontRuns.push_back(m_lineLen);
+			m_fontRuns.push_back(fontStyle);
+		}
 
-		// Add extends for last segment
-		if (lastpos < m_lineLen) {
-			m_sr.ApplyFontStyle(fontStyle);
-
-			// Get extends for current segment
-			m_extsBuf.clear();
-			const unsigned int seg_len = m_lineLen-lastpos;
-			ConvertFromUTF8toString(dbi+lastpos, seg_len, m_textBuf);
-			dc.GetPartialTextExtents(m_textBuf, m_extsBuf);
-			wxASSERT(!m_textBuf.empty() && m_extsBuf.size() == m_textBuf.size());
-
-			// Add to main list adjusted for offset
-			unsigned int extpos = 0;
-			unsigned int offset = xpos;
-			for (unsigned int i = lastpos; i < m_lineLen; ++i) {
-				if ((dbi[i] & 0xC0) == 0x80) m_extents.push_back(xpos); // Only count first byte of UTF-8 multibyte chars
-				else if (dbi[i] == '\t') {
-					// Add tab extend
-					xpos = ((xpos / tabwidth)+1) * tabwidth; // GetTabPoint(xpos);
-					offset += xpos - (m_extsBuf[extpos] + offset);
-					m_extents.push_back(xpos);
-					++extpos;
-				}
-				else {
-					xpos = m_extsBuf[extpos] + offset;
-					m_extents.push_back(xpos);
-					++extpos;
+		// Build list of text extends (totalling) compensating for tabs and styles
+		// There is one extent per byte in the text. In utf8 chars composed out of multiple
+		// bytes, they will all have same value.
+		if (!SetFixedExtents()) {
+			ExtentCache& extentCache = ExtentCache::Get();
+			const char* dbi = m_lineBuffer.data();
+
+			const vector<unsigned int>* extents = extentCache.Find(m_fontId, tabwidth, dbi, m_lineLen, m_fontRuns);
+			if (extents) m_extents = *extents;
+			else {
+				m_extents.clear();
+				m_extents.reserve(m_lineLen);
+				unsigned int xpos = 0;
+				runStart = 0;
+
+				for (size_t r = 0; r < m_fontRuns.size(); r += 2) {
+					const unsigned int runEnd = m_fontRuns[r];
+					const int runStyle = m_fontRuns[r+1];
+
+					m_sr.ApplyFontStyle(runStyle);
+					AddExtents(runStart, runEnd, xpos);
+
+					// Small hack to make lines that end with italics not cut off the edge of the last character
+					if (runEnd < m_lineLen && (runStyle & wxFONTFLAG_ITALIC)) {
+						m_extents.back() += 2;
+						xpos = m_extents.back();
+					}
+
+					runStart = runEnd;
 				}
+
+				extentCache.Add(m_fontId, tabwidth, dbi, m_lineLen, m_fontRuns, m_extents);
 			}
 		}
 
@@ -290,6 +279,41 @@ unsigned int FixedLine::SetLine(unsigned int startpos, unsigned int endpos, bool
 	return (m_wrapMode == cxWRAP_NONE) ? m_lineWidth : height;
 }
 
+void FixedLine::AddExtents(unsigned int start, unsigned int end, unsigned int& xpos) {
+	const char* dbi = m_lineBuffer.data();
+
+	// Get extends for current segment
+	m_extsBuf.clear();
+	ConvertFromUTF8toString(dbi+start, end-start, m_textBuf);
+	dc.GetPartialTextExtents(m_textBuf, m_extsBuf);
+	wxASSERT(!m_textBuf.empty() && m_extsBuf.size() == m_textBuf.size());
+
+	// Add to main list adjusted for offset
+	unsigned int extpos = 0;
+	unsigned int offset = xpos;
+	for (unsigned int i = start; i < end; ++i) {
+		if ((dbi[i] & 0xC0) == 0x80) m_extents.push_back(xpos); // Only count first byte of UTF-8 multibyte chars
+		else if (dbi[i] == '\t') {
+			// Add tab extend
+			xpos = ((xpos / tabwidth)+1) * tabwidth; // GetTabPoint(xpos);
+			offset += xpos - (m_extsBuf[extpos] + offset);
+			m_extents.push_back(xpos);
+			++extpos;
+		}
+		else {
+			xpos = m_extsBuf[extpos] + offset;
+			m_extents.push_back(xpos);
+			++extpos;
+		}
+	}
+}
+
+bool FixedLine::SetFixedExtents() {
+	// With monospace fonts, plain ascii text does not have to be measured
+	if (!m_isFontFixedWidth) return false;
+	return ExtentCache::GetFixedExtents(m_lineBuffer.data(), m_lineLen, m_fontRuns, tabwidth, charwidth, m_fixedNlWidth, m_fixedStyles, m_extents);
+}
+
 void FixedLine::FlushCache(unsigned int pos) {
 	// Invalidate cache if change happened before end
 	if (textend > pos) {
@@ -91,6 +91,8 @@ public:
 
 private:
 	unsigned int DrawText(int xoffset, int x, int y, unsigned int start, unsigned int end);
+	void AddExtents(unsigned int start, unsigned int end, unsigned int& xpos);
+	bool SetFixedExtents();
 	void BreakLine();
 	int GetTabPoint(int xpos) const;
 
@@ -136,6 +138,10 @@ private:
 	vector<unsigned int> breakpoints;
 	vector<Styler*> m_stylers;
 	bool m_isFontFixedWidth;
+	bool m_fixedStyles[4]; // font styles (bold|italic) keeping fixed width
+	int m_fixedNlWidth;
+	unsigned int m_fontId; // see ExtentCache
+	vector<unsigned int> m_fontRuns; // pairs of run end and font style
 
 	unsigned int m_foldWidth;
 	unsigned int m_foldHeight;
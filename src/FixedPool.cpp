@@ -0,0 +1,136 @@
+/*******************************************************************************
+ *
+ * Copyright (C) 2009, Alexander Stigsen, e-texteditor.com
+ *
+ * This software is licensed under the Open Company License as described
+ * in the file license.txt, which you should have received as part of this
+ * distribution. The terms are also available at http://opencompany.org/license.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ******************************************************************************/
+
+#include "FixedPool.h"
+#include <algorithm>
+#include <new>
+#include <cassert>
+#include <cstdlib>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+// Initializing static constants
+const size_t FixedPool::BLOCKSIZE = 64 * 1024; // VirtualAlloc granularity
+
+// Slots are aligned for any of the node members (pointers and ints)
+static size_t SlotSize(size_t size) {
+	const size_t align = sizeof(double) > sizeof(void*) ? sizeof(double) : sizeof(void*);
+	if (size < sizeof(void*)) size = sizeof(void*);
+	return (size + align - 1) & ~(align - 1);
+}
+
+FixedPool::FixedPool(size_t slotSize)
+: m_slotSize(SlotSize(slotSize)), m_headerSize(SlotSize(sizeof(Block))),
+  m_slotsPerBlock((BLOCKSIZE - m_headerSize) / m_slotSize), m_spare(NULL), m_used(0) {
+	assert(m_slotsPerBlock > 0);
+}
+
+FixedPool::~FixedPool() {
+	for (std::vector<Block*>::iterator p = m_blocks.begin(); p != m_blocks.end(); ++p) {
+		FreeBlock(*p);
+	}
+}
+
+FixedPool& FixedPool::GetPool(const void* p) {
+	return *GetBlock(p)->pool;
+}
+
+FixedPool::Block* FixedPool::GetBlock(const void* p) {
+	return (Block*)((size_t)p & ~(BLOCKSIZE - 1));
+}
+
+void* FixedPool::Alloc() {
+	if (m_available.empty()) {
+		Block* block = NewBlock();
+		m_blocks.push_back(block);
+		m_available.push_back(block);
+	}
+	++m_used;
+
+	Block& block = *m_available.back();
+	if (&block == m_spare) m_spare = NULL;
+	++block.used;
+
+	void* slot;
+	if (block.freeSlots) {
+		slot = block.freeSlots;
+		block.freeSlots = block.freeSlots->next;
+	}
+	else slot = GetData(&block) + m_slotSize * block.pos++;
+
+	if (IsFull(block)) {
+		block.isAvailable = false;
+		m_available.pop_back();
+	}
+
+	return slot;
+}
+
+void FixedPool::Free(void* p) {
+	if (!p) return;
+
+	Block* block = GetBlock(p);
+	assert(block->pool == this && block->used);
+
+	FreeSlot* slot = (FreeSlot*)p;
+	slot->next = block->freeSlots;
+	block->freeSlots = slot;
+	--block->used;
+	--m_used;
+
+	if (!block->isAvailable) {
+		block->isAvailable = true;
+		m_available.push_back(block);
+	}
+
+	if (block->used == 0) {
+		if (m_spare) ReleaseBlock(m_spare);
+		m_spare = block;
+	}
+}
+
+FixedPool::Block* FixedPool::NewBlock() {
+	// Blocks have to be aligned to their size for GetBlock()
+#ifdef _WIN32
+	void* p = VirtualAlloc(NULL, BLOCKSIZE, MEM_RESERVE|MEM_COMMIT, PAGE_READWRITE);
+#else
+	void* p = NULL;
+	if (posix_memalign(&p, BLOCKSIZE, BLOCKSIZE) != 0) p = NULL;
+#endif
+	if (!p) throw std::bad_alloc();
+	assert(GetBlock(p) == p);
+
+	Block* block = (Block*)p;
+	block->pool = this;
+	block->freeSlots = NULL;
+	block->pos = 0;
+	block->used = 0;
+	block->isAvailable = true;
+	return block;
+}
+
+void FixedPool::ReleaseBlock(Block* block) {
+	m_blocks.erase(std::find(m_blocks.begin(), m_blocks.end(), block));
+	m_available.erase(std::find(m_available.begin(), m_available.end(), block));
+	FreeBlock(block);
+}
+
+void FixedPool::FreeBlock(Block* block) {
+#ifdef _WIN32
+	VirtualFree(block, 0, MEM_RELEASE);
+#else
+	free(block);
+#endif
+}
@@ -0,0 +1,80 @@
+/*******************************************************************************
+ *
+ * Copyright (C) 2009, Alexander Stigsen, e-texteditor.com
+ *
+ * This software is licensed under the Open Company License as described
+ * in the file license.txt, which you should have received as part of this
+ * distribution. The terms are also available at http://opencompany.org/license.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ******************************************************************************/
+
+#ifndef __FIXEDPOOL_H__
+#define __FIXEDPOOL_H__
+
+#include <vector>
+#include <cstddef>
+
+// Allocator for many small objects of the same size (like the nodes of
+// the syntax match trees). Slots are carved out of large blocks, so there
+// is no per object overhead, and nodes created together are kept close
+// in memory. Freed slots are reused before the pool grows, and blocks
+// are returned to the heap when all their slots have been freed (one
+// empty block is kept, so alloc/free at a block edge does not thrash).
+//
+// Blocks are aligned to their size and start with a header pointing
+// back to the pool, so GetPool() can find the owner of any slot (objects
+// can then be deleted without knowing which pool they came from).
+//
+// It is not threadsafe, so a pool should only be used by one thread at
+// a time (or be locked by the caller).
+class FixedPool {
+public:
+	FixedPool(size_t slotSize);
+	~FixedPool();
+
+	void* Alloc();
+	void Free(void* p);
+
+	// The pool a slot was allocated from
+	static FixedPool& GetPool(const void* p);
+
+	// Statistics
+	size_t GetSlotSize() const {return m_slotSize;};
+	size_t GetSlotsPerBlock() const {return m_slotsPerBlock;};
+	size_t GetUsedCount() const {return m_used;};
+	size_t GetReservedBytes() const {return m_blocks.size() * BLOCKSIZE;};
+
+	static const size_t BLOCKSIZE;
+
+private:
+	struct FreeSlot {
+		FreeSlot* next;
+	};
+	struct Block { // header at start of block
+		FixedPool* pool;
+		FreeSlot* freeSlots;
+		size_t pos; // next unused slot
+		size_t used;
+		bool isAvailable; // in m_available
+	};
+
+	static Block* GetBlock(const void* p);
+	char* GetData(Block* block) const {return (char*)block + m_headerSize;};
+	bool IsFull(const Block& block) const {return !block.freeSlots && block.pos == m_slotsPerBlock;};
+	Block* NewBlock();
+	void ReleaseBlock(Block* block);
+	static void FreeBlock(Block* block);
+
+	const size_t m_slotSize;
+	const size_t m_headerSize;
+	const size_t m_slotsPerBlock;
+	std::vector<Block*> m_blocks;
+	std::vector<Block*> m_available; // blocks with free slots
+	Block* m_spare; // empty block kept for reuse
+	size_t m_used;
+};
+
+#endif // __FIXEDPOOL_H__
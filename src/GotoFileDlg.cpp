@@ -16,81 +16,11 @@
 #include <map>
 #include <algorithm>
 
-#include <wx/dir.h>
-
 #include "ProjectInfoHandler.h"
+#include "PathIndex.h"
 #include "SearchListBox.h"
 
-class FileEntry {
-public:
-	FileEntry() {};
-	FileEntry(const wxString& dirpath, const wxString& filename);
-	void SetPath(const wxString& path);
-	void Clear();
-
-	wxString name;
-	wxString nameLower;
-	wxString path;
-};
-
-class DirState {
-public:
-	static DirState* FromPath(const wxString& path) {
-		DirState* dirState = new DirState(path);
-		if (dirState->IsOpened()) return dirState;
-
-		delete dirState;
-		return NULL;
-	}
-
-	DirState(const wxString& path):
-		prefix(path + wxFILE_SEP_PATH),
-		walkingFiles(false)
-	{
-		dir.Open(path);
-	}
-
-	bool WalkFolders() {
-		// Find next folder included by our filters.
-		bool found = false, included = false;
-		do {
-			if (nextDirName.empty())
-				found = dir.GetFirst(&nextDirName, wxEmptyString, wxDIR_DIRS);
-			else
-				found = dir.GetNext(&nextDirName);
-
-			included = found && (!filter || filter->IsDirectoryIncluded(nextDirName));
-		} while (found && !included);
-		return found;
-	}
-
-	bool WalkFiles(wxString& file) {
-		// Find next file included by our filters.
-		bool found = false, included = false;
-		do {
-			if (walkingFiles) found = dir.GetNext(&file);
-			else {
-				found = dir.GetFirst(&file, wxEmptyString, wxDIR_FILES);
-				walkingFiles = true;
-			}
-
-			included = found && (!filter || filter->IsFileIncluded(file));
-		} while (found && !included);
-		return found;
-	}
-
-	wxString FullFolderName() const { return prefix + nextDirName; }
-
-	cxProjectInfo* info;
-	const cxProjectInfo* filter;
-	wxString prefix;
-	wxString nextDirName;
-
-private:
-	bool IsOpened() const {return dir.IsOpened();}
-	wxDir dir;
-	bool walkingFiles;
-};
+class FileMatchThread;
 
 class GotoFileList : public SearchListBox {
 public:
@@ -107,6 +37,7 @@ private:
 	int FindPath(const wxString& path) const;
 	void AddFileIfMatching(const wxString& searchtext, FileEntry* file_entry);
 	int FindMatchesAndSelection(const std::map<wxString,wxString>& triggers);
+	void FilterFiles(const std::vector<const FileEntry*>& candidates);
 
 	class aItem {
 	public:
@@ -124,6 +55,10 @@ private:
 		a->swap(*b);
 	};
 
+	friend class FileMatchThread;
+	static bool MatchFile(const wxString& text, const FileEntry& file_entry, std::vector<unsigned int>& hlChars);
+	static void MatchFiles(const wxString& text, const FileEntry* const* begin, const FileEntry* const* end, std::vector<aItem>& items);
+
 	const wxString m_project_root;
 	const std::vector<FileEntry*>& m_actions;
 	unsigned int m_actionCount;
@@ -134,6 +69,24 @@ private:
 	FileEntry* m_tempEntry;	// What is this used for, exactly?
 };
 
+// Matches part of the file list on a worker thread
+class FileMatchThread : public wxThread {
+public:
+	FileMatchThread(const wxString& text, const FileEntry* const* begin, const FileEntry* const* end, std::vector<GotoFileList::aItem>& items)
+		: wxThread(wxTHREAD_JOINABLE), m_text(text.c_str()), m_begin(begin), m_end(end), m_items(items) {};
+
+	virtual void* Entry() {
+		GotoFileList::MatchFiles(m_text, m_begin, m_end, m_items);
+		return NULL;
+	};
+
+private:
+	const wxString m_text;
+	const FileEntry* const* m_begin;
+	const FileEntry* const* m_end;
+	std::vector<GotoFileList::aItem>& m_items;
+};
+
 
 // Ctrl id's
 enum {
@@ -147,18 +100,22 @@ BEGIN_EVENT_TABLE(GotoFileDlg, wxDialog)
 	EVT_LISTBOX_DCLICK(CTRL_ALIST, GotoFileDlg::OnAction)
 	EVT_LISTBOX(CTRL_ALIST, GotoFileDlg::OnListSelection)
 	EVT_SIZE(GotoFileDlg::OnSize)
-	EVT_IDLE(GotoFileDlg::OnIdle)
+	EVT_TIMER(wxID_ANY, GotoFileDlg::OnLoadTimer)
 END_EVENT_TABLE()
 
-GotoFileDlg::GotoFileDlg(wxWindow *parent, ProjectInfoHandler& project):
+GotoFileDlg::GotoFileDlg(wxWindow *parent, ProjectInfoHandler& project, PathIndex& pathIndex):
 	wxDialog (parent, -1, _("Go to File"), wxDefaultPosition, wxDefaultSize, wxDEFAULT_DIALOG_STYLE|wxRESIZE_BORDER),
-	m_project(project), m_isDone(false), m_filesLoaded(false)
+	m_project(project), m_pathIndex(pathIndex), m_isDone(false), m_loadTimer(this)
 {
+	// Get files found so far (the index is shared by all dialogs)
+	m_pathIndex.BeginUse();
+	m_pathIndex.Update();
+
 	// Create controls
 	m_searchCtrl = new wxTextCtrl(this, CTRL_SEARCH, wxEmptyString, wxDefaultPosition, wxDefaultSize, wxTE_PROCESS_ENTER);
 
 	const wxString& project_root = m_project.GetRoot().GetPath();
-	m_cmdList = new GotoFileList(this, CTRL_ALIST, m_files, project_root);
+	m_cmdList = new GotoFileList(this, CTRL_ALIST, m_pathIndex.GetFiles(), project_root);
 	m_pathStatic = new wxStaticText(this, wxID_ANY, wxEmptyString);
 
 	// Add custom event handler
@@ -173,83 +130,23 @@ GotoFileDlg::GotoFileDlg(wxWindow *parent, ProjectInfoHandler& project):
 	SetSizer(mainSizer);
 	SetSize(400, 500);
 	Centre();
+
+	// Show files as they are found if the project is still being scanned
+	if (m_pathIndex.IsScanning()) m_loadTimer.Start(50);
 }
 
 GotoFileDlg::~GotoFileDlg() {
-	// Clean up allocated file entries
-	for (std::vector<FileEntry*>::iterator p = m_files.begin(); p != m_files.end(); ++p) {
-		delete *p;
-	}
-
-	// Clean up allocated dir traversing state
-	for (std::vector<DirState*>::iterator d = m_dirStack.begin(); d != m_dirStack.end(); ++d) {
-		delete *d;
-	}
+	m_loadTimer.Stop();
+	m_pathIndex.EndUse();
 }
 
 const wxString& GotoFileDlg::GetSelection() const {return m_cmdList->GetSelectedAction()->path;}
 const wxString GotoFileDlg::GetTrigger() const {return m_searchCtrl->GetValue();}
 
-void GotoFileDlg::OnIdle(wxIdleEvent& event) {
-	if (!m_project.HasProject()) return; // No project, so no files to load.
-	if (m_filesLoaded) return; // Already done loading files.
-
-	if (m_dirStack.empty()) {
-		const wxString root_path = m_project.GetRoot().GetPath();
-		m_files.reserve(100);
-		BuildFileList(root_path);
-	}
-	else {
-		DirState& dirState = *m_dirStack.back();
-
-		// Get next subdir
-		if (dirState.WalkFolders()) {
-			const wxString fulldirname = dirState.FullFolderName();
-			wxLogDebug(fulldirname);
-			BuildFileList(fulldirname);
-		}
-		else {
-			// All sub-dirs visited
-			if (dirState.info) {
-				m_filters.pop_back();
-				delete dirState.info;
-			}
-
-			delete m_dirStack.back();
-			m_dirStack.pop_back();
-
-			if (m_dirStack.empty())
-				m_filesLoaded = true;
-		}
-	}
-
-	m_cmdList->UpdateList();
-	if (!m_dirStack.empty()) event.RequestMore();
-}
-
-void GotoFileDlg::BuildFileList(const wxString& path) {
-	DirState* dirState = DirState::FromPath(path);
-	if (!dirState) return;
-	
-	m_dirStack.push_back(dirState);
-
-	// Load filters for this dir
-	dirState->info = new cxProjectInfo;
-	if (dirState->info->Load(m_project.GetRoot(), path, true)) {
-		m_filters.push_back(dirState->info);
-	}
-	else {
-		delete dirState->info;
-		dirState->info = NULL;
-	}
-
-	// Set active filter
-	dirState->filter = m_filters.empty() ? NULL : m_filters.back();
-
-	// Get all files
-	wxString eachFilename;
-	while(dirState->WalkFiles(eachFilename))
-		m_files.push_back(new FileEntry(dirState->prefix, eachFilename));
+void GotoFileDlg::OnLoadTimer(wxTimerEvent& WXUNUSED(event)) {
+	const bool isScanning = m_pathIndex.IsScanning();
+	if (m_pathIndex.Update()) m_cmdList->UpdateList();
+	if (!isScanning) m_loadTimer.Stop();
 }
 
 void GotoFileDlg::OnSearch(wxCommandEvent& event) {
@@ -326,27 +223,6 @@ void GotoFileDlg::UpdateStatusbar() {
 	m_pathStatic->SetLabel(path);
 }
 
-// ---- FileEntry ----------------------------------------------------
-
-FileEntry::FileEntry(const wxString& dirpath, const wxString& filename) {
-	name = filename;
-	nameLower = name.Lower();
-	path = dirpath + filename;
-}
-
-void FileEntry::SetPath(const wxString& p) {
-	wxFileName filepath(p);
-	name = filepath.GetFullName();
-	nameLower = name.Lower();
-	path = p;
-}
-
-void FileEntry::Clear() {
-	name.clear();
-	nameLower.clear();
-	path.clear();
-}
-
 // --- ActionList --------------------------------------------------------
 
 GotoFileList::GotoFileList(wxWindow* parent, wxWindowID id, const std::vector<FileEntry*>& actions, const wxString& project_root):
@@ -412,20 +288,24 @@ void GotoFileList::UpdateList(const bool reloadAll) {
 	const FileEntry* selEntry = GetSelectedAction();
 	const int topLine = GetFirstVisibleLine();
 	int selection = -1;
-	const unsigned int startItem = reloadAll ? 0 : m_items.size();
+	if (reloadAll) {
+		m_items.clear();
+		m_actionCount = 0;
+	}
+	const unsigned int startItem = m_items.size();
 
 	// Insert new items
 	if (m_searchText.empty()) {
 		// Copy all actions to items
-		m_items.resize(m_actions.size());
-		for (unsigned int i = startItem; i < m_actions.size(); ++i) {
-			m_items[i].file_entry = m_actions[i];
-			m_items[i].hlChars.clear();
+		const std::vector<unsigned int> noHl;
+		for (unsigned int i = m_actionCount; i < m_actions.size(); ++i) {
+			if (!m_actions[i]->removed) m_items.push_back(aItem(m_actions[i], noHl));
 		}
 	}
 	else {
 		// Copy matching actions to items
 		for (unsigned int i = m_actionCount; i < m_actions.size(); ++i) {
+			if (m_actions[i]->removed) continue;
 			if (m_tempEntry->path.empty() || m_actions[i]->path != m_tempEntry->path)
 				AddFileIfMatching(m_searchText, m_actions[i]);
 		}
@@ -507,9 +387,8 @@ int GotoFileList::FindMatchesAndSelection(const std::map<wxString,wxString>& tri
 }
 
 void GotoFileList::Find(const wxString& searchtext, const std::map<wxString,wxString>& triggers) {
-	m_tempEntry->Clear();
-
 	if (searchtext.empty()) {
+		m_tempEntry->Clear();
 		// Remove highlights
 		m_searchText.clear();
 		SetSelection(-1); // de-select
@@ -519,15 +398,27 @@ void GotoFileList::Find(const wxString& searchtext, const std::map<wxString,wxSt
 	}
 
 	// Convert to lower case for case insensitive search
-	m_searchText = searchtext.Lower();
+	const wxString text = searchtext.Lower();
+
+	// If the search text just got longer, only current matches can still match
+	std::vector<const FileEntry*> candidates;
+	if (!m_searchText.empty() && text.StartsWith(m_searchText)) {
+		candidates.reserve(m_items.size());
+		for (std::vector<aItem>::const_iterator p = m_items.begin(); p != m_items.end(); ++p) {
+			if (p->file_entry != m_tempEntry) candidates.push_back(p->file_entry);
+		}
 
-	// Find all matching filenames
-	m_items.clear();
-	std::vector<unsigned int> hlChars;
-	for (unsigned int i = 0; i < m_actions.size(); ++i)
-		AddFileIfMatching(m_searchText, m_actions[i]);
+		// Files added since the list was last updated have not been matched yet
+		for (unsigned int i = m_actionCount; i < m_actions.size(); ++i) candidates.push_back(m_actions[i]);
+	}
+	else candidates.assign(m_actions.begin(), m_actions.end());
+
+	m_tempEntry->Clear();
+	m_searchText = text;
+	m_actionCount = m_actions.size();
 
-	sort(m_items.begin(), m_items.end());
+	// Find all matching filenames
+	FilterFiles(candidates);
 
 	// Check if we have a matching trigger
 	int selection = FindMatchesAndSelection(triggers);
@@ -550,10 +441,14 @@ void GotoFileList::Find(const wxString& searchtext, const std::map<wxString,wxSt
 void GotoFileList::AddFileIfMatching(const wxString& text, FileEntry* file_entry) {
 	wxASSERT(!text.empty());
 
-	const wxString& name = file_entry->nameLower;
+	std::vector<unsigned int> hlChars;
+	if (MatchFile(text, *file_entry, hlChars)) m_items.push_back(aItem(file_entry, hlChars));
+}
 
-	// The string positions of the characters to highlight. (Note, variable is static!)
-	static std::vector<unsigned int> hlChars;
+bool GotoFileList::MatchFile(const wxString& text, const FileEntry& file_entry, std::vector<unsigned int>& hlChars) { // static
+	const wxString& name = file_entry.nameLower;
+
+	// The string positions of the characters to highlight
 	hlChars.clear();
 
 	unsigned int charpos = 0;
@@ -563,12 +458,66 @@ void GotoFileList::AddFileIfMatching(const wxString& text, FileEntry* file_entry
 
 		hlChars.push_back(textpos);
 		++charpos;
-		if (charpos == text.size()) {
-			// All chars found.
-			m_items.push_back(aItem(file_entry, hlChars));
-			break;
+		if (charpos == text.size()) return true; // All chars found.
+		c = text[charpos];
+	}
+
+	return false;
+}
+
+void GotoFileList::MatchFiles(const wxString& text, const FileEntry* const* begin, const FileEntry* const* end, std::vector<aItem>& items) { // static
+	std::vector<unsigned int> hlChars;
+	for (const FileEntry* const* p = begin; p != end; ++p) {
+		if (!(*p)->removed && MatchFile(text, **p, hlChars)) items.push_back(aItem(*p, hlChars));
+	}
+	sort(items.begin(), items.end());
+}
+
+void GotoFileList::FilterFiles(const std::vector<const FileEntry*>& candidates) {
+	m_items.clear();
+	if (candidates.empty()) return;
+
+	const FileEntry* const* const begin = &candidates[0];
+	const size_t count = candidates.size();
+
+	// Large lists are matched and ranked in parallel
+	unsigned int threadCount = 1;
+	if (count >= 10000) {
+		const int cpuCount = wxThread::GetCPUCount();
+		if (cpuCount > 1) threadCount = wxMin(cpuCount, 8);
+	}
+	if (threadCount == 1) {
+		MatchFiles(m_searchText, begin, begin + count, m_items);
+		return;
+	}
+
+	const size_t chunkSize = (count + threadCount - 1) / threadCount;
+	std::vector< std::vector<aItem> > results(threadCount);
+	std::vector<FileMatchThread*> threads;
+	for (unsigned int i = 1; i < threadCount; ++i) {
+		const FileEntry* const* const chunkBegin = begin + wxMin(i * chunkSize, count);
+		const FileEntry* const* const chunkEnd = begin + wxMin((i+1) * chunkSize, count);
+
+		FileMatchThread* thread = new FileMatchThread(m_searchText, chunkBegin, chunkEnd, results[i]);
+		if (thread->Create() == wxTHREAD_NO_ERROR && thread->Run() == wxTHREAD_NO_ERROR) threads.push_back(thread);
+		else {
+			delete thread;
+			MatchFiles(m_searchText, chunkBegin, chunkEnd, results[i]);
 		}
-		else c = text[charpos];
+	}
+	MatchFiles(m_searchText, begin, begin + wxMin(chunkSize, count), results[0]);
+
+	for (std::vector<FileMatchThread*>::iterator p = threads.begin(); p != threads.end(); ++p) {
+		(*p)->Wait();
+		delete *p;
+	}
+
+	// Merge the sorted chunks
+	m_items.swap(results[0]);
+	for (unsigned int i = 1; i < threadCount; ++i) {
+		const size_t mid = m_items.size();
+		m_items.insert(m_items.end(), results[i].begin(), results[i].end());
+		inplace_merge(m_items.begin(), m_items.begin() + mid, m_items.end());
 	}
 }
 
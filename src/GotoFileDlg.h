@@ -19,24 +19,21 @@
 #include <wx/wx.h>
 #endif
 
-#include <vector>
+#include <wx/timer.h>
 
 class ProjectInfoHandler;
-class cxProjectInfo;
+class PathIndex;
 class GotoFileList;
-class FileEntry;
-class DirState;
 
 class GotoFileDlg : public wxDialog {
 public:
-	GotoFileDlg(wxWindow *parent, ProjectInfoHandler& project);
+	GotoFileDlg(wxWindow *parent, ProjectInfoHandler& project, PathIndex& pathIndex);
 	~GotoFileDlg();
 
 	const wxString& GetSelection() const;
 	const wxString GetTrigger() const;
 
 private:
-	void BuildFileList(const wxString& path);
 	void UpdateStatusbar();
 
 	// Event handlers
@@ -45,18 +42,14 @@ private:
 	void OnListSelection(wxCommandEvent& event);
 	void OnSearchChar(wxKeyEvent& event);
 	void OnSize(wxSizeEvent& event);
-	void OnIdle(wxIdleEvent& event);
+	void OnLoadTimer(wxTimerEvent& event);
 	DECLARE_EVENT_TABLE();
 
 	// Member variables
 	ProjectInfoHandler& m_project;
-	std::vector<FileEntry*> m_files;
+	PathIndex& m_pathIndex;
 	bool m_isDone;
-
-	// Dir traversing state
-	bool m_filesLoaded;
-	std::vector<DirState*> m_dirStack;
-	std::vector<cxProjectInfo*> m_filters;
+	wxTimer m_loadTimer; // polls for files while index is being scanned
 
 	// Ctrls
 	wxTextCtrl* m_searchCtrl;
@@ -507,24 +507,15 @@ bool wxIEHtmlWin::AppendString(const wxString& html) {
 		return false;
 	wxAutoOleInterface<IHTMLElement> body(_body);
 
-	// get inner text
-    BSTR text = NULL;
-    hr = E_FAIL;
-
-	hr = body->get_innerHTML(&text);
-    if (hr != S_OK) return false;
-
-    wxString s = text;
-    SysFreeString(text);
-
-	// append the new text
-	s += html;
-
-	// update inner text
-	hr = body->put_innerHTML((BSTR) (const wchar_t *) s.wc_str(wxConvUTF8));
-    if (hr != S_OK) return false;
-
-    return true;
+	// insert the new html after existing content
+	// (so we don't have to re-parse the whole body)
+	BSTR where = SysAllocString(L"beforeEnd");
+	BSTR text = SysAllocString(html.wc_str(wxConvUTF8));
+	hr = body->insertAdjacentHTML(where, text);
+	SysFreeString(where);
+	SysFreeString(text);
+
+    return hr == S_OK;
 }
 
 wxString wxIEHtmlWin::GetRealLocation()
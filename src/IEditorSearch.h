@@ -13,6 +13,10 @@ public:
 	virtual bool Replace(const wxString& searchtext, const wxString& replacetext, int options=0) = 0;
 	virtual int ReplaceAll(const wxString& searchtext, const wxString& replacetext, int options=0) = 0;
 	virtual void ClearSearchHighlight() = 0;
+
+	// Position of the current match among the highlighted ones
+	// (false while the count is not yet known)
+	virtual bool GetMatchCount(unsigned int& index, unsigned int& count) = 0;
 };
 
 #endif // __IEDITORSEARCH_H__
@@ -20,6 +20,7 @@ public:
 	virtual ~IHtmlWnd() {};
 	virtual wxWindow* GetWindow() = 0;
 	virtual bool LoadString(const wxString& html, bool prependHtml=true) = 0;
+	virtual bool AppendString(const wxString& html) = 0; // adds to end of body
 	virtual void LoadUrl(const wxString &_url, const wxString &_frame = wxEmptyString, bool keepHistory=false) = 0;
 	virtual bool Refresh(wxHtmlRefreshLevel level) = 0;
 	virtual bool GoBack() = 0;
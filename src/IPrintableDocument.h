@@ -7,7 +7,7 @@ class IPrintableDocument {
 public:
 	virtual wxString GetName() const = 0;
 	virtual const DocumentWrapper& GetDocument() const = 0;
-	virtual const vector<unsigned int>& GetOffsets() const = 0;
+	virtual void GetOffsets(vector<unsigned int>& offsets) const = 0;
 };
 
 #endif // __IPRINTABLEDOCUMEHT_H__
@@ -0,0 +1,263 @@
+/*******************************************************************************
+ *
+ * Copyright (C) 2009, Alexander Stigsen, e-texteditor.com
+ *
+ * This software is licensed under the Open Company License as described
+ * in the file license.txt, which you should have received as part of this
+ * distribution. The terms are also available at http://opencompany.org/license.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ******************************************************************************/
+
+#include "LineDiff.h"
+#include "SimdScan.h"
+#include <algorithm>
+#include <cstring>
+
+// Initializing static constants
+const unsigned int LineDiff::MAXCHAIN = 64; // lines occurring more often are not used as anchors
+const unsigned int LineDiff::MAXDEPTH = 256;
+const unsigned int LineDiff::NONE = (unsigned int)-1;
+
+namespace {
+	// Utf-8 continuation byte
+	inline bool IsTrailByte(char c) {
+		return (c & 0xC0) == 0x80;
+	}
+}
+
+LineDiff::LineDiff()
+: m_text1(NULL), m_text2(NULL), m_cancel(false) {
+}
+
+void LineDiff::Diff(const char* text1, unsigned int len1, const char* text2, unsigned int len2, std::vector<Match>& matches, unsigned int offset1, unsigned int offset2) {
+	m_text1 = text1;
+	m_text2 = text2;
+	SplitLines(text1, len1, m_lines1);
+	SplitLines(text2, len2, m_lines2);
+	m_lineMatches.clear();
+
+	// Equal lines at the end are matched up front, so the recursion does
+	// not have to find them
+	const unsigned int n1 = m_lines1.size();
+	const unsigned int n2 = m_lines2.size();
+	unsigned int tail = 0;
+	while (tail < n1 && tail < n2 && IsEqual(n1-tail-1, n2-tail-1)) ++tail;
+
+	DiffLines(0, n1-tail, 0, n2-tail, 0);
+	if (tail) AddLines(n1-tail, n2-tail, tail);
+
+	Refine(len1, len2, matches);
+
+	if (offset1 || offset2) {
+		for (std::vector<Match>::iterator p = matches.begin(); p != matches.end(); ++p) {
+			p->start1 += offset1;
+			p->start2 += offset2;
+		}
+	}
+
+	m_buckets.clear();
+	m_chain.clear();
+	m_lineMatches.clear();
+}
+
+void LineDiff::SplitLines(const char* text, unsigned int len, std::vector<Line>& lines) { // static
+	lines.clear();
+
+	const char* const end = text + len;
+	const char* start = text;
+	const char* p = text;
+	while (p < end) {
+		p = FindEol(p, end);
+		if (p == end) break;
+		if (*p++ != '\n') continue; // documents only have "\n" newlines
+
+		Line line;
+		line.start = start - text;
+		line.len = p - start;
+		line.hash = Hash(start, line.len);
+		lines.push_back(line);
+		start = p;
+	}
+
+	if (start < end) {
+		Line line;
+		line.start = start - text;
+		line.len = end - start;
+		line.hash = Hash(start, line.len);
+		lines.push_back(line);
+	}
+}
+
+unsigned int LineDiff::Hash(const char* text, unsigned int len) { // static
+	unsigned int h = 2166136261u ^ len;
+	const char* p = text;
+	const char* const end = text + len;
+
+	// A word at a time
+	for (; p + sizeof(unsigned int) <= end; p += sizeof(unsigned int)) {
+		unsigned int w;
+		memcpy(&w, p, sizeof(unsigned int));
+		h = (h ^ w) * 0x9E3779B1u;
+		h ^= h >> 15;
+	}
+	for (; p < end; ++p) h = (h ^ (unsigned char)*p) * 16777619u;
+
+	return h ^ (h >> 16); // low bits are used for buckets
+}
+
+bool LineDiff::IsEqual(unsigned int line1, unsigned int line2) const {
+	const Line& l1 = m_lines1[line1];
+	const Line& l2 = m_lines2[line2];
+	return l1.hash == l2.hash && l1.len == l2.len && memcmp(m_text1 + l1.start, m_text2 + l2.start, l1.len) == 0;
+}
+
+void LineDiff::DiffLines(unsigned int a0, unsigned int a1, unsigned int b0, unsigned int b1, unsigned int depth) {
+	// Only the part before each anchor recurses, the rest is done
+	// in the loop (so a long list of changes does not go deep)
+	while (!m_cancel) {
+		// Equal lines at start
+		unsigned int n = 0;
+		while (a0 + n < a1 && b0 + n < b1 && IsEqual(a0 + n, b0 + n)) ++n;
+		if (n) {
+			AddLines(a0, b0, n);
+			a0 += n;
+			b0 += n;
+		}
+		if (a0 == a1 || b0 == b1) return;
+
+		// If no lines can be matched, it is all one change
+		unsigned int as, ae, bs;
+		if (depth == MAXDEPTH || !FindAnchor(a0, a1, b0, b1, as, ae, bs)) return;
+
+		DiffLines(a0, as, b0, bs, depth+1);
+		AddLines(as, bs, ae - as);
+
+		b0 = bs + (ae - as);
+		a0 = ae;
+	}
+}
+
+bool LineDiff::FindAnchor(unsigned int a0, unsigned int a1, unsigned int b0, unsigned int b1, unsigned int& as, unsigned int& ae, unsigned int& bs) {
+	// Index the lines of the first range by hash (chained in order, in
+	// a table at least twice the size of the range)
+	unsigned int size = 64;
+	while (size < 2 * (a1 - a0)) size <<= 1;
+	const unsigned int mask = size - 1;
+	m_buckets.assign(size, NONE);
+	m_chain.resize(a1 - a0);
+	for (unsigned int a = a1; a-- > a0; ) {
+		const unsigned int bucket = m_lines1[a].hash & mask;
+		m_chain[a - a0] = m_buckets[bucket];
+		m_buckets[bucket] = a;
+	}
+
+	// Find the run of equal lines with the least occurrences. Among
+	// equally rare ones the longest wins, and then the one nearest the
+	// middle (so the recursion stays balanced).
+	const unsigned int middle = b0 + (b1 - b0) / 2;
+	unsigned int bestCount = MAXCHAIN + 1;
+	unsigned int bestLen = 0;
+	unsigned int bestDist = 0;
+	for (unsigned int b = b0; b < b1 && !m_cancel; ) {
+		const unsigned int hash = m_lines2[b].hash;
+		const unsigned int first = m_buckets[hash & mask];
+
+		unsigned int count = 0;
+		for (unsigned int a = first; a != NONE && count <= MAXCHAIN; a = m_chain[a - a0]) {
+			if (m_lines1[a].hash == hash) ++count;
+		}
+
+		unsigned int next = b + 1;
+		if (count && count <= bestCount && count <= MAXCHAIN) {
+			for (unsigned int a = first; a != NONE; a = m_chain[a - a0]) {
+				if (!IsEqual(a, b)) continue;
+
+				// Extend the run both ways
+				unsigned int s = 0;
+				while (a - s > a0 && b - s > b0 && IsEqual(a-s-1, b-s-1)) ++s;
+				unsigned int e = 1;
+				while (a + e < a1 && b + e < b1 && IsEqual(a+e, b+e)) ++e;
+
+				// Lines in the run do not have to be tried again
+				if (b + e > next) next = b + e;
+
+				const unsigned int len = s + e;
+				const unsigned int start = b - s;
+				const unsigned int dist = (start + len/2 > middle) ? start + len/2 - middle : middle - (start + len/2);
+				if (count < bestCount || len > bestLen || (len == bestLen && dist < bestDist)) {
+					bestCount = count;
+					bestLen = len;
+					bestDist = dist;
+					as = a - s;
+					ae = a + e;
+					bs = start;
+				}
+			}
+		}
+
+		b = next;
+	}
+
+	return bestLen > 0;
+}
+
+void LineDiff::AddLines(unsigned int line1, unsigned int line2, unsigned int count) {
+	const Line& last = m_lines1[line1 + count - 1];
+	const unsigned int start1 = m_lines1[line1].start;
+	AddMatch(m_lineMatches, start1, m_lines2[line2].start, (last.start + last.len) - start1);
+}
+
+void LineDiff::AddMatch(std::vector<Match>& matches, unsigned int start1, unsigned int start2, unsigned int len) const {
+	if (len == 0) return;
+
+	if (!matches.empty()) {
+		Match& m = matches.back();
+		if (m.end1() == start1 && m.end2() == start2) {
+			m.len += len;
+			return;
+		}
+	}
+
+	matches.push_back(Match(start1, start2, len));
+}
+
+void LineDiff::Refine(unsigned int len1, unsigned int len2, std::vector<Match>& matches) const {
+	matches.clear();
+	matches.reserve(m_lineMatches.size() + 1);
+
+	unsigned int pos1 = 0;
+	unsigned int pos2 = 0;
+	for (size_t i = 0; i <= m_lineMatches.size(); ++i) {
+		const bool isLast = (i == m_lineMatches.size());
+		const unsigned int end1 = isLast ? len1 : m_lineMatches[i].start1;
+		const unsigned int end2 = isLast ? len2 : m_lineMatches[i].start2;
+
+		// Narrow the changed text with the bytes it starts and ends with
+		const unsigned int gap1 = end1 - pos1;
+		const unsigned int gap2 = end2 - pos2;
+		if (gap1 && gap2) {
+			const unsigned int maxLen = std::min(gap1, gap2);
+
+			unsigned int head = 0;
+			while (head < maxLen && m_text1[pos1+head] == m_text2[pos2+head]) ++head;
+			while (head && ((head < gap1 && IsTrailByte(m_text1[pos1+head])) || (head < gap2 && IsTrailByte(m_text2[pos2+head])))) --head;
+
+			unsigned int tail = 0;
+			while (tail < maxLen - head && m_text1[end1-tail-1] == m_text2[end2-tail-1]) ++tail;
+			while (tail && IsTrailByte(m_text1[end1-tail])) --tail;
+
+			AddMatch(matches, pos1, pos2, head);
+			AddMatch(matches, end1 - tail, end2 - tail, tail);
+		}
+
+		if (isLast) break;
+
+		const Match& m = m_lineMatches[i];
+		AddMatch(matches, m.start1, m.start2, m.len);
+		pos1 = m.end1();
+		pos2 = m.end2();
+	}
+}
@@ -0,0 +1,86 @@
+/*******************************************************************************
+ *
+ * Copyright (C) 2009, Alexander Stigsen, e-texteditor.com
+ *
+ * This software is licensed under the Open Company License as described
+ * in the file license.txt, which you should have received as part of this
+ * distribution. The terms are also available at http://opencompany.org/license.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ******************************************************************************/
+
+#ifndef __LINEDIFF_H__
+#define __LINEDIFF_H__
+
+#include <vector>
+#include <cstddef>
+
+// Diff of two texts by lines, using histogram diff (as in git): the
+// lines are hashed, and the ranges are split recursively around the
+// run of equal lines that occurs the least times in the first text
+// (unique lines first, like patience diff).
+//
+// The text left between the matched lines is narrowed with the bytes
+// it starts and ends with in both texts (not splitting utf-8 chars),
+// so a change inside a line only marks the changed part.
+//
+// It does not touch any shared state, so it can run in a worker thread.
+class LineDiff {
+public:
+	class Match {
+	public:
+		Match(unsigned int s1, unsigned int s2, unsigned int l) : start1(s1), start2(s2), len(l) {};
+		unsigned int end1() const {return start1 + len;};
+		unsigned int end2() const {return start2 + len;};
+
+		unsigned int start1;
+		unsigned int start2;
+		unsigned int len;
+	};
+
+	LineDiff();
+
+	// The matching ranges of the texts (in order, not adjacent). The
+	// positions are offset by offset1/offset2, so a part of a larger text
+	// can be diffed.
+	void Diff(const char* text1, unsigned int len1, const char* text2, unsigned int len2, std::vector<Match>& matches, unsigned int offset1=0, unsigned int offset2=0);
+
+	// Can be called from another thread to stop a running diff
+	// (leaving the result incomplete)
+	void Cancel() {m_cancel = true;};
+	bool IsCancelled() const {return m_cancel;};
+
+private:
+	struct Line {
+		unsigned int start;
+		unsigned int len; // including newline
+		unsigned int hash;
+	};
+
+	static void SplitLines(const char* text, unsigned int len, std::vector<Line>& lines);
+	static unsigned int Hash(const char* text, unsigned int len);
+
+	bool IsEqual(unsigned int line1, unsigned int line2) const;
+	void DiffLines(unsigned int a0, unsigned int a1, unsigned int b0, unsigned int b1, unsigned int depth);
+	bool FindAnchor(unsigned int a0, unsigned int a1, unsigned int b0, unsigned int b1, unsigned int& as, unsigned int& ae, unsigned int& bs);
+	void AddLines(unsigned int line1, unsigned int line2, unsigned int count);
+	void AddMatch(std::vector<Match>& matches, unsigned int start1, unsigned int start2, unsigned int len) const;
+	void Refine(unsigned int len1, unsigned int len2, std::vector<Match>& matches) const;
+
+	static const unsigned int MAXCHAIN;
+	static const unsigned int MAXDEPTH;
+	static const unsigned int NONE;
+
+	const char* m_text1;
+	const char* m_text2;
+	std::vector<Line> m_lines1;
+	std::vector<Line> m_lines2;
+	std::vector<Match> m_lineMatches; // unrefined
+	std::vector<unsigned int> m_buckets; // first line in each bucket (in FindAnchor)
+	std::vector<unsigned int> m_chain;   // next line in same bucket (by line - a0)
+	volatile bool m_cancel;
+};
+
+#endif // __LINEDIFF_H__
@@ -36,9 +36,8 @@ public:
 	virtual unsigned int EndFromPos(unsigned int pos) = 0;
 	virtual unsigned int StartFromPos(unsigned int pos) = 0;
 
-	virtual std::vector<unsigned int>& GetOffsets() = 0;
+	virtual void GetOffsets(std::vector<unsigned int>& offsets) const = 0;
 	virtual void SetOffsets(const std::vector<unsigned int>& offsets) = 0;
-	virtual void NewOffsets() = 0;
 
 	virtual void insert(unsigned int index, int newend) = 0;
 	virtual void insertlines(unsigned int index, std::vector<unsigned int>& newlines) = 0;
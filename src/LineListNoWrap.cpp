@@ -19,17 +19,17 @@ LineListNoWrap::LineListNoWrap(FixedLine& l, const DocumentWrapper& dw):
 	m_line(l), m_doc(dw), m_maxWidth(0) {}
 
 bool LineListNoWrap::IsValidIndex(unsigned int index) const {
-	return (index < m_textOffsets.size());
+	return (index < m_lengths.GetCount());
 }
 
 unsigned int LineListNoWrap::offset(unsigned int index) {
 	wxASSERT(IsValidIndex(index));
-	return index ? m_textOffsets[index-1] : 0;
+	return m_lengths.GetSum(index);
 }
 
 unsigned int LineListNoWrap::end(unsigned int index) {
 	wxASSERT(IsValidIndex(index));
-	return m_textOffsets[index];
+	return m_lengths.GetSum(index+1);
 }
 
 unsigned int LineListNoWrap::top(unsigned int index) {
@@ -43,126 +43,131 @@ unsigned int LineListNoWrap::bottom(unsigned int index) {
 }
 
 unsigned int LineListNoWrap::size() const {
-	return m_textOffsets.size();
+	return m_lengths.GetCount();
 }
 
 unsigned int LineListNoWrap::last() const {
-	wxASSERT(!m_textOffsets.empty());
-	return m_textOffsets.size()-1;
+	wxASSERT(!m_lengths.IsEmpty());
+	return m_lengths.GetCount()-1;
 }
 
 unsigned int LineListNoWrap::height() const {
-	return m_textOffsets.size() * m_line.GetCharHeight();
+	return m_lengths.GetCount() * m_line.GetCharHeight();
 }
 
 unsigned int LineListNoWrap::length() const {
-	return (!m_textOffsets.empty()) ? m_textOffsets.back() : 0;
+	return m_lengths.GetTotal();
 }
 
 bool LineListNoWrap::IsLineEnd(unsigned int pos) {
 	if (!size()) return false;
-	wxASSERT(pos <= m_textOffsets.back());
+	wxASSERT(pos <= length());
 
-	std::vector<unsigned int>::const_iterator posline = lower_bound(m_textOffsets.begin(), m_textOffsets.end(), pos);
-	return (pos == *posline);
+	return pos == end(find_offset(pos));
 }
 
 unsigned int LineListNoWrap::EndFromPos(unsigned int pos) {
 	if (!size()) return 0;
-	wxASSERT(pos <= m_textOffsets.back());
+	wxASSERT(pos <= length());
 
-	std::vector<unsigned int>::const_iterator posline = lower_bound(m_textOffsets.begin(), m_textOffsets.end(), pos);
-	if (pos != *posline) return *posline;
-	return pos == m_textOffsets.back() ? pos : *(++posline);
+	const unsigned int index = find_offset(pos);
+	const unsigned int lineEnd = end(index);
+	if (pos != lineEnd) return lineEnd;
+	return index == last() ? pos : end(index+1);
 }
 
 unsigned int LineListNoWrap::StartFromPos(unsigned int pos) {
 	if (!size()) return 0;
-	wxASSERT(pos <= m_textOffsets.back());
+	wxASSERT(pos <= length());
 
-	std::vector<unsigned int>::const_iterator posline = lower_bound(m_textOffsets.begin(), m_textOffsets.end(), pos);
-	if (pos == *posline) return pos;
-	return (posline == m_textOffsets.begin()) ? 0 : *(--posline);
+	const unsigned int index = find_offset(pos);
+	if (pos == end(index)) return pos;
+	return offset(index);
 }
 
-std::vector<unsigned int>& LineListNoWrap::GetOffsets() {
-	return m_textOffsets;
+void LineListNoWrap::GetOffsets(std::vector<unsigned int>& offsets) const {
+	m_lengths.GetValues(offsets);
+
+	// Convert lengths to end offsets
+	unsigned int lineEnd = 0;
+	for (std::vector<unsigned int>::iterator p = offsets.begin(); p != offsets.end(); ++p) {
+		lineEnd = *p += lineEnd;
+	}
 }
 
 void LineListNoWrap::SetOffsets(const vector<unsigned int>& offsets) {
-	m_textOffsets = offsets;
-	NewOffsets();
+	// Store the lengths of the lines
+	vector<unsigned int> lengths(offsets.size());
+	unsigned int lineStart = 0;
+	for (unsigned int i = 0; i < offsets.size(); ++i) {
+		wxASSERT(offsets[i] > lineStart);
+		lengths[i] = offsets[i] - lineStart;
+		lineStart = offsets[i];
+	}
+	m_lengths.Assign(lengths);
+
+	UpdateWidths();
 }
 
-// You have to call this after textOffsets heve been modified using GetOffsets()
-void LineListNoWrap::NewOffsets() {
-	m_lineWidths.resize(m_textOffsets.size());
+void LineListNoWrap::UpdateWidths() {
+	vector<unsigned int> widths;
+	m_lengths.GetValues(widths);
 
 	// Get all line widths
 	m_maxWidth = 0;
 	unsigned int lineStart = 0;
-	for (unsigned int i = 0; i < m_textOffsets.size(); ++i) {
-		const unsigned int lineWidth = m_line.GetQuickLineWidth(lineStart, m_textOffsets[i]);
+	for (std::vector<unsigned int>::iterator p = widths.begin(); p != widths.end(); ++p) {
+		const unsigned int lineEnd = lineStart + *p;
+		const unsigned int lineWidth = m_line.GetQuickLineWidth(lineStart, lineEnd);
 
-		m_lineWidths[i] = lineWidth;
-		lineStart = m_textOffsets[i];
+		*p = lineWidth;
+		lineStart = lineEnd;
 		if (lineWidth > m_maxWidth) m_maxWidth = lineWidth;
 	}
+	m_lineWidths.Assign(widths);
 }
 
 void LineListNoWrap::insert(unsigned int index, int newend) {
-	wxASSERT(index >= 0 && index <= m_textOffsets.size());
+	wxASSERT(index >= 0 && index <= m_lengths.GetCount());
 	wxASSERT(newend <= (int)m_doc.GetLength());
 
-	// Insert the text
-	m_textOffsets.insert(m_textOffsets.begin()+index, newend);
-
-	// Update the following offsets
-	const unsigned int diff = newend - (index ? m_textOffsets[index-1] : 0);
-	for (std::vector<unsigned int>::iterator p = m_textOffsets.begin()+index+1; p != m_textOffsets.end(); ++p) {
-		*p += diff;
-	}
+	// Insert the line (the following lines keep their lengths)
+	const unsigned int start = m_lengths.GetSum(index);
+	wxASSERT(newend > (int)start);
+	m_lengths.Insert(index, newend - start);
 
 	// Width of new line depends on syntax and theme
 	// so just set it to 0 for now, it will be updated when parsed
-	m_lineWidths.insert(m_lineWidths.begin()+index, 0);
+	m_lineWidths.Insert(index, 0);
 }
 
 void LineListNoWrap::insertlines(unsigned int index, vector<unsigned int>& newlines) {
-	wxASSERT(index >= 0 && index <= m_textOffsets.size());
+	wxASSERT(index >= 0 && index <= m_lengths.GetCount());
 	wxASSERT(!newlines.empty());
 
-	// Insert the lines
-	m_textOffsets.insert(m_textOffsets.begin()+index, newlines.begin(), newlines.end());
-
-	// Update the following offsets
-	const unsigned int diff = newlines.back() - (index ? m_textOffsets[index-1] : 0);
-	for (std::vector<unsigned int>::iterator p = m_textOffsets.begin() + index + newlines.size(); p != m_textOffsets.end(); ++p) {
-		*p += diff;
+	// Insert the lines (the following lines keep their lengths)
+	vector<unsigned int> lengths(newlines.size());
+	unsigned int lineStart = m_lengths.GetSum(index);
+	for (unsigned int i = 0; i < newlines.size(); ++i) {
+		wxASSERT(newlines[i] > lineStart);
+		lengths[i] = newlines[i] - lineStart;
+		lineStart = newlines[i];
 	}
-
-	// Insert width of the new lines
-	m_lineWidths.insert(m_lineWidths.begin()+index, newlines.size(), 0);
-	const unsigned int newlinesEnd = index + newlines.size();
+	m_lengths.Insert(index, lengths);
 
 	// Width of new lines depends on syntax and theme
 	// so just set it to 0 for now, it will be updated when parsed
-	for (unsigned int i = index; i < newlinesEnd; ++i) {
-		m_lineWidths[i] = 0;
-	}
+	m_lineWidths.Insert(index, 0, newlines.size());
 }
 
 void LineListNoWrap::update(unsigned int index, unsigned int newend) {
 	wxASSERT(IsValidIndex(index));
 	wxASSERT(newend <= m_doc.GetLength());
 
-	// Calc the change
-	const int tdiff = newend - m_textOffsets[index];
-
-	// Update the changed and following offsets
-	for (std::vector<unsigned int>::iterator p = m_textOffsets.begin()+index; p != m_textOffsets.end(); ++p) {
-		*p += tdiff;
-	}
+	// Update the changed line (the following lines keep their lengths)
+	const unsigned int start = m_lengths.GetSum(index);
+	wxASSERT(newend > start);
+	m_lengths.Set(index, newend - start);
 
 	// Width of new line depends on syntax and theme
 	// so leave it for now, it will be updated when parsed
@@ -171,77 +176,66 @@ void LineListNoWrap::update(unsigned int index, unsigned int newend) {
 void LineListNoWrap::update_parsed_line(unsigned int index) {
 	wxASSERT(IsValidIndex(index));
 
-	m_line.SetLine((index ? m_textOffsets[index-1] : 0), m_textOffsets[index]);
-	const unsigned int oldWidth = m_lineWidths[index];
+	m_line.SetLine(offset(index), end(index));
+	const unsigned int oldWidth = m_lineWidths.Get(index);
 	const unsigned int lineWidth = m_line.GetUnwrappedWidth();
-	m_lineWidths[index] = lineWidth;
+	m_lineWidths.Set(index, lineWidth);
 
 	// Calc maxWidth
 	if (lineWidth > m_maxWidth) m_maxWidth = lineWidth;
 	else if (oldWidth == m_maxWidth) {
 		// If this line could have been the widest, we have
 		// to calc m_maxWidth against all lines.
-		m_maxWidth = *max_element(m_lineWidths.begin(), m_lineWidths.end());
+		m_maxWidth = m_lineWidths.GetMax();
 	}
 }
 
 void LineListNoWrap::update_line_extent(unsigned int index, unsigned int extent) {
 	wxASSERT(IsValidIndex(index));
-	if (extent == m_lineWidths[index]) return; // no change
+	const unsigned int oldWidth = m_lineWidths.Get(index);
+	if (extent == oldWidth) return; // no change
 
-	const unsigned int oldWidth = m_lineWidths[index];
-	m_lineWidths[index] = extent;
+	m_lineWidths.Set(index, extent);
 
 	// Calc maxWidth
 	if (extent > m_maxWidth) m_maxWidth = extent;
 	else if (oldWidth == m_maxWidth) {
 		// If this line could have been the widest, we have
 		// to calc m_maxWidth against all lines.
-		m_maxWidth = *max_element(m_lineWidths.begin(), m_lineWidths.end());
+		m_maxWidth = m_lineWidths.GetMax();
 	}
 }
 
 void LineListNoWrap::remove(unsigned int startline, unsigned int endline) {
-	wxASSERT(startline >= 0 && startline < m_textOffsets.size());
-	wxASSERT(endline > startline && endline <= m_textOffsets.size());
+	wxASSERT(startline >= 0 && startline < m_lengths.GetCount());
+	wxASSERT(endline > startline && endline <= m_lengths.GetCount());
 	wxASSERT(size());
 
-	const unsigned int maxWidth = *max_element(m_lineWidths.begin()+startline, m_lineWidths.begin()+endline);
+	// Remove text lines (the following lines keep their lengths)
+	m_lengths.Erase(startline, endline);
+	m_lineWidths.Erase(startline, endline);
 
-	// Remove text lines
-	const int diff = offset(startline) - end(endline-1);
-	m_textOffsets.erase(m_textOffsets.begin()+startline, m_textOffsets.begin()+endline);
-	m_lineWidths.erase(m_lineWidths.begin()+startline, m_lineWidths.begin()+endline);
-
-	if (m_textOffsets.empty()) {
+	if (m_lengths.IsEmpty()) {
 		m_maxWidth = 0;
 		return;
 	}
 
-	// Update the following offsets
-	for (vector<unsigned int>::iterator p = m_textOffsets.begin()+startline; p != m_textOffsets.end(); ++p) {
-		*p += diff;
-	}
-
-	// If one of the lines could have been the widest,
-	// we have to calc m_maxWidth against all lines.
-	if (maxWidth == m_maxWidth) {
-		m_maxWidth = *max_element(m_lineWidths.begin(), m_lineWidths.end());
-	}
+	// One of the lines could have been the widest
+	m_maxWidth = m_lineWidths.GetMax();
 }
 
 void LineListNoWrap::clear() {
-	m_textOffsets.clear();
-	m_lineWidths.clear();
+	m_lengths.Clear();
+	m_lineWidths.Clear();
 	m_maxWidth = 0;
 }
 
 int LineListNoWrap::find_offset(int pos) {
 	if (!size()) return 0;
-	wxASSERT(pos >= 0 && pos <= (int)m_textOffsets.back());
+	wxASSERT(pos >= 0 && pos <= (int)length());
 
-	std::vector<unsigned int>::iterator posline = lower_bound(m_textOffsets.begin(), m_textOffsets.end(), (unsigned int)pos);
-	return distance(m_textOffsets.begin(), posline);
+	// First line ending at or after pos
+	return pos ? m_lengths.Find(pos-1) : 0;
 }
 
 int LineListNoWrap::find_ypos(unsigned int ypos) {
@@ -252,7 +246,7 @@ int LineListNoWrap::find_ypos(unsigned int ypos) {
 }
 
 void LineListNoWrap::invalidate(int WXUNUSED(index)) {
-	NewOffsets(); // to recalculate m_maxWidth
+	UpdateWidths(); // to recalculate m_maxWidth
 }
 
 void LineListNoWrap::Print() {
@@ -261,10 +255,10 @@ void LineListNoWrap::Print() {
 	wxLogDebug(wxT(" height:     %u"), height());
 
 	for (unsigned int i = 0; i < size(); ++i) {
-		wxLogDebug(wxT("  %u: %u %u"), i, m_textOffsets[i], m_lineWidths[i]);
+		wxLogDebug(wxT("  %u: %u %u"), i, m_lengths.GetSum(i+1), m_lineWidths.Get(i));
 	}
 }
 
 void LineListNoWrap::verify(bool WXUNUSED(deep)) const {
-	wxASSERT(m_textOffsets.size() == m_lineWidths.size());
+	wxASSERT(m_lengths.GetCount() == m_lineWidths.GetCount());
 }
@@ -15,6 +15,7 @@
 #define __LINELISTNOWRAP_H__
 
 #include "LineList.h"
+#include "PrefixSumTree.h"
 
 class FixedLine;
 class DocumentWrapper;
@@ -39,9 +40,8 @@ public:
 	unsigned int EndFromPos(unsigned int pos);
 	unsigned int StartFromPos(unsigned int pos);
 
-	std::vector<unsigned int>& GetOffsets();
+	void GetOffsets(std::vector<unsigned int>& offsets) const;
 	void SetOffsets(const std::vector<unsigned int>& offsets);
-	void NewOffsets();
 
 	void insert(unsigned int index, int newend);
 	void insertlines(unsigned int index, std::vector<unsigned int>& newlines);
@@ -66,13 +66,14 @@ public:
 
 private:
 	bool IsValidIndex(unsigned int index) const;
+	void UpdateWidths();
 
 	// Member variables
 	FixedLine& m_line;
 	const DocumentWrapper& m_doc;
 	unsigned int m_maxWidth;
-	std::vector<unsigned int> m_textOffsets;
-	std::vector<unsigned int> m_lineWidths;
+	PrefixSumTree m_lengths; // offsets are sums of the lines above
+	PrefixSumTree m_lineWidths; // only max is used
 
 private:
 	LineListNoWrap& operator = (const LineListNoWrap& other);
@@ -15,6 +15,7 @@
 #define __LINELISTWRAP_H__
 
 #include "LineList.h"
+#include "PrefixSumTree.h"
 
 class FixedLine;
 class DocumentWrapper;
@@ -39,9 +40,8 @@ public:
 	unsigned int EndFromPos(unsigned int pos);
 	unsigned int StartFromPos(unsigned int pos);
 
-	std::vector<unsigned int>& GetOffsets();
+	void GetOffsets(std::vector<unsigned int>& offsets) const;
 	void SetOffsets(const std::vector<unsigned int>& offsets);
-	void NewOffsets();
 
 	void insert(unsigned int index, int newend);
 	void insertlines(unsigned int index, std::vector<unsigned int>& newlines);
@@ -57,59 +57,33 @@ public:
 	void invalidate(int index=0);
 	void widthchanged(int index=0) {invalidate(index);};
 	int prepare(int ypos);
-	bool in_window(unsigned int pos);
 
 	int OnIdle();
-	bool NeedIdle() const {return (firstLoadedPos > 0 || lastLoadedPos != size());};
+	bool NeedIdle() const;
 
 	void Print();
 	void verify(bool deep=false) const;
 
 private:
-	void add_line(int end);
-
-	void validate_offsets(unsigned int index);
-	void validate_positions(unsigned int index);
-
-	void update_offsetDiff(unsigned int index, int diff);
-	void update_posDiff(unsigned int index, int diff);
-
-	void initwindow();
-	int extendwindow(unsigned int index);
-	int recalc_approx(bool movetop = false);
-
-	// Safe unsigned minus (won't go below 0)
-	unsigned int uMinus(unsigned int a, unsigned int b) {
-		if (b > a) return 0;
-		else return a - b;
-	}
-
-	// Safe unsigned plus signed (won't go below 0)
-	unsigned int uPluss(unsigned int a, int b) {
-		if (b < 0 && (unsigned int)-b > a) return 0;
-		else return a + b;
-	}
+	unsigned int estimate_height(unsigned int len) const;
+	void measure_line(unsigned int index);
 
 	// Constants
-	static const unsigned int WINSIZE;
+	static const unsigned int IDLE_LINES;
 
 	// Private member variables
 	FixedLine& line;
 	const DocumentWrapper& m_doc;
-	std::vector<unsigned int> yPositions;
-	std::vector<unsigned int> textOffsets;
-
-	unsigned int lastValidOffset;
-	unsigned int lastValidPos;
-	unsigned int firstLoadedPos;
-	unsigned int lastLoadedPos;
-	int offsetDiff;
-	int posDiff;
-
-	unsigned int approxTop;
-	unsigned int approxBottom;
-	unsigned int avr_lineheight;
-	int approxDiff;
+
+	// Lengths of all lines, so offsets are sums of the lines above
+	PrefixSumTree m_lengths;
+
+	// Heights of all lines, so positions are sums of the lines above.
+	// Until a line has been measured (when drawn or in idle time) it
+	// has an estimated height, and is counted in m_unmeasured.
+	PrefixSumTree m_heights;
+	PrefixSumTree m_unmeasured;
+	unsigned int m_idleLine; // where to continue measuring
 
 private:
 	LineListWrap& operator = (const LineListWrap& other);
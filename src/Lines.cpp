@@ -26,7 +26,7 @@ Lines::Lines(wxDC& dc, DocumentWrapper& dw, IFoldingEditor& editorCtrl, const tm
 	m_doc(dw), m_editorCtrl(editorCtrl), NewlineTerminated(false), pos(0), lastpos(0),
 	line(dc, dw, selections, m_editorCtrl.GetHlBracket(), lastpos, m_isSelShadow, theme),
 	m_theme(theme), m_lastSel(-1), m_marginChars(0), m_marginPos(0),
-	selections(), m_isSelShadow(false),
+	selections(), m_isSelShadow(false), m_hasChanges(false),
 	m_wrapMode(cxWRAP_NONE), ll(NULL), llWrap(line, dw), llNoWrap(line, dw)
 {
 	// WARNING: Do not touch the document here; it is not locked during construction
@@ -135,23 +135,15 @@ void Lines::SetWordWrap(cxWrapMode wrapMode) {
 
 	// Cache the offsets
 	vector<unsigned int> offsets;
-	ll->GetOffsets().swap(offsets);
+	ll->GetOffsets(offsets);
 
 	llWrap.clear();
 	llNoWrap.clear();
 
 	line.SetWordWrap(wrapMode);
-	if (wrapMode != cxWRAP_NONE) {
-		ll = &llWrap;
-		llWrap.GetOffsets().swap(offsets);
-		llWrap.NewOffsets();
-		ll->invalidate();
-	}
-	else {
-		ll = &llNoWrap;
-		llNoWrap.GetOffsets().swap(offsets);
-		llNoWrap.NewOffsets();
-	}
+	if (wrapMode != cxWRAP_NONE) ll = &llWrap;
+	else ll = &llNoWrap;
+	ll->SetOffsets(offsets);
 }
 
 void Lines::ShowIndent(bool showIndent) {
@@ -703,6 +695,8 @@ cxFileResult Lines::LoadText(const wxFileName& path, wxFontEncoding enc, const w
 	Clear(); // Clean up first
 	line.Invalidate(); // avoid styling lines prematurely
 	ll->SetOffsets(textOffsets);
+	m_changedRange.Set(0, m_doc.GetLength());
+	m_hasChanges = true;
 
 	// Check if we end with a newline
 	if (m_doc.GetLength()) {
@@ -723,10 +717,13 @@ void Lines::ReLoadText() {
 	line.Invalidate(); // avoid styling lines prematurely
 
 	// Get the new text offsets
+	vector<unsigned int> offsets;
 	cxLOCKDOC_READ(m_doc)
-		doc.GetLines(ll->GetOffsets());
+		doc.GetLines(offsets);
 	cxENDLOCK
-	ll->NewOffsets();
+	ll->SetOffsets(offsets);
+	m_changedRange.Set(0, m_doc.GetLength());
+	m_hasChanges = true;
 
 	// Check if we end with a newline
 	if (m_doc.GetLength() == 0 ) NewlineTerminated = false;
@@ -742,6 +739,7 @@ void Lines::InsertChar(unsigned int pos, const wxChar& newtext, unsigned int byt
 	wxASSERT(pos >= 0 && pos <= GetLength());
 
 	line.FlushCache(pos);
+	AddChangedRange(pos, pos, byte_len);
 
 	if (ll->size() == 0) {
 		// No text yet, create a new line
@@ -788,6 +786,7 @@ void Lines::Insert(unsigned int pos, unsigned int byte_len) {
 	wxASSERT(byte_len > 0);
 
 	line.FlushCache(pos);
+	AddChangedRange(pos, pos, byte_len);
 
 	int changedline = -1;
 	int linerest = 0;
@@ -882,6 +881,7 @@ void Lines::Delete(unsigned int startpos, unsigned int endpos) {
 	}
 
 	line.FlushCache(startpos);
+	AddChangedRange(startpos, endpos, 0);
 
 	// Find the line with startpos in it
 	unsigned int firstline = ll->find_offset(startpos);
@@ -984,6 +984,28 @@ void Lines::ApplyDiff(vector<cxChange>& changes) {
 #endif
 }
 
+void Lines::AddChangedRange(unsigned int start, unsigned int end, unsigned int len) {
+	// start-end is replaced by len bytes
+	if (!m_hasChanges) {
+		m_changedRange.Set(start, start + len);
+		m_hasChanges = true;
+		return;
+	}
+
+	// Extend the previous range (in new positions) to cover the change
+	if (m_changedRange.end > end) m_changedRange.end = (m_changedRange.end - (end - start)) + len;
+	else m_changedRange.end = start + len;
+	if (m_changedRange.start > start) m_changedRange.start = start;
+}
+
+bool Lines::PopChangedRange(interval& range) {
+	if (!m_hasChanges) return false;
+
+	range = m_changedRange;
+	m_hasChanges = false;
+	return true;
+}
+
 bool Lines::IsCaretInPreparedPos() const {
 	// Checks we can update caret without doing any validations that
 	// could move positions.
@@ -1016,6 +1038,10 @@ void Lines::Draw(int xoffset, int yoffset, wxRect& rect) {
 		// Get the first visible line
 		unsigned int firstline = ll->find_ypos(top_ypos);
 
+		// Skip a line ending at top of rect, so that partial redraws
+		// do not draw over the part of the bitmap that is kept
+		if (ll->bottom(firstline) <= top_ypos && firstline < ll->last()) ++firstline;
+
 		// Prepare for foldings
 		const vector<cxFold>& folds = m_editorCtrl.GetFolds();
 		const cxFold target(firstline);
@@ -52,7 +52,7 @@ public:
 
 	void UpdateParsedLine(unsigned int line_id);
 
-	const std::vector<unsigned int>& GetOffsets() const {return ll->GetOffsets();};
+	void GetOffsets(std::vector<unsigned int>& offsets) const {ll->GetOffsets(offsets);};
 
 	cxWrapMode GetWrapMode() const {return m_wrapMode;};
 	void SetWordWrap(cxWrapMode wrapMode);
@@ -131,6 +131,10 @@ public:
 	void ApplyDiff(std::vector<cxChange>& changes);
 	void Draw(int xoffset, int yoffset, wxRect& rect);
 
+	// Gets (and resets) the span of text changed since last call
+	// (deletions leave an empty span where the text was)
+	bool PopChangedRange(interval& range);
+
 	// Tabs
 	bool IsAtTabPoint();
 
@@ -167,6 +171,8 @@ private:
 	unsigned int UnFoldedYPos(unsigned int ypos) const;
 	unsigned int FoldedYPos(unsigned int ypos) const;
 
+	void AddChangedRange(unsigned int start, unsigned int end, unsigned int len);
+
 	// Member variables
 	wxDC& dc;
 	DocumentWrapper& m_doc;
@@ -189,6 +195,10 @@ private:
 	std::vector<interval> selections;
 	bool m_isSelShadow;
 
+	// Text changed since last PopChangedRange
+	interval m_changedRange;
+	bool m_hasChanges;
+
 	// LineList vars
 	cxWrapMode m_wrapMode;
 	LineList* ll;
@@ -0,0 +1,219 @@
+/*******************************************************************************
+ *
+ * Copyright (C) 2009, Alexander Stigsen, e-texteditor.com
+ *
+ * This software is licensed under the Open Company License as described
+ * in the file license.txt, which you should have received as part of this
+ * distribution. The terms are also available at http://opencompany.org/license.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ******************************************************************************/
+
+#include "LiteralMatcher.h"
+#include "SimdScan.h"
+#include <cstring>
+#include <algorithm>
+
+#ifdef SIMDSCAN_SSE2
+	#include <emmintrin.h>
+	#ifdef _MSC_VER
+		#include <intrin.h>
+	#endif
+#endif
+
+#ifdef SIMDSCAN_SSE2
+static inline unsigned int first_bit(unsigned int mask) {
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return index;
+#else
+	return __builtin_ctz(mask);
+#endif
+}
+#endif
+
+LiteralMatcher::LiteralMatcher() {
+	Clear();
+}
+
+void LiteralMatcher::Clear() {
+	m_lower.clear();
+	m_upper.clear();
+	for (unsigned int i = 0; i < 256; ++i) m_skip[i] = m_skipBack[i] = 1;
+}
+
+void LiteralMatcher::Set(const char* text, size_t len) {
+	Set(text, text, len);
+}
+
+void LiteralMatcher::Set(const char* lower, const char* upper, size_t len) {
+	Clear();
+	if (len == 0) return;
+
+	m_lower.assign((const unsigned char*)lower, (const unsigned char*)lower + len);
+	m_upper.assign((const unsigned char*)upper, (const unsigned char*)upper + len);
+
+	// Build skip tables (later entries override earlier with shorter distances)
+	const unsigned int last = (unsigned int)len - 1;
+	for (unsigned int c = 0; c < 256; ++c) m_skip[c] = m_skipBack[c] = (unsigned int)len;
+	for (unsigned int i = 0; i < last; ++i) {
+		m_skip[m_lower[i]] = last - i;
+		m_skip[m_upper[i]] = last - i;
+	}
+	for (unsigned int i = last; i > 0; --i) {
+		m_skipBack[m_lower[i]] = i;
+		m_skipBack[m_upper[i]] = i;
+	}
+}
+
+bool LiteralMatcher::MatchAt(const char* p) const {
+	const unsigned char* s = (const unsigned char*)p;
+	const size_t len = m_lower.size();
+	for (size_t i = 0; i < len; ++i) {
+		if (s[i] != m_lower[i] && s[i] != m_upper[i]) return false;
+	}
+	return true;
+}
+
+const char* LiteralMatcher::Find(const char* buf, size_t len) const {
+	const size_t n = m_lower.size();
+	if (n == 0 || len < n) return NULL;
+	size_t i = 0;
+
+#ifdef SIMDSCAN_SSE2
+	// Compare first and last byte of 16 candidate positions at a time
+	// and only verify the positions where both match.
+	const __m128i first = _mm_set1_epi8((char)m_lower[0]);
+	const __m128i firstUpper = _mm_set1_epi8((char)m_upper[0]);
+	const __m128i last = _mm_set1_epi8((char)m_lower[n-1]);
+	const __m128i lastUpper = _mm_set1_epi8((char)m_upper[n-1]);
+
+	while (i + n - 1 + 16 <= len) {
+		const __m128i vf = _mm_loadu_si128((const __m128i*)(buf + i));
+		const __m128i vl = _mm_loadu_si128((const __m128i*)(buf + i + n - 1));
+		const __m128i eqf = _mm_or_si128(_mm_cmpeq_epi8(vf, first), _mm_cmpeq_epi8(vf, firstUpper));
+		const __m128i eql = _mm_or_si128(_mm_cmpeq_epi8(vl, last), _mm_cmpeq_epi8(vl, lastUpper));
+		unsigned int mask = _mm_movemask_epi8(_mm_and_si128(eqf, eql));
+
+		while (mask) {
+			const unsigned int bit = first_bit(mask);
+			if (n <= 2 || MatchAt(buf + i + bit)) return buf + i + bit;
+			mask &= mask - 1;
+		}
+		i += 16;
+	}
+#endif
+
+	return FindHorspool(buf, i, len);
+}
+
+const char* LiteralMatcher::FindHorspool(const char* buf, size_t start, size_t len) const {
+	const size_t n = m_lower.size();
+	const unsigned char* s = (const unsigned char*)buf;
+
+	for (size_t i = start; i + n <= len; ) {
+		const unsigned char c = s[i + n - 1]; // candidate for last byte
+		if ((c == m_lower[n-1] || c == m_upper[n-1]) && MatchAt(buf + i)) return buf + i;
+		i += m_skip[c];
+	}
+
+	return NULL;
+}
+
+const char* LiteralMatcher::FindBackwards(const char* buf, size_t len) const {
+	const size_t n = m_lower.size();
+	if (n == 0 || len < n) return NULL;
+	const unsigned char* s = (const unsigned char*)buf;
+
+	size_t i = len - n;
+	for (;;) {
+		const unsigned char c = s[i]; // candidate for first byte
+		if ((c == m_lower[0] || c == m_upper[0]) && MatchAt(buf + i)) return buf + i;
+
+		const size_t skip = m_skipBack[c];
+		if (i < skip) break;
+		i -= skip;
+	}
+
+	return NULL;
+}
+
+// - CharFoldMatcher ---
+
+void CharFoldMatcher::Clear() {
+	m_lower.clear();
+	m_upper.clear();
+	m_lowerEnds.clear();
+	m_upperEnds.clear();
+	m_maxLength = 0;
+	m_firstByte.Clear();
+}
+
+void CharFoldMatcher::AddChar(const char* lower, size_t lowerLen, const char* upper, size_t upperLen) {
+	if (lowerLen == 0 || upperLen == 0) return;
+
+	m_lower.append(lower, lowerLen);
+	m_upper.append(upper, upperLen);
+	m_lowerEnds.push_back(m_lower.size());
+	m_upperEnds.push_back(m_upper.size());
+	m_maxLength += std::max(lowerLen, upperLen);
+
+	// Candidates are found by the lead byte of the first char
+	if (m_lowerEnds.size() == 1) m_firstByte.Set(lower, upper, 1);
+}
+
+size_t CharFoldMatcher::MatchAt(const char* p, const char* end) const {
+	// As utf-8 is prefix free, at most one of the forms can match
+	const char* s = p;
+	size_t lowerStart = 0;
+	size_t upperStart = 0;
+	for (size_t i = 0; i < m_lowerEnds.size(); ++i) {
+		const size_t lowerLen = m_lowerEnds[i] - lowerStart;
+		const size_t upperLen = m_upperEnds[i] - upperStart;
+		const size_t left = end - s;
+
+		if (lowerLen <= left && memcmp(s, m_lower.data() + lowerStart, lowerLen) == 0) s += lowerLen;
+		else if (upperLen <= left && memcmp(s, m_upper.data() + upperStart, upperLen) == 0) s += upperLen;
+		else return 0;
+
+		lowerStart = m_lowerEnds[i];
+		upperStart = m_upperEnds[i];
+	}
+	return s - p;
+}
+
+const char* CharFoldMatcher::Find(const char* buf, size_t len, size_t& matchLen) const {
+	if (IsEmpty()) return NULL;
+
+	const char* const end = buf + len;
+	const char* p = buf;
+	while (p < end) {
+		p = m_firstByte.Find(p, end - p);
+		if (!p) break;
+
+		matchLen = MatchAt(p, end);
+		if (matchLen) return p;
+		++p;
+	}
+	return NULL;
+}
+
+const char* CharFoldMatcher::FindBackwards(const char* buf, size_t len, size_t startLen, size_t& matchLen) const {
+	if (IsEmpty()) return NULL;
+
+	const char* const end = buf + len;
+	size_t limit = std::min(startLen, len);
+	while (limit) {
+		// Last candidate starting before limit
+		const char* p = m_firstByte.FindBackwards(buf, limit);
+		if (!p) break;
+
+		matchLen = MatchAt(p, end);
+		if (matchLen) return p;
+		limit = p - buf;
+	}
+	return NULL;
+}
@@ -0,0 +1,85 @@
+/*******************************************************************************
+ *
+ * Copyright (C) 2009, Alexander Stigsen, e-texteditor.com
+ *
+ * This software is licensed under the Open Company License as described
+ * in the file license.txt, which you should have received as part of this
+ * distribution. The terms are also available at http://opencompany.org/license.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ******************************************************************************/
+
+#ifndef __LITERALMATCHER_H__
+#define __LITERALMATCHER_H__
+
+#include <vector>
+#include <string>
+#include <cstddef>
+
+// Compiled search for a literal (utf-8) byte string.
+// For caseless searches each byte can match either its lower- or
+// uppercase version (which then have to be of same byte width).
+// Searching is done with a SSE2 first/last byte prefilter when
+// available and a Horspool skip table otherwise.
+class LiteralMatcher {
+public:
+	LiteralMatcher();
+
+	void Set(const char* text, size_t len);
+	void Set(const char* lower, const char* upper, size_t len);
+	void Clear();
+
+	bool IsEmpty() const {return m_lower.empty();};
+	unsigned int GetLength() const {return (unsigned int)m_lower.size();};
+
+	// Returns the first (or last) match entirely inside the buffer or NULL
+	const char* Find(const char* buf, size_t len) const;
+	const char* FindBackwards(const char* buf, size_t len) const;
+
+	bool MatchByte(unsigned int i, unsigned char c) const {return c == m_lower[i] || c == m_upper[i];};
+	bool MatchAt(const char* p) const;
+
+private:
+	const char* FindHorspool(const char* buf, size_t start, size_t len) const;
+
+	std::vector<unsigned char> m_lower;
+	std::vector<unsigned char> m_upper;
+	unsigned int m_skip[256];     // distance from last occurrence to end of text
+	unsigned int m_skipBack[256]; // distance from start to first occurrence
+};
+
+// Caseless search for text where the upper- and lowercase forms of a
+// char may have different utf-8 byte widths (like 'I' and dotless 'i').
+// Each char of the pattern matches either of its two forms, so matches
+// can have different lengths.
+class CharFoldMatcher {
+public:
+	CharFoldMatcher() : m_maxLength(0) {};
+
+	void Clear();
+	void AddChar(const char* lower, size_t lowerLen, const char* upper, size_t upperLen);
+	bool IsEmpty() const {return m_lowerEnds.empty();};
+	size_t GetMaxLength() const {return m_maxLength;}; // of a match
+
+	// Returns the first match entirely inside the buffer or NULL
+	const char* Find(const char* buf, size_t len, size_t& matchLen) const;
+
+	// Returns the last match starting in the first startLen bytes of
+	// the buffer (and entirely inside it) or NULL
+	const char* FindBackwards(const char* buf, size_t len, size_t startLen, size_t& matchLen) const;
+
+private:
+	size_t MatchAt(const char* p, const char* end) const;
+
+	// Forms of all chars concatenated
+	std::string m_lower;
+	std::string m_upper;
+	std::vector<size_t> m_lowerEnds;
+	std::vector<size_t> m_upperEnds;
+	size_t m_maxLength;
+	LiteralMatcher m_firstByte;
+};
+
+#endif // __LITERALMATCHER_H__
@@ -0,0 +1,87 @@
+/*******************************************************************************
+ *
+ * Copyright (C) 2009, Alexander Stigsen, e-texteditor.com
+ *
+ * This software is licensed under the Open Company License as described
+ * in the file license.txt, which you should have received as part of this
+ * distribution. The terms are also available at http://opencompany.org/license.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ******************************************************************************/
+
+#ifndef __LOCKFREEQUEUE_H__
+#define __LOCKFREEQUEUE_H__
+
+#include <cstddef>
+
+#ifdef _MSC_VER
+	#include <intrin.h>
+	#pragma intrinsic(_ReadWriteBarrier)
+#endif
+
+// Unbounded queue for passing items from one producer thread to one
+// consumer thread without locking. The producer only touches the tail
+// and the consumer only the head, so the sole shared state is the next
+// pointer of the last node, which is published after the item is written.
+template<class T> class LockFreeQueue {
+public:
+	LockFreeQueue() {
+		m_head = m_tail = new Node();
+	};
+	~LockFreeQueue() {
+		while (m_head) {
+			Node* const next = m_head->next;
+			delete m_head;
+			m_head = next;
+		}
+	};
+
+	// Producer side
+	void Push(const T& item) {
+		Node* const node = new Node();
+		node->item = item;
+		Barrier(); // item has to be written before node becomes visible
+		m_tail->next = node;
+		m_tail = node;
+	};
+
+	// Consumer side
+	bool Pop(T& item) {
+		Node* const next = m_head->next;
+		if (!next) return false;
+		Barrier(); // don't read item before the next pointer
+
+		item = next->item;
+		next->item = T();
+		delete m_head;
+		m_head = next; // next is new (empty) head
+		return true;
+	};
+
+private:
+	class Node {
+	public:
+		Node() : item(), next(NULL) {};
+		T item;
+		Node* volatile next;
+	};
+
+	static inline void Barrier() {
+#ifdef _MSC_VER
+		_ReadWriteBarrier(); // volatile access is acquire/release on msvc
+#else
+		__sync_synchronize();
+#endif
+	};
+
+	// Disallow copying
+	LockFreeQueue(const LockFreeQueue&);
+	LockFreeQueue& operator=(const LockFreeQueue&);
+
+	Node* m_head; // consumer only
+	Node* m_tail; // producer only
+};
+
+#endif // __LOCKFREEQUEUE_H__
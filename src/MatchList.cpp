@@ -0,0 +1,104 @@
+/*******************************************************************************
+ *
+ * Copyright (C) 2009, Alexander Stigsen, e-texteditor.com
+ *
+ * This software is licensed under the Open Company License as described
+ * in the file license.txt, which you should have received as part of this
+ * distribution. The terms are also available at http://opencompany.org/license.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ******************************************************************************/
+
+
+#include "MatchList.h"
+
+#include "wx/wxprec.h"
+#ifndef WX_PRECOMP
+   #include <wx/wx.h>
+#endif
+
+interval MatchList::Get(unsigned int index) const {
+	wxASSERT(index < GetCount());
+
+	const unsigned int start = m_tree.GetSum(2*index + 1);
+	return interval(start, start + m_tree.Get(2*index + 1));
+}
+
+unsigned int MatchList::FindEnding(unsigned int pos) const {
+	if (pos == 0) return 0;
+
+	// First element where the running sum reaches pos
+	return m_tree.Find(pos - 1) / 2;
+}
+
+unsigned int MatchList::FindStarting(unsigned int pos) const {
+	if (pos == 0) return 0;
+
+	// If pos is reached inside a match, it starts before pos
+	const unsigned int i = m_tree.Find(pos - 1);
+	return (i & 1) ? (i / 2) + 1 : i / 2;
+}
+
+void MatchList::Insert(unsigned int index, const interval& match) {
+	wxASSERT(index <= GetCount());
+	wxASSERT(match.start <= match.end);
+
+	const unsigned int prevEnd = m_tree.GetSum(2*index);
+	wxASSERT(match.start >= prevEnd);
+
+	// The gap before the next match now starts at end of the new one
+	if (index < GetCount()) {
+		const unsigned int nextStart = prevEnd + m_tree.Get(2*index);
+		wxASSERT(nextStart >= match.end);
+		m_tree.Set(2*index, nextStart - match.end);
+	}
+
+	std::vector<unsigned int> values(2);
+	values[0] = match.start - prevEnd;
+	values[1] = match.end - match.start;
+	m_tree.Insert(2*index, values);
+}
+
+void MatchList::Erase(unsigned int first, unsigned int last) {
+	wxASSERT(first <= last && last <= GetCount());
+	if (first == last) return;
+
+	// The gap before the next match now spans the removed ones
+	if (last < GetCount()) {
+		const unsigned int nextStart = m_tree.GetSum(2*last + 1);
+		m_tree.Set(2*last, nextStart - m_tree.GetSum(2*first));
+	}
+
+	m_tree.Erase(2*first, 2*last);
+}
+
+void MatchList::InsertText(unsigned int pos, unsigned int length) {
+	unsigned int i = FindEnding(pos + 1);
+	if (i == GetCount()) return; // all matches end before pos
+
+	// Remove match if pos is inside it
+	if (Get(i).start < pos) {
+		Erase(i, i+1);
+		if (i == GetCount()) return;
+	}
+
+	// Move the following matches
+	m_tree.Set(2*i, m_tree.Get(2*i) + length);
+}
+
+void MatchList::DeleteText(unsigned int start, unsigned int end) {
+	wxASSERT(start <= end);
+	if (start == end) return;
+
+	// Remove matches overlapping the deletion
+	const unsigned int first = FindEnding(start + 1);
+	Erase(first, FindStarting(end));
+	if (first == GetCount()) return;
+
+	// Move the following matches
+	const unsigned int gap = m_tree.Get(2*first);
+	wxASSERT(gap >= end - start);
+	m_tree.Set(2*first, gap - (end - start));
+}
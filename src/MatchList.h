@@ -0,0 +1,51 @@
+/*******************************************************************************
+ *
+ * Copyright (C) 2009, Alexander Stigsen, e-texteditor.com
+ *
+ * This software is licensed under the Open Company License as described
+ * in the file license.txt, which you should have received as part of this
+ * distribution. The terms are also available at http://opencompany.org/license.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ******************************************************************************/
+
+
+#ifndef __MATCHLIST_H__
+#define __MATCHLIST_H__
+
+#include "PrefixSumTree.h"
+#include "Interval.h"
+
+// Sorted list of non-overlapping matches (like search hits), stored as the
+// gap before each match followed by its length in a PrefixSumTree. Changes
+// to the text only adjust the gap before the first following match, so
+// the matches after an edit move in O(log n) rather than one by one.
+class MatchList {
+public:
+	unsigned int GetCount() const {return m_tree.GetCount() / 2;};
+	bool IsEmpty() const {return m_tree.IsEmpty();};
+	interval Get(unsigned int index) const;
+
+	// Index of the first match ending at or after pos
+	unsigned int FindEnding(unsigned int pos) const;
+
+	// Index of the first match starting at or after pos
+	unsigned int FindStarting(unsigned int pos) const;
+
+	// The match has to fit between its neighbours
+	void Insert(unsigned int index, const interval& match);
+	void Append(const interval& match) {Insert(GetCount(), match);};
+	void Erase(unsigned int first, unsigned int last);
+	void Clear() {m_tree.Clear();};
+
+	// Text changes (matches overlapping the change are removed)
+	void InsertText(unsigned int pos, unsigned int length);
+	void DeleteText(unsigned int start, unsigned int end);
+
+private:
+	PrefixSumTree m_tree;
+};
+
+#endif // __MATCHLIST_H__
@@ -0,0 +1,315 @@
+/*******************************************************************************
+ *
+ * Copyright (C) 2009, Alexander Stigsen, e-texteditor.com
+ *
+ * This software is licensed under the Open Company License as described
+ * in the file license.txt, which you should have received as part of this
+ * distribution. The terms are also available at http://opencompany.org/license.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ******************************************************************************/
+
+#include "PathIndex.h"
+#include <wx/tokenzr.h>
+
+// - PathIndexBuilder ---
+
+// Scans the project tree and hands the files to the index in batches
+class PathIndexBuilder : public wxThread {
+public:
+	PathIndexBuilder(PathIndex& index, const wxFileName& projectPath);
+	virtual void* Entry();
+	void Cancel() {m_cancel = true;};
+
+private:
+	void ScanDir(const wxString& path);
+	void Flush();
+
+	PathIndex& m_index;
+	wxFileName m_projectPath;
+	ProjectInfoHandler m_infoHandler;
+	std::vector<FileEntry*> m_batch;
+	volatile bool m_cancel;
+};
+
+PathIndexBuilder::PathIndexBuilder(PathIndex& index, const wxFileName& projectPath)
+: wxThread(wxTHREAD_JOINABLE), m_index(index), m_cancel(false) {
+	// wxString is not threadsafe, so we have to force copy
+	m_projectPath = projectPath.GetFullPath().c_str();
+}
+
+void* PathIndexBuilder::Entry() {
+	m_infoHandler.SetRoot(m_projectPath);
+	ScanDir(m_projectPath.GetPath() + wxFILE_SEP_PATH);
+
+	if (m_cancel) {
+		for (std::vector<FileEntry*>::iterator p = m_batch.begin(); p != m_batch.end(); ++p) delete *p;
+		return NULL;
+	}
+
+	Flush();
+	wxCriticalSectionLocker lock(m_index.m_crit);
+	m_index.m_scanDone = true;
+
+	return NULL;
+}
+
+void PathIndexBuilder::ScanDir(const wxString& path) {
+	wxArrayString dirs;
+	wxArrayString filenames;
+	m_infoHandler.GetDirAndFileLists(path, dirs, filenames);
+
+	// Names are copied, so that the entries share no strings with this thread
+	for (size_t f = 0; f < filenames.size(); ++f) {
+		m_batch.push_back(new FileEntry(path, filenames[f].c_str()));
+	}
+	if (m_batch.size() >= 500) Flush();
+
+	for (size_t d = 0; d < dirs.size(); ++d) {
+		if (m_cancel) return;
+		ScanDir(path + dirs[d] + wxFILE_SEP_PATH);
+	}
+}
+
+void PathIndexBuilder::Flush() {
+	wxCriticalSectionLocker lock(m_index.m_crit);
+	m_index.m_pending.insert(m_index.m_pending.end(), m_batch.begin(), m_batch.end());
+	m_batch.clear();
+}
+
+// - PathIndex ---
+
+PathIndex::PathIndex()
+: m_useCount(0), m_hasRemoved(false), m_builder(NULL), m_replacing(false), m_scanDone(false) {
+}
+
+PathIndex::~PathIndex() {
+	Close();
+}
+
+void PathIndex::Open(const wxFileName& projectPath) {
+	Close();
+
+	m_projectPath = projectPath;
+	m_infoHandler.SetRoot(projectPath);
+	StartScan();
+}
+
+void PathIndex::Close() {
+	StopScan();
+
+	for (std::vector<FileEntry*>::iterator p = m_files.begin(); p != m_files.end(); ++p) delete *p;
+	m_files.clear();
+	m_byPath.clear();
+	m_hasRemoved = false;
+	m_projectPath.Clear();
+}
+
+void PathIndex::StartScan() {
+	StopScan();
+
+	m_replacing = !m_files.empty();
+	m_scanDone = false;
+
+	m_builder = new PathIndexBuilder(*this, m_projectPath);
+	if (m_builder->Create() != wxTHREAD_NO_ERROR || m_builder->Run() != wxTHREAD_NO_ERROR) {
+		delete m_builder;
+		m_builder = NULL;
+	}
+}
+
+void PathIndex::StopScan() {
+	if (!m_builder) return;
+
+	m_builder->Cancel();
+	m_builder->Wait();
+	delete m_builder;
+	m_builder = NULL;
+
+	for (std::vector<FileEntry*>::iterator p = m_pending.begin(); p != m_pending.end(); ++p) delete *p;
+	for (std::vector<FileEntry*>::iterator p = m_next.begin(); p != m_next.end(); ++p) delete *p;
+	m_pending.clear();
+	m_next.clear();
+}
+
+bool PathIndex::Update() {
+	if (!m_builder) return false;
+
+	std::vector<FileEntry*> pending;
+	bool done;
+	{
+		wxCriticalSectionLocker lock(m_crit);
+		pending.swap(m_pending);
+		done = m_scanDone;
+	}
+
+	// On first scan, files are shown as they are found
+	bool changed = false;
+	if (m_replacing) m_next.insert(m_next.end(), pending.begin(), pending.end());
+	else {
+		for (std::vector<FileEntry*>::iterator p = pending.begin(); p != pending.end(); ++p) AddEntry(*p);
+		changed = !pending.empty();
+	}
+
+	if (!done) return changed;
+	if (m_replacing && m_useCount) return changed; // apply when released
+
+	m_builder->Wait();
+	delete m_builder;
+	m_builder = NULL;
+
+	if (m_replacing) {
+		for (std::vector<FileEntry*>::iterator p = m_files.begin(); p != m_files.end(); ++p) delete *p;
+		m_files.clear();
+		m_byPath.clear();
+		m_hasRemoved = false;
+
+		for (std::vector<FileEntry*>::iterator p = m_next.begin(); p != m_next.end(); ++p) AddEntry(*p);
+		m_next.clear();
+		changed = true;
+	}
+
+	return changed;
+}
+
+void PathIndex::EndUse() {
+	wxASSERT(m_useCount > 0);
+	if (--m_useCount) return;
+
+	Purge();
+	Update();
+}
+
+void PathIndex::AddEntry(FileEntry* entry) {
+	// Files may have been added by DirWatcher while scanning
+	if (m_byPath.find(entry->path) != m_byPath.end()) {
+		delete entry;
+		return;
+	}
+
+	m_files.push_back(entry);
+	m_byPath[entry->path] = entry;
+}
+
+void PathIndex::Purge() {
+	if (!m_hasRemoved) return;
+
+	std::vector<FileEntry*>::iterator out = m_files.begin();
+	for (std::vector<FileEntry*>::iterator p = m_files.begin(); p != m_files.end(); ++p) {
+		if ((*p)->removed) {
+			m_byPath.erase((*p)->path);
+			delete *p;
+		}
+		else *out++ = *p;
+	}
+	m_files.erase(out, m_files.end());
+	m_hasRemoved = false;
+}
+
+void PathIndex::PathAdded(const wxString& path) {
+	if (!m_projectPath.IsOk()) return;
+
+	// Only the new dir has to be scanned
+	if (wxDirExists(path)) {
+		if (IsIncluded(path)) ScanDir(path + wxFILE_SEP_PATH);
+		return;
+	}
+
+	std::map<wxString, FileEntry*>::iterator p = m_byPath.find(path);
+	if (p != m_byPath.end()) {
+		p->second->removed = false;
+		return;
+	}
+
+	if (!wxFileExists(path) || !IsIncluded(path)) return;
+
+	const wxFileName filepath(path);
+	AddEntry(new FileEntry(filepath.GetPath(wxPATH_GET_SEPARATOR), filepath.GetFullName()));
+}
+
+void PathIndex::PathRemoved(const wxString& path) {
+	if (!m_projectPath.IsOk()) return;
+
+	// Remove the file, or all files in the dir
+	const wxString dirPrefix = path + wxFILE_SEP_PATH;
+	for (std::map<wxString, FileEntry*>::iterator p = m_byPath.lower_bound(path); p != m_byPath.end() && p->first.StartsWith(path); ++p) {
+		if (p->first.size() == path.size() || p->first.StartsWith(dirPrefix)) {
+			p->second->removed = true;
+			m_hasRemoved = true;
+		}
+	}
+
+	if (!m_useCount) Purge();
+}
+
+void PathIndex::ScanDir(const wxString& path) {
+	wxArrayString dirs;
+	wxArrayString filenames;
+	m_infoHandler.GetDirAndFileLists(path, dirs, filenames);
+
+	for (size_t f = 0; f < filenames.size(); ++f) {
+		std::map<wxString, FileEntry*>::iterator p = m_byPath.find(path + filenames[f]);
+		if (p != m_byPath.end()) p->second->removed = false;
+		else AddEntry(new FileEntry(path, filenames[f]));
+
+		// A running rescan may already have passed this dir
+		if (m_builder && m_replacing) m_next.push_back(new FileEntry(path, filenames[f]));
+	}
+
+	for (size_t d = 0; d < dirs.size(); ++d) {
+		ScanDir(path + dirs[d] + wxFILE_SEP_PATH);
+	}
+}
+
+bool PathIndex::IsIncluded(const wxString& path) {
+	const wxString rootPath = m_projectPath.GetPath();
+	wxString relPath;
+	if (!path.StartsWith(rootPath + wxFILE_SEP_PATH, &relPath)) return false;
+
+	const wxArrayString names = wxStringTokenize(relPath, wxFileName::GetPathSeparators(), wxTOKEN_STRTOK);
+	if (names.IsEmpty()) return false;
+
+	// Check each dir in the path against the filters of its parent
+	wxString dirPath = rootPath;
+	for (size_t i = 0; i < names.GetCount(); ++i) {
+		wxArrayString includeDirs;
+		wxArrayString excludeDirs;
+		wxArrayString includeFiles;
+		wxArrayString excludeFiles;
+		m_infoHandler.GetFilters(dirPath, includeDirs, excludeDirs, includeFiles, excludeFiles);
+
+		const bool isDir = (i+1 < names.GetCount()) || wxDirExists(path);
+		if (isDir) {
+			if (!ProjectInfoHandler::MatchFilter(names[i], includeDirs, excludeDirs)) return false;
+		}
+		else if (!ProjectInfoHandler::MatchFilter(names[i], includeFiles, excludeFiles)) return false;
+
+		dirPath += wxFILE_SEP_PATH + names[i];
+	}
+
+	return true;
+}
+
+// - FileEntry ---
+
+FileEntry::FileEntry(const wxString& dirpath, const wxString& filename) : removed(false) {
+	name = filename;
+	nameLower = name.Lower();
+	path = dirpath + filename;
+}
+
+void FileEntry::SetPath(const wxString& p) {
+	wxFileName filepath(p);
+	name = filepath.GetFullName();
+	nameLower = name.Lower();
+	path = p;
+	removed = false;
+}
+
+void FileEntry::Clear() {
+	name.clear();
+	nameLower.clear();
+	path.clear();
+}
@@ -0,0 +1,99 @@
+/*******************************************************************************
+ *
+ * Copyright (C) 2009, Alexander Stigsen, e-texteditor.com
+ *
+ * This software is licensed under the Open Company License as described
+ * in the file license.txt, which you should have received as part of this
+ * distribution. The terms are also available at http://opencompany.org/license.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ******************************************************************************/
+
+#ifndef __PATHINDEX_H__
+#define __PATHINDEX_H__
+
+#include "wx/wxprec.h"
+#ifndef WX_PRECOMP
+   #include <wx/wx.h>
+#endif
+#include <wx/filename.h>
+#include <wx/thread.h>
+
+#include "ProjectInfoHandler.h"
+#include <map>
+#include <vector>
+
+class PathIndexBuilder;
+
+class FileEntry {
+public:
+	FileEntry() : removed(false) {};
+	FileEntry(const wxString& dirpath, const wxString& filename);
+	void SetPath(const wxString& path);
+	void Clear();
+
+	wxString name;
+	wxString nameLower;
+	wxString path;
+	bool removed;
+};
+
+// List of all files in the project (honoring the project filters), used by
+// the Go to File dialog. It is scanned in the background when the project
+// is opened and kept up to date from the DirWatcher notifications, so it
+// does not have to be rebuilt each time the dialog is opened.
+//
+// Except for the scanning, it should only be accessed from the main thread.
+class PathIndex {
+public:
+	PathIndex();
+	~PathIndex();
+
+	void Open(const wxFileName& projectPath);
+	void Close();
+
+	// Moves newly scanned files into the list. Returns true if it changed.
+	bool Update();
+	bool IsScanning() const {return m_builder != NULL;};
+	const std::vector<FileEntry*>& GetFiles() const {return m_files;};
+
+	// While in use, entries are only marked as removed (not deleted)
+	// and rescans are not applied before the list is released.
+	void BeginUse() {++m_useCount;};
+	void EndUse();
+
+	// Notifications from DirWatcher
+	void PathAdded(const wxString& path);
+	void PathRemoved(const wxString& path);
+
+private:
+	friend class PathIndexBuilder;
+
+	void StartScan();
+	void StopScan();
+	void AddEntry(FileEntry* entry);
+	void Purge();
+	void ScanDir(const wxString& path);
+	bool IsIncluded(const wxString& path);
+
+	wxFileName m_projectPath;
+	ProjectInfoHandler m_infoHandler;
+	std::vector<FileEntry*> m_files;
+	std::map<wxString, FileEntry*> m_byPath;
+	unsigned int m_useCount;
+	bool m_hasRemoved;
+
+	// Scanning state
+	PathIndexBuilder* m_builder;
+	bool m_replacing; // rescan replaces list when done
+	std::vector<FileEntry*> m_next;
+
+	// Shared with builder thread
+	wxCriticalSection m_crit;
+	std::vector<FileEntry*> m_pending;
+	bool m_scanDone;
+};
+
+#endif // __PATHINDEX_H__
@@ -0,0 +1,377 @@
+/*******************************************************************************
+ *
+ * Copyright (C) 2009, Alexander Stigsen, e-texteditor.com
+ *
+ * This software is licensed under the Open Company License as described
+ * in the file license.txt, which you should have received as part of this
+ * distribution. The terms are also available at http://opencompany.org/license.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ******************************************************************************/
+
+
+#include "PrefixSumTree.h"
+#include <numeric>
+#include <algorithm>
+
+#include "wx/wxprec.h"
+#ifndef WX_PRECOMP
+   #include <wx/wx.h>
+#endif
+
+// Initializing static constants
+const unsigned int PrefixSumTree::MAXCHUNK = 512;
+const unsigned int PrefixSumTree::MINCHUNK = 128;
+
+PrefixSumTree::PrefixSumTree() : m_topBit(0), m_count(0), m_total(0) {
+}
+
+PrefixSumTree::~PrefixSumTree() {
+	Clear();
+}
+
+unsigned int PrefixSumTree::Get(unsigned int index) const {
+	wxASSERT(index < m_count);
+
+	unsigned int chunkStart;
+	unsigned int sumStart;
+	const unsigned int c = Locate(index, chunkStart, sumStart);
+
+	return m_chunks[c]->values[index - chunkStart];
+}
+
+void PrefixSumTree::Set(unsigned int index, unsigned int value) {
+	wxASSERT(index < m_count);
+
+	unsigned int chunkStart;
+	unsigned int sumStart;
+	const unsigned int c = Locate(index, chunkStart, sumStart);
+
+	Chunk& chunk = *m_chunks[c];
+	unsigned int& v = chunk.values[index - chunkStart];
+	if (v == value) return;
+
+	const int diff = value - v;
+	const bool wasMax = (v == chunk.maxValue);
+	v = value;
+	if (value > chunk.maxValue) chunk.maxValue = value;
+	else if (wasMax) chunk.UpdateMax();
+	chunk.sum += diff;
+	m_total += diff;
+	Update(c, 0, diff);
+}
+
+unsigned int PrefixSumTree::GetSum(unsigned int index) const {
+	wxASSERT(index <= m_count);
+
+	if (index == 0) return 0;
+	if (index == m_count) return m_total;
+
+	unsigned int chunkStart;
+	unsigned int sumStart;
+	const unsigned int c = Locate(index, chunkStart, sumStart);
+	const Chunk& chunk = *m_chunks[c];
+	const unsigned int local = index - chunkStart;
+
+	// Sum the shortest side of index in the chunk
+	const std::vector<unsigned int>& v = chunk.values;
+	if (local <= v.size() / 2) return std::accumulate(v.begin(), v.begin() + local, sumStart);
+	else return sumStart + chunk.sum - std::accumulate(v.begin() + local, v.end(), 0U);
+}
+
+unsigned int PrefixSumTree::GetMax() const {
+	unsigned int maxValue = 0;
+	for (std::vector<Chunk*>::const_iterator p = m_chunks.begin(); p != m_chunks.end(); ++p) {
+		if ((*p)->maxValue > maxValue) maxValue = (*p)->maxValue;
+	}
+	return maxValue;
+}
+
+unsigned int PrefixSumTree::Find(unsigned int sum) const {
+	if (sum >= m_total) return m_count;
+
+	// Find the chunk containing sum
+	const unsigned int chunkCount = m_chunks.size();
+	unsigned int pos = 0;
+	unsigned int count = 0;
+	for (unsigned int bit = m_topBit; bit; bit >>= 1) {
+		const unsigned int next = pos + bit;
+		if (next <= chunkCount && m_sumTree[next] <= sum) {
+			pos = next;
+			count += m_countTree[next];
+			sum -= m_sumTree[next];
+		}
+	}
+	wxASSERT(pos < chunkCount);
+
+	// Find the element in the chunk
+	const std::vector<unsigned int>& v = m_chunks[pos]->values;
+	for (std::vector<unsigned int>::const_iterator p = v.begin(); p != v.end(); ++p) {
+		if (sum < *p) return count + (p - v.begin());
+		sum -= *p;
+	}
+
+	wxASSERT(false); // chunk sums out of sync
+	return m_count;
+}
+
+void PrefixSumTree::Insert(unsigned int index, unsigned int value, unsigned int count) {
+	wxASSERT(index <= m_count);
+	if (count == 0) return;
+
+	if (m_chunks.empty()) {
+		Assign(count, value);
+		return;
+	}
+
+	unsigned int chunkStart;
+	unsigned int sumStart;
+	const unsigned int c = Locate(index, chunkStart, sumStart);
+	Chunk& chunk = *m_chunks[c];
+
+	const unsigned int sum = value * count;
+	chunk.values.insert(chunk.values.begin() + (index - chunkStart), count, value);
+	chunk.sum += sum;
+	if (value > chunk.maxValue) chunk.maxValue = value;
+	m_count += count;
+	m_total += sum;
+
+	if (chunk.values.size() > MAXCHUNK) Split(c);
+	else Update(c, count, sum);
+}
+
+void PrefixSumTree::Insert(unsigned int index, const std::vector<unsigned int>& values) {
+	wxASSERT(index <= m_count);
+	if (values.empty()) return;
+
+	if (m_chunks.empty()) {
+		Assign(values);
+		return;
+	}
+
+	unsigned int chunkStart;
+	unsigned int sumStart;
+	const unsigned int c = Locate(index, chunkStart, sumStart);
+	Chunk& chunk = *m_chunks[c];
+
+	const unsigned int sum = std::accumulate(values.begin(), values.end(), 0U);
+	chunk.values.insert(chunk.values.begin() + (index - chunkStart), values.begin(), values.end());
+	chunk.sum += sum;
+	chunk.maxValue = wxMax(chunk.maxValue, *std::max_element(values.begin(), values.end()));
+	m_count += values.size();
+	m_total += sum;
+
+	if (chunk.values.size() > MAXCHUNK) Split(c);
+	else Update(c, values.size(), sum);
+}
+
+void PrefixSumTree::Erase(unsigned int first, unsigned int last) {
+	wxASSERT(first <= last && last <= m_count);
+	if (first == last) return;
+
+	if (first == 0 && last == m_count) {
+		Clear();
+		return;
+	}
+
+	unsigned int chunkStart;
+	unsigned int sumStart;
+	const unsigned int firstChunk = Locate(first, chunkStart, sumStart);
+
+	// Remove the elements chunk by chunk
+	unsigned int c = firstChunk;
+	unsigned int local = first - chunkStart;
+	unsigned int left = last - first;
+	unsigned int removedSum = 0;
+	while (left) {
+		Chunk& chunk = *m_chunks[c];
+		const unsigned int n = wxMin(left, (unsigned int)chunk.values.size() - local);
+		const std::vector<unsigned int>::iterator p = chunk.values.begin() + local;
+
+		const unsigned int sum = std::accumulate(p, p + n, 0U);
+		chunk.values.erase(p, p + n);
+		chunk.sum -= sum;
+		chunk.UpdateMax();
+		removedSum += sum;
+
+		left -= n;
+		local = 0;
+		++c;
+	}
+	m_count -= last - first;
+	m_total -= removedSum;
+
+	// If only one chunk changed and it still has a reasonable size,
+	// we can just update the tree
+	if (c == firstChunk+1 && m_chunks[firstChunk]->values.size() >= MINCHUNK) {
+		Update(firstChunk, -(int)(last - first), -(int)removedSum);
+		return;
+	}
+
+	// Remove the emptied chunks
+	std::vector<Chunk*>::iterator out = m_chunks.begin() + firstChunk;
+	for (std::vector<Chunk*>::iterator p = out; p != m_chunks.begin() + c; ++p) {
+		if ((*p)->values.empty()) delete *p;
+		else *out++ = *p;
+	}
+	m_chunks.erase(out, m_chunks.begin() + c);
+
+	// Merge small chunk at the edit with a neighbour
+	unsigned int m = wxMin(firstChunk, (unsigned int)m_chunks.size()-1);
+	if (m_chunks[m]->values.size() < MINCHUNK && m_chunks.size() > 1) {
+		if (m+1 == m_chunks.size()) --m; // merge into previous
+		Chunk& target = *m_chunks[m];
+		Chunk* source = m_chunks[m+1];
+		if (target.values.size() + source->values.size() <= MAXCHUNK) {
+			target.values.insert(target.values.end(), source->values.begin(), source->values.end());
+			target.sum += source->sum;
+			target.maxValue = wxMax(target.maxValue, source->maxValue);
+			delete source;
+			m_chunks.erase(m_chunks.begin() + m + 1);
+		}
+	}
+
+	Rebuild();
+}
+
+void PrefixSumTree::Assign(const std::vector<unsigned int>& values) {
+	Clear();
+
+	const unsigned int fill = MAXCHUNK / 2;
+	for (unsigned int i = 0; i < values.size(); i += fill) {
+		Chunk* chunk = new Chunk;
+		chunk->values.assign(values.begin() + i, values.begin() + wxMin(i + fill, (unsigned int)values.size()));
+		chunk->sum = std::accumulate(chunk->values.begin(), chunk->values.end(), 0U);
+		chunk->UpdateMax();
+		m_chunks.push_back(chunk);
+
+		m_total += chunk->sum;
+	}
+	m_count = values.size();
+
+	Rebuild();
+}
+
+void PrefixSumTree::Assign(unsigned int count, unsigned int value) {
+	Clear();
+
+	const unsigned int fill = MAXCHUNK / 2;
+	for (unsigned int i = 0; i < count; i += fill) {
+		Chunk* chunk = new Chunk;
+		chunk->values.assign(wxMin(fill, count - i), value);
+		chunk->sum = chunk->values.size() * value;
+		chunk->maxValue = value;
+		m_chunks.push_back(chunk);
+
+		m_total += chunk->sum;
+	}
+	m_count = count;
+
+	Rebuild();
+}
+
+void PrefixSumTree::Clear() {
+	for (std::vector<Chunk*>::iterator p = m_chunks.begin(); p != m_chunks.end(); ++p) delete *p;
+	m_chunks.clear();
+	m_countTree.clear();
+	m_sumTree.clear();
+	m_topBit = 0;
+	m_count = 0;
+	m_total = 0;
+}
+
+void PrefixSumTree::GetValues(std::vector<unsigned int>& values) const {
+	values.clear();
+	values.reserve(m_count);
+	for (std::vector<Chunk*>::const_iterator p = m_chunks.begin(); p != m_chunks.end(); ++p) {
+		values.insert(values.end(), (*p)->values.begin(), (*p)->values.end());
+	}
+}
+
+unsigned int PrefixSumTree::Locate(unsigned int index, unsigned int& chunkStart, unsigned int& sumStart) const {
+	wxASSERT(index <= m_count && !m_chunks.empty());
+
+	// Appending goes in the last chunk
+	if (index == m_count) {
+		const Chunk& lastChunk = *m_chunks.back();
+		chunkStart = m_count - lastChunk.values.size();
+		sumStart = m_total - lastChunk.sum;
+		return m_chunks.size()-1;
+	}
+
+	// Walk down the tree to the last chunk starting at or before index
+	const unsigned int chunkCount = m_chunks.size();
+	unsigned int pos = 0;
+	chunkStart = 0;
+	sumStart = 0;
+	for (unsigned int bit = m_topBit; bit; bit >>= 1) {
+		const unsigned int next = pos + bit;
+		if (next <= chunkCount && chunkStart + m_countTree[next] <= index) {
+			pos = next;
+			chunkStart += m_countTree[next];
+			sumStart += m_sumTree[next];
+		}
+	}
+
+	wxASSERT(pos < chunkCount);
+	return pos;
+}
+
+void PrefixSumTree::Update(unsigned int chunk, int countDiff, int sumDiff) {
+	const unsigned int chunkCount = m_chunks.size();
+	for (unsigned int i = chunk+1; i <= chunkCount; i += i & (0-i)) {
+		m_countTree[i] += countDiff;
+		m_sumTree[i] += sumDiff;
+	}
+}
+
+void PrefixSumTree::Split(unsigned int chunk) {
+	Chunk* full = m_chunks[chunk];
+	const unsigned int fill = MAXCHUNK / 2;
+
+	// Move all but the first fill values to new chunks
+	std::vector<Chunk*> newChunks;
+	for (unsigned int i = fill; i < full->values.size(); i += fill) {
+		Chunk* c = new Chunk;
+		c->values.assign(full->values.begin() + i, full->values.begin() + wxMin(i + fill, (unsigned int)full->values.size()));
+		c->sum = std::accumulate(c->values.begin(), c->values.end(), 0U);
+		c->UpdateMax();
+		full->sum -= c->sum;
+		newChunks.push_back(c);
+	}
+	full->values.resize(fill);
+	full->UpdateMax();
+
+	m_chunks.insert(m_chunks.begin() + chunk + 1, newChunks.begin(), newChunks.end());
+	Rebuild();
+}
+
+void PrefixSumTree::Rebuild() {
+	const unsigned int chunkCount = m_chunks.size();
+	m_countTree.assign(chunkCount+1, 0);
+	m_sumTree.assign(chunkCount+1, 0);
+
+	// Build Fenwick trees in linear time
+	for (unsigned int i = 1; i <= chunkCount; ++i) {
+		m_countTree[i] += m_chunks[i-1]->values.size();
+		m_sumTree[i] += m_chunks[i-1]->sum;
+
+		const unsigned int parent = i + (i & (0-i));
+		if (parent <= chunkCount) {
+			m_countTree[parent] += m_countTree[i];
+			m_sumTree[parent] += m_sumTree[i];
+		}
+	}
+
+	m_topBit = 0;
+	if (chunkCount) {
+		m_topBit = 1;
+		while (m_topBit * 2 <= chunkCount) m_topBit *= 2;
+	}
+}
+
+void PrefixSumTree::Chunk::UpdateMax() {
+	maxValue = values.empty() ? 0 : *std::max_element(values.begin(), values.end());
+}
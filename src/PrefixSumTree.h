@@ -0,0 +1,89 @@
+/*******************************************************************************
+ *
+ * Copyright (C) 2009, Alexander Stigsen, e-texteditor.com
+ *
+ * This software is licensed under the Open Company License as described
+ * in the file license.txt, which you should have received as part of this
+ * distribution. The terms are also available at http://opencompany.org/license.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ******************************************************************************/
+
+
+#ifndef __PREFIXSUMTREE_H__
+#define __PREFIXSUMTREE_H__
+
+#include <vector>
+
+// Sequence of unsigned values (like the heights of lines) that can give
+// the sum of any prefix, and find the element containing a given sum, in
+// O(log n). Elements can be changed, inserted and removed anywhere.
+//
+// The values are kept in chunks of limited size, with a Fenwick tree of
+// the counts and sums of the chunks on top. Changing a value only updates
+// the tree, while the tree is rebuilt (in O(n/chunksize)) when chunks are
+// split or merged. The chunks also keep their largest value, so the max
+// of all values can be found in O(n/chunksize).
+class PrefixSumTree {
+public:
+	PrefixSumTree();
+	~PrefixSumTree();
+
+	unsigned int GetCount() const {return m_count;};
+	unsigned int GetTotal() const {return m_total;};
+	bool IsEmpty() const {return m_count == 0;};
+	unsigned int GetMax() const;
+
+	unsigned int Get(unsigned int index) const;
+	void Set(unsigned int index, unsigned int value);
+
+	// Sum of the elements before index (index may be GetCount())
+	unsigned int GetSum(unsigned int index) const;
+
+	// Index of the element containing sum, i.e. the first element where
+	// the sum up to and including it is larger (GetCount() if none is)
+	unsigned int Find(unsigned int sum) const;
+
+	void Insert(unsigned int index, unsigned int value, unsigned int count=1);
+	void Insert(unsigned int index, const std::vector<unsigned int>& values);
+	void Erase(unsigned int first, unsigned int last);
+	void Assign(const std::vector<unsigned int>& values);
+	void Assign(unsigned int count, unsigned int value);
+	void Clear();
+
+	// Copy of all the values
+	void GetValues(std::vector<unsigned int>& values) const;
+
+private:
+	struct Chunk {
+		Chunk() : sum(0), maxValue(0) {};
+		void UpdateMax();
+
+		std::vector<unsigned int> values;
+		unsigned int sum;
+		unsigned int maxValue;
+	};
+
+	unsigned int Locate(unsigned int index, unsigned int& chunkStart, unsigned int& sumStart) const;
+	void Update(unsigned int chunk, int countDiff, int sumDiff);
+	void Split(unsigned int chunk);
+	void Rebuild();
+
+	static const unsigned int MAXCHUNK;
+	static const unsigned int MINCHUNK;
+
+	std::vector<Chunk*> m_chunks;
+	std::vector<unsigned int> m_countTree; // Fenwick trees over the chunks
+	std::vector<unsigned int> m_sumTree;
+	unsigned int m_topBit; // highest power of two <= chunk count
+	unsigned int m_count;
+	unsigned int m_total;
+
+private:
+	PrefixSumTree(const PrefixSumTree&);
+	PrefixSumTree& operator=(const PrefixSumTree&);
+};
+
+#endif // __PREFIXSUMTREE_H__
@@ -28,6 +28,7 @@
 #include "DirWatcher.h"
 #include "RemoteThread.h"
 #include "eDocumentPath.h"
+#include "eSettings.h"
 
 #include "images/NewFolder.xpm"
 #include "images/NewDocument.xpm"
@@ -253,6 +254,8 @@ void ProjectPane::Clear() {
 		m_projectService.GetDirWatcher().UnwatchDirectory(m_dirWatchHandle);
 		m_dirWatchHandle = NULL;
 	}
+	m_searchIndex.Close();
+	m_pathIndex.Close();
 	ResetBusy();
 }
 
@@ -299,6 +302,14 @@ void ProjectPane::Init() {
 	// Load project info (if available)
 	if (!m_isRemote) m_infoHandler.SetRoot(m_prjPath);
 
+	// Index project files for Find In Project
+	bool useSearchIndex = false;
+	eGetSettings().GetSettingBool(wxT("findInProjectIndex"), useSearchIndex);
+	if (!m_isRemote && useSearchIndex) m_searchIndex.Open(m_prjPath);
+
+	// List project files for Go to File
+	if (!m_isRemote) m_pathIndex.Open(m_prjPath);
+
 	// Always start with root expanded
 	Freeze();
 	ExpandDir(rootId); // probably not needed when next is handled
@@ -1359,6 +1370,18 @@ void ProjectPane::OnDirChanged(wxDirWatcherEvent& event) {
 		else if (changeType == DIRWATCHER_FILE_RENAMED) m_atomicPath.clear(); // atomic save done
 	}
 	if (changeType == DIRWATCHER_FILE_REMOVED && path == m_atomicPath) return;
+
+	// Files changed since indexing can not be filtered by the search index
+	m_searchIndex.FileChanged(path);
+	if (changeType == DIRWATCHER_FILE_RENAMED) m_searchIndex.FileChanged(event.GetNewFile());
+
+	// Keep file list for Go to File up to date
+	if (changeType == DIRWATCHER_FILE_ADDED) m_pathIndex.PathAdded(path);
+	else if (changeType == DIRWATCHER_FILE_REMOVED) m_pathIndex.PathRemoved(path);
+	else if (changeType == DIRWATCHER_FILE_RENAMED) {
+		m_pathIndex.PathRemoved(path);
+		m_pathIndex.PathAdded(event.GetNewFile());
+	}
 	
 	// Make path relative to project
 	wxString relativePath;
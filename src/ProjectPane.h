@@ -26,6 +26,8 @@
 
 #include "ProjectInfoHandler.h"
 #include "ProjectInfo.h"
+#include "TrigramIndex.h"
+#include "PathIndex.h"
 
 #include <deque>
 #include <vector>
@@ -73,6 +75,12 @@ public:
 	// ProjectInfo
 	ProjectInfoHandler& GetInfoHandler() {return m_infoHandler;};
 	void SaveCurrentProjectInfo() const {m_infoHandler.SaveRootInfo();};
+
+	// Find In Project
+	TrigramIndex& GetSearchIndex() {return m_searchIndex;};
+
+	// Go to File
+	PathIndex& GetPathIndex() {return m_pathIndex;};
 	
 #ifdef __WXMSW__
 	WXLRESULT MSWWindowProc(WXUINT nMsg, WXWPARAM wParam, WXLPARAM lParam);
@@ -163,6 +171,8 @@ private:
 	// Member variables
 	IFrameProjectService& m_projectService;
 	ProjectInfoHandler m_infoHandler;
+	TrigramIndex m_searchIndex;
+	PathIndex m_pathIndex;
 	wxImageList m_imageList;
 	void* m_dirWatchHandle;
 	bool m_isRemote;
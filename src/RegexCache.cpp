@@ -0,0 +1,151 @@
+/*******************************************************************************
+ *
+ * Copyright (C) 2009, Alexander Stigsen, e-texteditor.com
+ *
+ * This software is licensed under the Open Company License as described
+ * in the file license.txt, which you should have received as part of this
+ * distribution. The terms are also available at http://opencompany.org/license.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ******************************************************************************/
+
+#include "RegexCache.h"
+#include "pcre.h"
+
+// - RegexCache::Pattern ---
+
+RegexCache::Pattern::Pattern(Entry* entry) : m_entry(entry) {
+	// cache mutex is held by caller
+	if (m_entry) ++m_entry->refs;
+}
+
+RegexCache::Pattern::Pattern(const Pattern& pattern) : m_entry(pattern.m_entry) {
+	if (m_entry) {
+		wxMutexLocker lock(RegexCache::Get().m_mutex);
+		++m_entry->refs;
+	}
+}
+
+RegexCache::Pattern::~Pattern() {
+	Release();
+}
+
+RegexCache::Pattern& RegexCache::Pattern::operator=(const Pattern& pattern) {
+	if (m_entry == pattern.m_entry) return *this;
+
+	Release();
+	if (pattern.m_entry) {
+		wxMutexLocker lock(RegexCache::Get().m_mutex);
+		m_entry = pattern.m_entry;
+		++m_entry->refs;
+	}
+	return *this;
+}
+
+void RegexCache::Pattern::Release() {
+	if (!m_entry) return;
+
+	wxMutexLocker lock(RegexCache::Get().m_mutex);
+	--m_entry->refs;
+	if (m_entry->refs == 0 && !m_entry->cached) delete m_entry;
+	m_entry = NULL;
+}
+
+const pcre* RegexCache::Pattern::GetRegex() const {
+	wxASSERT(m_entry);
+	return m_entry->re;
+}
+
+const pcre_extra* RegexCache::Pattern::GetStudy() const {
+	wxASSERT(m_entry);
+	return m_entry->study;
+}
+
+// - RegexCache ---
+
+RegexCache::Entry::~Entry() {
+	if (study) free(study);
+	if (re) free(re);
+}
+
+RegexCache& RegexCache::Get() {
+	static RegexCache cache;
+	return cache;
+}
+
+RegexCache::RegexCache() : m_hits(0), m_misses(0), m_mutex(wxMUTEX_RECURSIVE) {
+}
+
+RegexCache::~RegexCache() {
+	Clear();
+}
+
+RegexCache::Pattern RegexCache::Lookup(const wxString& pattern, int options, bool study) {
+	wxMutexLocker lock(m_mutex);
+
+	for (std::list<Entry*>::iterator p = m_entries.begin(); p != m_entries.end(); ++p) {
+		Entry* entry = *p;
+		if (entry->options != options || entry->pattern != pattern) continue;
+
+		++m_hits;
+		++entry->uses;
+
+		// Move to front
+		if (p != m_entries.begin()) {
+			m_entries.erase(p);
+			m_entries.push_front(entry);
+		}
+
+		// Reused patterns are likely to be searched in loops
+		if (!entry->studied && (study || entry->uses == 2)) Study(*entry);
+
+		return Pattern(entry);
+	}
+	++m_misses;
+
+	// Compile the pattern
+	const char *error;
+	int erroffset;
+	pcre* re = pcre_compile(
+		pattern.mb_str(wxConvUTF8),   // the pattern
+		options,              // options
+		&error,               // for error message
+		&erroffset,           // for error offset
+		NULL);                // use default character tables
+	if (!re) return Pattern(); // invalid pattern
+
+	Entry* entry = new Entry(pattern, options, re);
+	if (study) Study(*entry);
+
+	// Drop least recently used
+	m_entries.push_front(entry);
+	if (m_entries.size() > s_maxEntries) {
+		Evict(m_entries.back());
+		m_entries.pop_back();
+	}
+
+	return Pattern(entry);
+}
+
+void RegexCache::Clear() {
+	wxMutexLocker lock(m_mutex);
+
+	for (std::list<Entry*>::iterator p = m_entries.begin(); p != m_entries.end(); ++p) {
+		Evict(*p);
+	}
+	m_entries.clear();
+}
+
+void RegexCache::Study(Entry& entry) {
+	const char *error;
+	entry.study = pcre_study(entry.re, 0, &error); // NULL if there is nothing to gain
+	entry.studied = true;
+}
+
+void RegexCache::Evict(Entry* entry) {
+	// Patterns still in use are deleted when released
+	entry->cached = false;
+	if (entry->refs == 0) delete entry;
+}
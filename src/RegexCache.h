@@ -0,0 +1,97 @@
+/*******************************************************************************
+ *
+ * Copyright (C) 2009, Alexander Stigsen, e-texteditor.com
+ *
+ * This software is licensed under the Open Company License as described
+ * in the file license.txt, which you should have received as part of this
+ * distribution. The terms are also available at http://opencompany.org/license.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ******************************************************************************/
+
+#ifndef __REGEXCACHE_H__
+#define __REGEXCACHE_H__
+
+#include "wx/wxprec.h"
+#ifndef WX_PRECOMP
+   #include <wx/wx.h>
+#endif
+#include <wx/thread.h>
+#include <list>
+
+struct real_pcre;                 // This double pre-definition is needed
+typedef struct real_pcre pcre;    // because of the way it is defined in pcre.h
+struct pcre_extra;
+
+// Bounded LRU cache of compiled regular expressions shared by all
+// documents and editors. Patterns that get reused (like when searching
+// in a loop) are studied on their second lookup.
+class RegexCache {
+private:
+	class Entry;
+
+public:
+	// Keeps a cached pattern alive while in use (even if evicted)
+	class Pattern {
+	public:
+		Pattern() : m_entry(NULL) {};
+		Pattern(const Pattern& pattern);
+		~Pattern();
+		Pattern& operator=(const Pattern& pattern);
+
+		bool IsOk() const {return m_entry != NULL;};
+		const pcre* GetRegex() const;
+		const pcre_extra* GetStudy() const;
+
+	private:
+		friend class RegexCache;
+		explicit Pattern(Entry* entry);
+		void Release();
+
+		Entry* m_entry;
+	};
+
+	static RegexCache& Get();
+
+	// Returns an invalid pattern if it could not be compiled
+	Pattern Lookup(const wxString& pattern, int options, bool study=false);
+	void Clear();
+
+	// Statistics
+	unsigned int GetHits() const {return m_hits;};
+	unsigned int GetMisses() const {return m_misses;};
+	unsigned int GetSize() const {return (unsigned int)m_entries.size();};
+
+private:
+	RegexCache();
+	~RegexCache();
+
+	class Entry {
+	public:
+		Entry(const wxString& p, int o, pcre* r) : pattern(p), options(o), re(r), study(NULL), refs(0), uses(1), studied(false), cached(true) {};
+		~Entry();
+
+		const wxString pattern;
+		const int options;
+		pcre* re;
+		pcre_extra* study;
+		unsigned int refs;
+		unsigned int uses;
+		bool studied;
+		bool cached;
+	};
+
+	void Study(Entry& entry);
+	void Evict(Entry* entry);
+
+	static const unsigned int s_maxEntries = 16;
+
+	std::list<Entry*> m_entries; // most recently used first
+	unsigned int m_hits;
+	unsigned int m_misses;
+	wxMutex m_mutex;
+};
+
+#endif // __REGEXCACHE_H__
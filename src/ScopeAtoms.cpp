@@ -0,0 +1,141 @@
+/*******************************************************************************
+ *
+ * Copyright (C) 2009, Alexander Stigsen, e-texteditor.com
+ *
+ * This software is licensed under the Open Company License as described
+ * in the file license.txt, which you should have received as part of this
+ * distribution. The terms are also available at http://opencompany.org/license.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ******************************************************************************/
+
+#include "ScopeAtoms.h"
+#include <algorithm>
+
+ScopeAtoms& ScopeAtoms::Get() {
+	static ScopeAtoms atoms;
+	return atoms;
+}
+
+ScopeAtoms::ScopeAtoms() {
+	// The empty word, scope and stack
+	m_atomIds[wxEmptyString] = 0;
+	m_words.push_back(wxEmptyString);
+	m_scopeIds[wxEmptyString] = 0;
+	m_scopes.push_back(wxEmptyString);
+	m_scopeAtoms.push_back(AtomList());
+	m_stacks.push_back(StackEntry(0, 0));
+}
+
+unsigned int ScopeAtoms::GetAtom(const wxString& word) {
+	wxCriticalSectionLocker lock(m_crit);
+	return DoGetAtom(word);
+}
+
+unsigned int ScopeAtoms::DoGetAtom(const wxString& word) {
+	std::map<wxString, unsigned int>::const_iterator p = m_atomIds.find(word);
+	if (p != m_atomIds.end()) return p->second;
+
+	const unsigned int atom = (unsigned int)m_words.size();
+	m_words.push_back(word.c_str()); // force copy, as it may be from another thread
+	m_atomIds[m_words.back()] = atom;
+	return atom;
+}
+
+const wxString& ScopeAtoms::GetWord(unsigned int atom) {
+	wxCriticalSectionLocker lock(m_crit);
+	wxASSERT(atom < m_words.size());
+	return m_words[atom];
+}
+
+unsigned int ScopeAtoms::GetScopeId(const wxString& scope) {
+	wxCriticalSectionLocker lock(m_crit);
+	return DoGetScopeId(scope);
+}
+
+unsigned int ScopeAtoms::DoGetScopeId(const wxString& scope) {
+	std::map<wxString, unsigned int>::const_iterator p = m_scopeIds.find(scope);
+	if (p != m_scopeIds.end()) return p->second;
+
+	// Split into words (like the selectors, a trailing dot adds no word)
+	AtomList atoms;
+	const size_t len = scope.size();
+	size_t wordstart = 0;
+	for (size_t i = 0; i < len; ++i) {
+		if (scope[i] == wxT('.')) {
+			atoms.push_back(DoGetAtom(scope.substr(wordstart, i - wordstart)));
+			wordstart = i+1;
+		}
+	}
+	if (wordstart < len) atoms.push_back(DoGetAtom(scope.substr(wordstart)));
+
+	const unsigned int scopeId = (unsigned int)m_scopeAtoms.size();
+	m_scopes.push_back(scope.c_str()); // force copy, as it may be from another thread
+	m_scopeAtoms.push_back(atoms);
+	m_scopeIds[m_scopes.back()] = scopeId;
+	return scopeId;
+}
+
+const wxString& ScopeAtoms::GetScope(unsigned int scopeId) {
+	wxCriticalSectionLocker lock(m_crit);
+	wxASSERT(scopeId < m_scopes.size());
+	return m_scopes[scopeId];
+}
+
+const ScopeAtoms::AtomList& ScopeAtoms::GetAtoms(unsigned int scopeId) {
+	wxCriticalSectionLocker lock(m_crit);
+	wxASSERT(scopeId < m_scopeAtoms.size());
+	return m_scopeAtoms[scopeId];
+}
+
+void ScopeAtoms::GetScopes(const std::deque<const wxString*>& scopes, ScopeList& result) {
+	wxCriticalSectionLocker lock(m_crit);
+
+	result.reserve(result.size() + scopes.size());
+	for (std::deque<const wxString*>::const_iterator p = scopes.begin(); p != scopes.end(); ++p) {
+		result.push_back(&m_scopeAtoms[DoGetScopeId(**p)]);
+	}
+}
+
+unsigned int ScopeAtoms::GetStackId(unsigned int parentId, unsigned int scopeId) {
+	if (scopeId == 0) return parentId;
+
+	wxCriticalSectionLocker lock(m_crit);
+	wxASSERT(parentId < m_stacks.size() && scopeId < m_scopeAtoms.size());
+
+	const StackEntry entry(parentId, scopeId);
+	std::map<StackEntry, unsigned int>::const_iterator p = m_stackIds.find(entry);
+	if (p != m_stackIds.end()) return p->second;
+
+	const unsigned int stackId = (unsigned int)m_stacks.size();
+	m_stacks.push_back(entry);
+	m_stackIds[entry] = stackId;
+	return stackId;
+}
+
+void ScopeAtoms::GetStackScopes(unsigned int stackId, ScopeList& result) {
+	wxCriticalSectionLocker lock(m_crit);
+	wxASSERT(stackId < m_stacks.size());
+
+	const size_t start = result.size();
+	while (stackId) {
+		const StackEntry& entry = m_stacks[stackId];
+		result.push_back(&m_scopeAtoms[entry.second]);
+		stackId = entry.first;
+	}
+	std::reverse(result.begin() + start, result.end());
+}
+
+void ScopeAtoms::GetStackNames(unsigned int stackId, std::deque<const wxString*>& result) {
+	wxCriticalSectionLocker lock(m_crit);
+	wxASSERT(stackId < m_stacks.size());
+
+	const size_t start = result.size();
+	while (stackId) {
+		const StackEntry& entry = m_stacks[stackId];
+		result.insert(result.begin() + start, &m_scopes[entry.second]);
+		stackId = entry.first;
+	}
+}
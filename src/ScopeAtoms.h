@@ -0,0 +1,73 @@
+/*******************************************************************************
+ *
+ * Copyright (C) 2009, Alexander Stigsen, e-texteditor.com
+ *
+ * This software is licensed under the Open Company License as described
+ * in the file license.txt, which you should have received as part of this
+ * distribution. The terms are also available at http://opencompany.org/license.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ******************************************************************************/
+
+#ifndef __SCOPEATOMS_H__
+#define __SCOPEATOMS_H__
+
+#include "wx/wxprec.h"
+#ifndef WX_PRECOMP
+   #include <wx/wx.h>
+#endif
+#include <wx/thread.h>
+
+#include <vector>
+#include <deque>
+#include <map>
+
+// Interned scope names. Each word of a scope ("string.quoted.double") gets
+// an atom, so selectors can be matched by comparing integers instead of
+// splitting strings on each lookup. Stacks of scopes are interned as a trie
+// (parent stack + scope), giving each distinct stack a small id that the
+// results of selector matching can be memoized on.
+//
+// Ids are never freed, so they stay valid when bundles are reloaded.
+// It is shared by all threads (the syntax parsers run in the background).
+class ScopeAtoms {
+public:
+	typedef std::vector<unsigned int> AtomList;
+	typedef std::vector<const AtomList*> ScopeList; // outermost scope first
+
+	static ScopeAtoms& Get();
+
+	unsigned int GetAtom(const wxString& word);
+	const wxString& GetWord(unsigned int atom);
+
+	// The empty scope has id 0
+	unsigned int GetScopeId(const wxString& scope);
+	const wxString& GetScope(unsigned int scopeId);
+	const AtomList& GetAtoms(unsigned int scopeId);
+	void GetScopes(const std::deque<const wxString*>& scopes, ScopeList& result);
+
+	// The empty stack has id 0, and pushing the empty scope gives the parent
+	unsigned int GetStackId(unsigned int parentId, unsigned int scopeId);
+	void GetStackScopes(unsigned int stackId, ScopeList& result);
+	void GetStackNames(unsigned int stackId, std::deque<const wxString*>& result);
+
+private:
+	ScopeAtoms();
+	unsigned int DoGetAtom(const wxString& word);
+	unsigned int DoGetScopeId(const wxString& scope);
+
+	typedef std::pair<unsigned int, unsigned int> StackEntry; // parent id, scope id
+
+	std::map<wxString, unsigned int> m_atomIds;
+	std::deque<wxString> m_words;          // by atom
+	std::map<wxString, unsigned int> m_scopeIds;
+	std::deque<wxString> m_scopes;         // by scope id (deque keeps refs valid)
+	std::deque<AtomList> m_scopeAtoms;     // by scope id
+	std::map<StackEntry, unsigned int> m_stackIds;
+	std::vector<StackEntry> m_stacks;      // by stack id
+	wxCriticalSection m_crit;
+};
+
+#endif // __SCOPEATOMS_H__
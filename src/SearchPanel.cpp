@@ -65,12 +65,14 @@ BEGIN_EVENT_TABLE(SearchPanel, wxPanel)
 	EVT_CHECKBOX(CHECK_HIGHLIGHT, SearchPanel::OnMenuHighlight)
 	EVT_CHECKBOX(CHECK_REGEX, SearchPanel::OnMenuRegex)
 	EVT_CHECKBOX(CHECK_MATCHCASE, SearchPanel::OnMenuMatchCase)
+
+	EVT_IDLE(SearchPanel::OnIdle)
 END_EVENT_TABLE()
 
 SearchPanel::SearchPanel(IFrameSearchService& searchService, wxWindow* parent, wxWindowID id, const wxPoint& pos, const wxSize& size):
 	wxPanel(parent, id, pos, size, wxTAB_TRAVERSAL|wxCLIP_CHILDREN|wxNO_BORDER|wxNO_FULL_REPAINT_ON_RESIZE),
 	m_searchService(searchService), m_settings(eGetSettings()),
-	m_use_regex(false), m_match_case(false), m_highlight(true), restart_next_search(false), nosearch(false)
+	m_use_regex(false), m_match_case(false), m_highlight(true), restart_next_search(false), nosearch(false), m_showCount(false)
 {
 	InitAcceleratorTable();
 
@@ -246,6 +248,9 @@ void SearchPanel::SetState(cxFindResult result, int resultCount) {
 
 	wxString results = (0 <= resultCount) ? wxString::Format(wxT("%d results"), resultCount) : wxGetEmptyString();
 	commandResults->SetLabel(results);
+
+	// Highlighted matches are counted by the editor in the background
+	m_showCount = (resultCount < 0 && result != cxNOT_FOUND && m_highlight);
 }
 
 int SearchPanel::GetOptionFlags() {
@@ -293,6 +298,20 @@ void SearchPanel::ReplaceAll() {
 	SetState(resultCount ? cxFOUND : cxNOT_FOUND, resultCount);
 }
 
+void SearchPanel::OnIdle(wxIdleEvent& WXUNUSED(evt)) {
+	if (!m_showCount || !IsShown()) return;
+
+	IEditorSearch* editorSearch = m_searchService.GetSearch();
+	if (!editorSearch) return;
+
+	unsigned int index;
+	unsigned int count;
+	if (!editorSearch->GetMatchCount(index, count)) return;
+
+	const wxString results = (index < count) ? wxString::Format(wxT("%u of %u"), index+1, count) : wxString::Format(wxT("%u results"), count);
+	if (results != commandResults->GetLabel()) commandResults->SetLabel(results);
+}
+
 void SearchPanel::HidePanel() {
 	m_searchService.ShowSearch(false);
 }
@@ -73,6 +73,7 @@ private:
 	void OnMenuRegex(wxCommandEvent& evt);
 	void OnMenuMatchCase(wxCommandEvent& evt);
 	void OnMenuHighlight(wxCommandEvent& evt);
+	void OnIdle(wxIdleEvent& evt);
 	DECLARE_EVENT_TABLE();
 
 	IFrameSearchService& m_searchService;
@@ -102,6 +103,7 @@ private:
 	// Member variables - internal state
 	bool restart_next_search;
 	bool nosearch;
+	bool m_showCount; // match count shown when editor has it
 };
 
 #endif
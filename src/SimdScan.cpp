@@ -0,0 +1,244 @@
+/*******************************************************************************
+ *
+ * Copyright (C) 2009, Alexander Stigsen, e-texteditor.com
+ *
+ * This software is licensed under the Open Company License as described
+ * in the file license.txt, which you should have received as part of this
+ * distribution. The terms are also available at http://opencompany.org/license.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ******************************************************************************/
+
+#include "SimdScan.h"
+#include <cstring>
+
+#ifdef SIMDSCAN_SSE2
+	#include <emmintrin.h>
+	#ifdef _MSC_VER
+		#include <intrin.h>
+	#endif
+#endif
+
+#ifdef SIMDSCAN_SSE2
+static inline unsigned int first_bit(unsigned int mask) {
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return index;
+#else
+	return __builtin_ctz(mask);
+#endif
+}
+#endif
+
+bool ScanUtf8Lines(const char* data, size_t len, EolScanResult& result) {
+	const unsigned char* const p = (const unsigned char*)data;
+	unsigned int removed = 0; // '\n' dropped from "\r\n" pairs
+	bool prev_r = false;
+	size_t i = 0;
+
+#ifdef SIMDSCAN_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i cr = _mm_set1_epi8('\r');
+	const __m128i nl = _mm_set1_epi8('\n');
+#endif
+
+	while (i < len) {
+#ifdef SIMDSCAN_SSE2
+		// Skip ahead over plain ascii (no newlines, nulls or multibyte chars)
+		// A byte directly following '\r' always has to be checked for "\r\n".
+		if (!prev_r) {
+			while (i + 16 <= len) {
+				const __m128i v = _mm_loadu_si128((const __m128i*)(p + i));
+				const unsigned int mask = _mm_movemask_epi8(v)
+					| _mm_movemask_epi8(_mm_cmpeq_epi8(v, zero))
+					| _mm_movemask_epi8(_mm_cmpeq_epi8(v, cr))
+					| _mm_movemask_epi8(_mm_cmpeq_epi8(v, nl));
+				if (mask) {
+					i += first_bit(mask);
+					break;
+				}
+				i += 16;
+			}
+			if (i >= len) break;
+		}
+#endif
+		const unsigned char c = p[i];
+
+		if (c < 0x80) {
+			switch (c) {
+			case '\r':
+				if (prev_r) ++result.nlMac;
+				++result.crCount;
+				result.lineEnds.push_back((unsigned int)(i + 1) - removed);
+				prev_r = true;
+				break;
+
+			case '\n':
+				if (prev_r) {
+					++result.nlDos;
+					++removed;
+				}
+				else {
+					++result.nlUnix;
+					result.lineEnds.push_back((unsigned int)(i + 1) - removed);
+				}
+				prev_r = false;
+				break;
+
+			case '\0':
+				result.isValid = false;
+				return false;
+
+			default:
+				if (prev_r) ++result.nlMac;
+				prev_r = false;
+			}
+			++i;
+			continue;
+		}
+
+		if (prev_r) ++result.nlMac;
+		prev_r = false;
+
+		// Validate multibyte sequence
+		unsigned int extra;
+		if ((c & 0xE0) == 0xC0) extra = 1;
+		else if ((c & 0xF0) == 0xE0) extra = 2;
+		else if ((c & 0xF8) == 0xF0) extra = 3;
+		else {
+			// Stray continuation byte or invalid lead byte
+			result.isValid = false;
+			return false;
+		}
+
+		// A sequence cut short by the end of the data is accepted
+		// (same as the old byte-by-byte loader did)
+		size_t k = 1;
+		for (; k <= extra && i + k < len; ++k) {
+			if ((p[i+k] & 0xC0) != 0x80) {
+				result.isValid = false;
+				return false;
+			}
+		}
+		i += k;
+	}
+
+	result.outLen = (unsigned int)len - removed;
+	return true;
+}
+
+const char* FindEol(const char* begin, const char* end) {
+	const char* p = begin;
+
+#ifdef SIMDSCAN_SSE2
+	const __m128i cr = _mm_set1_epi8('\r');
+	const __m128i nl = _mm_set1_epi8('\n');
+	while (p + 16 <= end) {
+		const __m128i v = _mm_loadu_si128((const __m128i*)p);
+		const unsigned int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, cr), _mm_cmpeq_epi8(v, nl)));
+		if (mask) return p + first_bit(mask);
+		p += 16;
+	}
+#endif
+
+	for (; p < end; ++p) {
+		if (*p == '\r' || *p == '\n') return p;
+	}
+	return end;
+}
+
+size_t CountByte(const char* begin, const char* end, char c) {
+	const char* p = begin;
+	size_t count = 0;
+
+#ifdef SIMDSCAN_SSE2
+	const __m128i needle = _mm_set1_epi8(c);
+	while (p + 16 <= end) {
+		// Accumulate up to 255 blocks in byte counters before summing up
+		__m128i acc = _mm_setzero_si128();
+		unsigned int blocks = 0;
+		while (p + 16 <= end && blocks < 255) {
+			const __m128i v = _mm_loadu_si128((const __m128i*)p);
+			acc = _mm_sub_epi8(acc, _mm_cmpeq_epi8(v, needle));
+			p += 16;
+			++blocks;
+		}
+		const __m128i sums = _mm_sad_epu8(acc, _mm_setzero_si128());
+		count += _mm_cvtsi128_si32(sums) + _mm_cvtsi128_si32(_mm_srli_si128(sums, 8));
+	}
+#endif
+
+	for (; p < end; ++p) {
+		if (*p == c) ++count;
+	}
+	return count;
+}
+
+// - ByteSet ---
+
+void ByteSet::Clear() {
+	memset(m_table, 0, sizeof(m_table));
+	m_rangeCount = 0;
+}
+
+void ByteSet::Prepare() {
+	m_rangeCount = 0;
+	unsigned int c = 0;
+	while (c < 256) {
+		if (!m_table[c]) {++c; continue;}
+
+		const unsigned int first = c;
+		while (c < 256 && m_table[c]) ++c;
+
+		if (m_rangeCount == MAX_RANGES) {
+			++m_rangeCount;
+			return;
+		}
+		m_rangeStart[m_rangeCount] = (unsigned char)first;
+		m_rangeSpan[m_rangeCount] = (unsigned char)(c - 1 - first);
+		++m_rangeCount;
+	}
+}
+
+const char* ByteSet::FindFirst(const char* begin, const char* end) const {
+	const unsigned char* p = (const unsigned char*)begin;
+	const unsigned char* const e = (const unsigned char*)end;
+
+	// Dense sets usually match right away
+	if (p < e && m_table[*p]) return (const char*)p;
+
+#ifdef SIMDSCAN_SSE2
+	if (m_rangeCount <= MAX_RANGES) {
+		if (m_rangeCount == 0) return end;
+
+		__m128i starts[MAX_RANGES];
+		__m128i spans[MAX_RANGES];
+		for (unsigned int r = 0; r < m_rangeCount; ++r) {
+			starts[r] = _mm_set1_epi8((char)m_rangeStart[r]);
+			spans[r] = _mm_set1_epi8((char)m_rangeSpan[r]);
+		}
+
+		while (p + 16 <= e) {
+			// c is in range if (c - start) <= span (unsigned)
+			const __m128i v = _mm_loadu_si128((const __m128i*)p);
+			__m128i hits = _mm_setzero_si128();
+			for (unsigned int r = 0; r < m_rangeCount; ++r) {
+				const __m128i offset = _mm_sub_epi8(v, starts[r]);
+				hits = _mm_or_si128(hits, _mm_cmpeq_epi8(_mm_min_epu8(offset, spans[r]), offset));
+			}
+
+			const unsigned int mask = _mm_movemask_epi8(hits);
+			if (mask) return (const char*)(p + first_bit(mask));
+			p += 16;
+		}
+	}
+#endif
+
+	for (; p < e; ++p) {
+		if (m_table[*p]) break;
+	}
+	return (const char*)p;
+}
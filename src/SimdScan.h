@@ -0,0 +1,82 @@
+/*******************************************************************************
+ *
+ * Copyright (C) 2009, Alexander Stigsen, e-texteditor.com
+ *
+ * This software is licensed under the Open Company License as described
+ * in the file license.txt, which you should have received as part of this
+ * distribution. The terms are also available at http://opencompany.org/license.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ******************************************************************************/
+
+#ifndef __SIMDSCAN_H__
+#define __SIMDSCAN_H__
+
+#include <vector>
+#include <cstddef>
+
+// Block scanning kernels for large text buffers.
+// They use SSE2 when the compiler targets it and fall back to plain
+// scalar loops otherwise, so results are identical on all platforms.
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#define SIMDSCAN_SSE2
+#endif
+
+// Result of scanning a block of UTF-8 text for line endings.
+// Line ends are in output coordinates (after "\r\n" and "\r" have been
+// normalized to "\n") relative to the start of the block.
+class EolScanResult {
+public:
+	EolScanResult() : outLen(0), nlDos(0), nlMac(0), nlUnix(0), crCount(0), isValid(true) {};
+
+	std::vector<unsigned int> lineEnds;
+	unsigned int outLen;
+	unsigned int nlDos;
+	unsigned int nlMac;
+	unsigned int nlUnix;
+	unsigned int crCount;
+	bool isValid;
+};
+
+// Validates UTF-8 and collects line endings in a single pass.
+// The block has to start at a character boundary and not in the middle
+// of a "\r\n" pair (splitting right after a '\n' satisfies both).
+bool ScanUtf8Lines(const char* data, size_t len, EolScanResult& result);
+
+// Returns pointer to first '\r' or '\n' in [begin,end), or end if none
+const char* FindEol(const char* begin, const char* end);
+
+// Counts occurences of byte c in [begin,end)
+size_t CountByte(const char* begin, const char* end, char c);
+
+// Set of byte values that can be searched for with FindFirst.
+// Blocks are tested against the ranges of the set, so it only beats
+// the scalar table lookup when the set consists of a few ranges.
+class ByteSet {
+public:
+	ByteSet() {Clear();};
+
+	void Clear();
+	void Add(unsigned char c) {m_table[c] = true;};
+	void Remove(unsigned char c) {m_table[c] = false;};
+	bool Contains(unsigned char c) const {return m_table[c];};
+
+	// Has to be called after modifying the set
+	void Prepare();
+
+	// Returns pointer to first byte in [begin,end) in the set, or end if none
+	const char* FindFirst(const char* begin, const char* end) const;
+
+private:
+	static const unsigned int MAX_RANGES = 8;
+
+	bool m_table[256];
+	unsigned int m_rangeCount; // MAX_RANGES+1 if too many for block scan
+	unsigned char m_rangeStart[MAX_RANGES];
+	unsigned char m_rangeSpan[MAX_RANGES]; // last - start
+};
+
+#endif // __SIMDSCAN_H__
@@ -990,7 +990,10 @@ bool SnippetHandler::ParseTransform(Transformation& tr) {
 
 	// Covert regex from Onigoruma to PCRE syntax
 	wxString regex(&content[m_pos], wxConvUTF8, regex_end-m_pos);
-	matcher::RegExConvert(regex);
+	{
+		wxCriticalSectionLocker lock(matcher::GetLock());
+		matcher::RegExConvert(regex);
+	}
 	wxCharBuffer buf = regex.mb_str(wxConvUTF8);
 
 	tr.regexp.assign(buf.data(), buf.data()+strlen(buf.data()));
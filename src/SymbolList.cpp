@@ -16,6 +16,7 @@
 #include "eSettings.h"
 #include "EditorCtrl.h"
 #include "Strings.h"
+#include "pcre.h"
 
 #include <algorithm>
 
@@ -76,13 +77,39 @@ void SymbolList::LoadFilters() {
 	m_filters = filters;
 	
 	const wxArrayString filtersList = wxSplit(m_filters, wxT('\n'), wxT('\0'));
-	m_regexFilters.clear();
-	
+
+	// Compile the valid filters into a single pattern, so that
+	// each symbol only has to be matched once
+	wxString pattern;
 	for(unsigned int c = 0; c < filtersList.GetCount(); c++) {
-		//m_regexes.push_back(Compile(filters[c]));
-		if(filtersList[c].Trim().Len() == 0) continue;
-		m_regexFilters.push_back(filtersList[c]);
+		wxString filter = filtersList[c];
+		if(filter.Trim().Len() == 0) continue;
+		if (!RegexCache::Get().Lookup(filter, PCRE_UTF8).IsOk()) continue;
+
+		if (!pattern.empty()) pattern += wxT('|');
+		pattern += wxT("(?:") + filter + wxT(')');
 	}
+
+	m_filterPattern = pattern.empty() ? RegexCache::Pattern() : RegexCache::Get().Lookup(pattern, PCRE_UTF8, true);
+}
+
+bool SymbolList::IsFiltered(const wxString& symbol) const {
+	if (!m_filterPattern.IsOk() || symbol.empty()) return false;
+
+	const wxCharBuffer subject = symbol.mb_str(wxConvUTF8);
+	const int OVECCOUNT = 3;
+	int ovector[OVECCOUNT];
+	const int rc = pcre_exec(
+		m_filterPattern.GetRegex(),   // the compiled pattern
+		m_filterPattern.GetStudy(),   // extra data from studying the pattern
+		subject.data(),               // the subject string
+		(int)strlen(subject.data()),  // the length of the subject
+		0,                            // start at offset in the subject
+		PCRE_NO_UTF8_CHECK,           // options
+		ovector,                      // output vector for substring information
+		OVECCOUNT);                   // number of elements in the output vector
+
+	return rc >= 0;
 }
 
 void SymbolList::OnIdle(wxIdleEvent& WXUNUSED(event)) {
@@ -111,21 +138,8 @@ void SymbolList::OnIdle(wxIdleEvent& WXUNUSED(event)) {
 		wxLogDebug(wxT("Doing Search"));
 		for (vector<SymbolRef>::const_iterator p = m_symbols.begin(); p != m_symbols.end(); ++p) {
 			const SymbolRef& sr = *p;
-			wxString symbol = m_editorSymbols->GetSymbolString(sr);
-			std::vector<char> symbolVector;
-			for(unsigned int c = 0; c < symbol.Len(); c++) {
-				symbolVector.push_back(symbol[c]);
-			}
-
-			bool good = true;
-			for(unsigned int c = 0; c < m_regexFilters.size(); c++) {
-				search_result sr = EditorCtrl::RawRegexSearch(m_regexFilters[c].mb_str(wxConvUTF8), symbolVector, 0, NULL);
-				if(sr.error_code > 0) {
-					good = false;
-					break;
-				}
-			}
-			if(!good) continue;
+			const wxString symbol = m_editorSymbols->GetSymbolString(sr);
+			if (IsFiltered(symbol)) continue;
 
 			symbolsTemp.push_back(sr);
 			m_symbolStrings.Add(symbol);
@@ -138,8 +152,14 @@ void SymbolList::OnIdle(wxIdleEvent& WXUNUSED(event)) {
 		// reload symbol strings
 		for (vector<SymbolRef>::const_iterator p = m_symbols.begin(); p != m_symbols.end(); ++p) {
 			const SymbolRef& sr = *p;
-			m_symbolStrings.Add(m_editorSymbols->GetSymbolString(sr));
+			const wxString symbol = m_editorSymbols->GetSymbolString(sr);
+			if (IsFiltered(symbol)) continue;
+
+			symbolsTemp.push_back(sr);
+			m_symbolStrings.Add(symbol);
 		}
+
+		m_symbols = symbolsTemp;
 		m_listBox->SetAllItems();
 	}
 	else {
@@ -218,6 +238,7 @@ SymbolList::ActionList::ActionList(wxWindow* parent, wxWindowID id, const wxArra
 
 void SymbolList::ActionList::SetAllItems() {
 	m_items.clear();
+	m_itemsText.clear(); // actions may have changed
 
 	Freeze();
 
@@ -264,9 +285,21 @@ void SymbolList::ActionList::Find(const wxString& searchtext, bool refresh) {
 	// Convert to upper case for case insensitive search
 	const wxString text = searchtext.Upper();
 
+	// If the search was extended, only the current items can still match
+	vector<unsigned int> candidates;
+	const bool narrowing = !m_itemsText.empty() && text.StartsWith(m_itemsText);
+	if (narrowing) {
+		candidates.reserve(m_items.size());
+		for (vector<aItem>::const_iterator p = m_items.begin(); p != m_items.end(); ++p)
+			candidates.push_back(p->id);
+		sort(candidates.begin(), candidates.end());
+	}
+	const unsigned int count = narrowing ? candidates.size() : m_actions.GetCount();
+
 	m_items.clear();
 	vector<unsigned int> hlChars;
-	for (unsigned int i = 0; i < m_actions.GetCount(); ++i) {
+	for (unsigned int n = 0; n < count; ++n) {
+		const unsigned int i = narrowing ? candidates[n] : n;
 		const wxString& name = m_actions[i];
 		unsigned int charpos = 0;
 		wxChar c = text[charpos];
@@ -287,6 +320,7 @@ void SymbolList::ActionList::Find(const wxString& searchtext, bool refresh) {
 	}
 
 	sort(m_items.begin(), m_items.end());
+	m_itemsText = text;
 
 	Freeze();
 	SetItemCount(m_items.size());
@@ -22,6 +22,7 @@
 
 #include "SearchListBox.h"
 #include "IEditorSymbols.h"
+#include "RegexCache.h"
 
 #include <vector>
 
@@ -34,6 +35,8 @@ public:
 	void LoadFilters();
 
 private:
+	bool IsFiltered(const wxString& symbol) const;
+
 	void OnIdle(wxIdleEvent& event);
 	void OnSearch(wxCommandEvent& event);
 	void OnAction(wxCommandEvent& event);
@@ -74,6 +77,7 @@ private:
 		const wxArrayString& m_actions;
 		std::vector<aItem> m_items;
 		wxString m_searchText;
+		wxString m_itemsText; // upper case search m_items were found with
 	};
 
 	// Member variables
@@ -89,7 +93,7 @@ private:
 
 	std::vector<SymbolRef> m_symbols;
 	wxArrayString m_symbolStrings;
-	std::vector<wxString> m_regexFilters;
+	RegexCache::Pattern m_filterPattern; // all filters as one alternation
 	wxString m_filters;
 };
 
@@ -0,0 +1,215 @@
+/*******************************************************************************
+ *
+ * Copyright (C) 2009, Alexander Stigsen, e-texteditor.com
+ *
+ * This software is licensed under the Open Company License as described
+ * in the file license.txt, which you should have received as part of this
+ * distribution. The terms are also available at http://opencompany.org/license.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ******************************************************************************/
+
+#include "TextWriterThread.h"
+#include "Utf.h"
+
+#ifdef __WXMSW__
+	#include <io.h>
+#else
+	#include <unistd.h>
+#endif
+
+using namespace std;
+
+// Max number of blocks waiting to be written
+static const size_t s_maxQueued = 4;
+
+static const char* s_nulls = "\0\0\0\0";
+
+static const char* FindByte(const char* p, const char* end, char c) {
+	const char* r = (const char*)memchr(p, c, end - p);
+	return r ? r : end;
+}
+
+static const char* FindNullStandIn(const char* p, const char* end) {
+	// Nulls are stored as a private use char ("\xEF\xA3\xBF")
+	for (;;) {
+		p = FindByte(p, end, '\xEF');
+		if (end - p < 3) return end;
+		if (p[1] == '\xA3' && p[2] == '\xBF') return p;
+		++p;
+	}
+}
+
+TextWriterThread::TextWriterThread(wxFFile& file, wxFontEncoding enc, bool unixEol, const char* nl, unsigned int nl_len, unsigned int char_len, bool doSync)
+: wxThread(wxTHREAD_JOINABLE), m_file(file), m_writer(file), m_encoding(enc), m_unixEol(unixEol),
+  m_nl(nl), m_nlLen(nl_len), m_charLen(char_len), m_doSync(doSync), m_conv(NULL),
+  m_utf8BuffLen(128), m_utf8Buff(m_utf8BuffLen), m_wcharBuffLen(128), m_wcharBuff(m_wcharBuffLen),
+  m_outBuffLen(128), m_outBuff(m_outBuffLen), m_queueCond(m_queueMutex),
+  m_isRunning(false), m_isDone(false), m_result(cxFILE_OK)
+{
+	if (m_encoding != wxFONTENCODING_UTF8) m_conv = new wxCSConv(m_encoding);
+
+	// If we can't get a thread, the blocks will be written directly from AddBlock()
+	if (Create() == wxTHREAD_NO_ERROR && Run() == wxTHREAD_NO_ERROR) m_isRunning = true;
+}
+
+TextWriterThread::~TextWriterThread() {
+	if (m_isRunning) {
+		{
+			wxMutexLocker lock(m_queueMutex);
+			m_isDone = true;
+			m_queueCond.Broadcast();
+		}
+		Wait();
+	}
+
+	for (deque<vector<char>*>::iterator p = m_queue.begin(); p != m_queue.end(); ++p) delete *p;
+	delete m_conv;
+}
+
+void TextWriterThread::AddBlock(vector<char>& block) {
+	if (block.empty()) return;
+
+	if (!m_isRunning) {
+		if (m_result == cxFILE_OK) m_result = WriteBlock(block);
+		block.clear();
+		return;
+	}
+
+	vector<char>* b = new vector<char>;
+	b->swap(block);
+
+	wxMutexLocker lock(m_queueMutex);
+
+	// Keep memory usage down by waiting if the writer falls behind
+	while (m_queue.size() >= s_maxQueued && m_result == cxFILE_OK) m_queueCond.Wait();
+
+	if (m_result != cxFILE_OK) {
+		delete b; // no need to write more
+		return;
+	}
+
+	m_queue.push_back(b);
+	m_queueCond.Broadcast();
+}
+
+cxFileResult TextWriterThread::Finish() {
+	if (m_isRunning) {
+		{
+			wxMutexLocker lock(m_queueMutex);
+			m_isDone = true;
+			m_queueCond.Broadcast();
+		}
+		Wait();
+		m_isRunning = false;
+	}
+	else if (m_result == cxFILE_OK && (!m_writer.Flush() || (m_doSync && !SyncFile()))) {
+		m_result = cxFILE_OPEN_ERROR;
+	}
+
+	return m_result;
+}
+
+bool TextWriterThread::IsOk() {
+	wxMutexLocker lock(m_queueMutex);
+	return m_result == cxFILE_OK;
+}
+
+void* TextWriterThread::Entry() {
+	for (;;) {
+		vector<char>* block = NULL;
+		{
+			wxMutexLocker lock(m_queueMutex);
+			while (m_queue.empty() && !m_isDone) m_queueCond.Wait();
+			if (m_queue.empty()) break; // all blocks written
+
+			block = m_queue.front();
+			m_queue.pop_front();
+			m_queueCond.Broadcast(); // room for more blocks
+		}
+
+		const cxFileResult result = WriteBlock(*block);
+		delete block;
+
+		if (result != cxFILE_OK) {
+			wxMutexLocker lock(m_queueMutex);
+			m_result = result;
+			m_queueCond.Broadcast();
+			return NULL;
+		}
+	}
+
+	// Make sure everything is on disk before the file gets renamed
+	if (!m_writer.Flush() || (m_doSync && !SyncFile())) {
+		wxMutexLocker lock(m_queueMutex);
+		m_result = cxFILE_OPEN_ERROR;
+	}
+
+	return NULL;
+}
+
+cxFileResult TextWriterThread::WriteBlock(const vector<char>& block) {
+	const char* p = &*block.begin();
+	const char* const end = p + block.size();
+
+	// Text is written in as large runs as possible, only broken
+	// up where newlines (if not unix) or nulls have to be converted.
+	const char* nextNl = NULL;
+	const char* nextNull = NULL;
+	while (p < end) {
+		if (nextNl < p) nextNl = m_unixEol ? end : FindByte(p, end, '\n');
+		if (nextNull < p) nextNull = FindNullStandIn(p, end);
+
+		const char* brk = wxMin(nextNl, nextNull);
+		if (!WriteText(p, brk)) return cxFILE_CONV_ERROR;
+		if (brk == end) break;
+
+		if (brk == nextNull) {
+			m_writer.Write(s_nulls, m_charLen);
+			p = brk + 3;
+		}
+		else {
+			m_writer.Write(m_nl, m_nlLen);
+			p = brk + 1;
+		}
+	}
+
+	return m_writer.IsOk() ? cxFILE_OK : cxFILE_OPEN_ERROR;
+}
+
+bool TextWriterThread::WriteText(const char* begin, const char* end) {
+	const size_t len = end - begin;
+	if (len == 0) return true;
+
+	// Fast path: internal text is already utf-8
+	if (m_encoding == wxFONTENCODING_UTF8) {
+		m_writer.Write(begin, len);
+		return true;
+	}
+
+	// Conversion needs a null terminated buffer
+	if (m_utf8BuffLen < len+1) {
+		m_utf8BuffLen = len+1;
+		m_utf8Buff = wxCharBuffer(m_utf8BuffLen);
+	}
+	memcpy(m_utf8Buff.data(), begin, len);
+	m_utf8Buff.data()[len] = '\0';
+
+	const size_t out_len = ConvertFromUTF8(m_utf8Buff, *m_conv, m_wcharBuff, m_wcharBuffLen, m_outBuff, m_outBuffLen, m_charLen);
+	if (out_len == (size_t)-1) return false; // Conversion failed
+	if (out_len) m_writer.Write(m_outBuff.data(), out_len);
+
+	return true;
+}
+
+bool TextWriterThread::SyncFile() {
+	if (!m_file.Flush()) return false;
+
+#ifdef __WXMSW__
+	return _commit(_fileno(m_file.fp())) == 0;
+#else
+	return fsync(fileno(m_file.fp())) == 0;
+#endif
+}
@@ -0,0 +1,77 @@
+/*******************************************************************************
+ *
+ * Copyright (C) 2009, Alexander Stigsen, e-texteditor.com
+ *
+ * This software is licensed under the Open Company License as described
+ * in the file license.txt, which you should have received as part of this
+ * distribution. The terms are also available at http://opencompany.org/license.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ******************************************************************************/
+
+#ifndef __TEXTWRITERTHREAD_H__
+#define __TEXTWRITERTHREAD_H__
+
+#include "wx/wxprec.h"
+#ifndef WX_PRECOMP
+	#include <wx/wx.h>
+#endif
+
+#include <wx/thread.h>
+#include <wx/ffile.h>
+#include <vector>
+#include <deque>
+#include "Catalyst.h"
+#include "BlockWriter.h"
+
+// Encodes and writes document text on a worker thread.
+// The saving thread reads the (utf-8) text in large blocks and hands them
+// over with AddBlock(). Newlines are converted to the target eol type and
+// the null stand-ins are converted back to real nulls.
+class TextWriterThread : public wxThread {
+public:
+	TextWriterThread(wxFFile& file, wxFontEncoding enc, bool unixEol, const char* nl, unsigned int nl_len, unsigned int char_len, bool doSync);
+	~TextWriterThread();
+
+	void AddBlock(std::vector<char>& block); // takes content of block (leaving it empty)
+	cxFileResult Finish();
+	bool IsOk();
+
+	virtual void* Entry();
+
+private:
+	cxFileResult WriteBlock(const std::vector<char>& block);
+	bool WriteText(const char* begin, const char* end);
+	bool SyncFile();
+
+	// Output
+	wxFFile& m_file;
+	BlockWriter m_writer;
+	const wxFontEncoding m_encoding;
+	const bool m_unixEol;
+	const char* m_nl;
+	const unsigned int m_nlLen;
+	const unsigned int m_charLen;
+	const bool m_doSync;
+
+	// Conversion buffers (only used from the writing thread)
+	wxCSConv* m_conv;
+	size_t m_utf8BuffLen;
+	wxCharBuffer m_utf8Buff;
+	size_t m_wcharBuffLen;
+	wxWCharBuffer m_wcharBuff;
+	size_t m_outBuffLen;
+	wxCharBuffer m_outBuff;
+
+	// Block queue
+	std::deque<std::vector<char>*> m_queue;
+	wxMutex m_queueMutex;
+	wxCondition m_queueCond;
+	bool m_isRunning;
+	bool m_isDone;
+	cxFileResult m_result;
+};
+
+#endif // __TEXTWRITERTHREAD_H__
@@ -0,0 +1,505 @@
+/*******************************************************************************
+ *
+ * Copyright (C) 2009, Alexander Stigsen, e-texteditor.com
+ *
+ * This software is licensed under the Open Company License as described
+ * in the file license.txt, which you should have received as part of this
+ * distribution. The terms are also available at http://opencompany.org/license.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ******************************************************************************/
+
+#include "TrigramIndex.h"
+#include "Trigrams.h"
+#include "ProjectInfoHandler.h"
+#include "IAppPaths.h"
+#include <wx/ffile.h>
+#include <algorithm>
+#include <memory>
+
+// Files bigger than this are not indexed (and so always searched)
+static const wxFileOffset s_maxIndexedFileSize = 64 * 1024 * 1024;
+static const unsigned int s_indexVersion = 1;
+
+// - TrigramIndexBuilder ---
+
+// Builds the index (or checks an existing one for changes) in the background
+class TrigramIndexBuilder : public wxThread {
+public:
+	TrigramIndexBuilder(TrigramIndex& index, bool verifyOnly, unsigned int startStamp);
+	virtual void* Entry();
+	void Cancel() {m_cancel = true;};
+
+private:
+	// Posting lists are kept as varint encoded deltas while building
+	class Posting {
+	public:
+		Posting() : last(0) {};
+		unsigned int last;
+		std::vector<unsigned char> ids;
+	};
+
+	bool Verify();
+	bool Build();
+	void IndexDir(const wxString& path, ProjectInfoHandler& infoHandler);
+	void IndexFile(const wxString& path);
+	void AddTrigram(unsigned int key, unsigned int fileId);
+	bool Write(const wxString& path);
+
+	TrigramIndex& m_index;
+	const bool m_verifyOnly;
+	const unsigned int m_startStamp;
+	wxFileName m_projectPath;
+	wxString m_rootPath;
+	wxString m_indexPath;
+	volatile bool m_cancel;
+
+	// Build state
+	MMapBuffer m_buf;
+	std::vector<TrigramIndex::FileEntry> m_files;
+	std::string m_strings;
+	std::vector<unsigned int> m_seen; // bitmap of trigrams in current file
+	std::vector<unsigned int> m_keys;
+	std::vector< std::vector<Posting*> > m_postings; // two-level table by key
+};
+
+TrigramIndexBuilder::TrigramIndexBuilder(TrigramIndex& index, bool verifyOnly, unsigned int startStamp)
+: wxThread(wxTHREAD_JOINABLE), m_index(index), m_verifyOnly(verifyOnly), m_startStamp(startStamp), m_cancel(false) {
+	// wxString is not threadsafe, so we have to force copy
+	m_projectPath = index.m_projectPath.GetFullPath().c_str();
+	m_rootPath = index.m_rootPath.c_str();
+	m_indexPath = index.GetIndexPath().c_str();
+}
+
+void* TrigramIndexBuilder::Entry() {
+	// If too much has changed since the index was written, we rebuild it
+	if (m_verifyOnly && Verify()) return NULL;
+
+	if (Build() && Write(m_indexPath + wxT(".tmp"))) {
+		m_index.OnBuildDone(m_indexPath, m_startStamp);
+	}
+
+	// Clean up
+	for (std::vector< std::vector<Posting*> >::iterator b = m_postings.begin(); b != m_postings.end(); ++b) {
+		for (std::vector<Posting*>::iterator p = b->begin(); p != b->end(); ++p) delete *p;
+	}
+	return NULL;
+}
+
+bool TrigramIndexBuilder::Verify() {
+	// Get list of indexed files
+	std::vector< std::pair<std::string, unsigned int> > files;
+	{
+		wxCriticalSectionLocker lock(m_index.m_crit);
+		const TrigramIndex::Mapping* mapping = m_index.m_mapping;
+		if (!mapping) return false;
+
+		files.reserve(mapping->header->fileCount);
+		for (unsigned int i = 0; i < mapping->header->fileCount; ++i) {
+			const TrigramIndex::FileEntry& f = mapping->files[i];
+			files.push_back(std::make_pair(std::string(mapping->strings + f.pathOffset, f.pathLen), f.modDate));
+		}
+	}
+
+	// Check which files have changed while we were not watching
+	std::vector<std::string> changed;
+	for (std::vector< std::pair<std::string, unsigned int> >::const_iterator p = files.begin(); p != files.end(); ++p) {
+		if (m_cancel) return true;
+
+		wxString relPath(p->first.c_str(), wxConvUTF8);
+		relPath.Replace(wxT("/"), wxString(wxFILE_SEP_PATH));
+		const wxFileName path(m_rootPath + relPath);
+		if (!path.FileExists()) continue; // deleted files are never found anyway
+
+		const unsigned int modDate = (unsigned int)path.GetModificationTime().GetTicks();
+		if (modDate != p->second) changed.push_back(p->first);
+	}
+	if (changed.size() > TrigramIndex::s_rebuildLimit) return false;
+
+	wxCriticalSectionLocker lock(m_index.m_crit);
+	for (std::vector<std::string>::const_iterator c = changed.begin(); c != changed.end(); ++c) {
+		m_index.m_changed[*c] = m_index.m_changeStamp++;
+	}
+	return true;
+}
+
+bool TrigramIndexBuilder::Build() {
+	m_seen.resize((1 << 24) / 32);
+	m_postings.resize(1 << 12);
+
+	ProjectInfoHandler infoHandler;
+	infoHandler.SetRoot(m_projectPath);
+	IndexDir(m_rootPath, infoHandler);
+
+	return !m_cancel;
+}
+
+void TrigramIndexBuilder::IndexDir(const wxString& path, ProjectInfoHandler& infoHandler) {
+	wxArrayString dirs;
+	wxArrayString filenames;
+	infoHandler.GetDirAndFileLists(path, dirs, filenames);
+
+	for (size_t f = 0; f < filenames.size(); ++f) {
+		if (m_cancel) return;
+		IndexFile(path + filenames[f]);
+	}
+
+	for (size_t d = 0; d < dirs.size(); ++d) {
+		if (m_cancel) return;
+		IndexDir(path + dirs[d] + wxFILE_SEP_PATH, infoHandler);
+	}
+}
+
+void TrigramIndexBuilder::IndexFile(const wxString& path) {
+	const wxFileName filepath(path);
+
+	// Files that are not in the index are always searched
+	m_buf.Open(filepath);
+	if (!m_buf.IsMapped()) return;
+	const wxFileOffset len = m_buf.Length();
+	if (len > s_maxIndexedFileSize) {
+		m_buf.Close();
+		return;
+	}
+
+	// Add file entry (path relative to root in utf8 with unix separators)
+	wxString relPath = path.Mid(m_rootPath.size());
+	relPath.Replace(wxT("\\"), wxT("/"));
+	const wxCharBuffer relPathUtf8 = relPath.mb_str(wxConvUTF8);
+	const TrigramIndex::FileEntry entry = {(unsigned int)m_strings.size(), (unsigned int)strlen(relPathUtf8), (unsigned int)filepath.GetModificationTime().GetTicks()};
+	m_strings.append(relPathUtf8.data(), entry.pathLen);
+	const unsigned int fileId = m_files.size();
+	m_files.push_back(entry);
+
+	// Binary files are skipped by search, so they get no trigrams
+	// (we use same check as SearchThread)
+	const unsigned char* const data = (const unsigned char*)m_buf.data();
+	if (memchr(data, '\0', wxMin(100, len))) {
+		m_buf.Close();
+		return;
+	}
+
+	// Collect unique trigrams in file
+	for (wxFileOffset i = 0; i + 3 <= len; ++i) {
+		const unsigned int key = TrigramKey(data + i);
+		unsigned int& word = m_seen[key >> 5];
+		const unsigned int bit = 1U << (key & 31);
+		if (word & bit) continue;
+
+		word |= bit;
+		m_keys.push_back(key);
+	}
+	m_buf.Close();
+
+	for (std::vector<unsigned int>::const_iterator k = m_keys.begin(); k != m_keys.end(); ++k) {
+		AddTrigram(*k, fileId);
+		m_seen[*k >> 5] = 0;
+	}
+	m_keys.clear();
+}
+
+void TrigramIndexBuilder::AddTrigram(unsigned int key, unsigned int fileId) {
+	std::vector<Posting*>& block = m_postings[key >> 12];
+	if (block.empty()) block.resize(1 << 12, NULL);
+
+	Posting*& posting = block[key & 0xFFF];
+	if (!posting) posting = new Posting();
+
+	AppendVarint(posting->ids, fileId - posting->last);
+	posting->last = fileId;
+}
+
+bool TrigramIndexBuilder::Write(const wxString& path) {
+	// Build trigram table (keys are sorted by the table layout)
+	std::vector<TrigramIndex::TrigramEntry> trigrams;
+	unsigned int postingsSize = 0;
+	for (unsigned int b = 0; b < m_postings.size(); ++b) {
+		const std::vector<Posting*>& block = m_postings[b];
+		for (unsigned int i = 0; i < block.size(); ++i) {
+			if (!block[i]) continue;
+			const TrigramIndex::TrigramEntry entry = {(b << 12) | i, postingsSize, (unsigned int)block[i]->ids.size()};
+			trigrams.push_back(entry);
+			postingsSize += entry.size;
+		}
+	}
+
+	TrigramIndex::Header header;
+	memcpy(header.magic, "eTRI", 4);
+	header.version = s_indexVersion;
+	header.fileCount = m_files.size();
+	header.trigramCount = trigrams.size();
+	header.filesOffset = sizeof(header);
+	header.trigramsOffset = header.filesOffset + header.fileCount * sizeof(TrigramIndex::FileEntry);
+	header.postingsOffset = header.trigramsOffset + header.trigramCount * sizeof(TrigramIndex::TrigramEntry);
+	header.stringsOffset = header.postingsOffset + postingsSize;
+	header.stringsSize = m_strings.size();
+
+	wxFFile file(path, wxT("wb"));
+	if (!file.IsOpened()) return false;
+
+	file.Write(&header, sizeof(header));
+	if (!m_files.empty()) file.Write(&*m_files.begin(), m_files.size() * sizeof(TrigramIndex::FileEntry));
+	if (!trigrams.empty()) file.Write(&*trigrams.begin(), trigrams.size() * sizeof(TrigramIndex::TrigramEntry));
+	for (unsigned int b = 0; b < m_postings.size(); ++b) {
+		const std::vector<Posting*>& block = m_postings[b];
+		for (unsigned int i = 0; i < block.size(); ++i) {
+			if (block[i]) file.Write(&*block[i]->ids.begin(), block[i]->ids.size());
+		}
+	}
+	file.Write(m_strings.data(), m_strings.size());
+
+	return !file.Error() && file.Close();
+}
+
+// - TrigramIndex ---
+
+TrigramIndex::TrigramIndex()
+: m_mapping(NULL), m_changeStamp(0), m_generation(0), m_builder(NULL) {
+}
+
+TrigramIndex::~TrigramIndex() {
+	Close();
+}
+
+void TrigramIndex::Open(const wxFileName& projectPath) {
+	Close();
+
+	{
+		wxCriticalSectionLocker lock(m_crit);
+		m_projectPath = projectPath;
+		m_rootPath = projectPath.GetPath() + wxFILE_SEP_PATH;
+	}
+	const wxString indexPath = GetIndexPath(); // only we change the root path
+
+	// Reuse the index from last session, but check that it is still valid
+	Mapping* mapping = Load(indexPath);
+
+	wxCriticalSectionLocker lock(m_crit);
+	delete SetMapping(mapping);
+	StartBuilder(mapping != NULL);
+}
+
+void TrigramIndex::Close() {
+	StopBuilder();
+
+	Mapping* mapping;
+	{
+		wxCriticalSectionLocker lock(m_crit);
+		mapping = SetMapping(NULL);
+		m_changed.clear();
+		m_projectPath.Clear();
+		m_rootPath.clear();
+	}
+	delete mapping; // unmapped outside the lock
+}
+
+bool TrigramIndex::IsReady() {
+	wxCriticalSectionLocker lock(m_crit);
+	return m_mapping != NULL;
+}
+
+void TrigramIndex::FileChanged(const wxString& path) {
+	wxCriticalSectionLocker lock(m_crit);
+	if (!m_projectPath.IsOk()) return;
+
+	std::string relPath;
+	if (!GetRelativePath(path, relPath)) return;
+	m_changed[relPath] = m_changeStamp++;
+
+	// Rebuild if the index has gotten too inaccurate
+	if (m_changed.size() > s_rebuildLimit && m_mapping) StartBuilder(false);
+}
+
+bool TrigramIndex::PrepareQuery(const std::vector<std::string>& literals, bool matchCase, Query& query) {
+	wxCriticalSectionLocker lock(m_crit);
+	if (!m_mapping) return false;
+	const Mapping& mapping = *m_mapping;
+
+	std::vector<unsigned int> keys;
+	for (std::vector<std::string>::const_iterator p = literals.begin(); p != literals.end(); ++p) {
+		GetLiteralTrigrams(*p, matchCase, keys);
+	}
+	if (keys.empty()) return false;
+	std::sort(keys.begin(), keys.end());
+	keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+	// Candidates are the files that contains all trigrams
+	const unsigned int fileCount = mapping.header->fileCount;
+	query.m_matches.assign(fileCount, true);
+	query.m_generation = m_generation;
+
+	std::vector<bool> hits;
+	const TrigramEntry* const trigramsEnd = mapping.trigrams + mapping.header->trigramCount;
+	for (std::vector<unsigned int>::const_iterator k = keys.begin(); k != keys.end(); ++k) {
+		const TrigramEntry* t = std::lower_bound(mapping.trigrams, trigramsEnd, *k, KeyLess);
+		if (t == trigramsEnd || t->key != *k) {
+			query.m_matches.assign(fileCount, false);
+			break;
+		}
+
+		hits.assign(fileCount, false);
+		const unsigned char* p = mapping.postings + t->offset;
+		const unsigned char* const end = p + t->size;
+		unsigned int id = 0;
+		while (p && p < end) {
+			unsigned int delta;
+			p = ReadVarint(p, end, delta);
+			id += delta;
+			if (p && id < fileCount) hits[id] = true;
+		}
+
+		for (unsigned int i = 0; i < fileCount; ++i) {
+			if (!hits[i]) query.m_matches[i] = false;
+		}
+	}
+
+	return true;
+}
+
+bool TrigramIndex::IsCandidate(const Query& query, const wxString& path) {
+	wxCriticalSectionLocker lock(m_crit);
+	if (query.m_generation != m_generation) return true; // index has been reloaded
+
+	std::string relPath;
+	if (!GetRelativePath(path, relPath)) return true;
+	if (m_changed.find(relPath) != m_changed.end()) return true;
+
+	if (!m_mapping) return true;
+	const std::map<std::string, unsigned int>::const_iterator p = m_mapping->fileIds.find(relPath);
+	if (p == m_mapping->fileIds.end()) return true; // not indexed
+
+	return query.m_matches[p->second];
+}
+
+TrigramIndex::Mapping* TrigramIndex::Load(const wxString& indexPath) { // static
+	if (!wxFileExists(indexPath)) return NULL;
+
+	std::auto_ptr<Mapping> mapping(new Mapping);
+	MMapBuffer& buf = mapping->buf;
+	buf.Open(indexPath);
+	if (!buf.IsMapped()) return NULL;
+
+	// Verify the layout (in 64 bits, so corrupt counts can not overflow)
+	const wxFileOffset len = buf.Length();
+	const Header* header = (const Header*)buf.data();
+	if (len < (wxFileOffset)sizeof(Header) || memcmp(header->magic, "eTRI", 4) != 0 || header->version != s_indexVersion
+		|| header->filesOffset < sizeof(Header) || header->filesOffset % sizeof(unsigned int) != 0
+		|| (wxFileOffset)header->trigramsOffset != (wxFileOffset)header->filesOffset + (wxFileOffset)header->fileCount * sizeof(FileEntry)
+		|| (wxFileOffset)header->postingsOffset != (wxFileOffset)header->trigramsOffset + (wxFileOffset)header->trigramCount * sizeof(TrigramEntry)
+		|| header->stringsOffset < header->postingsOffset
+		|| (wxFileOffset)header->stringsOffset + header->stringsSize != len) return NULL;
+
+	const FileEntry* files = (const FileEntry*)(buf.data() + header->filesOffset);
+	const TrigramEntry* trigrams = (const TrigramEntry*)(buf.data() + header->trigramsOffset);
+	const char* strings = buf.data() + header->stringsOffset;
+
+	// Every entry has to be inside its region (and the trigrams sorted,
+	// as they are binary searched), or the whole cache is discarded
+	const wxFileOffset postingsSize = header->stringsOffset - header->postingsOffset;
+	for (unsigned int i = 0; i < header->trigramCount; ++i) {
+		const TrigramEntry& t = trigrams[i];
+		if ((wxFileOffset)t.offset + t.size > postingsSize || (i && t.key <= trigrams[i-1].key)) return NULL;
+	}
+	for (unsigned int i = 0; i < header->fileCount; ++i) {
+		const FileEntry& f = files[i];
+		if ((wxFileOffset)f.pathOffset + f.pathLen > header->stringsSize) return NULL;
+		mapping->fileIds[std::string(strings + f.pathOffset, f.pathLen)] = i;
+	}
+
+	mapping->header = header;
+	mapping->files = files;
+	mapping->trigrams = trigrams;
+	mapping->postings = (const unsigned char*)(buf.data() + header->postingsOffset);
+	mapping->strings = strings;
+
+	return mapping.release();
+}
+
+TrigramIndex::Mapping* TrigramIndex::SetMapping(Mapping* mapping) {
+	// crit has to be held by caller
+	Mapping* old = m_mapping;
+	m_mapping = mapping;
+	++m_generation; // queries on the old mapping are invalid
+	return old;
+}
+
+void TrigramIndex::StartBuilder(bool verifyOnly) {
+	// crit has to be held by caller
+	if (m_builder) {
+		if (m_builder->IsRunning()) return;
+		m_builder->Wait();
+		delete m_builder;
+		m_builder = NULL;
+	}
+
+	m_builder = new TrigramIndexBuilder(*this, verifyOnly, m_changeStamp);
+	if (m_builder->Create() != wxTHREAD_NO_ERROR || m_builder->Run() != wxTHREAD_NO_ERROR) {
+		delete m_builder;
+		m_builder = NULL;
+		return;
+	}
+	m_builder->SetPriority(WXTHREAD_MIN_PRIORITY);
+}
+
+void TrigramIndex::StopBuilder() {
+	TrigramIndexBuilder* builder;
+	{
+		wxCriticalSectionLocker lock(m_crit);
+		builder = m_builder;
+		m_builder = NULL;
+	}
+	if (!builder) return;
+
+	builder->Cancel();
+	builder->Wait();
+	delete builder;
+}
+
+void TrigramIndex::OnBuildDone(const wxString& indexPath, unsigned int startStamp) {
+	// Replace the old index (it has to be unmapped first). Searches
+	// done in between just don't get filtered.
+	Mapping* old;
+	{
+		wxCriticalSectionLocker lock(m_crit);
+		old = SetMapping(NULL);
+	}
+	delete old;
+
+	if (wxFileExists(indexPath)) wxRemoveFile(indexPath);
+	wxRenameFile(indexPath + wxT(".tmp"), indexPath);
+	Mapping* mapping = Load(indexPath);
+
+	wxCriticalSectionLocker lock(m_crit);
+	delete SetMapping(mapping); // nothing could have been set in between
+
+	// Changes made after we started scanning may not be in the index
+	std::map<std::string, unsigned int>::iterator p = m_changed.begin();
+	while (p != m_changed.end()) {
+		if (p->second < startStamp) m_changed.erase(p++);
+		else ++p;
+	}
+}
+
+bool TrigramIndex::GetRelativePath(const wxString& path, std::string& relPath) const {
+	if (m_rootPath.empty() || !path.StartsWith(m_rootPath)) return false;
+
+	wxString rel = path.Mid(m_rootPath.size());
+	rel.Replace(wxT("\\"), wxT("/"));
+	relPath = rel.mb_str(wxConvUTF8);
+	return true;
+}
+
+wxString TrigramIndex::GetIndexPath() const {
+	// Name the index after a hash of the project path
+	const wxCharBuffer path = m_rootPath.mb_str(wxConvUTF8);
+	unsigned int hash = 2166136261U; // FNV-1a
+	for (const char* p = path.data(); *p; ++p) {
+		hash = (hash ^ (unsigned char)*p) * 16777619U;
+	}
+
+	const wxString dir = GetAppPaths().AppDataPath() + wxT("SearchIndex");
+	if (!wxDirExists(dir)) wxMkdir(dir);
+	return dir + wxFILE_SEP_PATH + wxString::Format(wxT("%08x.idx"), hash);
+}
@@ -0,0 +1,123 @@
+/*******************************************************************************
+ *
+ * Copyright (C) 2009, Alexander Stigsen, e-texteditor.com
+ *
+ * This software is licensed under the Open Company License as described
+ * in the file license.txt, which you should have received as part of this
+ * distribution. The terms are also available at http://opencompany.org/license.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ******************************************************************************/
+
+#ifndef __TRIGRAMINDEX_H__
+#define __TRIGRAMINDEX_H__
+
+#include "wx/wxprec.h"
+#ifndef WX_PRECOMP
+   #include <wx/wx.h>
+#endif
+#include <wx/filename.h>
+#include <wx/thread.h>
+
+#include "MMapBuffer.h"
+#include <map>
+#include <string>
+#include <vector>
+
+class TrigramIndexBuilder;
+
+// On-disk trigram index of the files in a project, used by Find In Project
+// to skip files that can not contain a match. The index is built in the
+// background (honoring the project filters) and memory mapped when ready.
+// Files changed since it was written (reported by the DirWatcher) are always
+// treated as candidates, and it is rebuilt when too many have changed.
+class TrigramIndex {
+public:
+	TrigramIndex();
+	~TrigramIndex();
+
+	void Open(const wxFileName& projectPath);
+	void Close();
+	bool IsReady();
+
+	// Notification from DirWatcher
+	void FileChanged(const wxString& path);
+
+	class Query {
+	public:
+		Query() : m_generation(0) {};
+	private:
+		friend class TrigramIndex;
+		std::vector<bool> m_matches; // by file id
+		unsigned int m_generation;
+	};
+
+	// Returns false if the index can not be used to filter the search
+	bool PrepareQuery(const std::vector<std::string>& literals, bool matchCase, Query& query);
+	bool IsCandidate(const Query& query, const wxString& path);
+
+private:
+	friend class TrigramIndexBuilder;
+
+	struct FileEntry {
+		unsigned int pathOffset;
+		unsigned int pathLen;
+		unsigned int modDate;
+	};
+
+	struct TrigramEntry {
+		unsigned int key;
+		unsigned int offset;
+		unsigned int size;
+	};
+
+	struct Header {
+		char magic[4];
+		unsigned int version;
+		unsigned int fileCount;
+		unsigned int trigramCount;
+		unsigned int filesOffset;
+		unsigned int trigramsOffset;
+		unsigned int postingsOffset;
+		unsigned int stringsOffset;
+		unsigned int stringsSize;
+	};
+
+	// A mapped index file. It is loaded without holding the lock
+	// and then swapped in whole.
+	struct Mapping {
+		Mapping() : header(NULL), files(NULL), trigrams(NULL), postings(NULL), strings(NULL) {};
+		MMapBuffer buf;
+		const Header* header;
+		const FileEntry* files;
+		const TrigramEntry* trigrams;
+		const unsigned char* postings;
+		const char* strings;
+		std::map<std::string, unsigned int> fileIds;
+	};
+
+	static bool KeyLess(const TrigramEntry& entry, unsigned int key) {return entry.key < key;};
+
+	static Mapping* Load(const wxString& indexPath); // NULL if missing or invalid
+	Mapping* SetMapping(Mapping* mapping); // returns the old one
+	void StartBuilder(bool verifyOnly);
+	void StopBuilder();
+	void OnBuildDone(const wxString& indexPath, unsigned int startStamp);
+	bool GetRelativePath(const wxString& path, std::string& relPath) const;
+	wxString GetIndexPath() const;
+
+	static const unsigned int s_rebuildLimit = 2000;
+
+	wxCriticalSection m_crit;
+	wxFileName m_projectPath;
+	wxString m_rootPath;
+	Mapping* m_mapping;
+	std::map<std::string, unsigned int> m_changed; // path -> change stamp
+	unsigned int m_changeStamp;
+	unsigned int m_generation;
+	TrigramIndexBuilder* m_builder;
+};
+
+#endif // __TRIGRAMINDEX_H__
@@ -0,0 +1,229 @@
+/*******************************************************************************
+ *
+ * Copyright (C) 2009, Alexander Stigsen, e-texteditor.com
+ *
+ * This software is licensed under the Open Company License as described
+ * in the file license.txt, which you should have received as part of this
+ * distribution. The terms are also available at http://opencompany.org/license.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ******************************************************************************/
+
+#include "Trigrams.h"
+#include <cstring>
+
+void GetLiteralTrigrams(const std::string& literal, bool matchCase, std::vector<unsigned int>& keys) {
+	const unsigned char* p = (const unsigned char*)literal.data();
+	for (size_t i = 0; i + 3 <= literal.size(); ++i) {
+		if (!matchCase && (p[i] & 0x80 || p[i+1] & 0x80 || p[i+2] & 0x80)) continue;
+		keys.push_back(TrigramKey(p + i));
+	}
+}
+
+static void EndRun(std::string& run, std::vector<std::string>& literals) {
+	if (run.size() >= 3) literals.push_back(run);
+	run.clear();
+}
+
+static bool IsOptionalQuantifier(const char* p) {
+	return *p == '?' || *p == '*' || (p[0] == '{' && (p[1] == '0' || p[1] == ','));
+}
+
+static bool IsQuantifier(const char* p) {
+	return *p == '?' || *p == '*' || *p == '+' || (p[0] == '{' && p[1] >= '0' && p[1] <= '9') || (p[0] == '{' && p[1] == ',');
+}
+
+static const char* SkipQuantifier(const char* p) {
+	if (*p == '{') {
+		const char* end = strchr(p, '}');
+		p = end ? end + 1 : p + strlen(p);
+	}
+	else ++p;
+
+	if (*p == '?' || *p == '+') ++p; // lazy or possessive
+	return p;
+}
+
+// Returns pointer to the char after the matching ')' (or end of string)
+static const char* SkipGroup(const char* p) {
+	int depth = 0;
+	for (; *p; ++p) {
+		if (*p == '\\') {
+			if (p[1]) ++p;
+		}
+		else if (*p == '[') {
+			++p;
+			if (*p == '^') ++p;
+			if (*p == ']') ++p;
+			while (*p && *p != ']') {
+				if (*p == '\\' && p[1]) ++p;
+				++p;
+			}
+			if (!*p) return p;
+		}
+		else if (*p == '(') ++depth;
+		else if (*p == ')') {
+			if (--depth == 0) return p + 1;
+		}
+	}
+	return p;
+}
+
+bool GetRequiredLiterals(const char* pattern, std::vector<std::string>& literals) {
+	// Alternations make parts optional. We could do better by
+	// looking at the branches, but then we would need an OR query.
+	for (const char* p = pattern; *p; ++p) {
+		if (*p == '\\') {
+			if (p[1]) ++p;
+		}
+		else if (*p == '|') return false;
+		else if (p[0] == '(' && p[1] == '?' && (p[2] == '-' || (p[2] >= 'a' && p[2] <= 'z') || (p[2] >= 'A' && p[2] <= 'Z'))) {
+			return false; // inline options may change case
+		}
+	}
+
+	std::string run;
+	const char* p = pattern;
+	while (*p) {
+		char literal = 0;
+		bool isLiteral = false;
+
+		switch (*p) {
+		case '\\':
+			++p;
+			if (*p == '\0') break;
+			if (*p == 'Q') {
+				// Quoted sequence
+				++p;
+				const char* end = strstr(p, "\\E");
+				const size_t len = end ? (size_t)(end - p) : strlen(p);
+				run.append(p, len);
+				p += len;
+				if (end) p += 2;
+				if (IsQuantifier(p)) {
+					// Quantifier only applies to last char
+					if (!run.empty() && IsOptionalQuantifier(p)) run.erase(run.size()-1);
+					EndRun(run, literals);
+					p = SkipQuantifier(p);
+				}
+				continue;
+			}
+			else if (*p == 't') {literal = '\t'; isLiteral = true;}
+			else if (*p == 'n') {literal = '\n'; isLiteral = true;}
+			else if (*p == 'r') {literal = '\r'; isLiteral = true;}
+			else if (!((*p >= 'a' && *p <= 'z') || (*p >= 'A' && *p <= 'Z') || (*p >= '0' && *p <= '9'))) {
+				literal = *p; // escaped special char
+				isLiteral = true;
+			}
+			else if (*p >= '0' && *p <= '9') {
+				// Octal char or back reference (the digits are all part of it)
+				while (p[1] >= '0' && p[1] <= '9') ++p;
+			}
+			else if (*p == 'x' || *p == 'o' || *p == 'c' || *p == 'p' || *p == 'P' || *p == 'g' || *p == 'k') {
+				// Skip argument of escape
+				if (p[1] == '{') {
+					const char* end = strchr(p, '}');
+					p = end ? end : p + strlen(p) - 1;
+				}
+				else if (*p == 'c' && p[1]) ++p;
+				else if (*p == 'x') {
+					while ((p[1] >= '0' && p[1] <= '9') || (p[1] >= 'a' && p[1] <= 'f') || (p[1] >= 'A' && p[1] <= 'F')) ++p;
+				}
+				else if (p[1]) ++p;
+			}
+			++p;
+			break;
+
+		case '[':
+			{
+				// Character class
+				++p;
+				if (*p == '^') ++p;
+				if (*p == ']') ++p;
+				while (*p && *p != ']') {
+					if (*p == '\\' && p[1]) ++p;
+					++p;
+				}
+				if (*p) ++p;
+			}
+			break;
+
+		case '(':
+			{
+				const char* end = SkipGroup(p);
+				if (p[1] == '?' && p[2] != ':') {
+					// Lookarounds and other special groups do not consume text
+					EndRun(run, literals);
+					p = end;
+					if (IsQuantifier(p)) p = SkipQuantifier(p);
+					continue;
+				}
+				if (IsOptionalQuantifier(end)) {
+					// Whole group is optional
+					EndRun(run, literals);
+					p = SkipQuantifier(end);
+					continue;
+				}
+				EndRun(run, literals);
+				p += (p[1] == '?') ? 3 : 1; // contents are required
+				continue;
+			}
+
+		case ')':
+			EndRun(run, literals);
+			++p;
+			if (IsQuantifier(p)) p = SkipQuantifier(p);
+			continue;
+
+		case '.':
+		case '^':
+		case '$':
+			++p;
+			break;
+
+		default:
+			literal = *p;
+			isLiteral = true;
+			++p;
+		}
+
+		if (isLiteral) {
+			if (IsQuantifier(p)) {
+				if (!IsOptionalQuantifier(p)) run += literal; // at least once
+				EndRun(run, literals);
+				p = SkipQuantifier(p);
+			}
+			else run += literal;
+		}
+		else {
+			EndRun(run, literals);
+			if (IsQuantifier(p)) p = SkipQuantifier(p);
+		}
+	}
+
+	EndRun(run, literals);
+	return true;
+}
+
+void AppendVarint(std::vector<unsigned char>& out, unsigned int value) {
+	while (value >= 0x80) {
+		out.push_back((unsigned char)(value | 0x80));
+		value >>= 7;
+	}
+	out.push_back((unsigned char)value);
+}
+
+const unsigned char* ReadVarint(const unsigned char* p, const unsigned char* end, unsigned int& value) {
+	value = 0;
+	unsigned int shift = 0;
+	while (p < end) {
+		const unsigned char c = *p++;
+		value |= (unsigned int)(c & 0x7F) << shift;
+		if (!(c & 0x80)) return p;
+		shift += 7;
+		if (shift > 28) break;
+	}
+	return NULL; // corrupt data
+}
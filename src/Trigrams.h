@@ -0,0 +1,48 @@
+/*******************************************************************************
+ *
+ * Copyright (C) 2009, Alexander Stigsen, e-texteditor.com
+ *
+ * This software is licensed under the Open Company License as described
+ * in the file license.txt, which you should have received as part of this
+ * distribution. The terms are also available at http://opencompany.org/license.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ******************************************************************************/
+
+#ifndef __TRIGRAMS_H__
+#define __TRIGRAMS_H__
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+// Trigrams are keyed on three bytes with ascii letters folded to
+// lowercase, so the same index can serve both caseless and case
+// sensitive searches (the latter just get a few more candidates).
+
+inline unsigned int FoldTrigramByte(unsigned char c) {
+	return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+inline unsigned int TrigramKey(const unsigned char* p) {
+	return (FoldTrigramByte(p[0]) << 16) | (FoldTrigramByte(p[1]) << 8) | FoldTrigramByte(p[2]);
+}
+
+// Adds the keys of all trigrams in a literal that any match has to contain.
+// For caseless searches trigrams with non-ascii bytes are skipped, as the
+// other case may have different bytes.
+void GetLiteralTrigrams(const std::string& literal, bool matchCase, std::vector<unsigned int>& keys);
+
+// Extracts literal runs (of at least 3 bytes) that every match of the
+// regex has to contain. The pattern is treated as bytes (like Find In
+// Project does). Returns false if nothing can be said about the pattern
+// (alternations or inline options).
+bool GetRequiredLiterals(const char* pattern, std::vector<std::string>& literals);
+
+// Variable length encoding of sorted id lists (as deltas)
+void AppendVarint(std::vector<unsigned char>& out, unsigned int value);
+const unsigned char* ReadVarint(const unsigned char* p, const unsigned char* end, unsigned int& value);
+
+#endif // __TRIGRAMS_H__
@@ -36,6 +36,18 @@ bool wxBrowser::LoadString(const wxString& html, bool WXUNUSED(prependHtml)) {
 	return true;
 }
 
+bool wxBrowser::AppendString(const wxString& html) {
+	// Quote html as a javascript string
+	wxString str = html;
+	str.Replace(wxT("\\"), wxT("\\\\"));
+	str.Replace(wxT("'"), wxT("\\'"));
+	str.Replace(wxT("\n"), wxT("\\n"));
+	str.Replace(wxT("\r"), wxT("\\r"));
+
+	wxWebView::RunScript(wxT("document.body.insertAdjacentHTML('beforeend', '") + str + wxT("');"));
+	return true;
+}
+
 void wxBrowser::LoadUrl(const wxString &_url,
 	const wxString &_frame /*= wxEmptyString*/,
 	bool keepHistory /*=false*/) {
@@ -27,6 +27,7 @@ public:
 	virtual ~wxBrowser();
 	virtual wxWindow* GetWindow();
 	virtual bool LoadString(const wxString& html, bool prependHtml=true);
+	virtual bool AppendString(const wxString& html);
 	virtual void LoadUrl(const wxString &_url, const wxString &_frame = wxEmptyString, bool keepHistory=false);
 	virtual bool Refresh(wxHtmlRefreshLevel level);
 	virtual bool GoBack();
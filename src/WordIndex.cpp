@@ -0,0 +1,407 @@
+/*******************************************************************************
+ *
+ * Copyright (C) 2009, Alexander Stigsen, e-texteditor.com
+ *
+ * This software is licensed under the Open Company License as described
+ * in the file license.txt, which you should have received as part of this
+ * distribution. The terms are also available at http://opencompany.org/license.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ******************************************************************************/
+
+
+#include "WordIndex.h"
+#include "Document.h"
+#include "Strings.h"
+#include <set>
+
+#include "wx/wxprec.h"
+#ifndef WX_PRECOMP
+   #include <wx/wx.h>
+#endif
+
+// Initializing static constants
+const unsigned int WordIndex::MAXCHUNK = 512;
+
+namespace {
+	// Chars that can be kept in front of a word
+	bool IsLeadByte(char c) {
+		return c > ' ' && c < 0x7F && !WordIndex::IsWordByte(c);
+	}
+
+	// Length of the char at i if it is a word char (zero if not)
+	unsigned int WordCharLen(const char* text, unsigned int i, unsigned int len) {
+		const unsigned char c = text[i];
+		if (c < 0x80) return WordIndex::IsWordByte(c) ? 1 : 0;
+
+		// Decode utf-8
+		unsigned int n;
+		unsigned int cp;
+		if ((c & 0xE0) == 0xC0) {n = 2; cp = c & 0x1F;}
+		else if ((c & 0xF0) == 0xE0) {n = 3; cp = c & 0x0F;}
+		else return 0; // chars outside the BMP are not word chars
+		if (i + n > len) return 0;
+		for (unsigned int j = 1; j < n; ++j) {
+			const unsigned char cc = text[i+j];
+			if ((cc & 0xC0) != 0x80) return 0;
+			cp = (cp << 6) | (cc & 0x3F);
+		}
+
+		return Isalnum((wxChar)cp) ? n : 0;
+	}
+
+	// End of the word (if any) at pos
+	unsigned int SkipWord(const Document& doc, unsigned int pos, unsigned int len) {
+		unsigned char buffer[64];
+		while (pos < len) {
+			const unsigned int blockEnd = wxMin(pos + 64, len);
+			doc.GetTextPart(pos, blockEnd, buffer);
+
+			unsigned int i = 0;
+			while (pos + i < blockEnd && WordIndex::IsWordByte(buffer[i])) ++i;
+			pos += i;
+			if (pos < blockEnd) break;
+		}
+		return pos;
+	}
+}
+
+WordIndex::WordIndex() : m_count(0), m_length(0) {
+}
+
+WordIndex::~WordIndex() {
+	Clear();
+}
+
+bool WordIndex::IsWordByte(char c) {
+	// All bytes of multibyte chars count, so words are not split
+	// between them (the chars are checked when scanned)
+	const unsigned char b = c;
+	return (b >= 'a' && b <= 'z') || (b >= 'A' && b <= 'Z') || (b >= '0' && b <= '9') || b == '_' || b >= 0x80;
+}
+
+void WordIndex::Clear(unsigned int length) {
+	for (std::vector<Chunk*>::iterator p = m_chunks.begin(); p != m_chunks.end(); ++p) delete *p;
+	m_chunks.clear();
+	m_words.clear();
+	m_count = 0;
+	m_length = length;
+}
+
+void WordIndex::GetWords(const std::string& prefix, std::vector<std::string>& words) const {
+	const bool isLead = !prefix.empty() && !IsWordByte(prefix[0]);
+
+	for (WordMap::const_iterator p = m_words.lower_bound(prefix); p != m_words.end(); ++p) {
+		const std::string& word = p->first;
+		if (word.compare(0, prefix.size(), prefix) != 0) break;
+		if (word.size() == prefix.size() || IsWordByte(word[0]) == isLead) continue;
+
+		words.push_back(isLead ? word.substr(1) : word);
+	}
+}
+
+void WordIndex::GetCompletions(const std::string& prefix, unsigned int pos, std::vector<std::string>& words) const {
+	const bool isLead = !prefix.empty() && !IsWordByte(prefix[0]);
+
+	// Count the words to find
+	unsigned int candidates = 0;
+	for (WordMap::const_iterator p = m_words.lower_bound(prefix); p != m_words.end(); ++p) {
+		const std::string& word = p->first;
+		if (word.compare(0, prefix.size(), prefix) != 0) break;
+		if (word.size() > prefix.size() && IsWordByte(word[0]) != isLead) ++candidates;
+	}
+	if (!candidates) return;
+
+	// Walk out from pos in both directions, taking the nearest
+	// occurrence each time, until all the words have been found
+	std::set<const std::string*> found;
+	unsigned int fi;
+	unsigned int fc = Locate(pos, fi);
+	unsigned int bc = fc;
+	unsigned int bi = fi; // backward is before bi
+	while (found.size() < candidates) {
+		if (fc < m_chunks.size() && fi == m_chunks[fc]->occurrences.size()) {
+			++fc;
+			fi = 0;
+		}
+		if (bi == 0 && bc > 0) {
+			--bc;
+			bi = m_chunks[bc]->occurrences.size();
+		}
+
+		const bool hasNext = fc < m_chunks.size();
+		const bool hasPrev = bi > 0;
+		if (!hasNext && !hasPrev) break;
+
+		const Occurrence* o;
+		if (hasNext && (!hasPrev || m_chunks[fc]->offset + m_chunks[fc]->occurrences[fi].pos - pos <= pos - (m_chunks[bc]->offset + m_chunks[bc]->occurrences[bi-1].pos))) {
+			o = &m_chunks[fc]->occurrences[fi++];
+		}
+		else o = &m_chunks[bc]->occurrences[--bi];
+
+		const WordMap::iterator w = isLead ? o->leadWord : o->word;
+		if (isLead && w == m_words.end()) continue;
+
+		const std::string& word = w->first;
+		if (word.size() == prefix.size() || word.compare(0, prefix.size(), prefix) != 0) continue;
+		if (found.insert(&word).second) words.push_back(isLead ? word.substr(1) : word);
+	}
+}
+
+unsigned int WordIndex::Locate(unsigned int pos, unsigned int& index) const {
+	// Find the first chunk ending at or after pos
+	unsigned int first = 0;
+	unsigned int last = m_chunks.size();
+	while (first < last) {
+		const unsigned int mid = (first + last) / 2;
+		const Chunk& chunk = *m_chunks[mid];
+		if (chunk.offset + chunk.occurrences.back().pos < pos) first = mid + 1;
+		else last = mid;
+	}
+
+	index = 0;
+	if (first == m_chunks.size()) return first;
+
+	// Find the first occurrence in it at or after pos
+	const Chunk& chunk = *m_chunks[first];
+	unsigned int end = chunk.occurrences.size();
+	while (index < end) {
+		const unsigned int mid = (index + end) / 2;
+		if (chunk.offset + chunk.occurrences[mid].pos < pos) index = mid + 1;
+		else end = mid;
+	}
+	return first;
+}
+
+void WordIndex::Insert(unsigned int pos, unsigned int length) {
+	m_length += length;
+
+	unsigned int i;
+	unsigned int c = Locate(pos, i);
+	if (c == m_chunks.size()) return;
+
+	// Move the occurrences after pos
+	Chunk& chunk = *m_chunks[c];
+	if (i == 0) chunk.offset += length;
+	else {
+		for (std::vector<Occurrence>::iterator p = chunk.occurrences.begin() + i; p != chunk.occurrences.end(); ++p) {
+			p->pos += length;
+		}
+	}
+	for (++c; c < m_chunks.size(); ++c) m_chunks[c]->offset += length;
+}
+
+void WordIndex::Delete(unsigned int start, unsigned int end) {
+	wxASSERT(start <= end && end <= m_length);
+	Remove(start, end);
+	const unsigned int length = end - start;
+	m_length -= length;
+
+	unsigned int i;
+	unsigned int c = Locate(start, i);
+	for (; c < m_chunks.size(); ++c, i = 0) {
+		Chunk& chunk = *m_chunks[c];
+		if (i == 0 && chunk.offset >= length) {
+			chunk.offset -= length;
+			continue;
+		}
+
+		// Move the occurrences after the deletion (and the offset
+		// to zero if it would otherwise be past the first of them)
+		unsigned int diff = length;
+		if (i == 0) {
+			diff -= chunk.offset;
+			chunk.offset = 0;
+		}
+		for (std::vector<Occurrence>::iterator p = chunk.occurrences.begin() + i; p != chunk.occurrences.end(); ++p) {
+			p->pos -= diff;
+		}
+	}
+}
+
+void WordIndex::ReleaseWord(WordMap::iterator word) {
+	if (word == m_words.end()) return;
+	if (--word->second.count == 0) m_words.erase(word);
+}
+
+void WordIndex::Remove(unsigned int start, unsigned int end) {
+	unsigned int i;
+	unsigned int c = Locate(start, i);
+
+	while (c < m_chunks.size()) {
+		Chunk& chunk = *m_chunks[c];
+		unsigned int j = i;
+		while (j < chunk.occurrences.size() && chunk.offset + chunk.occurrences[j].pos < end) ++j;
+		if (j == i) break;
+
+		const bool toEnd = (j == chunk.occurrences.size());
+		for (unsigned int n = i; n < j; ++n) {
+			ReleaseWord(chunk.occurrences[n].word);
+			ReleaseWord(chunk.occurrences[n].leadWord);
+		}
+		chunk.occurrences.erase(chunk.occurrences.begin() + i, chunk.occurrences.begin() + j);
+		m_count -= j - i;
+
+		if (chunk.occurrences.empty()) {
+			delete m_chunks[c];
+			m_chunks.erase(m_chunks.begin() + c);
+		}
+		else ++c;
+		if (!toEnd) break;
+		i = 0;
+	}
+}
+
+void WordIndex::AddWord(std::vector<Occurrence>& occurrences, unsigned int pos, const char* word, unsigned int len, char lead) {
+	const std::string text(word, len);
+	Occurrence o;
+	o.pos = pos;
+	o.word = m_words.insert(WordMap::value_type(text, WordInfo())).first;
+	++o.word->second.count;
+
+	if (lead) {
+		o.leadWord = m_words.insert(WordMap::value_type(lead + text, WordInfo())).first;
+		++o.leadWord->second.count;
+	}
+	else o.leadWord = m_words.end();
+
+	occurrences.push_back(o);
+}
+
+void WordIndex::Add(unsigned int start, std::vector<Occurrence>& occurrences) {
+	if (occurrences.empty()) return;
+
+	// New occurrences go at the end of the chunk before, if there is one
+	unsigned int i;
+	unsigned int c = Locate(start, i);
+	if (i == 0 && c > 0) {
+		--c;
+		i = m_chunks[c]->occurrences.size();
+	}
+	else if (c == m_chunks.size()) {
+		m_chunks.push_back(new Chunk(occurrences[0].pos));
+	}
+
+	Chunk& chunk = *m_chunks[c];
+	if (occurrences[0].pos < chunk.offset) {
+		// Positions are relative to the offset, so it can't be past them
+		const unsigned int diff = chunk.offset - occurrences[0].pos;
+		for (std::vector<Occurrence>::iterator p = chunk.occurrences.begin(); p != chunk.occurrences.end(); ++p) {
+			p->pos += diff;
+		}
+		chunk.offset = occurrences[0].pos;
+	}
+
+	for (std::vector<Occurrence>::iterator p = occurrences.begin(); p != occurrences.end(); ++p) {
+		p->pos -= chunk.offset;
+	}
+	chunk.occurrences.insert(chunk.occurrences.begin() + i, occurrences.begin(), occurrences.end());
+	m_count += occurrences.size();
+
+	Split(c);
+}
+
+void WordIndex::Split(unsigned int c) {
+	Chunk& chunk = *m_chunks[c];
+	const unsigned int size = chunk.occurrences.size();
+	if (size <= MAXCHUNK) return;
+
+	// Split into half-full chunks, so the following inserts don't split again
+	const unsigned int half = MAXCHUNK / 2;
+	std::vector<Chunk*> pieces;
+	for (unsigned int start = half; start < size; start += half) {
+		Chunk* piece = new Chunk(chunk.offset);
+		piece->occurrences.assign(chunk.occurrences.begin() + start, chunk.occurrences.begin() + wxMin(start + half, size));
+		pieces.push_back(piece);
+	}
+	chunk.occurrences.resize(half);
+
+	m_chunks.insert(m_chunks.begin() + c + 1, pieces.begin(), pieces.end());
+}
+
+void WordIndex::Scan(unsigned int start, const char* text, unsigned int len, char lead) {
+	Remove(start, start + len);
+
+	std::vector<Occurrence> occurrences;
+	unsigned int i = 0;
+	while (i < len) {
+		unsigned int n = WordCharLen(text, i, len);
+		if (!n) {
+			++i;
+			continue;
+		}
+
+		const unsigned int wordStart = i;
+		do i += n;
+		while (i < len && (n = WordCharLen(text, i, len)) != 0);
+
+		// Is it kept with the char before?
+		char wordLead = lead;
+		if (wordStart > 0) {
+			const char c = text[wordStart-1];
+			wordLead = (IsLeadByte(c) && (wordStart == 1 || !IsWordByte(text[wordStart-2]))) ? c : 0;
+		}
+
+		AddWord(occurrences, start + wordStart, text + wordStart, i - wordStart, wordLead);
+	}
+
+	Add(start, occurrences);
+}
+
+void WordIndex::Scan(const Document& doc, unsigned int start, unsigned int end) {
+	const unsigned int len = doc.GetLength();
+	wxASSERT(start <= end && end <= len);
+
+	// Words may have been joined or split at both ends, and the
+	// word after end may have got (or lost) its lead char
+	std::vector<char> text;
+	while (start > 0) {
+		const unsigned int blockStart = start > 64 ? start - 64 : 0;
+		text.resize(start - blockStart);
+		doc.GetTextPart(blockStart, start, (unsigned char*)&*text.begin());
+
+		unsigned int i = text.size();
+		while (i > 0 && IsWordByte(text[i-1])) --i;
+		start = blockStart + i;
+		if (i > 0) break;
+	}
+	end = SkipWord(doc, end, len);
+	if (end < len) end = SkipWord(doc, end+1, len);
+
+	char lead = 0;
+	if (start > 0) {
+		char before[2];
+		const unsigned int beforeStart = start > 1 ? start - 2 : 0;
+		doc.GetTextPart(beforeStart, start, (unsigned char*)before);
+		const char c = before[start - beforeStart - 1];
+		if (IsLeadByte(c) && (start == 1 || !IsWordByte(before[0]))) lead = c;
+	}
+
+	// Read the text in blocks (not splitting words between them)
+	const unsigned int BLOCKSIZE = 64 * 1024;
+	unsigned int pos = start;
+	while (pos < end) {
+		const unsigned int blockEnd = (end - pos > BLOCKSIZE) ? pos + BLOCKSIZE : end;
+		text.resize(blockEnd - pos);
+		doc.GetTextPart(pos, blockEnd, (unsigned char*)&*text.begin());
+
+		unsigned int n = text.size();
+		if (blockEnd < end) {
+			while (n > 0 && IsWordByte(text[n-1])) --n;
+			if (n == 0) n = text.size(); // very long word
+		}
+		Scan(pos, &*text.begin(), n, lead);
+
+		const char c = text[n-1];
+		lead = (IsLeadByte(c) && (n == 1 || !IsWordByte(text[n-2]))) ? c : 0;
+		pos += n;
+	}
+}
+
+void WordIndex::Build(const Document& doc) {
+	const unsigned int len = doc.GetLength();
+	Clear(len);
+	Scan(doc, 0, len);
+}
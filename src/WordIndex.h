@@ -0,0 +1,106 @@
+/*******************************************************************************
+ *
+ * Copyright (C) 2009, Alexander Stigsen, e-texteditor.com
+ *
+ * This software is licensed under the Open Company License as described
+ * in the file license.txt, which you should have received as part of this
+ * distribution. The terms are also available at http://opencompany.org/license.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ******************************************************************************/
+
+
+#ifndef __WORDINDEX_H__
+#define __WORDINDEX_H__
+
+#include <vector>
+#include <map>
+#include <string>
+
+class Document;
+
+// The words (runs of alphanumeric chars and '_') in a document, for
+// completion. Each distinct word is kept once in a sorted dictionary,
+// so the words with a given prefix are a range in it, and each
+// occurrence in a list ordered by position, so the nearest can be
+// found by walking out from the caret.
+//
+// Words right after a non-word char (like '$' or '.') that does not
+// itself follow a word char are also kept with that char in front, so
+// they can be completed from it alone.
+//
+// Like BracketIndex, the positions are kept in chunks relative to an
+// offset, so edits only move the following chunks.
+class WordIndex {
+public:
+	WordIndex();
+	~WordIndex();
+
+	unsigned int GetLength() const {return m_length;}; // of the indexed text
+	unsigned int GetCount() const {return m_count;}; // occurrences
+
+	// Words longer than prefix starting with it, nearest to pos first. If
+	// prefix is a single non-word char, it is left out of the result.
+	void GetCompletions(const std::string& prefix, unsigned int pos, std::vector<std::string>& words) const;
+
+	// Same in sorted order (for completing from other documents)
+	void GetWords(const std::string& prefix, std::vector<std::string>& words) const;
+
+	// Text changes (words in deleted text are removed, and the following
+	// ones moved). The changed text has to be scanned again after.
+	void Insert(unsigned int pos, unsigned int length);
+	void Delete(unsigned int start, unsigned int end);
+
+	// Replaces the words starting in the range of text starting at start.
+	// The char before start must not be a word char, and lead is the char
+	// before a word at start (zero if it is not kept with one).
+	void Scan(unsigned int start, const char* text, unsigned int len, char lead=0);
+
+	// Scans [start, end) of the document again (extended to the words
+	// that may have changed by an edit there)
+	void Scan(const Document& doc, unsigned int start, unsigned int end);
+	void Build(const Document& doc);
+	void Clear(unsigned int length=0);
+
+	static bool IsWordByte(char c);
+
+private:
+	struct WordInfo {
+		WordInfo() : count(0) {};
+		unsigned int count;
+	};
+	typedef std::map<std::string, WordInfo> WordMap;
+
+	struct Occurrence {
+		unsigned int pos; // relative to chunk offset
+		WordMap::iterator word;
+		WordMap::iterator leadWord; // m_words.end() if none
+	};
+	struct Chunk {
+		Chunk(unsigned int o) : offset(o) {};
+		unsigned int offset;
+		std::vector<Occurrence> occurrences;
+	};
+
+	unsigned int Locate(unsigned int pos, unsigned int& index) const;
+	void Remove(unsigned int start, unsigned int end);
+	void Add(unsigned int start, std::vector<Occurrence>& occurrences);
+	void Split(unsigned int c);
+	void AddWord(std::vector<Occurrence>& occurrences, unsigned int pos, const char* word, unsigned int len, char lead);
+	void ReleaseWord(WordMap::iterator word);
+
+	static const unsigned int MAXCHUNK;
+
+	WordMap m_words;
+	std::vector<Chunk*> m_chunks; // never empty ones
+	unsigned int m_count;
+	unsigned int m_length;
+
+private:
+	WordIndex(const WordIndex&);
+	WordIndex& operator=(const WordIndex&);
+};
+
+#endif // __WORDINDEX_H__
@@ -0,0 +1,222 @@
+#include "stdafx.h"
+#include <vector>
+#include <string>
+#include <cstdlib>
+#include <algorithm>
+#include "BracketIndex.h"
+#include <gtest/gtest.h>
+
+namespace {
+
+// Reference implementation scanning the text
+bool IsEscaped(const std::string& text, unsigned int pos) {
+	bool escaped = false;
+	while (pos > 0 && text[pos-1] == '\\') {
+		escaped = !escaped;
+		--pos;
+	}
+	return escaped;
+}
+
+void GetBrackets(const std::string& text, std::vector<unsigned int>& positions) {
+	for (unsigned int i = 0; i < text.size(); ++i) {
+		if ((text[i] == '(' || text[i] == ')') && !IsEscaped(text, i)) positions.push_back(i);
+	}
+}
+
+// Matches of all the brackets (or -1 if unmatched)
+void GetMatches(const std::string& text, const std::vector<unsigned int>& positions, std::vector<int>& matches) {
+	std::vector<unsigned int> open;
+	matches.assign(positions.size(), -1);
+	for (unsigned int i = 0; i < positions.size(); ++i) {
+		if (text[positions[i]] == '(') open.push_back(i);
+		else if (!open.empty()) {
+			matches[i] = positions[open.back()];
+			matches[open.back()] = positions[i];
+			open.pop_back();
+		}
+	}
+}
+
+// Leaves out the brackets between double quotes
+class QuoteFilter : public IBracketFilter {
+public:
+	QuoteFilter(const std::string& text) : m_text(text) {};
+
+	void GetIgnored(const std::vector<unsigned int>& positions, std::vector<bool>& ignored) {
+		// Positions are sorted, so we count the quotes as we go
+		unsigned int pos = 0;
+		bool inString = false;
+		for (unsigned int i = 0; i < positions.size(); ++i) {
+			for (; pos < positions[i]; ++pos) {
+				if (m_text[pos] == '"') inString = !inString;
+			}
+			ignored[i] = inString;
+		}
+	}
+
+private:
+	const std::string& m_text;
+};
+
+// Rescans the changed text like Scan(doc, ...) does
+void Rescan(BracketIndex& index, const std::string& text, unsigned int start, unsigned int end) {
+	while (end < text.size() && text[end] == '\\') ++end;
+	if (end < text.size()) ++end;
+	index.Scan(start, text.data() + start, end - start, IsEscaped(text, start));
+}
+
+void Verify(BracketIndex& index, const std::string& text, QuoteFilter* filter=NULL) {
+	std::vector<unsigned int> expected;
+	std::vector<unsigned int> positions;
+	GetBrackets(text, expected);
+	index.GetPositions(positions);
+
+	ASSERT_EQ(expected, positions);
+	EXPECT_EQ(expected.size(), index.GetCount());
+	EXPECT_EQ(text.size(), index.GetLength());
+
+	std::vector<int> matches;
+	GetMatches(text, expected, matches);
+	if (filter) {
+		// Brackets in code only match each other
+		std::vector<bool> ignored(expected.size());
+		filter->GetIgnored(expected, ignored);
+		std::vector<unsigned int> code;
+		for (unsigned int i = 0; i < expected.size(); ++i) {
+			if (!ignored[i]) code.push_back(expected[i]);
+		}
+		std::vector<int> codeMatches;
+		GetMatches(text, code, codeMatches);
+		for (unsigned int i = 0, j = 0; i < expected.size(); ++i) {
+			if (!ignored[i]) matches[i] = codeMatches[j++];
+		}
+	}
+
+	for (unsigned int i = 0; i < expected.size(); ++i) {
+		unsigned int match = 0;
+		ASSERT_EQ(matches[i] != -1, index.FindMatching(expected[i], match, filter)) << "at " << expected[i];
+		if (matches[i] != -1) EXPECT_EQ((unsigned int)matches[i], match) << "at " << expected[i];
+	}
+}
+
+}
+
+TEST(BracketIndex, Basic) {
+	const std::string text = "(a(b)\\)c)";
+	BracketIndex index('(', ')');
+	index.Clear(text.size());
+	index.Scan(0, text.data(), text.size());
+
+	EXPECT_EQ(4u, index.GetCount());
+	unsigned int match = 0;
+	EXPECT_TRUE(index.FindMatching(0, match));
+	EXPECT_EQ(8u, match);
+	EXPECT_TRUE(index.FindMatching(8, match));
+	EXPECT_EQ(0u, match);
+	EXPECT_TRUE(index.FindMatching(4, match));
+	EXPECT_EQ(2u, match);
+	EXPECT_FALSE(index.FindMatching(6, match)); // escaped
+	EXPECT_FALSE(index.FindMatching(1, match)); // no bracket
+
+	BracketIndex noEscapes('(', ')', false);
+	noEscapes.Clear(text.size());
+	noEscapes.Scan(0, text.data(), text.size());
+	EXPECT_EQ(5u, noEscapes.GetCount());
+	EXPECT_TRUE(noEscapes.FindMatching(6, match));
+	EXPECT_EQ(0u, match);
+	EXPECT_FALSE(noEscapes.FindMatching(8, match)); // unmatched
+}
+
+TEST(BracketIndex, RandomEdits) {
+	const char chars[] = "(()\\x";
+	srand(42);
+
+	std::string text;
+	BracketIndex index('(', ')');
+
+	for (unsigned int n = 0; n < 3000; ++n) {
+		if (text.empty() || (text.size() < 20000 && rand() % 2)) {
+			const unsigned int pos = rand() % (text.size() + 1);
+			const unsigned int len = 1 + rand() % ((rand() % 10) ? 8 : 2000);
+			std::string insert;
+			for (unsigned int i = 0; i < len; ++i) insert += chars[rand() % 5];
+
+			text.insert(pos, insert);
+			index.Insert(pos, len);
+			Rescan(index, text, pos, pos + len);
+		}
+		else {
+			const unsigned int start = rand() % text.size();
+			const unsigned int end = start + rand() % std::min<size_t>(text.size() - start, ((rand() % 10) ? 8 : 1000));
+
+			text.erase(start, end - start);
+			index.Delete(start, end);
+			Rescan(index, text, start, start);
+		}
+
+		if (n % 50 == 0) {
+			Verify(index, text);
+			if (HasFatalFailure()) return;
+		}
+	}
+	Verify(index, text);
+}
+
+TEST(BracketIndex, Filter) {
+	const std::string text = "(a\")\"b)(\"(\")";
+	BracketIndex index('(', ')');
+	index.Clear(text.size());
+	index.Scan(0, text.data(), text.size());
+	QuoteFilter filter(text);
+
+	unsigned int match = 0;
+	EXPECT_TRUE(index.FindMatching(0, match, &filter));
+	EXPECT_EQ(6u, match);
+	EXPECT_TRUE(index.FindMatching(0, match));
+	EXPECT_EQ(3u, match);
+	EXPECT_TRUE(index.FindMatching(7, match, &filter));
+	EXPECT_EQ(11u, match);
+	EXPECT_FALSE(index.FindMatching(7, match));
+
+	// In a string all brackets count
+	EXPECT_TRUE(index.FindMatching(3, match, &filter));
+	EXPECT_EQ(0u, match);
+	EXPECT_TRUE(index.FindMatching(9, match, &filter));
+	EXPECT_EQ(11u, match);
+}
+
+TEST(BracketIndex, FilterRandomEdits) {
+	const char chars[] = "(()\"x";
+	srand(7);
+
+	std::string text;
+	BracketIndex index('(', ')', false);
+	QuoteFilter filter(text);
+
+	for (unsigned int n = 0; n < 1000; ++n) {
+		if (text.empty() || (text.size() < 20000 && rand() % 2)) {
+			const unsigned int pos = rand() % (text.size() + 1);
+			const unsigned int len = 1 + rand() % ((rand() % 10) ? 8 : 2000);
+			std::string insert;
+			for (unsigned int i = 0; i < len; ++i) insert += chars[rand() % 5];
+
+			text.insert(pos, insert);
+			index.Insert(pos, len);
+			index.Scan(pos, text.data() + pos, len);
+		}
+		else {
+			const unsigned int start = rand() % text.size();
+			const unsigned int end = start + rand() % std::min<size_t>(text.size() - start, ((rand() % 10) ? 8 : 1000));
+
+			text.erase(start, end - start);
+			index.Delete(start, end);
+		}
+
+		if (n % 50 == 0) {
+			Verify(index, text, &filter);
+			if (HasFatalFailure()) return;
+		}
+	}
+	Verify(index, text, &filter);
+}
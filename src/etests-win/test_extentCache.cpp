@@ -0,0 +1,118 @@
+#include "stdafx.h"
+#include <vector>
+#include <cstring>
+#include "ExtentCache.h"
+#include <gtest/gtest.h>
+
+namespace {
+
+std::vector<unsigned int> Runs(unsigned int end, unsigned int fontStyle=wxFONTFLAG_DEFAULT) {
+	std::vector<unsigned int> runs;
+	runs.push_back(end);
+	runs.push_back(fontStyle);
+	return runs;
+}
+
+void Add(ExtentCache& cache, unsigned int fontId, unsigned int tabWidth, const char* text, const std::vector<unsigned int>& runs) {
+	const unsigned int len = strlen(text);
+	std::vector<unsigned int> extents;
+	for (unsigned int i = 0; i < len; ++i) extents.push_back((i+1) * 10);
+	cache.Add(fontId, tabWidth, text, len, runs, extents);
+}
+
+bool Has(ExtentCache& cache, unsigned int fontId, unsigned int tabWidth, const char* text, const std::vector<unsigned int>& runs) {
+	return cache.Find(fontId, tabWidth, text, strlen(text), runs) != NULL;
+}
+
+} // namespace
+
+TEST(ExtentCacheTest, Key) {
+	ExtentCache cache;
+	Add(cache, 1, 32, "int x;", Runs(6));
+
+	const std::vector<unsigned int>* extents = cache.Find(1, 32, "int x;", 6, Runs(6));
+	ASSERT_TRUE(extents != NULL);
+	ASSERT_EQ(6u, extents->size());
+	EXPECT_EQ(60u, extents->back());
+
+	// All parts of the key have to match
+	EXPECT_FALSE(Has(cache, 2, 32, "int x;", Runs(6)));
+	EXPECT_FALSE(Has(cache, 1, 16, "int x;", Runs(6)));
+	EXPECT_FALSE(Has(cache, 1, 32, "int y;", Runs(6)));
+	EXPECT_FALSE(Has(cache, 1, 32, "int x", Runs(5)));
+	EXPECT_FALSE(Has(cache, 1, 32, "int x;", Runs(6, wxFONTFLAG_BOLD)));
+
+	std::vector<unsigned int> runs = Runs(3, wxFONTFLAG_BOLD);
+	runs.push_back(6);
+	runs.push_back(wxFONTFLAG_DEFAULT);
+	EXPECT_FALSE(Has(cache, 1, 32, "int x;", runs));
+
+	EXPECT_EQ(1u, cache.GetHits());
+	EXPECT_EQ(6u, cache.GetMisses());
+
+	// Empty lines are not cached
+	cache.Add(1, 32, "", 0, std::vector<unsigned int>(), std::vector<unsigned int>());
+	EXPECT_EQ(1u, cache.GetSize());
+
+	cache.Clear();
+	EXPECT_EQ(0u, cache.GetSize());
+	EXPECT_FALSE(Has(cache, 1, 32, "int x;", Runs(6)));
+}
+
+TEST(ExtentCacheTest, EvictsLeastRecentlyUsed) {
+	// Each entry takes 4 bytes of text, 4 extents and a run
+	const size_t entryBytes = 4 * (1 + sizeof(unsigned int)) + 2 * sizeof(unsigned int);
+	ExtentCache cache(3 * entryBytes);
+
+	Add(cache, 1, 32, "aaaa", Runs(4));
+	Add(cache, 1, 32, "bbbb", Runs(4));
+	Add(cache, 1, 32, "cccc", Runs(4));
+	EXPECT_EQ(3u, cache.GetSize());
+
+	// Lookups move entries to the front
+	EXPECT_TRUE(Has(cache, 1, 32, "aaaa", Runs(4)));
+
+	Add(cache, 1, 32, "dddd", Runs(4));
+	EXPECT_EQ(3u, cache.GetSize());
+	EXPECT_FALSE(Has(cache, 1, 32, "bbbb", Runs(4)));
+	EXPECT_TRUE(Has(cache, 1, 32, "aaaa", Runs(4)));
+	EXPECT_TRUE(Has(cache, 1, 32, "cccc", Runs(4)));
+	EXPECT_TRUE(Has(cache, 1, 32, "dddd", Runs(4)));
+
+	// Lines larger than the cache are kept until the next one
+	Add(cache, 1, 32, "a very long line that does not fit", Runs(34));
+	EXPECT_EQ(1u, cache.GetSize());
+	EXPECT_TRUE(Has(cache, 1, 32, "a very long line that does not fit", Runs(34)));
+}
+
+TEST(ExtentCacheTest, FixedExtents) {
+	const bool allFixed[4] = {true, true, true, true};
+	std::vector<unsigned int> extents;
+
+	// Tabs go to next tab stop, newline has its own width
+	const char* text = "a\tb\n";
+	ASSERT_TRUE(ExtentCache::GetFixedExtents(text, 4, Runs(4), 32, 8, 5, allFixed, extents));
+	ASSERT_EQ(4u, extents.size());
+	EXPECT_EQ(8u, extents[0]);
+	EXPECT_EQ(32u, extents[1]);
+	EXPECT_EQ(40u, extents[2]);
+	EXPECT_EQ(45u, extents[3]);
+
+	// Italic runs get room for the slant (except at end of line)
+	std::vector<unsigned int> runs = Runs(1, wxFONTFLAG_ITALIC);
+	runs.push_back(2);
+	runs.push_back(wxFONTFLAG_ITALIC);
+	ASSERT_TRUE(ExtentCache::GetFixedExtents("ab", 2, runs, 32, 8, 5, allFixed, extents));
+	ASSERT_EQ(2u, extents.size());
+	EXPECT_EQ(10u, extents[0]);
+	EXPECT_EQ(18u, extents[1]);
+
+	// Multibyte and control chars have to be measured
+	EXPECT_FALSE(ExtentCache::GetFixedExtents("\xC3\xA9", 2, Runs(2), 32, 8, 5, allFixed, extents));
+	EXPECT_FALSE(ExtentCache::GetFixedExtents("a\x01", 2, Runs(2), 32, 8, 5, allFixed, extents));
+
+	// And so do styles that change the width
+	const bool boldWider[4] = {true, false, true, false};
+	EXPECT_TRUE(ExtentCache::GetFixedExtents("ab", 2, Runs(2, wxFONTFLAG_ITALIC), 32, 8, 5, boldWider, extents));
+	EXPECT_FALSE(ExtentCache::GetFixedExtents("ab", 2, Runs(2, wxFONTFLAG_BOLD), 32, 8, 5, boldWider, extents));
+}
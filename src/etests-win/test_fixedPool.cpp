@@ -0,0 +1,112 @@
+#include "stdafx.h"
+#include <vector>
+#include <ctime>
+#include <new>
+#include "FixedPool.h"
+#include <gtest/gtest.h>
+
+TEST(FixedPoolTest, ReusesFreedSlots) {
+	FixedPool pool(20);
+	EXPECT_EQ(0u, pool.GetSlotSize() % sizeof(void*));
+	EXPECT_LE(20u, pool.GetSlotSize());
+	const size_t n = pool.GetSlotsPerBlock();
+	EXPECT_LT(0u, n);
+
+	std::vector<void*> slots;
+	for (size_t i = 0; i < n + 2; ++i) slots.push_back(pool.Alloc());
+	EXPECT_EQ(n + 2, pool.GetUsedCount());
+	EXPECT_EQ(2 * FixedPool::BLOCKSIZE, pool.GetReservedBytes());
+
+	// Slots in a block are contiguous and do not overlap
+	for (size_t i = 1; i < n; ++i) {
+		EXPECT_EQ((char*)slots[i-1] + pool.GetSlotSize(), (char*)slots[i]);
+	}
+
+	pool.Free(slots[2]);
+	EXPECT_EQ(n + 1, pool.GetUsedCount());
+	EXPECT_EQ(slots[2], pool.Alloc());
+	EXPECT_EQ(2 * FixedPool::BLOCKSIZE, pool.GetReservedBytes());
+
+	pool.Free(NULL);
+	EXPECT_EQ(n + 2, pool.GetUsedCount());
+}
+
+TEST(FixedPoolTest, FindsOwnerPool) {
+	FixedPool pool1(16);
+	FixedPool pool2(16);
+
+	for (size_t i = 0; i < 2 * pool1.GetSlotsPerBlock(); ++i) {
+		void* p1 = pool1.Alloc();
+		void* p2 = pool2.Alloc();
+		EXPECT_EQ(&pool1, &FixedPool::GetPool(p1));
+		EXPECT_EQ(&pool2, &FixedPool::GetPool(p2));
+	}
+}
+
+TEST(FixedPoolTest, ReleasesEmptyBlocks) {
+	FixedPool pool(16);
+	const size_t n = pool.GetSlotsPerBlock();
+	const size_t blockBytes = FixedPool::BLOCKSIZE;
+
+	std::vector<void*> slots;
+	for (size_t i = 0; i < 3 * n; ++i) slots.push_back(pool.Alloc());
+	EXPECT_EQ(3 * blockBytes, pool.GetReservedBytes());
+
+	// One empty block is kept for reuse
+	for (size_t i = 0; i < n; ++i) pool.Free(slots[i]);
+	EXPECT_EQ(3 * blockBytes, pool.GetReservedBytes());
+	for (size_t i = n; i < 2 * n; ++i) pool.Free(slots[i]);
+	EXPECT_EQ(2 * blockBytes, pool.GetReservedBytes());
+	EXPECT_EQ(n, pool.GetUsedCount());
+
+	// Freed in any order
+	for (size_t i = 2 * n + 1; i < 3 * n; i += 2) pool.Free(slots[i]);
+	for (size_t i = 2 * n; i < 3 * n; i += 2) pool.Free(slots[i]);
+	EXPECT_EQ(0u, pool.GetUsedCount());
+	EXPECT_EQ(blockBytes, pool.GetReservedBytes());
+
+	// The kept block is used again
+	for (size_t i = 0; i < n; ++i) pool.Alloc();
+	EXPECT_EQ(blockBytes, pool.GetReservedBytes());
+	pool.Alloc();
+	EXPECT_EQ(2 * blockBytes, pool.GetReservedBytes());
+}
+
+namespace {
+
+// Same layout as a syntax match node
+struct Node {
+	unsigned int scopeId;
+	unsigned int stackId;
+	const void* matcher;
+	unsigned int start;
+	unsigned int end;
+	const void* style;
+	Node* subMatch;
+	Node* parent;
+};
+
+}
+
+// Micro-benchmark of building and freeing match nodes (the memory used
+// by the trees of parsed documents is reported by Styler_Syntax).
+// Disabled by default, run with --gtest_also_run_disabled_tests.
+TEST(FixedPoolBench, DISABLED_MatchNodes) {
+	const size_t count = 2000000; // roughly the matches in 20MB of xml
+	std::vector<Node*> nodes(count);
+
+	clock_t start = clock();
+	for (size_t i = 0; i < count; ++i) nodes[i] = new Node();
+	for (size_t i = 0; i < count; ++i) delete nodes[i];
+	const clock_t heapTicks = clock() - start;
+
+	FixedPool pool(sizeof(Node));
+	start = clock();
+	for (size_t i = 0; i < count; ++i) nodes[i] = new (pool.Alloc()) Node();
+	const size_t reserved = pool.GetReservedBytes();
+	for (size_t i = 0; i < count; ++i) pool.Free(nodes[i]);
+	const clock_t poolTicks = clock() - start;
+
+	printf("%u nodes of %u bytes: heap %ld ms, pool %ld ms, pool uses %.1f MB\n", (unsigned int)count, (unsigned int)sizeof(Node),
+		(long)(heapTicks * 1000 / CLOCKS_PER_SEC), (long)(poolTicks * 1000 / CLOCKS_PER_SEC), (double)reserved / (1024*1024));
+}
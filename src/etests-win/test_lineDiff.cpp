@@ -0,0 +1,233 @@
+#include "stdafx.h"
+#include <vector>
+#include <string>
+#include <cstdlib>
+#include <cstdio>
+#include <ctime>
+#include "LineDiff.h"
+#include <gtest/gtest.h>
+
+namespace {
+
+std::vector<LineDiff::Match> GetDiff(const std::string& text1, const std::string& text2) {
+	std::vector<LineDiff::Match> matches;
+	LineDiff diff;
+	diff.Diff(text1.data(), text1.size(), text2.data(), text2.size(), matches);
+	return matches;
+}
+
+// The matches have to be in order, not adjacent and cover equal text.
+// Returns the number of matched bytes.
+unsigned int Verify(const std::string& text1, const std::string& text2, const std::vector<LineDiff::Match>& matches) {
+	unsigned int pos1 = 0;
+	unsigned int pos2 = 0;
+	unsigned int matched = 0;
+	for (size_t i = 0; i < matches.size(); ++i) {
+		const LineDiff::Match& m = matches[i];
+		EXPECT_GT(m.len, 0u);
+		EXPECT_LE(m.end1(), text1.size());
+		EXPECT_LE(m.end2(), text2.size());
+		EXPECT_GE(m.start1, pos1);
+		EXPECT_GE(m.start2, pos2);
+		if (i) {
+			EXPECT_TRUE(m.start1 > pos1 || m.start2 > pos2);
+		}
+		EXPECT_EQ(text1.substr(m.start1, m.len), text2.substr(m.start2, m.len));
+
+		pos1 = m.end1();
+		pos2 = m.end2();
+		matched += m.len;
+	}
+	return matched;
+}
+
+std::string MakeLine(unsigned int n) {
+	static const char* words[] = {"if", "for", "while", "return", "int", "x", "y", "{", "}", "(", ")", "=", "+", ";", "foo", "bar"};
+	std::string line = "\t";
+	const unsigned int count = 2 + rand() % 8;
+	for (unsigned int i = 0; i < count; ++i) {
+		line += words[rand() % 16];
+		line += ' ';
+	}
+	if (n != (unsigned int)-1) {
+		char buffer[16];
+		sprintf(buffer, "%u", n);
+		line += buffer;
+	}
+	line += '\n';
+	return line;
+}
+
+std::string Join(const std::vector<std::string>& lines) {
+	std::string text;
+	for (size_t i = 0; i < lines.size(); ++i) text += lines[i];
+	return text;
+}
+
+// Changes, inserts and deletes random lines
+void EditLines(std::vector<std::string>& lines, unsigned int edits, unsigned int& n) {
+	for (unsigned int e = 0; e < edits && !lines.empty(); ++e) {
+		const size_t i = rand() % lines.size();
+		switch (rand() % 3) {
+		case 0: lines[i].insert(1 + rand() % (lines[i].size()-1), "z"); break;
+		case 1: lines.insert(lines.begin() + i, MakeLine(n++)); break;
+		case 2: lines.erase(lines.begin() + i); break;
+		}
+	}
+}
+
+// Length of a shortest edit script between the texts (byte level
+// Myers O(ND) diff, as the documents were compared with before)
+unsigned int MyersDistance(const std::string& a, const std::string& b) {
+	const int n = a.size();
+	const int m = b.size();
+	const int maxD = n + m;
+	std::vector<int> v(2 * maxD + 3);
+	const int o = maxD + 1;
+
+	for (int d = 0; d <= maxD; ++d) {
+		for (int k = -d; k <= d; k += 2) {
+			int x = (k == -d || (k != d && v[o+k-1] < v[o+k+1])) ? v[o+k+1] : v[o+k-1] + 1;
+			int y = x - k;
+			while (x < n && y < m && a[x] == b[y]) {++x; ++y;}
+			v[o+k] = x;
+			if (x >= n && y >= m) return d;
+		}
+	}
+	return maxD;
+}
+
+} // namespace
+
+TEST(LineDiff, Basic) {
+	// Equal
+	std::vector<LineDiff::Match> m = GetDiff("a\nb\n", "a\nb\n");
+	ASSERT_EQ(1u, m.size());
+	EXPECT_EQ(4u, m[0].len);
+
+	EXPECT_TRUE(GetDiff("", "").empty());
+	EXPECT_TRUE(GetDiff("a\n", "").empty());
+	EXPECT_TRUE(GetDiff("a\n", "b\n").size() == 1); // newline
+
+	// Inserted line
+	m = GetDiff("a\nb\nc\n", "a\nx\nb\nc\n");
+	ASSERT_EQ(2u, m.size());
+	EXPECT_EQ(0u, m[0].start1); EXPECT_EQ(0u, m[0].start2); EXPECT_EQ(2u, m[0].len);
+	EXPECT_EQ(2u, m[1].start1); EXPECT_EQ(4u, m[1].start2); EXPECT_EQ(4u, m[1].len);
+
+	// Deleted line
+	m = GetDiff("a\nx\nb\nc\n", "a\nb\nc\n");
+	ASSERT_EQ(2u, m.size());
+	EXPECT_EQ(4u, m[1].start1); EXPECT_EQ(2u, m[1].start2); EXPECT_EQ(4u, m[1].len);
+
+	// Changed inside line
+	m = GetDiff("x\nfoo bar\ny\n", "x\nfoo baz\ny\n");
+	ASSERT_EQ(2u, m.size());
+	EXPECT_EQ(8u, m[0].len); // "x\nfoo ba"
+	EXPECT_EQ(9u, m[1].start1); EXPECT_EQ(9u, m[1].start2); EXPECT_EQ(3u, m[1].len);
+
+	// Last line without newline
+	m = GetDiff("a\nb", "a\nb\n");
+	ASSERT_EQ(1u, m.size());
+	EXPECT_EQ(3u, m[0].len);
+
+	// Offsets
+	std::vector<LineDiff::Match> matches;
+	LineDiff diff;
+	diff.Diff("a\n", 2, "b\na\n", 4, matches, 10, 20);
+	ASSERT_EQ(1u, matches.size());
+	EXPECT_EQ(10u, matches[0].start1);
+	EXPECT_EQ(22u, matches[0].start2);
+}
+
+TEST(LineDiff, Utf8) {
+	// Changed chars are not split
+	std::vector<LineDiff::Match> m = GetDiff("\xC3\xA9\n", "\xC3\xA8\n");
+	ASSERT_EQ(1u, m.size());
+	EXPECT_EQ(2u, m[0].start1);
+	EXPECT_EQ(1u, m[0].len);
+
+	m = GetDiff("a\xC3\xA9", "b\xC3\xA9");
+	ASSERT_EQ(1u, m.size());
+	EXPECT_EQ(1u, m[0].start1);
+	EXPECT_EQ(2u, m[0].len);
+}
+
+TEST(LineDiff, MovedLines) {
+	// Unique lines are matched over common ones
+	const std::string text1 = "}\nfirst\n}\nsecond\n}\nthird\n}\n";
+	const std::string text2 = "}\nthird\n}\nfirst\n}\nsecond\n}\n";
+	const std::vector<LineDiff::Match> m = GetDiff(text1, text2);
+	EXPECT_EQ(text1.size() - 8, Verify(text1, text2, m)); // all but "third\n}\n"
+}
+
+TEST(LineDiff, RandomEdits) {
+	srand(1);
+	for (unsigned int round = 0; round < 200; ++round) {
+		unsigned int n = 0;
+		std::vector<std::string> lines;
+		const unsigned int count = rand() % 200;
+		for (unsigned int i = 0; i < count; ++i) lines.push_back(MakeLine(round % 2 ? n++ : (unsigned int)-1));
+
+		const std::string text1 = Join(lines);
+		EditLines(lines, rand() % 10, n);
+		const std::string text2 = Join(lines);
+
+		const std::vector<LineDiff::Match> m = GetDiff(text1, text2);
+		const unsigned int matched = Verify(text1, text2, m);
+		if (text1 == text2) {
+			EXPECT_EQ(text1.size(), matched);
+		}
+	}
+}
+
+TEST(LineDiff, SingleChange) {
+	// With unique lines, only the changed line differs
+	srand(2);
+	for (unsigned int round = 0; round < 50; ++round) {
+		unsigned int n = 0;
+		std::vector<std::string> lines;
+		for (unsigned int i = 0; i < 500; ++i) lines.push_back(MakeLine(n++));
+		const std::string text1 = Join(lines);
+
+		const size_t i = rand() % lines.size();
+		const size_t changedLen = lines[i].size();
+		lines[i] = MakeLine(n++);
+		const std::string text2 = Join(lines);
+
+		const unsigned int matched = Verify(text1, text2, GetDiff(text1, text2));
+		EXPECT_GE(matched + changedLen, text1.size());
+	}
+}
+
+TEST(LineDiffBench, DISABLED_LargeFiles) {
+	srand(3);
+	const unsigned int lineCounts[] = {10000, 100000};
+	const unsigned int editCounts[] = {10, 200, 2000};
+
+	for (unsigned int c = 0; c < 2; ++c) {
+		for (unsigned int e = 0; e < 3; ++e) {
+			unsigned int n = 0;
+			std::vector<std::string> lines;
+			for (unsigned int i = 0; i < lineCounts[c]; ++i) lines.push_back(MakeLine(n++));
+			const std::string text1 = Join(lines);
+			EditLines(lines, editCounts[e], n);
+			const std::string text2 = Join(lines);
+
+			const clock_t oldStart = clock();
+			const unsigned int distance = MyersDistance(text1, text2);
+			const clock_t oldTicks = clock() - oldStart;
+
+			const clock_t newStart = clock();
+			std::vector<LineDiff::Match> matches;
+			LineDiff diff;
+			diff.Diff(text1.data(), text1.size(), text2.data(), text2.size(), matches);
+			const clock_t newTicks = clock() - newStart;
+
+			const unsigned int matched = Verify(text1, text2, matches);
+			printf("%6u lines %4u edits  myers %8.1f ms (%u)  linediff %8.1f ms (%u)\n", lineCounts[c], editCounts[e],
+				oldTicks * 1000.0 / CLOCKS_PER_SEC, distance,
+				newTicks * 1000.0 / CLOCKS_PER_SEC, (unsigned int)((text1.size() - matched) + (text2.size() - matched)));
+		}
+	}
+}
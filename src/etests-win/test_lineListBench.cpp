@@ -0,0 +1,151 @@
+#include "stdafx.h"
+#include <vector>
+#include <ctime>
+#include <cstdio>
+#include "Document.h"
+#include "ISettings.h"
+#include "FixedLine.h"
+#include "Interval.h"
+#include "BracketHighlight.h"
+#include "LineListNoWrap.h"
+#include "LineListWrap.h"
+#include "tmTheme.h"
+#include "Support.h"
+#include <wx/dcmemory.h>
+#include <gtest/gtest.h>
+
+// Micro-benchmark of typing in a huge file, with the line lists used by
+// the editor (so it includes the line widths and heights they keep).
+// Disabled by default, run with --gtest_also_run_disabled_tests.
+
+namespace {
+
+class NoSettings: public ISettings {
+public:
+	virtual bool GetSettingBool(const wxString& WXUNUSED(name), bool& WXUNUSED(value)) const {return false;};
+	virtual bool GetSettingInt(const wxString& WXUNUSED(name), int& WXUNUSED(value)) const {return false;};
+	virtual bool GetSettingLong(const wxString& WXUNUSED(name), wxLongLong& WXUNUSED(value)) const {return false;};
+	virtual bool GetSettingString(const wxString& WXUNUSED(name), wxString& WXUNUSED(value)) const {return false;};
+};
+
+// Types in the document and updates the line list like Lines does.
+// Only the time spent in the line list is counted.
+clock_t TypeLines(Document& doc, LineList& ll, unsigned int line, unsigned int keystrokes, unsigned int charWidth) {
+	clock_t ticks = 0;
+	for (unsigned int k = 1; k <= keystrokes; ++k) {
+		const unsigned int pos = ll.end(line) - 1; // before newline
+
+		if (k % 10 == 0) {
+			doc.Insert(pos, "\n");
+
+			const clock_t start = clock();
+			const unsigned int oldEnd = ll.end(line);
+			ll.update(line, pos + 1);
+			ll.insert(line + 1, oldEnd + 1);
+			ll.update_line_extent(line, (pos + 1 - ll.offset(line)) * charWidth);
+			++line;
+			ticks += clock() - start;
+		}
+		else {
+			doc.Insert(pos, "x");
+
+			const clock_t start = clock();
+			ll.update(line, ll.end(line) + 1);
+			ll.update_line_extent(line, (ll.end(line) - ll.offset(line)) * charWidth);
+			ticks += clock() - start;
+		}
+
+		// Every fiftieth keystroke joins two lines
+		if (k % 50 == 0 && line + 1 < ll.size()) {
+			const unsigned int nlPos = ll.end(line) - 1;
+			doc.Delete(nlPos, nlPos + 1);
+
+			const clock_t start = clock();
+			const unsigned int nextEnd = ll.end(line + 1);
+			ll.remove(line + 1, line + 2);
+			ll.update(line, nextEnd - 1);
+			ticks += clock() - start;
+		}
+	}
+	return ticks;
+}
+
+} // namespace
+
+class LineListBench : public testing::Test {
+protected:
+	virtual void SetUp() {
+		wxString edb;
+		if (!RequireEdb(edb)) {
+			FAIL() << "Need to copy a registered e.db into this folder for this test to run.";
+		}
+
+		m_catalyst = new Catalyst(edb);
+		m_cw = new CatalystWrapper(*m_catalyst);
+	};
+
+	virtual void TearDown() {
+		delete m_cw;
+		m_cw = NULL;
+		delete m_catalyst;
+		m_catalyst = NULL;
+	};
+
+	Catalyst* m_catalyst;
+	CatalystWrapper* m_cw;
+};
+
+TEST_F(LineListBench, DISABLED_TypingInHugeFile) {
+	const unsigned int lineCount = 500000;
+	const unsigned int keystrokes = 200; // every tenth is a newline
+	const char* names[] = {"top", "middle", "bottom"};
+	const unsigned int lines[] = {10, lineCount / 2, lineCount - 10};
+
+	std::vector<char> text;
+	for (unsigned int i = 0; i < lineCount; ++i) {
+		const unsigned int len = 20 + i % 60;
+		text.insert(text.end(), len - 1, 'a');
+		text.push_back('\n');
+	}
+	text.push_back('\0');
+
+	wxMemoryDC dc;
+	wxBitmap bitmap(100, 100);
+	dc.SelectObject(bitmap);
+	dc.SetFont(wxFont(10, wxFONTFAMILY_MODERN, wxFONTSTYLE_NORMAL, wxFONTWEIGHT_NORMAL));
+
+	const NoSettings settings;
+	const std::vector<interval> selections;
+	const BracketHighlight brackets;
+	const unsigned int lastpos = 0;
+	const bool isShadow = false;
+	tmTheme theme;
+
+	for (unsigned int n = 0; n < 3; ++n) {
+		for (unsigned int wrap = 0; wrap < 2; ++wrap) {
+			Document doc(*m_cw);
+			doc.CreateNew(settings);
+			doc.Insert(0, &text[0]);
+			DocumentWrapper dw(doc);
+
+			FixedLine line(dc, dw, selections, brackets, lastpos, isShadow, theme);
+			line.Init();
+			line.SetWordWrap(wrap ? cxWRAP_NORMAL : cxWRAP_NONE);
+			line.SetWidth(800);
+
+			LineListNoWrap noWrap(line, dw);
+			LineListWrap lineWrap(line, dw);
+			LineList& ll = wrap ? (LineList&)lineWrap : (LineList&)noWrap;
+
+			std::vector<unsigned int> offsets;
+			doc.GetLines(offsets);
+			ll.SetOffsets(offsets);
+
+			const clock_t ticks = TypeLines(doc, ll, lines[n], keystrokes, line.GetCharWidth());
+			EXPECT_EQ(doc.GetLength(), ll.length());
+
+			printf("%u keystrokes at %s of %u lines: %s %ld ms\n", keystrokes, names[n], lineCount,
+				wrap ? "LineListWrap" : "LineListNoWrap", (long)(ticks * 1000 / CLOCKS_PER_SEC));
+		}
+	}
+}
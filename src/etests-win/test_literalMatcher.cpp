@@ -0,0 +1,102 @@
+#include "stdafx.h"
+#include <limits.h>
+#include <string>
+#include "LiteralMatcher.h"
+#include <gtest/gtest.h>
+
+TEST(LiteralMatcherTest, FindsFirstAndLast) {
+	const std::string text = "one needle, then a longer stretch of hay and another needle at the end";
+	LiteralMatcher matcher;
+	matcher.Set("needle", 6);
+
+	const char* match = matcher.Find(text.data(), text.size());
+	ASSERT_TRUE(match != NULL);
+	EXPECT_EQ(4, match - text.data());
+
+	match = matcher.FindBackwards(text.data(), text.size());
+	ASSERT_TRUE(match != NULL);
+	EXPECT_EQ((int)text.rfind("needle"), match - text.data());
+
+	EXPECT_TRUE(matcher.Find(text.data(), 9) == NULL);
+}
+
+TEST(LiteralMatcherTest, CaselessMatchesMixedCase) {
+	const std::string text = "padding padding padding padding NeEdLe";
+	LiteralMatcher matcher;
+	matcher.Set("needle", "NEEDLE", 6);
+
+	const char* match = matcher.Find(text.data(), text.size());
+	ASSERT_TRUE(match != NULL);
+	EXPECT_EQ((int)text.size() - 6, match - text.data());
+
+	match = matcher.FindBackwards(text.data(), text.size());
+	ASSERT_TRUE(match != NULL);
+	EXPECT_EQ((int)text.size() - 6, match - text.data());
+}
+
+TEST(LiteralMatcherTest, MatchesAgainstBruteForce) {
+	const std::string text = "abacabadabacabaeabacabadabacabaf abacabad ABACABA";
+	const char* needles[] = {"a", "aba", "abad", "cabae", "abacabaf", "ABA", "zz"};
+
+	for (unsigned int n = 0; n < sizeof(needles)/sizeof(needles[0]); ++n) {
+		const std::string needle = needles[n];
+		LiteralMatcher matcher;
+		matcher.Set(needle.data(), needle.size());
+
+		const char* match = matcher.Find(text.data(), text.size());
+		const size_t first = text.find(needle);
+		if (first == std::string::npos) EXPECT_TRUE(match == NULL);
+		else EXPECT_EQ((int)first, match - text.data());
+
+		match = matcher.FindBackwards(text.data(), text.size());
+		const size_t last = text.rfind(needle);
+		if (last == std::string::npos) EXPECT_TRUE(match == NULL);
+		else EXPECT_EQ((int)last, match - text.data());
+	}
+}
+
+TEST(LiteralMatcherTest, CharFoldMatchesDifferentWidths) {
+	// dotless i (2 bytes) has plain 'I' (1 byte) as uppercase
+	CharFoldMatcher matcher;
+	matcher.AddChar("\xC4\xB1", 2, "I", 1);
+	matcher.AddChar("n", 1, "N", 1);
+
+	const std::string text = "xx in \xC4\xB1N In";
+	size_t matchLen = 0;
+	const char* match = matcher.Find(text.data(), text.size(), matchLen);
+	ASSERT_TRUE(match != NULL);
+	EXPECT_EQ(6, match - text.data());
+	EXPECT_EQ(3u, matchLen);
+
+	const size_t next = (match - text.data()) + matchLen;
+	match = matcher.Find(text.data() + next, text.size() - next, matchLen);
+	ASSERT_TRUE(match != NULL);
+	EXPECT_EQ((int)text.size() - 2, match - text.data());
+	EXPECT_EQ(2u, matchLen);
+
+	EXPECT_TRUE(matcher.Find(text.data(), 5, matchLen) == NULL);
+}
+
+TEST(LiteralMatcherTest, CharFoldFindsBackwards) {
+	CharFoldMatcher matcher;
+	matcher.AddChar("\xC4\xB1", 2, "I", 1);
+	matcher.AddChar("n", 1, "N", 1);
+	EXPECT_EQ(3u, matcher.GetMaxLength());
+
+	const std::string text = "xx in \xC4\xB1N In";
+	size_t matchLen = 0;
+	const char* match = matcher.FindBackwards(text.data(), text.size(), text.size(), matchLen);
+	ASSERT_TRUE(match != NULL);
+	EXPECT_EQ((int)text.size() - 2, match - text.data());
+	EXPECT_EQ(2u, matchLen);
+
+	// Only matches starting in the first startLen bytes
+	match = matcher.FindBackwards(text.data(), text.size(), text.size() - 2, matchLen);
+	ASSERT_TRUE(match != NULL);
+	EXPECT_EQ(6, match - text.data());
+	EXPECT_EQ(3u, matchLen);
+
+	// and entirely inside the buffer
+	EXPECT_TRUE(matcher.FindBackwards(text.data(), 8, 8, matchLen) == NULL);
+	EXPECT_TRUE(matcher.FindBackwards(text.data(), text.size(), 6, matchLen) == NULL);
+}
@@ -0,0 +1,140 @@
+#include "stdafx.h"
+#include <string>
+#include <vector>
+#include <ctime>
+#include "LiteralMatcher.h"
+#include <wx/dir.h>
+#include <wx/ffile.h>
+#include <gtest/gtest.h>
+
+// Micro-benchmark of the Find In Project literal search.
+// Disabled by default, run with --gtest_also_run_disabled_tests.
+// Searches the source tree in E_BENCH_TREE (or the e sources).
+
+namespace {
+
+// The Horspool search SearchThread::DoSearch used before LiteralMatcher
+size_t HorspoolCount(const std::string& text, const std::string& lower, const std::string& upper, bool matchCase) {
+	const size_t byte_len = lower.size();
+	char charmap[256];
+	memset(charmap, (int)byte_len, 256);
+	const size_t last_char_pos = byte_len-1;
+	for (size_t i = 0; i < last_char_pos; ++i) {
+		charmap[(unsigned char)lower[i]] = (char)(last_char_pos-i);
+		if (!matchCase) charmap[(unsigned char)upper[i]] = (char)(last_char_pos-i);
+	}
+
+	const char lastChar = lower[last_char_pos];
+	const char lastCharUpper = matchCase ? '\0' : upper[last_char_pos];
+	const char* subject = text.data() + last_char_pos;
+	const char* const end_pos = text.data() + text.size();
+	size_t count = 0;
+
+	while (subject < end_pos) {
+		const char c = *subject;
+		if (c == lastChar || (!matchCase && c == lastCharUpper)) {
+			const char* byte_ptr = subject-1;
+			const char* const first_byte_pos = subject - last_char_pos;
+			unsigned int char_pos = last_char_pos-1;
+			while (byte_ptr >= first_byte_pos) {
+				const char c2 = *byte_ptr;
+				if (c2 != lower[char_pos]) {
+					if (matchCase || c2 != upper[char_pos]) break;
+				}
+				--byte_ptr; --char_pos;
+			}
+
+			if (byte_ptr < first_byte_pos) {
+				++count;
+				subject += byte_len;
+				continue;
+			}
+		}
+		subject += charmap[(unsigned char)c];
+	}
+	return count;
+}
+
+size_t MatcherCount(const std::string& text, const LiteralMatcher& matcher) {
+	const char* const end = text.data() + text.size();
+	const char* p = text.data();
+	size_t count = 0;
+	while ((p = matcher.Find(p, end - p)) != NULL) {
+		++count;
+		p += matcher.GetLength();
+	}
+	return count;
+}
+
+std::string Upper(const std::string& s) {
+	std::string upper = s;
+	for (size_t i = 0; i < upper.size(); ++i) upper[i] = (char)toupper((unsigned char)upper[i]);
+	return upper;
+}
+
+std::string Lower(const std::string& s) {
+	std::string lower = s;
+	for (size_t i = 0; i < lower.size(); ++i) lower[i] = (char)tolower((unsigned char)lower[i]);
+	return lower;
+}
+
+void LoadTree(std::vector<std::string>& files) {
+	wxString root;
+	if (!wxGetEnv(wxT("E_BENCH_TREE"), &root)) root = wxT("..");
+
+	wxArrayString paths;
+	wxDir::GetAllFiles(root, &paths, wxT("*.cpp"));
+	wxDir::GetAllFiles(root, &paths, wxT("*.h"));
+
+	for (size_t i = 0; i < paths.size(); ++i) {
+		wxFFile file(paths[i], wxT("rb"));
+		if (!file.IsOpened()) continue;
+
+		std::string text((size_t)file.Length(), '\0');
+		if (!text.empty() && file.Read(&text[0], text.size()) == text.size()) files.push_back(text);
+	}
+}
+
+}
+
+TEST(LiteralMatcherBench, DISABLED_SourceTree) {
+	std::vector<std::string> files;
+	LoadTree(files);
+	ASSERT_FALSE(files.empty());
+
+	size_t totalBytes = 0;
+	for (size_t f = 0; f < files.size(); ++f) totalBytes += files[f].size();
+
+	const char* needles[] = {"if", "int", "wxT", "const", "Find", "m_doc", "GetLength", "wxString::Format", "SearchThread::DoSearch"};
+	const int rounds = 5;
+
+	for (size_t n = 0; n < sizeof(needles)/sizeof(needles[0]); ++n) {
+		for (int caseless = 0; caseless < 2; ++caseless) {
+			const std::string lower = caseless ? Lower(needles[n]) : needles[n];
+			const std::string upper = caseless ? Upper(needles[n]) : needles[n];
+
+			LiteralMatcher matcher;
+			matcher.Set(lower.data(), upper.data(), lower.size());
+
+			size_t oldCount = 0;
+			const clock_t oldStart = clock();
+			for (int r = 0; r < rounds; ++r) {
+				for (size_t f = 0; f < files.size(); ++f) oldCount += HorspoolCount(files[f], lower, upper, !caseless);
+			}
+			const clock_t oldTicks = clock() - oldStart;
+
+			size_t newCount = 0;
+			const clock_t newStart = clock();
+			for (int r = 0; r < rounds; ++r) {
+				for (size_t f = 0; f < files.size(); ++f) newCount += MatcherCount(files[f], matcher);
+			}
+			const clock_t newTicks = clock() - newStart;
+
+			EXPECT_EQ(oldCount, newCount) << needles[n];
+
+			const double mb = (double)totalBytes * rounds / (1024*1024);
+			printf("%-24s %s %8u matches  horspool %8.1f MB/s  matcher %8.1f MB/s\n", needles[n], caseless ? "nocase" : "case  ", (unsigned int)(newCount / rounds),
+				mb / ((double)(oldTicks+1) / CLOCKS_PER_SEC), mb / ((double)(newTicks+1) / CLOCKS_PER_SEC));
+		}
+	}
+}
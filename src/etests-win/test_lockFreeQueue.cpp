@@ -0,0 +1,37 @@
+#include "stdafx.h"
+#include <string>
+#include "LockFreeQueue.h"
+#include <gtest/gtest.h>
+
+TEST(LockFreeQueueTest, PopsInPushOrder) {
+	LockFreeQueue<int> queue;
+	int value = -1;
+	EXPECT_FALSE(queue.Pop(value));
+
+	for (int i = 0; i < 100; ++i) queue.Push(i);
+	for (int i = 0; i < 100; ++i) {
+		ASSERT_TRUE(queue.Pop(value));
+		EXPECT_EQ(i, value);
+	}
+	EXPECT_FALSE(queue.Pop(value));
+}
+
+TEST(LockFreeQueueTest, InterleavedPushAndPop) {
+	LockFreeQueue<std::string> queue;
+	std::string value;
+
+	queue.Push("a");
+	queue.Push("b");
+	ASSERT_TRUE(queue.Pop(value));
+	EXPECT_EQ("a", value);
+
+	queue.Push("c");
+	ASSERT_TRUE(queue.Pop(value));
+	EXPECT_EQ("b", value);
+	ASSERT_TRUE(queue.Pop(value));
+	EXPECT_EQ("c", value);
+	EXPECT_FALSE(queue.Pop(value));
+
+	// Items left in the queue are freed with it
+	queue.Push("d");
+}
@@ -0,0 +1,155 @@
+#include "stdafx.h"
+#include <vector>
+#include <cstdlib>
+#include "MatchList.h"
+#include <gtest/gtest.h>
+
+namespace {
+
+// Reference implementation with the matches in a flat vector
+void InsertText(std::vector<interval>& ref, unsigned int pos, unsigned int length) {
+	for (std::vector<interval>::iterator p = ref.begin(); p != ref.end(); ) {
+		if (p->end > pos) {
+			if (p->start < pos) {
+				p = ref.erase(p);
+				continue;
+			}
+			p->start += length;
+			p->end += length;
+		}
+		++p;
+	}
+}
+
+void DeleteText(std::vector<interval>& ref, unsigned int start, unsigned int end) {
+	for (std::vector<interval>::iterator p = ref.begin(); p != ref.end(); ) {
+		if (p->end > start) {
+			if (p->start < end) {
+				p = ref.erase(p);
+				continue;
+			}
+			p->start -= end - start;
+			p->end -= end - start;
+		}
+		++p;
+	}
+}
+
+void ExpectSame(const std::vector<interval>& ref, const MatchList& matches) {
+	ASSERT_EQ(ref.size(), matches.GetCount());
+	for (unsigned int i = 0; i < ref.size(); ++i) {
+		ASSERT_EQ(ref[i], matches.Get(i));
+	}
+}
+
+unsigned int FindEnding(const std::vector<interval>& ref, unsigned int pos) {
+	unsigned int i = 0;
+	while (i < ref.size() && ref[i].end < pos) ++i;
+	return i;
+}
+
+unsigned int FindStarting(const std::vector<interval>& ref, unsigned int pos) {
+	unsigned int i = 0;
+	while (i < ref.size() && ref[i].start < pos) ++i;
+	return i;
+}
+
+}
+
+TEST(MatchListTest, Basic) {
+	MatchList matches;
+	EXPECT_TRUE(matches.IsEmpty());
+	EXPECT_EQ(0u, matches.FindEnding(10));
+
+	matches.Append(interval(5, 8));
+	matches.Append(interval(8, 8)); // zero-length
+	matches.Append(interval(20, 25));
+	matches.Insert(0, interval(0, 2));
+	EXPECT_EQ(4u, matches.GetCount());
+	EXPECT_EQ(interval(8, 8), matches.Get(2));
+	EXPECT_EQ(interval(20, 25), matches.Get(3));
+
+	EXPECT_EQ(1u, matches.FindEnding(3));
+	EXPECT_EQ(1u, matches.FindEnding(8));
+	EXPECT_EQ(3u, matches.FindEnding(9));
+	EXPECT_EQ(2u, matches.FindStarting(6));
+	EXPECT_EQ(2u, matches.FindStarting(8));
+	EXPECT_EQ(4u, matches.FindStarting(21));
+
+	// Typing inside a match removes it, the rest move
+	matches.InsertText(6, 2);
+	EXPECT_EQ(3u, matches.GetCount());
+	EXPECT_EQ(interval(10, 10), matches.Get(1));
+	EXPECT_EQ(interval(22, 27), matches.Get(2));
+
+	matches.DeleteText(12, 20);
+	EXPECT_EQ(interval(14, 19), matches.Get(2));
+
+	matches.Erase(0, 2);
+	EXPECT_EQ(1u, matches.GetCount());
+	EXPECT_EQ(interval(14, 19), matches.Get(0));
+}
+
+TEST(MatchListTest, RandomEdits) {
+	srand(7);
+	std::vector<interval> ref;
+	MatchList matches;
+
+	// Enough matches for a tree of many chunks
+	unsigned int pos = 0;
+	for (unsigned int i = 0; i < 5000; ++i) {
+		pos += rand() % 30;
+		const interval iv(pos, pos + rand() % 6);
+		ref.push_back(iv);
+		matches.Append(iv);
+		pos = iv.end;
+	}
+	ExpectSame(ref, matches);
+
+	for (unsigned int n = 0; n < 3000; ++n) {
+		const unsigned int textLen = ref.empty() ? 100 : ref.back().end + 50;
+		const unsigned int at = rand() % textLen;
+		switch (rand() % 4) {
+		case 0:
+			{
+				const unsigned int length = 1 + rand() % 20;
+				InsertText(ref, at, length);
+				matches.InsertText(at, length);
+			}
+			break;
+		case 1:
+			{
+				const unsigned int end = at + rand() % 40;
+				DeleteText(ref, at, end);
+				matches.DeleteText(at, end);
+			}
+			break;
+		case 2:
+			{
+				// Add a match in a free gap
+				const unsigned int i = FindStarting(ref, at);
+				const unsigned int prevEnd = i ? ref[i-1].end : 0;
+				const unsigned int nextStart = (i < ref.size()) ? ref[i].start : prevEnd + 20;
+				if (at >= prevEnd && at <= nextStart) {
+					const interval iv(at, at + rand() % (nextStart - at + 1));
+					ref.insert(ref.begin() + i, iv);
+					matches.Insert(i, iv);
+				}
+			}
+			break;
+		case 3:
+			if (!ref.empty()) {
+				const unsigned int first = rand() % ref.size();
+				const unsigned int last = first + rand() % (ref.size() - first + 1);
+				ref.erase(ref.begin() + first, ref.begin() + last);
+				matches.Erase(first, last);
+			}
+			break;
+		}
+
+		ASSERT_EQ(FindEnding(ref, at), matches.FindEnding(at));
+		ASSERT_EQ(FindStarting(ref, at), matches.FindStarting(at));
+		if (n % 100 == 0) ExpectSame(ref, matches);
+	}
+	ExpectSame(ref, matches);
+}
@@ -0,0 +1,170 @@
+#include "stdafx.h"
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+#include <ctime>
+#include <cstdio>
+#include "PrefixSumTree.h"
+#include <gtest/gtest.h>
+
+namespace {
+
+void ExpectSame(const std::vector<unsigned int>& ref, const PrefixSumTree& tree) {
+	ASSERT_EQ(ref.size(), tree.GetCount());
+
+	unsigned int sum = 0;
+	unsigned int max = 0;
+	for (unsigned int i = 0; i < ref.size(); ++i) {
+		ASSERT_EQ(ref[i], tree.Get(i));
+		ASSERT_EQ(sum, tree.GetSum(i));
+		if (ref[i]) {
+			ASSERT_EQ(i, tree.Find(sum));
+			ASSERT_EQ(i, tree.Find(sum + ref[i] - 1));
+		}
+		sum += ref[i];
+		if (ref[i] > max) max = ref[i];
+	}
+	EXPECT_EQ(sum, tree.GetTotal());
+	EXPECT_EQ(max, tree.GetMax());
+	EXPECT_EQ(sum, tree.GetSum(ref.size()));
+	EXPECT_EQ(ref.size(), tree.Find(sum));
+}
+
+}
+
+TEST(PrefixSumTreeTest, Basic) {
+	PrefixSumTree tree;
+	EXPECT_TRUE(tree.IsEmpty());
+	EXPECT_EQ(0u, tree.GetTotal());
+	EXPECT_EQ(0u, tree.Find(0));
+
+	tree.Insert(0, 10, 3); // 10 10 10
+	tree.Insert(1, 5);     // 10 5 10 10
+	tree.Set(3, 0);        // 10 5 10 0
+	EXPECT_EQ(10u, tree.GetMax());
+	EXPECT_EQ(4u, tree.GetCount());
+	EXPECT_EQ(25u, tree.GetTotal());
+	EXPECT_EQ(15u, tree.GetSum(2));
+	EXPECT_EQ(0u, tree.Find(9));
+	EXPECT_EQ(1u, tree.Find(10));
+	EXPECT_EQ(2u, tree.Find(24));
+	EXPECT_EQ(4u, tree.Find(25)); // zero height element is never found
+
+	tree.Erase(0, 2);
+	EXPECT_EQ(2u, tree.GetCount());
+	EXPECT_EQ(10u, tree.GetTotal());
+	tree.Set(0, 3);
+	EXPECT_EQ(3u, tree.GetMax());
+
+	tree.Clear();
+	EXPECT_TRUE(tree.IsEmpty());
+}
+
+TEST(PrefixSumTreeTest, RandomEdits) {
+	srand(42);
+	std::vector<unsigned int> ref;
+	PrefixSumTree tree;
+
+	// Start with enough elements for a tree of many chunks
+	for (unsigned int i = 0; i < 5000; ++i) ref.push_back(rand() % 40);
+	tree.Assign(ref);
+	ExpectSame(ref, tree);
+
+	for (unsigned int n = 0; n < 2000; ++n) {
+		const unsigned int index = ref.empty() ? 0 : rand() % (ref.size()+1);
+		switch (rand() % 5) {
+		case 0:
+			{
+				const unsigned int count = 1 + rand() % 3;
+				const unsigned int value = rand() % 40;
+				ref.insert(ref.begin() + index, count, value);
+				tree.Insert(index, value, count);
+			}
+			break;
+		case 1:
+			{
+				std::vector<unsigned int> values(rand() % 1200);
+				for (unsigned int i = 0; i < values.size(); ++i) values[i] = rand() % 40;
+				ref.insert(ref.begin() + index, values.begin(), values.end());
+				tree.Insert(index, values);
+			}
+			break;
+		case 2:
+		case 3:
+			if (index < ref.size()) {
+				const unsigned int last = index + rand() % std::min(1500u, (unsigned int)ref.size() - index);
+				ref.erase(ref.begin() + index, ref.begin() + last);
+				tree.Erase(index, last);
+			}
+			break;
+		case 4:
+			if (index < ref.size()) {
+				ref[index] = rand() % 40;
+				tree.Set(index, ref[index]);
+			}
+			break;
+		}
+
+		if (n % 50 == 0) ExpectSame(ref, tree);
+	}
+	ExpectSame(ref, tree);
+
+	std::vector<unsigned int> values;
+	tree.GetValues(values);
+	EXPECT_EQ(ref, values);
+}
+
+// Micro-benchmark of typing in a huge file, with the line offsets in a
+// flat vector (where each edit shifts the following offsets) compared
+// to line lengths in the tree (see test_lineListBench.cpp for the line
+// lists using it).
+// Disabled by default, run with --gtest_also_run_disabled_tests.
+TEST(PrefixSumTreeBench, DISABLED_TypingInHugeFile) {
+	const unsigned int lineCount = 5000000;
+	const unsigned int keystrokes = 200; // every tenth is a newline
+	const char* names[] = {"top", "middle", "bottom"};
+	const unsigned int lines[] = {10, lineCount / 2, lineCount - 10};
+
+	std::vector<unsigned int> lengths(lineCount);
+	for (unsigned int i = 0; i < lineCount; ++i) lengths[i] = 20 + i % 60;
+
+	for (unsigned int n = 0; n < 3; ++n) {
+		// Flat vector of end offsets
+		std::vector<unsigned int> offsets(lineCount);
+		unsigned int lineEnd = 0;
+		for (unsigned int i = 0; i < lineCount; ++i) offsets[i] = lineEnd += lengths[i];
+
+		clock_t start = clock();
+		unsigned int line = lines[n];
+		for (unsigned int k = 1; k <= keystrokes; ++k) {
+			if (k % 10 == 0) {
+				const unsigned int lineStart = line ? offsets[line-1] : 0;
+				offsets.insert(offsets.begin() + line, lineStart + 1);
+				for (std::vector<unsigned int>::iterator p = offsets.begin() + line + 1; p != offsets.end(); ++p) ++*p;
+				++line;
+			}
+			else {
+				for (std::vector<unsigned int>::iterator p = offsets.begin() + line; p != offsets.end(); ++p) ++*p;
+			}
+		}
+		const clock_t vectorTicks = clock() - start;
+
+		// Tree of line lengths
+		PrefixSumTree tree;
+		tree.Assign(lengths);
+
+		start = clock();
+		line = lines[n];
+		for (unsigned int k = 1; k <= keystrokes; ++k) {
+			if (k % 10 == 0) tree.Insert(++line, 1);
+			else tree.Set(line, tree.Get(line) + 1);
+		}
+		const clock_t treeTicks = clock() - start;
+
+		EXPECT_EQ(offsets.back(), tree.GetTotal());
+		EXPECT_EQ(offsets[line], tree.GetSum(line+1));
+
+		printf("%u keystrokes at %s of %u lines: vector %ld ms, tree %ld ms\n", keystrokes, names[n], lineCount,
+			(long)(vectorTicks * 1000 / CLOCKS_PER_SEC), (long)(treeTicks * 1000 / CLOCKS_PER_SEC));
+	}
+}
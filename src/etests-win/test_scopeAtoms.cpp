@@ -0,0 +1,54 @@
+#include "stdafx.h"
+#include "ScopeAtoms.h"
+#include <gtest/gtest.h>
+
+TEST(ScopeAtomsTest, InternsWords) {
+	ScopeAtoms& atoms = ScopeAtoms::Get();
+
+	EXPECT_EQ(0u, atoms.GetScopeId(wxEmptyString));
+	EXPECT_TRUE(atoms.GetAtoms(0).empty());
+
+	const unsigned int scopeId = atoms.GetScopeId(wxT("string.quoted.double"));
+	EXPECT_NE(0u, scopeId);
+	EXPECT_EQ(scopeId, atoms.GetScopeId(wxT("string.quoted.double")));
+
+	const ScopeAtoms::AtomList& words = atoms.GetAtoms(scopeId);
+	ASSERT_EQ(3u, words.size());
+	EXPECT_EQ(atoms.GetAtom(wxT("string")), words[0]);
+	EXPECT_EQ(atoms.GetAtom(wxT("quoted")), words[1]);
+	EXPECT_EQ(atoms.GetAtom(wxT("double")), words[2]);
+	EXPECT_EQ(wxT("quoted"), atoms.GetWord(words[1]));
+
+	// Shares atoms with other scopes, and a trailing dot adds no word
+	const ScopeAtoms::AtomList& words2 = atoms.GetAtoms(atoms.GetScopeId(wxT("string.")));
+	ASSERT_EQ(1u, words2.size());
+	EXPECT_EQ(words[0], words2[0]);
+}
+
+TEST(ScopeAtomsTest, InternsStacks) {
+	ScopeAtoms& atoms = ScopeAtoms::Get();
+	const unsigned int source = atoms.GetScopeId(wxT("source.c"));
+	const unsigned int comment = atoms.GetScopeId(wxT("comment.line"));
+
+	const unsigned int outer = atoms.GetStackId(0, source);
+	const unsigned int inner = atoms.GetStackId(outer, comment);
+	EXPECT_NE(0u, outer);
+	EXPECT_NE(outer, inner);
+	EXPECT_EQ(inner, atoms.GetStackId(atoms.GetStackId(0, source), comment));
+	EXPECT_NE(inner, atoms.GetStackId(0, comment));
+
+	// The empty scope does not add a level
+	EXPECT_EQ(inner, atoms.GetStackId(inner, 0));
+
+	ScopeAtoms::ScopeList scopes;
+	atoms.GetStackScopes(inner, scopes);
+	ASSERT_EQ(2u, scopes.size());
+	EXPECT_EQ(&atoms.GetAtoms(source), scopes[0]);
+	EXPECT_EQ(&atoms.GetAtoms(comment), scopes[1]);
+
+	std::deque<const wxString*> names;
+	atoms.GetStackNames(inner, names);
+	ASSERT_EQ(2u, names.size());
+	EXPECT_EQ(&atoms.GetScope(source), names[0]);
+	EXPECT_EQ(&atoms.GetScope(comment), names[1]);
+}
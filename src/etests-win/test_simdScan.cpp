@@ -0,0 +1,96 @@
+#include "stdafx.h"
+#include <limits.h>
+#include <string>
+#include "SimdScan.h"
+#include <gtest/gtest.h>
+
+TEST(SimdScanTest, UnixLines) {
+	const std::string text = "first line\nsecond line that is longer than a block\n\nlast";
+	EolScanResult result;
+	ASSERT_TRUE(ScanUtf8Lines(text.data(), text.size(), result));
+
+	ASSERT_EQ(3u, result.lineEnds.size());
+	EXPECT_EQ(11u, result.lineEnds[0]);
+	EXPECT_EQ(51u, result.lineEnds[1]);
+	EXPECT_EQ(52u, result.lineEnds[2]);
+	EXPECT_EQ(3u, result.nlUnix);
+	EXPECT_EQ(0u, result.nlDos);
+	EXPECT_EQ(0u, result.crCount);
+	EXPECT_EQ(text.size(), result.outLen);
+}
+
+TEST(SimdScanTest, NormalizesDosAndMacLines) {
+	const std::string text = "dos line\r\nmac line\rmac again\r\rend";
+	EolScanResult result;
+	ASSERT_TRUE(ScanUtf8Lines(text.data(), text.size(), result));
+
+	// Offsets are in the normalized ("\n" only) text
+	ASSERT_EQ(4u, result.lineEnds.size());
+	EXPECT_EQ(9u, result.lineEnds[0]);
+	EXPECT_EQ(18u, result.lineEnds[1]);
+	EXPECT_EQ(28u, result.lineEnds[2]);
+	EXPECT_EQ(29u, result.lineEnds[3]);
+	EXPECT_EQ(1u, result.nlDos);
+	EXPECT_EQ(3u, result.nlMac);
+	EXPECT_EQ(4u, result.crCount);
+	EXPECT_EQ(text.size() - 1, result.outLen);
+}
+
+TEST(SimdScanTest, ValidatesUtf8) {
+	const std::string valid = "\xC3\xA5\xE2\x82\xAC\xF0\x9F\x98\x80 padding to get past the first block\n";
+	EolScanResult result;
+	EXPECT_TRUE(ScanUtf8Lines(valid.data(), valid.size(), result));
+
+	const std::string stray = "padding to get past the first block \x80\n";
+	EolScanResult result2;
+	EXPECT_FALSE(ScanUtf8Lines(stray.data(), stray.size(), result2));
+
+	const std::string cut = "abc\xE2\x82\nabc";
+	EolScanResult result3;
+	EXPECT_FALSE(ScanUtf8Lines(cut.data(), cut.size(), result3));
+
+	const std::string nulls("padding to get past the first block\0", 36);
+	EolScanResult result4;
+	EXPECT_FALSE(ScanUtf8Lines(nulls.data(), nulls.size(), result4));
+}
+
+TEST(SimdScanTest, FindAndCount) {
+	std::string text(1000, 'x');
+	text[517] = '\r';
+	text[700] = '\n';
+	text[900] = '\n';
+
+	EXPECT_EQ(text.data() + 517, FindEol(text.data(), text.data() + text.size()));
+	EXPECT_EQ(text.data() + 700, FindEol(text.data() + 518, text.data() + text.size()));
+	EXPECT_EQ(2u, CountByte(text.data(), text.data() + text.size(), '\n'));
+	EXPECT_EQ(997u, CountByte(text.data(), text.data() + text.size(), 'x'));
+}
+
+TEST(SimdScanTest, ByteSetFindFirst) {
+	const std::string text = "    \t  some_identifier = 42; // comment that spans a few blocks \xc3\xa6\xc3\xb8 {}";
+
+	ByteSet digits;
+	for (char c = '0'; c <= '9'; ++c) digits.Add(c);
+	digits.Prepare();
+	EXPECT_EQ(text.find_first_of("0123456789"), (size_t)(digits.FindFirst(text.data(), text.data() + text.size()) - text.data()));
+
+	// Enough ranges to fall back to table lookups
+	ByteSet scattered;
+	const char* punct = "{}!#%&";
+	for (const char* c = punct; *c; ++c) scattered.Add(*c);
+	scattered.Add(0xc3);
+	scattered.Add('a'); scattered.Add('c'); scattered.Add('e');
+	scattered.Prepare();
+	EXPECT_EQ(text.find_first_of("{}!#%&\xc3" "ace"), (size_t)(scattered.FindFirst(text.data(), text.data() + text.size()) - text.data()));
+	EXPECT_EQ(text.find_first_of("{}!#%&\xc3" "ace", 20), (size_t)(scattered.FindFirst(text.data() + 20, text.data() + text.size()) - text.data()));
+
+	// High bytes and empty sets
+	ByteSet high;
+	high.Add(0xc3);
+	high.Prepare();
+	EXPECT_EQ(text.find('\xc3'), (size_t)(high.FindFirst(text.data(), text.data() + text.size()) - text.data()));
+
+	ByteSet empty;
+	empty.Prepare();
+	EXPECT_EQ(text.data() + text.size(), empty.FindFirst(text.data(), text.data() + text.size()));
+}
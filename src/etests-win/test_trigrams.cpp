@@ -0,0 +1,72 @@
+#include "stdafx.h"
+#include <limits.h>
+#include <string>
+#include <vector>
+#include "Trigrams.h"
+#include <gtest/gtest.h>
+
+TEST(TrigramsTest, FoldsAsciiCase) {
+	const unsigned char lower[] = "abc";
+	const unsigned char upper[] = "ABC";
+	EXPECT_EQ(TrigramKey(lower), TrigramKey(upper));
+
+	std::vector<unsigned int> keys;
+	GetLiteralTrigrams("Find", true, keys);
+	ASSERT_EQ(2u, keys.size());
+	EXPECT_EQ(TrigramKey((const unsigned char*)"fin"), keys[0]);
+	EXPECT_EQ(TrigramKey((const unsigned char*)"ind"), keys[1]);
+
+	// Caseless search can not trust non-ascii bytes
+	keys.clear();
+	GetLiteralTrigrams("ab\xC3\xA5", false, keys);
+	EXPECT_TRUE(keys.empty());
+}
+
+TEST(TrigramsTest, RequiredLiterals) {
+	std::vector<std::string> literals;
+	ASSERT_TRUE(GetRequiredLiterals("foo\\.bar(baz)?\\s+quux[0-9]", literals));
+	ASSERT_EQ(2u, literals.size());
+	EXPECT_EQ("foo.bar", literals[0]);
+	EXPECT_EQ("quux", literals[1]);
+
+	literals.clear();
+	ASSERT_TRUE(GetRequiredLiterals("colou?r=(value)+", literals));
+	ASSERT_EQ(2u, literals.size());
+	EXPECT_EQ("colo", literals[0]);
+	EXPECT_EQ("value", literals[1]);
+
+	literals.clear();
+	ASSERT_TRUE(GetRequiredLiterals("abcd*ef", literals));
+	ASSERT_EQ(1u, literals.size());
+	EXPECT_EQ("abc", literals[0]);
+
+	// Escapes with arguments are skipped whole
+	literals.clear();
+	ASSERT_TRUE(GetRequiredLiterals("abc\\0123def\\x{41}ghi\\o{101}jkl\\1mno", literals));
+	ASSERT_EQ(5u, literals.size());
+	EXPECT_EQ("abc", literals[0]);
+	EXPECT_EQ("def", literals[1]);
+	EXPECT_EQ("ghi", literals[2]);
+	EXPECT_EQ("jkl", literals[3]);
+	EXPECT_EQ("mno", literals[4]);
+
+	// Alternation can not be used for filtering
+	literals.clear();
+	EXPECT_FALSE(GetRequiredLiterals("first|second", literals));
+}
+
+TEST(TrigramsTest, Varints) {
+	std::vector<unsigned char> buf;
+	const unsigned int values[] = {0, 1, 127, 128, 300, 16384, 0xFFFFFFFF};
+	for (unsigned int i = 0; i < 7; ++i) AppendVarint(buf, values[i]);
+
+	const unsigned char* p = &buf[0];
+	const unsigned char* end = p + buf.size();
+	for (unsigned int i = 0; i < 7; ++i) {
+		unsigned int value;
+		p = ReadVarint(p, end, value);
+		ASSERT_TRUE(p != NULL);
+		EXPECT_EQ(values[i], value);
+	}
+	EXPECT_TRUE(p == end);
+}
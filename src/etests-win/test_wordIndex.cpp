@@ -0,0 +1,173 @@
+#include "stdafx.h"
+#include <vector>
+#include <string>
+#include <map>
+#include <cstdlib>
+#include <algorithm>
+#include "WordIndex.h"
+#include <gtest/gtest.h>
+
+namespace {
+
+// Reference implementation scanning the (ascii) text
+struct RefWord {
+	unsigned int pos;
+	std::string word;
+};
+
+void GetWords(const std::string& text, std::vector<RefWord>& words) {
+	unsigned int i = 0;
+	while (i < text.size()) {
+		if (!WordIndex::IsWordByte(text[i])) {
+			++i;
+			continue;
+		}
+
+		const unsigned int start = i;
+		while (i < text.size() && WordIndex::IsWordByte(text[i])) ++i;
+
+		RefWord w = {start, text.substr(start, i - start)};
+		words.push_back(w);
+
+		// Also with the lead char
+		if (start > 0) {
+			const char c = text[start-1];
+			if (c > ' ' && c < 0x7F && (start == 1 || !WordIndex::IsWordByte(text[start-2]))) {
+				RefWord lw = {start, c + w.word};
+				words.push_back(lw);
+			}
+		}
+	}
+}
+
+void GetCompletions(const std::string& text, const std::string& prefix, unsigned int pos, std::vector<std::string>& result) {
+	std::vector<RefWord> words;
+	GetWords(text, words);
+	const bool isLead = !prefix.empty() && !WordIndex::IsWordByte(prefix[0]);
+
+	// Nearest occurrence of each word (ties go to the one after pos)
+	std::map<std::string, unsigned int> nearest;
+	for (std::vector<RefWord>::const_iterator p = words.begin(); p != words.end(); ++p) {
+		if (p->word.size() <= prefix.size() || p->word.compare(0, prefix.size(), prefix) != 0) continue;
+		if (WordIndex::IsWordByte(p->word[0]) == isLead) continue;
+
+		const unsigned int key = (p->pos >= pos) ? (p->pos - pos) * 2 : (pos - p->pos) * 2 + 1;
+		std::map<std::string, unsigned int>::iterator n = nearest.find(p->word);
+		if (n == nearest.end() || key < n->second) nearest[p->word] = key;
+	}
+
+	std::map<unsigned int, std::string> sorted;
+	for (std::map<std::string, unsigned int>::const_iterator p = nearest.begin(); p != nearest.end(); ++p) {
+		sorted[p->second] = isLead ? p->first.substr(1) : p->first;
+	}
+	for (std::map<unsigned int, std::string>::const_iterator p = sorted.begin(); p != sorted.end(); ++p) {
+		result.push_back(p->second);
+	}
+}
+
+// Rescans the changed text like Scan(doc, ...) does
+void Rescan(WordIndex& index, const std::string& text, unsigned int start, unsigned int end) {
+	while (start > 0 && WordIndex::IsWordByte(text[start-1])) --start;
+	while (end < text.size() && WordIndex::IsWordByte(text[end])) ++end;
+	if (end < text.size()) ++end;
+	while (end < text.size() && WordIndex::IsWordByte(text[end])) ++end;
+
+	char lead = 0;
+	if (start > 0) {
+		const char c = text[start-1];
+		if (c > ' ' && c < 0x7F && (start == 1 || !WordIndex::IsWordByte(text[start-2]))) lead = c;
+	}
+	index.Scan(start, text.data() + start, end - start, lead);
+}
+
+void Verify(const WordIndex& index, const std::string& text, unsigned int pos, const std::string& prefix) {
+	std::vector<std::string> expected;
+	std::vector<std::string> completions;
+	GetCompletions(text, prefix, pos, expected);
+	index.GetCompletions(prefix, pos, completions);
+	EXPECT_EQ(expected, completions) << "prefix '" << prefix << "' at " << pos;
+}
+
+}
+
+TEST(WordIndex, Basic) {
+	const std::string text = "foo $foobar foo.bar fox a.fob";
+	WordIndex index;
+	index.Clear(text.size());
+	index.Scan(0, text.data(), text.size());
+
+	std::vector<std::string> words;
+	index.GetCompletions("fo", 24, words);
+	ASSERT_EQ(4u, words.size());
+	EXPECT_EQ("fob", words[0]);
+	EXPECT_EQ("fox", words[1]);
+	EXPECT_EQ("foo", words[2]);
+	EXPECT_EQ("foobar", words[3]);
+
+	// Words after a non-word char (not following a word)
+	words.clear();
+	index.GetCompletions("$", 0, words);
+	ASSERT_EQ(1u, words.size());
+	EXPECT_EQ("foobar", words[0]);
+	words.clear();
+	index.GetCompletions(".", 0, words);
+	EXPECT_TRUE(words.empty());
+
+	words.clear();
+	index.GetWords("fo", words);
+	ASSERT_EQ(4u, words.size());
+	EXPECT_EQ("fob", words[0]);
+	EXPECT_EQ("foo", words[1]);
+	EXPECT_EQ("foobar", words[2]);
+	EXPECT_EQ("fox", words[3]);
+}
+
+TEST(WordIndex, Utf8) {
+	const std::string text = "caf\xC3\xA9s caf\xE2\x82\xAC" "x";
+	WordIndex index;
+	index.Clear(text.size());
+	index.Scan(0, text.data(), text.size());
+
+	// The euro sign is not a word char
+	std::vector<std::string> words;
+	index.GetWords("ca", words);
+	ASSERT_EQ(2u, words.size());
+	EXPECT_EQ("caf", words[0]);
+	EXPECT_EQ("caf\xC3\xA9s", words[1]);
+}
+
+TEST(WordIndex, RandomEdits) {
+	const char chars[] = "abcab_$.  \n";
+	const char* prefixes[] = {"a", "ab", "b", "c_", "$", ".", "$a"};
+	srand(7);
+
+	std::string text;
+	WordIndex index;
+
+	for (unsigned int n = 0; n < 3000; ++n) {
+		if (text.empty() || (text.size() < 20000 && rand() % 2)) {
+			const unsigned int pos = rand() % (text.size() + 1);
+			const unsigned int len = 1 + rand() % ((rand() % 10) ? 8 : 2000);
+			std::string insert;
+			for (unsigned int i = 0; i < len; ++i) insert += chars[rand() % 11];
+
+			text.insert(pos, insert);
+			index.Insert(pos, len);
+			Rescan(index, text, pos, pos + len);
+		}
+		else {
+			const unsigned int start = rand() % text.size();
+			const unsigned int end = start + rand() % std::min<size_t>(text.size() - start, (rand() % 10) ? 8 : 1000);
+
+			text.erase(start, end - start);
+			index.Delete(start, end);
+			Rescan(index, text, start, start);
+		}
+
+		if (n % 50 == 0) {
+			EXPECT_EQ(text.size(), index.GetLength());
+			Verify(index, text, rand() % (text.size() + 1), prefixes[rand() % 7]);
+			if (HasFailure()) return;
+		}
+	}
+}
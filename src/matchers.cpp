@@ -26,6 +26,9 @@ wxRegEx matcher::s_tabspattern(wxT("^\\t+"));
 wxRegEx matcher::s_repfromzero(wxT("{,([[:digit:]]+)}"));
 wxRegEx matcher::s_backref(wxT("\\\\([[:digit:]]+)"));
 wxRegEx span_matcher::s_refToCapture(wxT("\\\\([[:digit:]]+)"));
+unsigned int match_matcher::s_patternVersion = 0;
+wxArrayString match_matcher::s_errors;
+wxCriticalSection matcher::s_lock;
 
 void matcher::OptimizeRegex(wxString& pattern) {
 	if (!s_alternatives.Matches(pattern)) return;
@@ -182,26 +185,78 @@ bool match_matcher::RegExCompile(const wxString& pattern, bool matchcase) {
 
 	if (m_compiledPattern) {
 		m_patternStudy = pcre_study(m_compiledPattern, 0, &error);
+		SetStartBits();
 		return true;
 	}
 
-	wxLogDebug(wxT("RegEx error: %s"), wxString(error, wxConvUTF8).c_str());
-	wxLogDebug(wxT("Invalid pattern: %s"), pattern.c_str());
-	wxString loc = pattern;
-	loc.Remove(0, erroffset);
-	wxLogDebug(wxT("Location: %s"), loc.c_str());
+	if (wxThread::IsMain()) {
+		wxLogDebug(wxT("RegEx error: %s"), wxString(error, wxConvUTF8).c_str());
+		wxLogDebug(wxT("Invalid pattern: %s"), pattern.c_str());
+		wxString loc = pattern;
+		loc.Remove(0, erroffset);
+		wxLogDebug(wxT("Location: %s"), loc.c_str());
+	}
 
 	// Notify user of error
-	wxString msg = m_name + _(" contains invalid regex pattern!\n");
+	// (deferred, as we may be in a background parser or holding the lock)
+	// wxString is not threadsafe, so we have to force copy of name
+	wxString msg = m_name.c_str();
+	msg += _(" contains invalid regex pattern!\n");
 	msg += wxT("Error: ") + wxString(error, wxConvUTF8) + wxT("\n\n");
 	//msg += pattern;
-	wxMessageBox(msg, _("Syntax error"), wxICON_ERROR|wxOK);
+	s_errors.Add(msg);
 	return false;
 }
 
+void match_matcher::ShowErrors() {
+	wxASSERT(wxThread::IsMain());
+
+	wxArrayString errors;
+	{
+		wxCriticalSectionLocker lock(s_lock);
+		if (s_errors.IsEmpty()) return;
+		for (size_t i = 0; i < s_errors.GetCount(); ++i) errors.Add(s_errors[i].c_str());
+		s_errors.Clear();
+	}
+
+	for (size_t i = 0; i < errors.GetCount(); ++i) {
+		wxMessageBox(errors[i], _("Syntax error"), wxICON_ERROR|wxOK);
+	}
+}
+
+
+void match_matcher::SetStartBits() {
+	wxASSERT(m_compiledPattern);
+
+	// Same start hints pcre_exec uses for unanchored searches
+	int firstbyte;
+	if (pcre_fullinfo(m_compiledPattern, m_patternStudy, PCRE_INFO_FIRSTBYTE, &firstbyte) == 0 && firstbyte >= 0) {
+		static const int caseless_flag = 0x0100; // REQ_CASELESS in pcre_internal.h
+		const unsigned char c = (unsigned char)(firstbyte & 0xFF);
+
+		memset(m_startBits, 0, sizeof(m_startBits));
+		m_startBits[c >> 3] |= 1 << (c & 7);
+		if ((firstbyte & caseless_flag) && c < 128 && isalpha(c)) {
+			const unsigned char other = (unsigned char)(islower(c) ? toupper(c) : tolower(c));
+			m_startBits[other >> 3] |= 1 << (other & 7);
+		}
+		return;
+	}
+
+	const unsigned char* table = NULL;
+	if (pcre_fullinfo(m_compiledPattern, m_patternStudy, PCRE_INFO_FIRSTTABLE, &table) == 0 && table) {
+		memcpy(m_startBits, table, sizeof(m_startBits));
+	}
+}
+
 
 // -------------------------------------------------------------------------------------
 
+match_matcher::match_matcher()
+: matcher(), m_hasCaptures(false), m_compiledPattern(NULL), m_patternStudy(NULL), m_patternVersion(++s_patternVersion) {
+	memset(m_startBits, 0xFF, sizeof(m_startBits));
+}
+
 match_matcher::~match_matcher() {
 	if (m_compiledPattern) free(m_compiledPattern);
 	if (m_patternStudy) free(m_patternStudy);
@@ -217,6 +272,8 @@ void match_matcher::SetPattern(const wxString& pattern) {
 	if (m_patternStudy) free(m_patternStudy);
 	m_compiledPattern = NULL;
 	m_patternStudy = NULL;
+	memset(m_startBits, 0xFF, sizeof(m_startBits));
+	m_patternVersion = ++s_patternVersion;
 
 	m_pattern = pattern;
 	RegExConvert(m_pattern);
@@ -255,11 +312,12 @@ void match_matcher::AddCapture(unsigned int capkey, const wxString& name) {
 
 	if (capkey == 0) {
 		// If the capture cover the entire pattern we have to replace the name
-		m_name = name;
+		SetName(name);
 	}
 	else {
 		m_hasCaptures = true;
 		m_captures[capkey] = name;
+		m_captureScopes[capkey] = ScopeAtoms::Get().GetScopeId(name);
 	}
 }
 
@@ -269,6 +327,12 @@ const wxString& match_matcher::GetCaptureName(unsigned int capkey) const {
 	else return s_emptyString;
 }
 
+unsigned int match_matcher::GetCaptureScopeId(unsigned int capkey) const {
+	std::map<unsigned int,unsigned int>::const_iterator p = m_captureScopes.find(capkey);
+	if (p != m_captureScopes.end()) return p->second;
+	else return 0;
+}
+
 int match_matcher::Match(char* line, unsigned int start, unsigned int len, unsigned int& callout_id, int *ovector, int ovecsize, int WXUNUSED(zeromatch)) {
 	wxASSERT(start < len);
 
@@ -514,24 +578,76 @@ unsigned int group_matcher::GetSubId(unsigned int id) {
 	return cf.matchptr->SubGetId(cf.callout_id);
 }
 
+bool group_matcher::IsDispatchValid() {
+	if (m_dispatchVersion == match_matcher::GetLastPatternVersion()) return true;
+	if (m_refVersions.size() != m_refs.size()) return false;
+
+	// Some pattern was set, check if it was one of ours
+	for (unsigned int i = 0; i < m_refs.size(); ++i) {
+		if (m_refs[i].realMatchptr->GetPatternVersion() != m_refVersions[i]) return false;
+	}
+
+	m_dispatchVersion = match_matcher::GetLastPatternVersion();
+	return true;
+}
+
+void group_matcher::BuildDispatch() {
+	const unsigned int ref_count = m_refs.size();
+	m_refVersions.resize(ref_count);
+	m_dispatchRefs.clear();
+	m_dispatchStart.resize(257);
+	m_startBytes.Clear();
+
+	// Compile all patterns to get their start bytes
+	for (unsigned int i = 0; i < ref_count; ++i) {
+		match_matcher& m = *m_refs[i].realMatchptr;
+		m.GetMatchPattern();
+		m_refVersions[i] = m.GetPatternVersion();
+	}
+
+	for (unsigned int c = 0; c < 256; ++c) {
+		m_dispatchStart[c] = m_dispatchRefs.size();
+
+		// Matches only start at valid utf8 chars
+		if ((c & 0xC0) == 0x80) continue;
+
+		for (unsigned int i = 0; i < ref_count; ++i) {
+			if (m_refs[i].realMatchptr->CanStartWith((unsigned char)c)) m_dispatchRefs.push_back(i);
+		}
+		if (m_dispatchRefs.size() > m_dispatchStart[c]) m_startBytes.Add((unsigned char)c);
+	}
+	m_dispatchStart[256] = m_dispatchRefs.size();
+
+	m_startBytes.Prepare();
+	m_dispatchVersion = match_matcher::GetLastPatternVersion();
+}
+
 int group_matcher::Match(char* line, unsigned int start, unsigned int len, unsigned int& callout_id, int *ovector, int ovecsize, int zeromatch) {
 	wxASSERT(m_isInitialized);
 	wxASSERT(start < len);
 
 	static const int search_options = PCRE_ANCHORED|PCRE_NO_UTF8_CHECK;
-	const size_t ref_count = m_refs.size();
+	if (!IsDispatchValid()) BuildDispatch();
+
+	const char* const line_end = line + len;
 
 	for (unsigned int pos = start; pos < len; ++pos) {
-		// Only start at valid utf8 chars
-		if ((line[pos] & 0xC0) == 0x80) continue;
+		// Skip to next position where any of the patterns can start
+		// (continuation bytes are not in the set)
+		pos = m_startBytes.FindFirst(line + pos, line_end) - line;
+		if (pos == len) break;
 
-		for (unsigned int i = 0; i < ref_count; ++i) {
+		const unsigned char c = line[pos];
+		const unsigned int dispatch_end = m_dispatchStart[c+1];
+
+		for (unsigned int d = m_dispatchStart[c]; d < dispatch_end; ++d) {
+			const unsigned int i = m_dispatchRefs[d];
 			match_matcher& m = *m_refs[i].realMatchptr;
 			//wxLogDebug(wxT("%d: %s (%x)"), i, m_refs[i].matchptr->GetName().c_str(), m_refs[i].matchptr);
 			//wxLogDebug(wxT("    (%x) %s"), m_refs[i].realMatchptr, m_refs[i].realMatchptr->GetPattern().c_str());
 
-			// Get search pattern from matcher
-			const pcre* re = m.GetMatchPattern();
+			// Get search pattern from matcher (compiled by BuildDispatch)
+			const pcre* re = m.GetCompiledPattern();
 			if (!re) return PCRE_ERROR_NULL;
 			const pcre_extra* study = m.GetPatternStudy();
 			
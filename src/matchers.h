@@ -5,9 +5,12 @@
 #ifndef WX_PRECOMP
 	#include <wx/wx.h>
 #endif
+#include <wx/thread.h>
 
 #include <vector>
 #include <map>
+#include "SimdScan.h"
+#include "ScopeAtoms.h"
 
 // pre-declarations
 class wxRegEx;
@@ -22,11 +25,12 @@ class match_matcher;
 class matcher {
 public:
 	matcher()
-	: m_isEnabled(true), m_isInitialized(false) {};
+	: m_isEnabled(true), m_isInitialized(false), m_scopeId(0) {};
 	virtual ~matcher() {};
 
-	void SetName(const wxString& name) {m_name =  name;};
+	void SetName(const wxString& name) {m_name =  name; m_scopeId = ScopeAtoms::Get().GetScopeId(name);};
 	const wxString& GetName() const {return m_name;};
+	unsigned int GetScopeId() const {return m_scopeId;};
 	virtual bool Init(bool deep=false) = 0;
 	
 	bool IsInitialized() const {return m_isInitialized;};
@@ -35,6 +39,8 @@ public:
 
 	virtual const wxString& GetCaptureName(unsigned int WXUNUSED(capkey)) const {wxASSERT(false); return s_emptyString;};
 	virtual const wxString& GetContentName() const {return s_emptyString;};
+	virtual unsigned int GetCaptureScopeId(unsigned int WXUNUSED(capkey)) const {wxASSERT(false); return 0;};
+	virtual unsigned int GetContentScopeId() const {return 0;};
 
 	virtual matcher& GetCallout(unsigned int callout_id) = 0;
 
@@ -65,6 +71,11 @@ public:
 	// Regex support functions
 	static void RegExConvert(wxString& pattern);
 
+	// Matchers are shared by all documents and used by the background
+	// syntax parsers, so they (and RegExConvert) may only be used while
+	// holding this lock.
+	static wxCriticalSection& GetLock() {return s_lock;};
+
 protected:
 #ifdef __WXDEBUG__
 	static bool RegExVerify(const wxString& pattern, bool matchcase=true);
@@ -80,6 +91,7 @@ protected:
 	bool m_isEnabled;
 	wxString m_name;
 	bool m_isInitialized;
+	unsigned int m_scopeId; // interned name
 	static const wxString s_emptyString;
 
 	// static regexes
@@ -87,12 +99,14 @@ protected:
 	static wxRegEx s_tabspattern;
 	static wxRegEx s_repfromzero;
 	static wxRegEx s_backref;
+
+	static wxCriticalSection s_lock;
 };
 
 class group_matcher : public matcher {
 public:
 	group_matcher()
-	: matcher(), m_initializing(false) {};
+	: matcher(), m_initializing(false), m_dispatchVersion(0) {};
 	~group_matcher() {};
 	void AddMember(matcher* m);
 
@@ -121,11 +135,23 @@ protected:
 	std::vector<calloutref> m_refs;
 
 	bool m_initializing;
+
+private:
+	bool IsDispatchValid();
+	void BuildDispatch();
+
+	// First byte dispatch: the refs that can start with each byte (in
+	// ref order), so each position is only tried against those.
+	std::vector<unsigned int> m_dispatchRefs;
+	std::vector<unsigned int> m_dispatchStart; // 257 offsets into m_dispatchRefs
+	std::vector<unsigned int> m_refVersions;   // pattern versions when built
+	unsigned int m_dispatchVersion;
+	ByteSet m_startBytes;
 };
 
 class match_matcher : public matcher {
 public:
-	match_matcher() : matcher(), m_hasCaptures(false), m_compiledPattern(NULL), m_patternStudy(NULL) {};
+	match_matcher();
 	~match_matcher();
 	bool Init(bool) {return true;};
 
@@ -134,8 +160,20 @@ public:
 	const wxString& GetPattern() {return m_pattern;};
 
 	pcre* GetMatchPattern();
+	pcre* GetCompiledPattern() {return m_compiledPattern;};
 	pcre_extra* GetPatternStudy() {return m_patternStudy;};
 
+	// Bytes a match can start with (any byte until compiled)
+	bool CanStartWith(unsigned char c) const {return (m_startBits[c >> 3] & (1 << (c & 7))) != 0;};
+
+	// Shows the pattern errors found while compiling
+	// (must be called from main thread without holding the lock)
+	static void ShowErrors();
+
+	// Changes each time a pattern is set on any matcher
+	unsigned int GetPatternVersion() const {return m_patternVersion;};
+	static unsigned int GetLastPatternVersion() {return s_patternVersion;};
+
 	// Matching
 	int Match(char* line, unsigned int start, unsigned int len, unsigned int& callout_id, int *ovector, int ovecsize, int zeromatch);
 
@@ -143,6 +181,7 @@ public:
 	bool HasCaptures() const {return m_hasCaptures;};
 	void AddCapture(unsigned int capkey, const wxString& name);
 	const wxString& GetCaptureName(unsigned int capkey) const;
+	unsigned int GetCaptureScopeId(unsigned int capkey) const;
 
 	// Generic class functions
 	matcher& GetCallout(unsigned int callout_id);
@@ -155,6 +194,7 @@ public:
 
 private:
 	bool RegExCompile(const wxString& pattern, bool matchcase=true);
+	void SetStartBits();
 
 	// Member variables
 	wxString m_pattern;
@@ -162,13 +202,19 @@ private:
 	bool m_hasCaptures;
 	pcre* m_compiledPattern;
 	pcre_extra* m_patternStudy;
+	unsigned char m_startBits[32];
+	unsigned int m_patternVersion;
 	std::map<unsigned int,wxString> m_captures;
+	std::map<unsigned int,unsigned int> m_captureScopes;
+
+	static unsigned int s_patternVersion;
+	static wxArrayString s_errors;
 };
 
 class span_matcher : public group_matcher {
 public:
 	span_matcher()
-	: group_matcher(), m_startMatcher(NULL), m_endMatcher(NULL), m_hasEndCaptures(false) {};
+	: group_matcher(), m_startMatcher(NULL), m_endMatcher(NULL), m_hasEndCaptures(false), m_contentScopeId(0) {};
 	~span_matcher() {};
 
 	bool Init(bool deep=false);
@@ -179,8 +225,9 @@ public:
 	void SetEndPattern(const wxString& pattern) {m_endPattern = pattern;};
 	bool HasEndCaptures() const {return m_hasEndCaptures;};
 
-	void SetContentName(const wxString& name) {m_contentName = name;};
+	void SetContentName(const wxString& name) {m_contentName = name; m_contentScopeId = ScopeAtoms::Get().GetScopeId(name);};
 	const wxString& GetContentName() const {return m_contentName;};
+	unsigned int GetContentScopeId() const {return m_contentScopeId;};
 
 	bool IsSpan() const {return true;};
 	bool IsSpanEnd(unsigned int callout_id);
@@ -202,6 +249,7 @@ private:
 	wxString m_groupPattern;
 	bool m_hasEndCaptures;
 	wxString m_contentName;
+	unsigned int m_contentScopeId;
 
 	static wxRegEx s_refToCapture;
 };
@@ -28,8 +28,8 @@ inline bool isAlphaNumeric(wxChar c) {
 
 /**
  * This features highlights matching html tags in a document.
- * To do this efficiently, it maintains a list of all the brackets (< and >) in a document.
- * When text is inserted or deleted, only the changed brackets must be added/removed to the list,
+ * To do this efficiently, it maintains an index of all the brackets (< and >) in a document.
+ * When text is inserted or deleted, only the changed brackets must be added/removed to the index,
  * thus avooiding a costly full document scan.
  * Each time the document is changed, this list of brackets is scanned to find pairs that form a valid tag.
  * When the cursor moves in any way, only the list of tags needs to be scanned to find 
@@ -38,7 +38,8 @@ inline bool isAlphaNumeric(wxChar c) {
 Styler_HtmlHL::Styler_HtmlHL(const DocumentWrapper& rev, const Lines& lines, const tmTheme& theme, eSettings& settings, EditorCtrl& editorCtrl)
 : m_doc(rev), m_lines(lines), m_theme(theme), m_settings(settings), m_editorCtrl(editorCtrl),
   m_selectionHighlightColor(m_theme.selectionColor),
-  m_searchHighlightColor(m_theme.searchHighlightColor)
+  m_searchHighlightColor(m_theme.searchHighlightColor),
+  m_brackets('<', '>', false)
 {
 	needReparse = true;
 	needReparseTags = true;
@@ -138,63 +139,11 @@ void Styler_HtmlHL::SelectParentTag() {
 }
 
 void Styler_HtmlHL::FindAllBrackets(const Document& doc) {
-	m_brackets.clear();
-	FindBrackets(0, doc.GetLength(), doc);
+	m_brackets.Build(doc);
 }
 
 bool Styler_HtmlHL::FindBrackets(unsigned int start, unsigned int end, const Document& doc) {
-	vector<unsigned int> buffer;
-	bool foundBracket = false;
-	
-	//If there are no brackets in the inserted text, then we dont need to do anything
-	wxChar chr;
-	for(unsigned int c = start; c < end; c++) {
-		chr = doc.GetChar(c);
-		if(chr == '<' || chr == '>') {
-			foundBracket = true;
-			break;
-		}
-	}
-	if(!foundBracket) return false;
-
-	//copy the existing brackets to a temporary array so we can add them in order, in linear time
-	unsigned int index = 0;
-	for(index = 0; index < m_brackets.size(); index++) {
-		buffer.push_back(m_brackets[index]);
-	}
-	index = 0;
-	m_brackets.clear();
-	
-	for(unsigned int c = start; c < end; c++) {
-		switch(doc.GetChar(c)) {
-			case '<':
-			case '>':
-				//now we have the index of a bracket inside the search range
-			
-				//add any items in buffer that are before this bracket
-				for(; index < buffer.size(); index++) {
-					if(buffer[index] < c) {
-						m_brackets.push_back(buffer[index]);
-					} else {
-						index--;
-						break;
-					}
-				}
-			
-				//now add this bracket
-				m_brackets.push_back(c);
-				foundBracket = true;
-				
-			break;
-		}
-	}
-
-	//add any existing brackets that occur after the last bracket from the new text
-	for(; index < buffer.size(); index++) {
-		m_brackets.push_back(buffer[index]);
-	}
-	
-	return true;
+	return m_brackets.Scan(doc, start, end) != 0;
 }
 
 bool Styler_HtmlHL::IsValidTag(unsigned int start, unsigned int end, const Document& doc) {
@@ -230,10 +179,12 @@ bool Styler_HtmlHL::IsCloseComment(const Document& doc, unsigned int bracket) {
 void Styler_HtmlHL::FindTags(const Document& doc) {
 	m_tags.clear();
 	bool haveOpenBracket = false, inComment = false;;
-	int openBracketIndex = -1, closeBracketIndex = -1, size = (int)m_brackets.size(), index;
+	vector<unsigned int> brackets;
+	m_brackets.GetPositions(brackets);
+	int openBracketIndex = -1, closeBracketIndex = -1, size = (int)brackets.size(), index;
 	
 	for(int c = 0; c < size; c++) {
-		index = m_brackets[c];
+		index = brackets[c];
 		if(inComment) {
 			if(doc.GetChar(index) == '>' && IsCloseComment(doc, index)) {
 				inComment = false;
@@ -404,14 +355,9 @@ void Styler_HtmlHL::Insert(unsigned int start, unsigned int length) {
 	if(needReparse) return;
 
 	unsigned int end = start+length;
-	int count = m_brackets.size();
 
 	//update all the brackets to point to their new locations
-	for(int c = 0; c < count; c++) {
-		if(m_brackets[c] >= start) {
-			m_brackets[c] += length;
-		}
-	}
+	m_brackets.Insert(start, length);
 	
 	bool foundBrackets = false;
 	//do a search for any new brackets inside of the inserted text
@@ -420,7 +366,8 @@ void Styler_HtmlHL::Insert(unsigned int start, unsigned int length) {
 	cxENDLOCK
 	
 	if(foundBrackets) {
-		needReparse = true;
+		//the bracket index is up to date, so only the tags have to be found again
+		needReparseTags = true;
 	} else {
 		if(!needReparseTags) {
 			int size = (int) m_tags.size();
@@ -445,24 +392,11 @@ void Styler_HtmlHL::Delete(unsigned int start, unsigned int end) {
 
 	if(needReparse) return;
 
-	int count = m_brackets.size();
 	int length = end - start;
 
 	//update all the brackets to point to their new locations
 	//remove any brackets that were inside the deleted text
-	bool erasedBracket = false;
-	for(int c = 0; c < count; c++) {
-		if(m_brackets[c] >= start) {
-			if(m_brackets[c] < end) {
-				m_brackets.erase(m_brackets.begin()+c);
-				erasedBracket = true;
-				count--;
-				c--;
-			} else {
-				m_brackets[c] -= length;
-			}
-		}
-	}
+	const bool erasedBracket = m_brackets.Delete(start, end) != 0;
 	
 	if(!erasedBracket && !needReparseTags) {
 		int size = (int) m_tags.size();
@@ -477,7 +411,7 @@ void Styler_HtmlHL::Delete(unsigned int start, unsigned int end) {
 			}
 		}
 	} else {
-		needReparse = true;
+		needReparseTags = true;
 	}
 }
 
@@ -23,6 +23,7 @@
 #include "Catalyst.h"
 #include "styler.h"
 #include "eSettings.h"
+#include "BracketIndex.h"
 
 #include <vector>
 
@@ -81,7 +82,7 @@ private:
 	unsigned int m_cursorPosition;
 	bool needReparse, needReparseTags;
 	int m_currentTag, m_matchingTag;
-	std::vector<unsigned int> m_brackets;
+	BracketIndex m_brackets;
 	std::vector<TagInterval> m_tags;
 
 	// Theme variables
@@ -19,6 +19,7 @@
 #include "FindFlags.h"
 
 const unsigned int Styler_SearchHL::EXTSIZE = 1000;
+const unsigned int Styler_SearchHL::CHUNKSIZE = 256 * 1024;
 
 Styler_SearchHL::Styler_SearchHL(const DocumentWrapper& rev, const Lines& lines, const vector<interval>& ranges, const std::vector<unsigned int>& cursors, const tmTheme& theme)
 : m_doc(rev), m_lines(lines), m_searchRanges(ranges), m_cursors(cursors),
@@ -31,13 +32,13 @@ Styler_SearchHL::Styler_SearchHL(const DocumentWrapper& rev, const Lines& lines,
 void Styler_SearchHL::Clear() {
 	m_text.Clear();
 	m_options = 0;
-	m_matches.clear();
+	m_matches.Clear();
 	m_search_start = 0;
 	m_search_end = 0;
 }
 
 void Styler_SearchHL::Invalidate() {
-	m_matches.clear();
+	m_matches.Clear();
 	m_search_start = 0;
 	m_search_end = 0;
 }
@@ -90,39 +91,28 @@ void Styler_SearchHL::Style(StyleRun& sr) {
 	if (sr_start < m_search_start || m_search_end < sr_end) {
 		// Check if there is overlap so we can just extend the search area
 		if (sr_end > m_search_start && sr_start < m_search_end) {
-			sr_start = wxMin(sr_start, m_search_start);
-			sr_end = wxMax(sr_end, m_search_end);
+			if (sr_start < m_search_start) ExtendUp(sr_start);
+			if (sr_end > m_search_end) ExtendDown(sr_end);
 		}
 		else {
 			// Else we have to move it
-			m_matches.clear();
-			m_search_start = 0;
-			m_search_end = 0;
-		}
-
-		// Do the search
-		if (sr_start < m_search_start) {
-			// Search from top
-			DoSearch(sr_start, sr_end);
-		}
-		else if (sr_end > m_search_end) {
-			// Search from bottom
+			m_matches.Clear();
 			DoSearch(sr_start, sr_end, true);
+			m_search_start = sr_start;
+			m_search_end = sr_end;
 		}
-		else wxASSERT(false);
-
-		m_search_start = sr_start;
-		m_search_end = sr_end;
 	}
 
 	// Style the run with matches
-	for (vector<interval>::iterator p = m_matches.begin(); p != m_matches.end(); ++p) {
-		if (p->start > rend) break;
+	const unsigned int count = m_matches.GetCount();
+	for (unsigned int i = m_matches.FindEnding(rstart); i < count; ++i) {
+		const interval m = m_matches.Get(i);
+		if (m.start > rend) break;
 
 		// Check for overlap (or zero-length sel at start-of-line)
-		if ((p->end > rstart && p->start < rend) || (p->start == p->end && p->end == rstart)) {
-			unsigned int start = wxMax(rstart, p->start);
-			unsigned int end   = wxMin(rend, p->end);
+		if ((m.end > rstart && m.start < rend) || (m.start == m.end && m.end == rstart)) {
+			unsigned int start = wxMax(rstart, m.start);
+			unsigned int end   = wxMin(rend, m.end);
 
 			// Only draw it if it is in range
 			if (!m_searchRanges.empty()) {
@@ -152,21 +142,20 @@ void Styler_SearchHL::DoSearch(unsigned int start, unsigned int end, bool from_l
 
 	bool matchcase = m_options & FIND_MATCHCASE;
 
-	vector<interval>::iterator next_match = m_matches.begin();
+	unsigned int next_match = 0;
 	if (from_last) {
 		// Start search from last match
-		if (!m_matches.empty())	start = m_matches.back().end;
+		if (!m_matches.IsEmpty()) start = wxMax(start, m_matches.Get(m_matches.GetCount()-1).end);
+		if (start >= end) return;
 	}
 	else {
-		// Find the match before start pos (if there is any)
-		for (; next_match != m_matches.end(); ++next_match) {
-			if (next_match->end > start) break;
-		}
+		// Find the first match after start pos (if there is any)
+		next_match = m_matches.FindEnding(start+1);
 	}
 
 	//wxLogDebug("  DoSearch %u %u %d", start, end, from_last);
 
-	// Search from start until we hit a previous match (or end)
+	// Search from start until we are back in step with the previous matches (or end)
 	search_result result = {-1, 0, start};
 	while(result.end < end) {
 		bool skip = false;
@@ -182,16 +171,26 @@ void Styler_SearchHL::DoSearch(unsigned int start, unsigned int end, bool from_l
 		if(!skip) {
 			// Add new match to list
 			const interval iv(result.start, result.end);
-			if (from_last) m_matches.push_back(iv);
+			if (from_last) m_matches.Append(iv);
 			else {
-				// Check if we have hit a previous match
-				while (next_match != m_matches.end() && result.end > next_match->start) {
-					// if not equivalent, replace and continue
-					if (next_match->start == result.start && next_match->end == result.end)	break;
-					next_match = m_matches.erase(next_match);
+				// Remove previous matches overlapping the new one
+				unsigned int last = next_match;
+				bool inStep = false;
+				while (last < m_matches.GetCount()) {
+					const interval m = m_matches.Get(last);
+					if (m == iv) {
+						inStep = true;
+						break;
+					}
+					if (result.end <= m.start) break;
+					++last;
 				}
-	
-				next_match = m_matches.insert(next_match, iv);
+				m_matches.Erase(next_match, last);
+
+				// The rest will be found just as before
+				if (inStep) return;
+
+				m_matches.Insert(next_match, iv);
 				++next_match;
 			}
 		}
@@ -199,6 +198,65 @@ void Styler_SearchHL::DoSearch(unsigned int start, unsigned int end, bool from_l
 		// Avoid never ending loop if zero-length match
 		if (result.start == result.end) ++result.end;
 	}
+
+	if (!from_last) {
+		// Previous matches that were not found again are no longer valid
+		unsigned int last = next_match;
+		while (last < m_matches.GetCount() && m_matches.Get(last).end < end) ++last;
+		m_matches.Erase(next_match, last);
+	}
+}
+
+void Styler_SearchHL::ExtendUp(unsigned int start) {
+	wxASSERT(start < m_search_start);
+
+	// Search until we hit the first previous match (or
+	// far enough in that no new match can cross the old start)
+	unsigned int end = m_search_start + EXTSIZE;
+	if (!m_matches.IsEmpty()) end = wxMin(end, m_matches.Get(0).end);
+	end = wxMin(end, m_search_end);
+
+	cxLOCKDOC_READ(m_doc)
+		if (end < doc.GetLength()) end = doc.GetValidCharPos(end);
+	cxENDLOCK
+
+	if (start < end) DoSearch(start, end);
+	m_search_start = start;
+}
+
+void Styler_SearchHL::ExtendDown(unsigned int end) {
+	wxASSERT(end > m_search_end);
+
+	// Matches may cross the old end, so we start a bit before it
+	unsigned int start = m_search_end > EXTSIZE ? m_search_end - EXTSIZE : 0;
+	start = wxMax(start, m_search_start);
+
+	cxLOCKDOC_READ(m_doc)
+		start = doc.GetValidCharPos(start);
+	cxENDLOCK
+
+	DoSearch(start, end, true);
+	m_search_end = end;
+}
+
+void Styler_SearchHL::ReSearch(unsigned int changeStart, unsigned int changeEnd) {
+	// Search from the end of the last match before the change until we are
+	// back in step with the matches after it (they have already been moved)
+	const unsigned int next_match = m_matches.FindEnding(changeStart+1);
+	unsigned int start = changeStart > EXTSIZE ? changeStart - EXTSIZE : 0;
+	if (next_match > 0) start = wxMax(start, m_matches.Get(next_match-1).end);
+	start = wxMax(start, m_search_start);
+
+	unsigned int end = changeEnd + EXTSIZE;
+	if (next_match < m_matches.GetCount()) end = wxMin(end, m_matches.Get(next_match).end);
+	end = wxMin(end, m_search_end);
+
+	cxLOCKDOC_READ(m_doc)
+		start = doc.GetValidCharPos(start);
+		if (end < doc.GetLength()) end = doc.GetValidCharPos(end);
+	cxENDLOCK
+
+	if (start < end) DoSearch(start, end);
 }
 
 void Styler_SearchHL::Insert(unsigned int pos, unsigned int length) {
@@ -211,44 +269,10 @@ void Styler_SearchHL::Insert(unsigned int pos, unsigned int length) {
 	if (m_search_end > pos)	m_search_end += length;
 	else return; // Change outside search area
 
-	unsigned int search_start = m_search_start;
-
-	if (!m_matches.empty()) {
-		if (pos >= m_matches.back().end) {
-			// Do a new search from end of last match
-			DoSearch(search_start, m_search_end, true);
-			return;
-		}
-
-		// Find first match containing or bigger than pos
-		bool is_first = true;
-		vector<interval>::iterator p = m_matches.begin();
-		while (p != m_matches.end()) {
-			if (p->end > pos) {
-				// Remember first valid match before pos
-				if (is_first) {
-					if (p != m_matches.begin()) search_start = (p-1)->end;
-					is_first = false;
-				}
-
-				if (p->start < pos) {
-					// pos inside match. Delete and continue
-					p = m_matches.erase(p);
-					if (p != m_matches.end()) continue; // new iterator
-					else break;
-				}
-				else {
-					// Move match to correct position
-					p->start += length;
-					p->end += length;
-				}
-			}
-			++p;
-		}
-	}
+	// Move following matches and remove the one containing pos
+	m_matches.InsertText(pos, length);
 
-	// Do a new search starting from end of first match before pos
-	DoSearch(search_start, m_search_end, false);
+	ReSearch(pos, pos+length);
 }
 
 void Styler_SearchHL::Delete(unsigned int start_pos, unsigned int end_pos) {
@@ -276,46 +300,60 @@ void Styler_SearchHL::Delete(unsigned int start_pos, unsigned int end_pos) {
 	}
 	else return; // Change after search area, no need to re-search
 
-	unsigned int search_start = m_search_start;
+	// Move following matches and remove those touched by deletion
+	m_matches.DeleteText(start_pos, end_pos);
 
-	if (!m_matches.empty()) {
-		if (start_pos >= m_matches.back().end) {
-			// Do a new search from end of last match
-			DoSearch(search_start, m_search_end, true);
-			return;
-		}
+	ReSearch(start_pos, start_pos);
+}
 
-		// Find matches touched by deletion and remove those. Update all following
-		bool is_first = true;
-		vector<interval>::iterator p = m_matches.begin();
-		while (p != m_matches.end()) {
-			if (p->end > start_pos) {
-				// Remember first valid match before pos
-				if (is_first) {
-					if (p != m_matches.begin()) search_start = (p-1)->end;
-					is_first = false;
-				}
+void Styler_SearchHL::ApplyDiff(const vector<cxChange>& WXUNUSED(changes)) {
+	Invalidate();
+}
 
-				if (p->start < end_pos) {
-					// pos inside match. Delete and continue
-					p = m_matches.erase(p);
-					if (p != m_matches.end()) continue; // new iterator
-					else break;
-				}
-				else {
-					// Move match to correct position
-					p->start -= length;
-					p->end -= length;
-				}
-			}
-			++p;
-		}
+bool Styler_SearchHL::OnIdle() {
+	if (m_text.empty()) return false;
+
+	// The area around the visible text is searched when styled,
+	// the rest of the document is searched downwards and then upwards
+	const unsigned int len = m_doc.GetLength();
+	if (m_search_end < len) {
+		unsigned int end = (len - m_search_end > CHUNKSIZE) ? m_search_end + CHUNKSIZE : len;
+		cxLOCKDOC_READ(m_doc)
+			if (end < len) end = doc.GetValidCharPos(end);
+		cxENDLOCK
+
+		ExtendDown(end);
+	}
+	else if (m_search_start > 0) {
+		unsigned int start = (m_search_start > CHUNKSIZE) ? m_search_start - CHUNKSIZE : 0;
+		cxLOCKDOC_READ(m_doc)
+			start = doc.GetValidCharPos(start);
+		cxENDLOCK
+
+		ExtendUp(start);
 	}
+	else return false;
 
-	// Do a new search starting from end of first match before pos
-	DoSearch(search_start, m_search_end, false);
+	return m_search_start > 0 || m_search_end < len;
 }
 
-void Styler_SearchHL::ApplyDiff(const vector<cxChange>& WXUNUSED(changes)) {
-	Invalidate();
+bool Styler_SearchHL::GetMatchCount(unsigned int pos, unsigned int& index, unsigned int& count) const {
+	if (m_text.empty()) return false;
+	if (m_search_start > 0 || m_search_end < m_doc.GetLength()) return false; // still searching
+
+	if (m_searchRanges.empty()) {
+		index = m_matches.FindStarting(pos);
+		count = m_matches.GetCount();
+		return true;
+	}
+
+	// Only count the matches starting in the search ranges
+	index = 0;
+	count = 0;
+	for (vector<interval>::const_iterator r = m_searchRanges.begin(); r != m_searchRanges.end(); ++r) {
+		const unsigned int first = m_matches.FindStarting(r->start);
+		count += m_matches.FindStarting(r->end) - first;
+		if (pos > r->start) index += m_matches.FindStarting(wxMin(pos, r->end)) - first;
+	}
+	return true;
 }
@@ -22,6 +22,7 @@
 
 #include "Catalyst.h"
 #include "styler.h"
+#include "MatchList.h"
 
 #include <vector>
 
@@ -45,6 +46,13 @@ public:
 	virtual void Insert(unsigned int pos, unsigned int length);
 	virtual void Delete(unsigned int start_pos, unsigned int end_pos);
 	virtual void ApplyDiff(const std::vector<cxChange>& changes);
+
+	// Extends the search to the rest of the document a chunk at a time
+	virtual bool OnIdle();
+
+	// Index of the first match starting at or after pos and the total count
+	// (only known when the whole document has been searched)
+	bool GetMatchCount(unsigned int pos, unsigned int& index, unsigned int& count) const;
 	
 	virtual void ApplyStyle(StyleRun& sr, unsigned int start, unsigned int pos);
 	virtual bool FilterMatch(search_result& WXUNUSED(result), const Document& WXUNUSED(doc)) { return true; }
@@ -52,13 +60,16 @@ public:
 
 protected:
 	void DoSearch(unsigned int start, unsigned int end, bool from_last=false);
+	void ExtendUp(unsigned int start);
+	void ExtendDown(unsigned int end);
+	void ReSearch(unsigned int changeStart, unsigned int changeEnd);
 
 	// Member variables
 	const DocumentWrapper& m_doc;
 	const Lines& m_lines;
 	wxString m_text;
 	int m_options;
-	std::vector<interval> m_matches;
+	MatchList m_matches;
 	const std::vector<interval>& m_searchRanges;
 	const std::vector<unsigned int>& m_cursors;
 
@@ -70,6 +81,7 @@ protected:
 	unsigned int m_search_start;
 	unsigned int m_search_end;
 	static const unsigned int EXTSIZE;
+	static const unsigned int CHUNKSIZE;
 };
 
 #endif // __STYLER_SEARCHHL_H__
@@ -49,6 +49,7 @@ public:
 	void ApplyDiff(std::vector<cxChange>& changes);
 
 	void EnableNavigation();
+	bool IsNavigating() const {return m_enabled;};
 	void NextSelection();
 	void PreviousSelection();
 private:
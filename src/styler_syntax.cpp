@@ -24,9 +24,57 @@
 #include "pcre.h"
 
 const unsigned int Styler_Syntax::EXTSIZE = 1000;
+const unsigned int Styler_Syntax::SYNCSIZE = 32000;
+const unsigned int Styler_Syntax::CHUNKSIZE = 32000;
+const unsigned int Styler_Syntax::SNAPSHOTSIZE = 256000;
+const unsigned int Styler_Syntax::SCOPECACHESIZE = 64;
+vector<Styler_Syntax*> Styler_Syntax::s_parsing;
+
+static const unsigned int NO_WAIT = (unsigned int)-1;
+
+// - SyntaxParser ---
+
+// Extends the syntax matches in the background. It works on a snapshot
+// of the document (from the end of the parsed text), so the text can not
+// change under it. When it reaches the end of the snapshot it is done, and
+// is restarted with the next part.
+class SyntaxParser : public wxThread {
+public:
+	SyntaxParser(Styler_Syntax& styler, Styler_Syntax::TextSnapshot& text);
+	virtual void* Entry();
+	void Cancel() {m_cancel = true;};
+	bool IsDone() const {return m_isDone;};
+
+private:
+	Styler_Syntax& m_styler;
+	Styler_Syntax::TextSnapshot m_text;
+	volatile bool m_cancel;
+	volatile bool m_isDone;
+};
+
+SyntaxParser::SyntaxParser(Styler_Syntax& styler, Styler_Syntax::TextSnapshot& text)
+: wxThread(wxTHREAD_JOINABLE), m_styler(styler), m_cancel(false), m_isDone(false) {
+	m_text.offset = text.offset;
+	m_text.text.swap(text.text);
+	m_text.spanLines.swap(text.spanLines);
+}
+
+void* SyntaxParser::Entry() {
+	while (!m_cancel && m_styler.ParseChunk(m_text, m_cancel)) {
+		wxWakeUpIdle(); // editor may be waiting to redraw
+	}
+
+	m_isDone = true;
+	wxWakeUpIdle();
+	return NULL;
+}
+
+// - Styler_Syntax ---
 
 Styler_Syntax::Styler_Syntax(const DocumentWrapper& dw, Lines& lines, TmSyntaxHandler* syntaxHandler)
-: m_doc(dw), m_syntaxHandler(syntaxHandler), m_lines(lines), m_syntax_end(0), m_updateLineHeight(false) {
+: m_doc(dw), m_syntaxHandler(syntaxHandler), m_lines(lines), m_syntax_end(0), m_updateLineHeight(false),
+  m_matchPool(sizeof(stxmatch)), m_submatchPool(sizeof(submatch)), m_reportMemory(false),
+  m_scopeCache(SCOPECACHESIZE), m_parser(NULL), m_waitPos(NO_WAIT), m_needRedraw(false), m_changedBeyondEdit(false) {
 	m_topMatches.subMatcher = NULL;
 	m_topStyle = NULL;
 
@@ -36,9 +84,15 @@ Styler_Syntax::Styler_Syntax(const DocumentWrapper& dw, Lines& lines, TmSyntaxHa
 }
 
 bool Styler_Syntax::IsParsed() const {
+	wxCriticalSectionLocker lock(m_parseCrit);
 	return !IsOk() || m_syntax_end == m_doc.GetLength();
 }
 
+unsigned int Styler_Syntax::GetLastParsedPos() const {
+	wxCriticalSectionLocker lock(m_parseCrit);
+	return m_syntax_end;
+}
+
 void Styler_Syntax::Clear() {
 	Invalidate();
 	m_topMatches.subMatcher = NULL;
@@ -47,12 +101,21 @@ void Styler_Syntax::Clear() {
 }
 
 void Styler_Syntax::Invalidate() {
+	StopParser();
+	ClearScopeCache();
+
 	m_topMatches.flags = 0;
 	m_topMatches.matches.clear();
 	m_syntax_end = 0;
+	m_waitPos = NO_WAIT;
+	m_changedBeyondEdit = true;
+	m_reportMemory = true;
 }
 
 void Styler_Syntax::ReStyle() {
+	StopParser();
+	m_changedBeyondEdit = true;
+
 	// Check if base syntax has a style
 	// (disabled until styles get more dynamic handling of transparency)
 	/*const wxString& topScope = m_topMatches.subMatcher->GetName();
@@ -81,6 +144,7 @@ void Styler_Syntax::ReStyleSub(const submatch& sm) {
 
 bool Styler_Syntax::GetNextMatch(const wxString& scope, unsigned int startpos, interval& match, interval& content) const {
 	if(!HaveActiveSyntax()) return false;
+	wxCriticalSectionLocker lock(m_parseCrit);
 
 	// We only do a very simple scope match
 	const wxString& topScope = m_topMatches.subMatcher->GetName();
@@ -99,7 +163,7 @@ bool Styler_Syntax::GetSubNextMatch(const submatch& sm, const wxString& scope, u
 		if (m.end <= startpos) continue;
 
 		// We only do a very simple scope match
-		if (m.m_name.StartsWith(scope)) {
+		if (m.GetName().StartsWith(scope)) {
 			match.start = m.start;
 			match.end = m.end;
 			content = match;
@@ -172,25 +236,110 @@ void Styler_Syntax::SetSyntax(const wxString& syntaxName, const wxString& ext) {
 }
 
 const deque<const wxString*> Styler_Syntax::GetScope(unsigned int pos) {
+	deque<const wxString*> scopes;
+	ScopeAtoms::Get().GetStackNames(GetScopeStackId(pos), scopes);
+	return scopes;
+}
+
+unsigned int Styler_Syntax::GetScopeStackId(unsigned int pos) {
 	wxASSERT(pos <= m_doc.GetLength());
-	if(!HaveActiveSyntax()) return deque<const wxString*>();
+	if(!HaveActiveSyntax()) return 0;
+
+	ScopeCacheEntry& entry = m_scopeCache[pos % SCOPECACHESIZE];
+	if (entry.pos == pos) return entry.stackId;
 
 	// Make sure the syntax is valid
 	ParseTo(pos);
+	wxCriticalSectionLocker lock(m_parseCrit);
 
-	deque<const wxString*> scopes;
-	const wxString& topScope = m_topMatches.subMatcher->GetName();
-	if (!topScope.empty()) {
-		scopes.push_back(&m_topMatches.subMatcher->GetName());
+	entry.stackId = GetSubStackId(pos, m_topMatches, GetStackId(NULL, 0));
+	entry.pos = pos;
+	return entry.stackId;
+}
+
+void Styler_Syntax::GetScopeStackIds(const vector<unsigned int>& positions, vector<unsigned int>& stackIds) {
+	stackIds.assign(positions.size(), 0);
+	if (positions.empty() || !HaveActiveSyntax()) return;
+	wxASSERT(positions.back() <= m_doc.GetLength());
+
+	// Make sure the syntax is valid
+	ParseTo(positions.back());
+	wxCriticalSectionLocker lock(m_parseCrit);
+
+	const unsigned int* first = &*positions.begin();
+	GetSubStackIds(m_topMatches, 0, GetStackId(NULL, 0), first, first + positions.size(), &*stackIds.begin());
+}
+
+void Styler_Syntax::ClearScopeCache() {
+	for (vector<ScopeCacheEntry>::iterator p = m_scopeCache.begin(); p != m_scopeCache.end(); ++p) {
+		p->pos = (unsigned int)-1;
+	}
+}
+
+size_t Styler_Syntax::FindMatch(const submatch& sm, unsigned int pos) {
+	// Find the last match starting at or before pos
+	size_t first = 0;
+	size_t last = sm.matches.size();
+	while (first < last) {
+		const size_t mid = (first + last) / 2;
+		if (sm.matches[mid]->start <= pos) first = mid + 1;
+		else last = mid;
 	}
 
-	GetSubScopeIntervals(pos, m_topMatches, scopes);
-	return scopes;
+	// Empty matches can come after the one containing pos
+	while (first > 0) {
+		const stxmatch& m = *sm.matches[first-1];
+		if (pos < m.end) return first-1;
+		if (m.start != m.end) break;
+		--first;
+	}
+	return sm.matches.size();
+}
+
+unsigned int Styler_Syntax::GetSubStackId(unsigned int pos, const submatch& sm, unsigned int stackId) const {
+	// The stack of the innermost match holds all the scopes down to it
+	const submatch* s = &sm;
+	for (;;) {
+		const size_t i = FindMatch(*s, pos);
+		if (i == s->matches.size()) return stackId;
+
+		const stxmatch& m = *s->matches[i];
+		stackId = m.stackId;
+		if (!m.subMatch.get()) return stackId;
+
+		pos -= m.start;
+		s = m.subMatch.get();
+	}
+}
+
+void Styler_Syntax::GetSubStackIds(const submatch& sm, unsigned int offset, unsigned int stackId, const unsigned int* first, const unsigned int* last, unsigned int* stackIds) const {
+	while (first < last) {
+		wxASSERT(first+1 == last || *first <= *(first+1));
+
+		const size_t i = FindMatch(sm, *first - offset);
+		if (i == sm.matches.size()) {
+			*stackIds++ = stackId;
+			++first;
+			continue;
+		}
+
+		// All following positions in the same match are done together
+		const stxmatch& m = *sm.matches[i];
+		const unsigned int* runEnd = first + 1;
+		while (runEnd < last && *runEnd - offset < m.end) ++runEnd;
+
+		if (m.subMatch.get()) GetSubStackIds(*m.subMatch, offset + m.start, m.stackId, first, runEnd, stackIds);
+		else fill(stackIds, stackIds + (runEnd - first), m.stackId);
+
+		stackIds += runEnd - first;
+		first = runEnd;
+	}
 }
 
 const deque<interval> Styler_Syntax::GetScopeIntervals(unsigned int pos) const {
 	wxASSERT(pos <= m_doc.GetLength());
 	if(!HaveActiveSyntax()) return deque<interval>();
+	wxCriticalSectionLocker lock(m_parseCrit);
 
 	deque<interval> intervals;
 	deque<const wxString*> scopes;
@@ -216,27 +365,23 @@ const deque<interval> Styler_Syntax::GetScopeIntervals(unsigned int pos) const {
 }
 
 void Styler_Syntax::GetSubScopeIntervals(unsigned int pos, const submatch& sm, deque<const wxString*>& scopes, unsigned int offset, deque<interval>* intervals) const {
-	for (auto_vector<stxmatch>::const_iterator p = sm.matches.begin(); p != sm.matches.end(); ++p) {
-		const stxmatch& m = *(*p);
-
-		if (pos >= m.start && pos < m.end) {
-			if (!m.m_name.empty()) {
-				if (intervals != NULL && !intervals->empty() && intervals->back() == interval(offset+m.start, offset+m.end)) {
-					scopes.back() = &m.m_name;
-				} else {
-					scopes.push_back(&m.m_name);
-					if (intervals) intervals->push_back(interval(offset+m.start, offset+m.end));
-				}
-			}
-
-			// Check if there are submatches
-			if (m.subMatch.get()) {
-				wxASSERT(pos >= m.start);
-				GetSubScopeIntervals(pos - m.start, *m.subMatch, scopes, offset+m.start, intervals);
-			}
-			return;
+	const size_t i = FindMatch(sm, pos);
+	if (i == sm.matches.size()) return;
+	const stxmatch& m = *sm.matches[i];
+
+	if (!m.GetName().empty()) {
+		if (intervals != NULL && !intervals->empty() && intervals->back() == interval(offset+m.start, offset+m.end)) {
+			scopes.back() = &m.GetName();
+		} else {
+			scopes.push_back(&m.GetName());
+			if (intervals) intervals->push_back(interval(offset+m.start, offset+m.end));
 		}
-		else if (m.start > pos) break;
+	}
+
+	// Check if there are submatches
+	if (m.subMatch.get()) {
+		wxASSERT(pos >= m.start);
+		GetSubScopeIntervals(pos - m.start, *m.subMatch, scopes, offset+m.start, intervals);
 	}
 }
 bool Styler_Syntax::ExpandScopeIntervals(unsigned int pos, deque<const wxString*>& scopes, deque<interval>& intervals) const {
@@ -278,24 +423,15 @@ bool Styler_Syntax::ExpandScopeIntervals(unsigned int pos, deque<const wxString*
 }
 
 const style* Styler_Syntax::GetStyle(stxmatch& m) const {
-	// Build the list of scopes
-	deque<const wxString*> scopes;
-	if (!m.m_name.empty()) scopes.push_back(&m.m_name);
-	const stxmatch* p = m.parent;
-	while (p) {
-		if (!p->m_name.empty()) {
-			scopes.push_front(&p->m_name);
-		}
-		p = p->parent;
-	}
+	return m_syntaxHandler->GetStyle(m.stackId);
+}
 
-	const wxString& topScope = m_topMatches.subMatcher->GetName();
-	if (!topScope.empty()) {
-		scopes.push_front(&topScope);
-	}
+unsigned int Styler_Syntax::GetStackId(const stxmatch* parent, unsigned int scopeId) const {
+	ScopeAtoms& atoms = ScopeAtoms::Get();
 
-	const style* st = m_syntaxHandler->GetStyle(scopes);
-	return st;
+	// Top level matches are inside the scope of the syntax itself
+	const unsigned int parentId = parent ? parent->stackId : atoms.GetStackId(0, m_topMatches.subMatcher->GetScopeId());
+	return atoms.GetStackId(parentId, scopeId);
 }
 
 void Styler_Syntax::GetTextWithScopes(unsigned int start, unsigned int end, vector<char>& text) {
@@ -303,6 +439,7 @@ void Styler_Syntax::GetTextWithScopes(unsigned int start, unsigned int end, vect
 	wxASSERT(end <= m_doc.GetLength());
 
 	// Make sure syntax is valid
+	StopParser();
 	if (m_syntax_end < end) {
 		DoSearch(m_syntax_end, end, end);
 	}
@@ -352,7 +489,7 @@ void Styler_Syntax::XmlText(unsigned int offset, const submatch& sm, unsigned in
 		}
 
 		// Start tag
-		const wxCharBuffer name = m.m_name.mb_str();
+		const wxCharBuffer name = m.GetName().mb_str();
 		const size_t len = strlen(name.data());
 		if (len) {
 			text.push_back('<');
@@ -398,80 +535,86 @@ void Styler_Syntax::XmlText(unsigned int offset, const submatch& sm, unsigned in
 
 void Styler_Syntax::GetSymbols(vector<SymbolRef>& symbols) const {
 	if(!HaveActiveSyntax()) return;
+	wxCriticalSectionLocker lock(m_parseCrit);
 
-	deque<const wxString*> scopes;
-
-	// Add top scope
-	const wxString& topScope = m_topMatches.subMatcher->GetName();
-	if (!topScope.empty()) {
-		scopes.push_back(&m_topMatches.subMatcher->GetName());
-	}
-
-	// Check for matching symbol
+	// Check for matching symbol in top scope
+	// (which symbols each scope stack gives is memoized by the syntax handler)
 	const wxString* transform;
-	if (m_syntaxHandler->ShowSymbol(scopes, transform)) {
+	if (m_syntaxHandler->ShowSymbol(GetStackId(NULL, 0), transform)) {
 		const SymbolRef sr = {0, m_doc.GetLength(), transform};
 		symbols.push_back(sr);
 	}
 	else {
 		// Go into subscopes
-		GetSubSymbols(0, m_topMatches, scopes, symbols);
+		GetSubSymbols(0, m_topMatches, symbols);
 	}
 }
 
-void Styler_Syntax::GetSubSymbols(unsigned int offset, const submatch& sm, deque<const wxString*>& scopes, vector<SymbolRef>& symbols) const {
+void Styler_Syntax::GetSubSymbols(unsigned int offset, const submatch& sm, vector<SymbolRef>& symbols) const {
 	for (auto_vector<stxmatch>::const_iterator p = sm.matches.begin(); p != sm.matches.end(); ++p) {
 		const stxmatch& m = *(*p);
 
-		if (!m.m_name.empty()) {
-			// Add new scope
-			scopes.push_back( &m.m_name );
-
-			// Check for matching symbol
-			const wxString* transform;
-			if (m_syntaxHandler->ShowSymbol(scopes, transform)) {
-				const SymbolRef sr = {offset+m.start, offset+m.end, transform};
-				symbols.push_back(sr);
-
-				scopes.pop_back();
-				continue;
-			}
+		// Check for matching symbol
+		const wxString* transform;
+		if (m.scopeId && m_syntaxHandler->ShowSymbol(m.stackId, transform)) {
+			const SymbolRef sr = {offset+m.start, offset+m.end, transform};
+			symbols.push_back(sr);
+			continue;
 		}
 
 		if (m.subMatch.get()) {
 			// Go into subscopes
-			GetSubSymbols(offset + m.start, *m.subMatch, scopes, symbols);
-		}
-
-		if (!m.m_name.empty()) {
-			// Remove current scope
-			scopes.pop_back();
+			GetSubSymbols(offset + m.start, *m.subMatch, symbols);
 		}
 	}
 }
 
+size_t Styler_Syntax::GetMatchCount() const {
+	wxCriticalSectionLocker lock(m_parseCrit);
+	return m_matchPool.GetUsedCount();
+}
+
+size_t Styler_Syntax::GetMatchMemory() const {
+	wxCriticalSectionLocker lock(m_parseCrit);
+	return m_matchPool.GetReservedBytes() + m_submatchPool.GetReservedBytes();
+}
+
 void Styler_Syntax::Style(StyleRun& sr) {
 	if (!HaveActiveSyntax()) return;
 
 	unsigned int sr_end = sr.GetRunEnd();
+	const unsigned int parsed_end = GetLastParsedPos();
 
 	// Check if we need to do a new search
-	if (sr_end > m_syntax_end) {
-		// Make sure the extended position is valid and extends
-		// from start-of-line to end-of-line
-		unsigned int sr_start;
-		cxLOCKDOC_READ(m_doc)
-			sr_start = doc.GetLineStart(m_syntax_end);
-		cxENDLOCK
+	if (sr_end > parsed_end) {
+		// Text far beyond the parsed part is left to the background
+		// parser. We style what we have and redraw when it gets there.
+		if (sr_end - parsed_end > SYNCSIZE && (m_parser || StartParser())) {
+			m_waitPos = wxMin(m_waitPos, wxMax(sr.GetRunStart(), parsed_end));
+		}
+		else {
+			StopParser();
+
+			if (sr_end > m_syntax_end) {
+				// Make sure the extended position is valid and extends
+				// from start-of-line to end-of-line
+				unsigned int sr_start;
+				cxLOCKDOC_READ(m_doc)
+					sr_start = doc.GetLineStart(m_syntax_end);
+				cxENDLOCK
 
-		// Extend stylerun to get better search results (round up to whole EXTSIZEs)
-		const unsigned int ext = ((sr_end / EXTSIZE) + 1) * EXTSIZE;
-		sr_end =  ext < m_lines.GetLength() ? ext : m_lines.GetLength();
-		sr_end = m_lines.GetLineEndFromPos(sr_end);
+				// Extend stylerun to get better search results (round up to whole EXTSIZEs)
+				const unsigned int ext = ((sr_end / EXTSIZE) + 1) * EXTSIZE;
+				sr_end =  ext < m_lines.GetLength() ? ext : m_lines.GetLength();
+				sr_end = m_lines.GetLineEndFromPos(sr_end);
 
-		DoSearch(sr_start, sr_end, sr_end);
+				DoSearch(sr_start, sr_end, sr_end);
+			}
+		}
 	}
 
+	wxCriticalSectionLocker lock(m_parseCrit);
+
 	// Apply base style
 	if (m_topStyle) {
 		const unsigned int start =  sr.GetRunStart();
@@ -492,7 +635,7 @@ void Styler_Syntax::DoStyle(StyleRun& sr, unsigned int offset, const auto_vector
 	const unsigned int rstart =  sr.GetRunStart();
 	const unsigned int rend = sr.GetRunEnd();
 	const unsigned int styleStart = offset < rstart ? rstart - offset : 0;
-	const stxmatch m(wxEmptyString, NULL, styleStart, 0, 0, 0, NULL);
+	const stxmatch m(0, 0, NULL, styleStart, 0, 0, 0, NULL);
 
 	if (matches.empty()) return;
 
@@ -527,19 +670,22 @@ void Styler_Syntax::DoStyle(StyleRun& sr, unsigned int offset, const auto_vector
 	}
 }
 
-void Styler_Syntax::DoSearch(unsigned int start, unsigned int end, unsigned int limit) {
-	wxASSERT(0 <= start && start < m_doc.GetLength());
-	wxASSERT(start < end && end <= m_doc.GetLength());
-	wxASSERT(limit <= m_doc.GetLength());
+void Styler_Syntax::DoSearch(unsigned int start, unsigned int end, unsigned int limit, const TextSnapshot* text, const volatile bool* cancel) {
+	// The background parser searches a snapshot of the document
+	const unsigned int docLen = text ? text->End() : m_doc.GetLength();
+	wxASSERT(!text || text->offset <= start);
+	wxASSERT(0 <= start && start < docLen);
+	wxASSERT(start < end && end <= docLen);
+	wxASSERT(limit <= docLen);
 	wxASSERT(HaveActiveSyntax());
 	
 	// Don't try to parse if there is no valid parser
 	if (!HaveActiveSyntax()) {
-		m_syntax_end = m_lines.GetLength();
+		m_syntax_end = text ? docLen : m_lines.GetLength();
 		return;
 	}
 
-	wxLogDebug(wxT("DoSearch %u-%u %u"), start, end, limit);
+	if (!text) wxLogDebug(wxT("DoSearch %u-%u %u"), start, end, limit);
 
 	// Make sure we don't get gaps in the parsing
 	if (start > m_syntax_end) start = m_syntax_end;
@@ -547,12 +693,23 @@ void Styler_Syntax::DoSearch(unsigned int start, unsigned int end, unsigned int
 	// Initialize SearchInfo
 	SearchInfo si;
 	si.pos = start;
-	si.line_id = m_lines.GetLineFromCharPos(start);
-	m_lines.GetLineExtent(si.line_id, si.lineStart, si.lineEnd);
-	cxLOCKDOC_READ(m_doc)
-		doc.GetTextPart(si.lineStart, si.lineEnd, si.line);
-	cxENDLOCK
-	si.lineLen = si.lineEnd - si.lineStart;
+	si.text = text;
+	si.cancel = cancel;
+	if (text) {
+		si.line_id = 0; // lines are only used with the document
+		const vector<char>& snapshot = text->text;
+		si.lineStart = start;
+		while (si.lineStart > text->offset && snapshot[si.lineStart - text->offset - 1] != '\n') --si.lineStart;
+		ReadLine(si);
+	}
+	else {
+		si.line_id = m_lines.GetLineFromCharPos(start);
+		m_lines.GetLineExtent(si.line_id, si.lineStart, si.lineEnd);
+		cxLOCKDOC_READ(m_doc)
+			doc.GetTextPart(si.lineStart, si.lineEnd, si.line);
+		cxENDLOCK
+		si.lineLen = si.lineEnd - si.lineStart;
+	}
 	si.changeEnd = end;
 	si.limit = limit;
 	si.hitLimit = false;
@@ -561,11 +718,37 @@ void Styler_Syntax::DoSearch(unsigned int start, unsigned int end, unsigned int
 	//wxLogDebug(wxT("  si %u-%u-%u,%u"), si.pos,si.line_id, si.lineStart, si.lineEnd);
 
 	// Do the search
-	m_syntax_end = Search(m_topMatches, si, 0, m_syntax_end, NULL);
+	{
+		wxCriticalSectionLocker lock(matcher::GetLock());
+		m_syntax_end = Search(m_topMatches, si, 0, m_syntax_end, NULL);
+	}
+	if (text) return;
+
+	// If we hit the limit, the text after it will be reparsed
+	if (si.hitLimit) m_changedBeyondEdit = true;
 
 #ifdef __WXDEBUG__
 	Verify();
 #endif  //__WXDEBUG__
+
+	match_matcher::ShowErrors();
+}
+
+void Styler_Syntax::ReadLine(SearchInfo& si) {
+	if (si.text) {
+		const vector<char>& text = si.text->text;
+		const unsigned int offset = si.text->offset;
+		const vector<char>::const_iterator eol = find(text.begin() + (si.lineStart - offset), text.end(), '\n');
+		si.lineEnd = offset + ((eol == text.end()) ? text.size() : (eol - text.begin()) + 1);
+		if (si.lineEnd > si.lineStart) si.line.assign(text.begin() + (si.lineStart - offset), text.begin() + (si.lineEnd - offset));
+	}
+	else {
+		si.lineEnd = m_lines.GetLineEndpos(si.line_id, false);
+		cxLOCKDOC_READ(m_doc)
+			doc.GetTextPart(si.lineStart, si.lineEnd, si.line);
+		cxENDLOCK
+	}
+	si.lineLen = si.lineEnd - si.lineStart;
 }
 
 unsigned int Styler_Syntax::Search(submatch& submatches, SearchInfo& si, unsigned int scopeStart, unsigned int scopeEnd, stxmatch* scope) {
@@ -573,7 +756,7 @@ unsigned int Styler_Syntax::Search(submatch& submatches, SearchInfo& si, unsigne
 	//const unsigned int adjEnd = si.changeEnd - scopeStart;
 
 	// Find the first match after or containing start
-	stxmatch m(wxEmptyString, NULL, 0, adjPos, 0, 0, NULL);
+	stxmatch m(0, 0, NULL, 0, adjPos, 0, 0, NULL);
 	auto_vector<stxmatch>& matches = submatches.matches;
 	auto_vector<stxmatch>::iterator next_match = lower_bound(matches.begin(), matches.end(), &m, stxmatch_end_less());
 
@@ -670,6 +853,10 @@ unsigned int Styler_Syntax::Search(submatch& submatches, SearchInfo& si, unsigne
 			m_lines.UpdateParsedLine(si.line_id);
 		}*/
 
+		// If the background parser is stopped, we end at this line
+		// (as if the chunk ended here)
+		if (si.cancel && *si.cancel && si.pos == si.lineEnd && si.lineEnd < si.limit) si.limit = si.lineEnd;
+
 		// Check if we can end this search
 		if (!si.hitLimit && isEndScope && (si.pos == si.changeEnd)) {
 			si.done = true;
@@ -687,11 +874,7 @@ unsigned int Styler_Syntax::Search(submatch& submatches, SearchInfo& si, unsigne
 			// Advance to next line
 			++si.line_id;
 			si.lineStart = si.lineEnd;
-			si.lineEnd = m_lines.GetLineEndpos(si.line_id, false);
-			cxLOCKDOC_READ(m_doc)
-				doc.GetTextPart(si.lineStart, si.lineEnd, si.line);
-			cxENDLOCK
-			si.lineLen = si.lineEnd - si.lineStart;
+			ReadLine(si);
 			zeromatch = -1;
 		}
 
@@ -772,7 +955,7 @@ unsigned int Styler_Syntax::Search(submatch& submatches, SearchInfo& si, unsigne
 				}
 				else {
 					// Create the new match
-					auto_ptr<stxmatch> iv(new stxmatch(m.GetName(), &m, matchStart, matchEnd, NULL, NULL, scope));
+					auto_ptr<stxmatch> iv(new (m_matchPool) stxmatch(m.GetScopeId(), GetStackId(scope, m.GetScopeId()), &m, matchStart, matchEnd, NULL, NULL, scope));
 
 					// Style It
 					iv->st = GetStyle(*iv);
@@ -843,8 +1026,8 @@ void Styler_Syntax::AddCaptures(matcher& m, stxmatch& sm, unsigned int offset, c
 	for (unsigned int i = 1; (int)i < rc; ++i) {
 		if (ovector[2*i] == -1) continue;
 
-		const wxString& name = m.GetCaptureName(i);
-		if (name.empty()) continue;
+		const unsigned int scopeId = m.GetCaptureScopeId(i);
+		if (scopeId == 0) continue; // no name
 
 		const interval capiv(si.lineStart + ovector[2*i], si.lineStart + ovector[2*i+1]);
 
@@ -868,12 +1051,12 @@ void Styler_Syntax::AddCaptures(matcher& m, stxmatch& sm, unsigned int offset, c
 
 		// Create submatch list if not there
 		if (!parent.subMatch.get()) {
-			parent.subMatch = auto_ptr<submatch>(new submatch);
+			parent.subMatch = auto_ptr<submatch>(new (m_submatchPool) submatch);
 			parent.subMatch->subMatcher = NULL; // matches with captures distinguishes from spans by not having subMatcher
 		}
 
 		// Create the new match
-		auto_ptr<stxmatch> cap(new stxmatch(name, &m, cap_start, cap_end, NULL, NULL, &parent));
+		auto_ptr<stxmatch> cap(new (m_matchPool) stxmatch(scopeId, GetStackId(&parent, scopeId), &m, cap_start, cap_end, NULL, NULL, &parent));
 
 		wxASSERT(capiv.end <= offset + sm.end);
 
@@ -889,7 +1072,7 @@ void Styler_Syntax::CreateSpan(unsigned int starterStart, unsigned int starterEn
 	wxASSERT(scope->subMatch.get() == NULL); // Newly created span should not yet have submatches
 
 	// Create submatches for the new span
-	scope->subMatch = auto_ptr<submatch>(new submatch);
+	scope->subMatch = auto_ptr<submatch>(new (m_submatchPool) submatch);
 	submatch& span_sub = *scope->subMatch;
 	span_sub.subMatcher = &subMatcher.GetCallout(id);
 	wxASSERT(span_sub.subMatcher && span_sub.subMatcher->IsSpan());
@@ -905,7 +1088,7 @@ void Styler_Syntax::CreateSpan(unsigned int starterStart, unsigned int starterEn
 		const unsigned int span_id = subMatcher.GetSubId(id);
 		matcher* const spanstarter = sm->GetStartMember(span_id);
 
-		auto_ptr<stxmatch> spanstart(new stxmatch(spanstarter->GetName(), spanstarter, 0, starterEnd - starterStart, NULL, NULL, scope));
+		auto_ptr<stxmatch> spanstart(new (m_matchPool) stxmatch(spanstarter->GetScopeId(), GetStackId(scope, spanstarter->GetScopeId()), spanstarter, 0, starterEnd - starterStart, NULL, NULL, scope));
 		spanstart->st = GetStyle(*spanstart); // style the match
 
 		// Check if the match has any captures
@@ -920,13 +1103,13 @@ void Styler_Syntax::CreateSpan(unsigned int starterStart, unsigned int starterEn
 	unsigned int spanEnd = starterEnd;
 
 	// Check if we should apply a contentName
-	const wxString& contentName = span_sub.subMatcher->GetContentName();
-	if (!contentName.empty()) {
+	const unsigned int contentScopeId = span_sub.subMatcher->GetContentScopeId();
+	if (contentScopeId) {
 		const unsigned int contentStart = span_sub.matches.empty() ? 0 : span_sub.matches[0]->end;
 
 		// Create content span
-		auto_ptr<stxmatch> contentIv(new stxmatch(contentName, NULL, contentStart, contentStart, NULL, NULL, scope));
-		contentIv->subMatch = auto_ptr<submatch>(new submatch);
+		auto_ptr<stxmatch> contentIv(new (m_matchPool) stxmatch(contentScopeId, GetStackId(scope, contentScopeId), NULL, contentStart, contentStart, NULL, NULL, scope));
+		contentIv->subMatch = auto_ptr<submatch>(new (m_submatchPool) submatch);
 		contentIv->subMatch->subMatcher = span_sub.subMatcher; // same as parent
 		contentIv->subMatch->flags |= cxSPAN_IS_CONTENT;
 		contentIv->st = GetStyle(*contentIv);
@@ -975,9 +1158,26 @@ void Styler_Syntax::ReInitSpan(span_matcher& sm, unsigned int start, const Searc
 	else {
 		usingSi = false;
 		lineStart = start; // TODO: set to start-of-line
-		cxLOCKDOC_READ(m_doc)
-			lineEnd = doc.GetLine(lineStart, line);
-		cxENDLOCK
+		if (si.text && lineStart < si.text->offset) {
+			// Spans started before the snapshot have their lines saved with it
+			map<unsigned int, vector<char> >::const_iterator p = si.text->spanLines.find(lineStart);
+			wxASSERT(p != si.text->spanLines.end());
+			if (p != si.text->spanLines.end()) line = p->second;
+			lineEnd = lineStart + line.size();
+		}
+		else if (si.text) {
+			const vector<char>& text = si.text->text;
+			const unsigned int offset = si.text->offset;
+			const vector<char>::const_iterator eol = find(text.begin() + (lineStart - offset), text.end(), '\n');
+			lineEnd = offset + ((eol == text.end()) ? text.size() : (eol - text.begin()) + 1);
+			line.assign(text.begin() + (lineStart - offset), text.begin() + (lineEnd - offset));
+		}
+		else {
+			cxLOCKDOC_READ(m_doc)
+				lineEnd = doc.GetLine(lineStart, line);
+			cxENDLOCK
+		}
+		if (line.empty()) return; // no line to get the captures from
 		lineLen = lineEnd - lineStart;
 		ptrLine = &*line.begin();
 	}
@@ -1009,6 +1209,9 @@ void Styler_Syntax::ReInitSpan(span_matcher& sm, unsigned int start, const Searc
 }
 
 void Styler_Syntax::Insert(unsigned int pos, unsigned int length) {
+	StopParser();
+	ClearScopeCache();
+
 #ifdef __WXDEBUG__
 	Verify();
 
@@ -1044,6 +1247,9 @@ void Styler_Syntax::Insert(unsigned int pos, unsigned int length) {
 }
 
 void Styler_Syntax::Delete(unsigned int start_pos, unsigned int end_pos) {
+	StopParser();
+	ClearScopeCache();
+
 	const unsigned int docLen = m_doc.GetLength();
 	wxASSERT(start_pos >= 0 && start_pos <= docLen);
 
@@ -1091,6 +1297,9 @@ void Styler_Syntax::Delete(unsigned int start_pos, unsigned int end_pos) {
 }
 
 void Styler_Syntax::ApplyDiff(const vector<cxLineChange>& linechanges) {
+	StopParser();
+	ClearScopeCache();
+
 	if (m_lines.GetLength() == 0) {
 		Invalidate();
 		return;
@@ -1142,7 +1351,7 @@ unsigned int Styler_Syntax::AdjustForInsertion(unsigned int pos, unsigned int le
 	if (matches.empty()) return change_end;
 
 	// Find first match containing or bigger than pos
-	const stxmatch target(wxEmptyString, NULL, 0, pos, NULL, NULL, NULL);
+	const stxmatch target(0, 0, NULL, 0, pos, NULL, NULL, NULL);
 	auto_vector<stxmatch>::iterator p = lower_bound(matches.begin(), matches.end(), &target, stxmatch_end_less());
 	if (p == matches.end()) return change_end;
 
@@ -1208,7 +1417,7 @@ unsigned int Styler_Syntax::AdjustForDeletion(unsigned int start, unsigned int e
 	if (matches.empty()) return start;
 
 	// Find first match containing or bigger than start
-	const stxmatch target(wxEmptyString, NULL, 0, start, NULL, NULL, NULL);
+	const stxmatch target(0, 0, NULL, 0, start, NULL, NULL, NULL);
 	auto_vector<stxmatch>::iterator p = lower_bound(matches.begin(), matches.end(), &target, stxmatch_end_less());
 	if (p == matches.end()) return start; // search from end of last match
 
@@ -1279,6 +1488,8 @@ unsigned int Styler_Syntax::AdjustForDeletion(unsigned int start, unsigned int e
 }
 
 void Styler_Syntax::ParseAll() {
+	StopParser();
+
 	const unsigned int len = m_doc.GetLength();
 	if (m_syntax_end < len) {
 		DoSearch(m_syntax_end, len, len);
@@ -1288,17 +1499,40 @@ void Styler_Syntax::ParseAll() {
 void Styler_Syntax::ParseTo(unsigned int pos) {
 	wxASSERT(pos <= m_doc.GetLength());
 
-	if (m_syntax_end < pos) {
+	if (GetLastParsedPos() < pos) {
+		StopParser();
 		const unsigned int sr_end = m_lines.GetLineEndFromPos(pos); // always parse to end-of-line
-		DoSearch(m_syntax_end, sr_end, sr_end);
+		if (m_syntax_end < sr_end) DoSearch(m_syntax_end, sr_end, sr_end);
 	}
 }
 
 bool Styler_Syntax::OnIdle() {
 	if (!HaveActiveSyntax()) return false;
 
-	// Extend syntax a bit longer
+	// Report errors found by the parser
+	match_matcher::ShowErrors();
+
+	if (m_parser) {
+		if (m_waitPos != NO_WAIT && GetLastParsedPos() > m_waitPos) {
+			m_waitPos = NO_WAIT;
+			m_needRedraw = true;
+		}
+
+		// The parser wakes us up when it has done more
+		if (!m_parser->IsDone()) return false;
+		StopParser();
+	}
+
+	if (m_waitPos != NO_WAIT) {
+		m_waitPos = NO_WAIT;
+		m_needRedraw = true;
+	}
+
+	// Extend syntax in the background
 	if (m_syntax_end < m_doc.GetLength()) {
+		if (StartParser()) return false;
+
+		// Extend syntax a bit longer
 		// Make sure the extended position is valid and extends to end-of-line
 		unsigned int ext = wxMin(m_syntax_end+EXTSIZE, m_doc.GetLength());
 		cxLOCKDOC_READ(m_doc)
@@ -1308,7 +1542,116 @@ bool Styler_Syntax::OnIdle() {
 		DoSearch(m_syntax_end, ext, ext);
 	}
 
-	return m_syntax_end != m_doc.GetLength(); // true if we want more idle events
+	const unsigned int docLen = m_doc.GetLength();
+	if (m_syntax_end != docLen) return true; // we want more idle events
+
+	// Report the size of the match tree when a full parse is done
+	if (m_reportMemory) {
+		m_reportMemory = false;
+		if (docLen) {
+			const double matchMB = (double)GetMatchMemory() / (1024*1024);
+			const double textMB = (double)docLen / (1024*1024);
+			wxLogDebug(wxT("Syntax %s: %u matches in %.1f MB for %.2f MB of text (%.1f MB per MB)"),
+				m_syntaxName.c_str(), (unsigned int)GetMatchCount(), matchMB, textMB, matchMB / textMB);
+		}
+	}
+	return false;
+}
+
+bool Styler_Syntax::NeedRedraw() {
+	const bool needRedraw = m_needRedraw;
+	m_needRedraw = false;
+	return needRedraw;
+}
+
+bool Styler_Syntax::ChangedBeyondEdit() {
+	const bool changed = m_changedBeyondEdit;
+	m_changedBeyondEdit = false;
+	return changed;
+}
+
+bool Styler_Syntax::StartParser() {
+	wxASSERT(!m_parser);
+	if (!HaveActiveSyntax()) return false;
+
+	const unsigned int docLen = m_doc.GetLength();
+	if (m_syntax_end >= docLen) return false;
+
+	// Only the lines from the end of the parsed text are copied (a part at
+	// a time), along with the lines of the spans open there
+	TextSnapshot text;
+	text.offset = m_lines.GetLineStartFromPos(m_syntax_end);
+	const unsigned int end = m_lines.GetLineEndFromPos(wxMin(text.offset + SNAPSHOTSIZE, docLen));
+	cxLOCKDOC_READ(m_doc)
+		doc.GetTextPart(text.offset, end, text.text);
+	cxENDLOCK
+	GetSpanLines(m_topMatches, 0, text.offset, text.spanLines);
+
+	m_parser = new SyntaxParser(*this, text);
+	if (m_parser->Create() != wxTHREAD_NO_ERROR || m_parser->Run() != wxTHREAD_NO_ERROR) {
+		delete m_parser;
+		m_parser = NULL;
+		return false;
+	}
+
+	s_parsing.push_back(this);
+	return true;
+}
+
+void Styler_Syntax::StopParser() {
+	if (!m_parser) return;
+
+	// Parsing stops at end of current line
+	m_parser->Cancel();
+	m_parser->Wait();
+	delete m_parser;
+	m_parser = NULL;
+
+	s_parsing.erase(find(s_parsing.begin(), s_parsing.end(), this));
+}
+
+void Styler_Syntax::StopAllParsers() {
+	while (!s_parsing.empty()) s_parsing.back()->StopParser();
+}
+
+bool Styler_Syntax::ParseChunk(const TextSnapshot& text, const volatile bool& cancel) {
+	wxCriticalSectionLocker lock(m_parseCrit);
+
+	const unsigned int len = text.End();
+	if (m_syntax_end >= len) return false;
+
+	// Chunks always end at end-of-line, so the parser can resume from there
+	// (the snapshot also ends at end-of-line)
+	unsigned int end = wxMin(m_syntax_end + CHUNKSIZE, len);
+	const vector<char>::const_iterator eol = find(text.text.begin() + (end - text.offset), text.text.end(), '\n');
+	end = (eol == text.text.end()) ? len : text.offset + (eol - text.text.begin()) + 1;
+
+	const unsigned int start = m_syntax_end;
+	DoSearch(start, end, end, &text, &cancel);
+	return m_syntax_end > start && m_syntax_end < len;
+}
+
+void Styler_Syntax::GetSpanLines(const submatch& sm, unsigned int offset, unsigned int pos, map<unsigned int, vector<char> >& spanLines) const {
+	// Matches do not overlap, so only the last one starting before pos can be open
+	size_t first = 0;
+	size_t last = sm.matches.size();
+	while (first < last) {
+		const size_t mid = (first + last) / 2;
+		if (offset + sm.matches[mid]->start < pos) first = mid + 1;
+		else last = mid;
+	}
+	if (first == 0) return;
+
+	const stxmatch& m = *sm.matches[first-1];
+	if (offset + m.end < pos || !m.subMatch.get() || !m.subMatch->subMatcher) return;
+
+	// The parser re-inits the span from its start (see ReInitSpan)
+	const unsigned int start = offset + m.start;
+	cxLOCKDOC_READ(m_doc)
+		doc.GetLine(start, spanLines[start]);
+	cxENDLOCK
+
+	GetSpanLines(*m.subMatch, start, pos, spanLines);
 }
 
 
@@ -1335,7 +1678,7 @@ void Styler_Syntax::PrintMatches(unsigned int level, const submatch& submatches)
 		const stxmatch& m = *matches[i];
 		const wxString indent(wxT(' '), level*2);
 
-		wxLogDebug(wxT("%s%d: %d-%d %s %d"),indent.c_str(), i, m.start, m.end, m.m_name.c_str(), m.subMatch.get() != NULL);
+		wxLogDebug(wxT("%s%d: %d-%d %s %d"),indent.c_str(), i, m.start, m.end, m.GetName().c_str(), m.subMatch.get() != NULL);
 
 		if (m.subMatch.get()) {
 			PrintMatches(level+1, *m.subMatch);
@@ -1407,8 +1750,34 @@ void Styler_Syntax::VerifyMatch(const stxmatch* m) const {
 
 #endif  //__WXDEBUG__
 
-Styler_Syntax::stxmatch::stxmatch(const wxString& name, const matcher* m, unsigned int start, unsigned int end, style *st, submatch* subMatch, stxmatch* parent)
-: m_name(name), m_matcher(m), start(start), end(end), st(st), subMatch(subMatch), parent(parent) {
+void* Styler_Syntax::stxmatch::operator new(size_t WXUNUSED_UNLESS_DEBUG(size), FixedPool& pool) {
+	wxASSERT(size <= pool.GetSlotSize());
+	return pool.Alloc();
+}
+
+void Styler_Syntax::stxmatch::operator delete(void* p, FixedPool& pool) {
+	pool.Free(p);
+}
+
+void Styler_Syntax::stxmatch::operator delete(void* p) {
+	if (p) FixedPool::GetPool(p).Free(p);
+}
+
+void* Styler_Syntax::submatch::operator new(size_t WXUNUSED_UNLESS_DEBUG(size), FixedPool& pool) {
+	wxASSERT(size <= pool.GetSlotSize());
+	return pool.Alloc();
+}
+
+void Styler_Syntax::submatch::operator delete(void* p, FixedPool& pool) {
+	pool.Free(p);
+}
+
+void Styler_Syntax::submatch::operator delete(void* p) {
+	if (p) FixedPool::GetPool(p).Free(p);
+}
+
+Styler_Syntax::stxmatch::stxmatch(unsigned int scopeId, unsigned int stackId, const matcher* m, unsigned int start, unsigned int end, style *st, submatch* subMatch, stxmatch* parent)
+: scopeId(scopeId), stackId(stackId), m_matcher(m), start(start), end(end), st(st), subMatch(subMatch), parent(parent) {
 }
 
 Styler_Syntax::stxmatch::~stxmatch() {
@@ -18,6 +18,7 @@
 #ifndef WX_PRECOMP
 	#include <wx/wx.h>
 #endif
+#include <wx/thread.h>
 
 #include "Document.h"
 #include "Interval.h"
@@ -25,7 +26,10 @@
 #include "SymbolRef.h"
 
 #include "auto_vector.h"
+#include "ScopeAtoms.h"
+#include "FixedPool.h"
 #include <deque>
+#include <map>
 
 class DocumentWrapper;
 class TmSyntaxHandler;
@@ -35,6 +39,7 @@ struct style;
 
 class matcher;
 class span_matcher;
+class SyntaxParser;
 
 class Styler_Syntax : public Styler {
 public:
@@ -45,7 +50,7 @@ public:
 
 	bool IsOk() const {return m_topMatches.subMatcher != NULL;};
 	bool IsParsed() const;
-	unsigned int GetLastParsedPos() const {return m_syntax_end;};
+	unsigned int GetLastParsedPos() const;
 
 	bool UpdateSyntax();
 	void SetSyntax(const wxString& syntaxName, const wxString& ext=wxEmptyString);
@@ -54,6 +59,11 @@ public:
 	void ParseTo(unsigned int pos);
 
 	const deque<const wxString*> GetScope(unsigned int pos);
+
+	// Interned scope stack at pos (see ScopeAtoms). The stacks are shared
+	// handles, so they can be compared and memoized on by the callers.
+	unsigned int GetScopeStackId(unsigned int pos);
+	void GetScopeStackIds(const vector<unsigned int>& positions, vector<unsigned int>& stackIds); // sorted positions
 	void GetTextWithScopes(unsigned int start, unsigned int end, vector<char>& text);
 
 	const deque<interval> GetScopeIntervals(unsigned int pos) const;
@@ -68,16 +78,41 @@ public:
 
 	bool OnIdle();
 
+	// True (once) when the background parser has reached text that
+	// was drawn before it was parsed
+	bool NeedRedraw();
+
+	// True (once) when edits may have changed the styles after
+	// the edited lines (partial redraws have to go to the end)
+	bool ChangedBeyondEdit();
+
+	// Stops parsers before the shared matchers or styles are changed
+	// (they resume from where they got to on next idle)
+	static void StopAllParsers();
+
 	void GetSymbols(vector<SymbolRef>& symbols) const;
 
+	// Memory used by the match tree
+	size_t GetMatchCount() const;
+	size_t GetMatchMemory() const;
+
 private:
 	// Definitions
 	class submatch; // pre-def
 	class stxmatch {
 	public:
-		stxmatch(const wxString& name, const matcher* m, unsigned int start, unsigned int end, style *st, submatch* submatch, stxmatch* parent);
+		stxmatch(unsigned int scopeId, unsigned int stackId, const matcher* m, unsigned int start, unsigned int end, style *st, submatch* submatch, stxmatch* parent);
 		~stxmatch();
-		const wxString& m_name;
+		const wxString& GetName() const {return ScopeAtoms::Get().GetScope(scopeId);};
+
+		// Allocated from the pools of the styler (see FixedPool),
+		// as in new (m_matchPool) stxmatch(...)
+		static void* operator new(size_t size, FixedPool& pool);
+		static void operator delete(void* p, FixedPool& pool);
+		static void operator delete(void* p);
+
+		const unsigned int scopeId; // interned name
+		const unsigned int stackId; // interned scope stack
 		const matcher* m_matcher;
 		unsigned int start;
 		unsigned int end;
@@ -96,10 +131,25 @@ private:
 	class submatch {
 	public:
 		submatch() : flags(0), subMatcher(NULL) {};
+
+		static void* operator new(size_t size, FixedPool& pool);
+		static void operator delete(void* p, FixedPool& pool);
+		static void operator delete(void* p);
+
 		int flags;
 		auto_vector<stxmatch> matches;
 		matcher* subMatcher;
 	};
+	// Part of the document copied for the background parser (whole lines)
+	struct TextSnapshot {
+		unsigned int End() const {return offset + text.size();};
+
+		unsigned int offset; // document pos of text start
+		vector<char> text;
+
+		// Starter lines (from span start) of the spans open at offset
+		map<unsigned int, vector<char> > spanLines;
+	};
 	struct SearchInfo {
 		unsigned int pos;
 		unsigned int line_id;
@@ -109,6 +159,8 @@ private:
 		unsigned int changeEnd;
 		unsigned int limit;
 		vector<char> line;
+		const TextSnapshot* text; // when in background parser
+		const volatile bool* cancel; // set when the background parser is stopped
 		bool hitLimit;
 		bool done;
 	};
@@ -126,12 +178,18 @@ private:
 	// Private methods
 	bool HaveActiveSyntax() const { return m_topMatches.subMatcher != NULL; };
 	void DoStyle(StyleRun& sr, unsigned int offset, const auto_vector<stxmatch>& matches);
-	void DoSearch(unsigned int start, unsigned int end, unsigned int limit);
+	void DoSearch(unsigned int start, unsigned int end, unsigned int limit, const TextSnapshot* text=NULL, const volatile bool* cancel=NULL);
+	void ReadLine(SearchInfo& si);
 	unsigned int SubSearch(unsigned int offset, unsigned int start, unsigned int end, submatch& submatches, stxmatch* parent, bool doAdjust, bool& done);
 	void CreateSpan(unsigned int starterStart, unsigned int starterEnd, matcher& subMatcher, unsigned int id, SearchInfo& si, stxmatch* scope, int rc, int* ovector);
 	const style* GetStyle(stxmatch& m) const;
+	unsigned int GetStackId(const stxmatch* parent, unsigned int scopeId) const;
 	void ReStyleSub(const submatch& sm);
 
+	static size_t FindMatch(const submatch& sm, unsigned int pos);
+	unsigned int GetSubStackId(unsigned int pos, const submatch& sm, unsigned int stackId) const;
+	void GetSubStackIds(const submatch& sm, unsigned int offset, unsigned int stackId, const unsigned int* first, const unsigned int* last, unsigned int* stackIds) const;
+	void ClearScopeCache();
 	void GetSubScopeIntervals(unsigned int pos, const submatch& sm, deque<const wxString*>& scopes, unsigned int offset = 0, deque<interval>* intervals = NULL) const;
 	bool GetSubNextMatch(const submatch& sm, const wxString& scope, unsigned int startpos, interval& match, interval& content) const;
 	bool ExpandScopeIntervals(unsigned int pos, deque<const wxString*>& scopes, deque<interval>& intervals) const;
@@ -144,7 +202,14 @@ private:
 
 	void XmlText(unsigned int offset, const submatch& sm, unsigned int start, unsigned int end, vector<char>& text) const;
 
-	void GetSubSymbols(unsigned int offset, const submatch& sm, deque<const wxString*>& scopes, vector<SymbolRef>& symbols) const;
+	void GetSubSymbols(unsigned int offset, const submatch& sm, vector<SymbolRef>& symbols) const;
+
+	// Background parsing
+	friend class SyntaxParser;
+	bool StartParser();
+	void StopParser();
+	bool ParseChunk(const TextSnapshot& text, const volatile bool& cancel);
+	void GetSpanLines(const submatch& sm, unsigned int offset, unsigned int pos, map<unsigned int, vector<char> >& spanLines) const;
 
 	// Member variables
 	const DocumentWrapper& m_doc;
@@ -152,12 +217,44 @@ private:
 	Lines& m_lines;
 	unsigned int m_syntax_end;
 	static const unsigned int EXTSIZE;
+	static const unsigned int SYNCSIZE;
+	static const unsigned int CHUNKSIZE;
+	static const unsigned int SNAPSHOTSIZE;
 	wxString m_syntaxName;
 	bool m_updateLineHeight;
 
+	// The match tree is allocated from pools owned by the styler. They
+	// are only used by one thread at a time (the parser is stopped before
+	// the tree is changed from the main thread), so they need no locking.
+	// Declared before m_topMatches, so they outlive it.
+	FixedPool m_matchPool;
+	FixedPool m_submatchPool;
+	bool m_reportMemory; // log memory use when fully parsed
+
 	submatch m_topMatches;
 	const style* m_topStyle;
 
+	// The scopes of the last positions looked up (indexed by pos), as the
+	// same positions are queried many times between changes
+	struct ScopeCacheEntry {
+		ScopeCacheEntry() : pos((unsigned int)-1), stackId(0) {};
+		unsigned int pos;
+		unsigned int stackId;
+	};
+	static const unsigned int SCOPECACHESIZE;
+	vector<ScopeCacheEntry> m_scopeCache;
+
+	// The parser extends the matches in chunks (ending at line ends)
+	// while holding m_parseCrit. In the main thread it only has to be
+	// held when reading while the parser runs, as everything that
+	// changes the matches stops the parser first.
+	SyntaxParser* m_parser;
+	mutable wxCriticalSection m_parseCrit;
+	unsigned int m_waitPos; // redraw when parsed beyond this
+	bool m_needRedraw;
+	bool m_changedBeyondEdit;
+	static vector<Styler_Syntax*> s_parsing;
+
 #ifdef __WXDEBUG__
 	void Print() const;
 	void PrintMatches(unsigned int level, const submatch& submatches) const;
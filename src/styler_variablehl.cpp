@@ -49,7 +49,7 @@ bool Styler_VariableHL::OnIdle() {
 	m_cursorPosition = m_editorCtrl.GetPos();
 	const wxString text = m_editorCtrl.GetWord(m_cursorPosition);
 	//Instead of parsing the document in the styler, I moved it to an OnIdle function so the editor doesn't appear to lag as much.
-	//It will perform a full document search about 1 second after the most recent change to the document.
+	//It will start a new search about 1 second after the most recent change to the document.
 	if(wxGetLocalTimeMillis() - m_lastUpdateTime <= 1000) {
 		return false;
 	} else if (m_editorCtrl.GetChangeState() != m_lastEditorState) {
@@ -59,11 +59,9 @@ bool Styler_VariableHL::OnIdle() {
 		return false;
 	} else if (text != m_text) {
 		//wxLogDebug(wxT("Search: %s"), text);
+		// Only the visible text is searched (when styled)
 		Clear();
-		if(text.Len() > 0) {
-			m_text = text;
-			DoSearch(0, m_doc.GetLength());
-		}
+		m_text = text;
 		//we have to force a redraw now because the selections have probably changed
 		m_editorCtrl.DrawLayout();
 
@@ -22,6 +22,7 @@
 #include "Document.h"
 #include "eSettings.h"
 #include "matchers.h"
+#include "styler_syntax.h"
 #include "Dispatcher.h"
 #include "BundleMenu.h"
 #include "tmStyle.h"
@@ -130,7 +131,7 @@ const wxString TmSyntaxHandler::s_emptyString;
 
 TmSyntaxHandler::TmSyntaxHandler(Dispatcher& disp, PListHandler& plistHandler)
 : m_plistHandler(plistHandler),
-  m_dispatcher(disp), m_styleNode(NULL), m_bundleMenu(NULL), m_nextMenuID(9000), m_nextFoldID(0), m_doUpdateBundles(true),
+  m_dispatcher(disp), m_styleNode(NULL), m_styleCacheHits(0), m_styleCacheMisses(0), m_bundleMenu(NULL), m_nextMenuID(9000), m_nextFoldID(0), m_doUpdateBundles(true),
   m_nextBundle(0), m_currentSyntax(NULL), m_currentMatchers(NULL), m_currentParsedReps(NULL), m_repsInParsing(NULL) {
 	// Initialize TinyXml
 	TiXmlBase::SetCondenseWhiteSpace(false);
@@ -212,6 +213,9 @@ bool TmSyntaxHandler::DoIdle() {
 }
 
 void TmSyntaxHandler::ClearBundleInfo() {
+	// Background parsers may still be using the matchers and styles
+	Styler_Syntax::StopAllParsers();
+
 	// Release allocated syntaxes
 	for (vector<cxSyntaxInfo*>::iterator x = m_syntaxes.begin(); x != m_syntaxes.end(); ++x) {
 		delete *x;
@@ -237,6 +241,7 @@ void TmSyntaxHandler::ClearBundleInfo() {
 	m_styles.clear();
 	delete m_styleNode;
 	m_styleNode = NULL;
+	ClearStyleCache();
 
 	// Release allocated indentation preferences
 	for (vector<tmPrefs*>::iterator p = m_prefs.begin(); p != m_prefs.end(); ++p) {
@@ -280,6 +285,8 @@ void TmSyntaxHandler::ClearBundleInfo() {
 	}
 	m_symbolTransforms.clear();
 	m_symbolNode.clear();
+	m_symbolCache.clear();
+	m_symbolCacheValid.clear();
 
 	// Release allocated Fold Rules
 	for (vector<cxFoldRule*>::iterator f = m_foldRules.begin(); f != m_foldRules.end(); ++f) {
@@ -652,6 +659,44 @@ const style* TmSyntaxHandler::GetStyle(const deque<const wxString*>& scopes) con
 	return NULL;
 }
 
+const style* TmSyntaxHandler::GetStyle(unsigned int stackId) const {
+	wxCriticalSectionLocker lock(m_styleCacheCrit);
+
+	if (stackId < m_styleCacheValid.size() && m_styleCacheValid[stackId]) {
+		++m_styleCacheHits;
+		return m_styleCache[stackId];
+	}
+	++m_styleCacheMisses;
+
+	const style* st = NULL;
+	if (m_styleNode) {
+		ScopeAtoms::ScopeList scopes;
+		ScopeAtoms::Get().GetStackScopes(stackId, scopes);
+
+		const vector<const style*>* s = m_styleNode->GetMatch(scopes);
+		if (s && !s->empty()) st = (*s)[0];
+	}
+
+	if (stackId >= m_styleCacheValid.size()) {
+		m_styleCache.resize(stackId+1, NULL);
+		m_styleCacheValid.resize(stackId+1, false);
+	}
+	m_styleCache[stackId] = st;
+	m_styleCacheValid[stackId] = true;
+
+	return st;
+}
+
+void TmSyntaxHandler::ClearStyleCache() {
+	wxCriticalSectionLocker lock(m_styleCacheCrit);
+
+	wxLogDebug(wxT("Style cache: %u hits, %u misses"), m_styleCacheHits, m_styleCacheMisses);
+	m_styleCache.clear();
+	m_styleCacheValid.clear();
+	m_styleCacheHits = 0;
+	m_styleCacheMisses = 0;
+}
+
 const wxString& TmSyntaxHandler::GetIndentNonePattern(const deque<const wxString*>& scopes) const {
 	// Find all matching indentation rules
 	vector<const tmPrefs*> result;
@@ -761,6 +806,26 @@ bool TmSyntaxHandler::ShowSymbol(const deque<const wxString*>& scopes, const wxS
 	return false;
 }
 
+bool TmSyntaxHandler::ShowSymbol(unsigned int stackId, const wxString*& transform) const {
+	if (stackId >= m_symbolCacheValid.size() || !m_symbolCacheValid[stackId]) {
+		ScopeAtoms::ScopeList scopes;
+		ScopeAtoms::Get().GetStackScopes(stackId, scopes);
+
+		const vector<const wxString*>* result = m_symbolNode.GetMatch(scopes);
+		const wxString* t = (result && !result->empty()) ? (*result)[0] : NULL;
+
+		if (stackId >= m_symbolCacheValid.size()) {
+			m_symbolCache.resize(stackId+1, NULL);
+			m_symbolCacheValid.resize(stackId+1, false);
+		}
+		m_symbolCache[stackId] = t;
+		m_symbolCacheValid[stackId] = true;
+	}
+
+	transform = m_symbolCache[stackId];
+	return transform != NULL;
+}
+
 const TmSyntaxHandler::cxFoldRule* TmSyntaxHandler::GetFoldRule(const deque<const wxString*>& scopes) const {
 	const vector<const cxFoldRule*>* result = m_foldNode.GetMatch(scopes);
 	if (result && !result->empty())  return (*result)[0];
@@ -1075,8 +1140,16 @@ cxSyntaxInfo* TmSyntaxHandler::GetSyntaxInfo(unsigned int bundleId, unsigned int
 	return si;
 }
 
-const cxSyntaxInfo* TmSyntaxHandler::InitSyntax(cxSyntaxInfo& si, bool WXUNUSED(isTop)) {
+const cxSyntaxInfo* TmSyntaxHandler::InitSyntax(cxSyntaxInfo& si, bool isTop) {
 	if (si.topmatcher) return &si;
+
+	// The new matchers may get included in syntaxes being parsed in
+	// the background (included syntaxes are inited under same lock)
+	if (isTop) {
+		wxCriticalSectionLocker lock(matcher::GetLock());
+		return InitSyntax(si, false);
+	}
+
 	if (ParseSyntax(si)) {
 		//if (isTop && si.topmatcher) si.topmatcher->Init(true);
 		/*if (isTop) {
@@ -1541,12 +1614,14 @@ bool TmSyntaxHandler::LoadTheme(const char* uuid) {
 
 		// Set if we successfully loaded theme
 		m_currentTheme = themeSettings;
+		Styler_Syntax::StopAllParsers(); // parsers may be using old styles
 		for (vector<style*>::iterator v = m_styles.begin(); v != m_styles.end(); ++v) {
 			delete *v; // release old styles
 		}
 		m_styles = styles;
 		delete m_styleNode;
 		m_styleNode = rootNode;
+		ClearStyleCache();
 	}
 	return true;
 
@@ -2207,9 +2282,41 @@ wxMenu* TmSyntaxHandler::ParseMenu(const PListArray& itemsArray, const PListDict
 // ---- cxFoldRule ------------------------------------------------
 
 TmSyntaxHandler::cxFoldRule::cxFoldRule(unsigned int id, const char* startMarker, const char* endMarker):
-	ruleId(id),
-	foldingStartMarker(startMarker, startMarker + strlen(startMarker)+1),
-	foldingEndMarker(endMarker, endMarker + strlen(endMarker)+1) {}
+	ruleId(id), m_startStudy(NULL), m_endStudy(NULL)
+{
+	// Invalid patterns are left NULL and never match
+	const char *error;
+	int erroffset;
+	m_startPattern = pcre_compile(startMarker, PCRE_UTF8, &error, &erroffset, NULL);
+	if (m_startPattern) m_startStudy = pcre_study(m_startPattern, 0, &error);
+	m_endPattern = pcre_compile(endMarker, PCRE_UTF8, &error, &erroffset, NULL);
+	if (m_endPattern) m_endStudy = pcre_study(m_endPattern, 0, &error);
+}
+
+TmSyntaxHandler::cxFoldRule::~cxFoldRule() {
+	if (m_startStudy) pcre_free(m_startStudy);
+	if (m_startPattern) pcre_free(m_startPattern);
+	if (m_endStudy) pcre_free(m_endStudy);
+	if (m_endPattern) pcre_free(m_endPattern);
+}
+
+bool TmSyntaxHandler::cxFoldRule::Match(const pcre* re, const pcre_extra* study, const char* line, unsigned int len) {
+	if (!re) return false;
+
+	const int OVECCOUNT = 3;
+	int ovector[OVECCOUNT];
+	const int rc = pcre_exec(
+		re,                   // the compiled pattern
+		study,                // extra data from studying the pattern
+		len ? line : "",      // the subject string
+		len,                  // the length of the subject
+		0,                    // start at offset in the subject
+		PCRE_NO_UTF8_CHECK,   // options
+		ovector,              // output vector for substring information
+		OVECCOUNT);           // number of elements in the output vector
+
+	return rc >= 0;
+}
 
 // ---- SelectorParser ------------------------------------------------
 
@@ -2343,18 +2450,18 @@ template<class T> typename SelectorParser<T>::selToken SelectorParser<T>::GetNex
 template<class T> bool SelectorParser<T>::ParseScope() {
 	// Parse first word (required)
 	wxASSERT(m_currentToken == TOKEN_WORD);
-	m_currentNode = m_scopeNode = new sNode<T>(m_tokenValue);
+	m_currentNode = m_scopeNode = new sNode<T>(ScopeAtoms::Get().GetAtom(m_tokenValue));
 
 	while(GetNextToken() == TOKEN_DOT) {
 		if (GetNextToken() != TOKEN_WORD)
 			return false; // Invalid scope
 
 		// Add the new word to current scope
-		sNode<T>* newNode = new sNode<T>(m_tokenValue);
+		sNode<T>* newNode = new sNode<T>(ScopeAtoms::Get().GetAtom(m_tokenValue));
 		if (!m_currentNode->postfix)
-			m_currentNode->postfix = new map<wxString,sNode<T>*>;
+			m_currentNode->postfix = new typename sNode<T>::NodeMap;
 
-		(*m_currentNode->postfix)[m_tokenValue] = newNode;
+		(*m_currentNode->postfix)[newNode->word] = newNode;
 		m_currentNode = newNode;
 	}
 
@@ -2364,9 +2471,9 @@ template<class T> bool SelectorParser<T>::ParseScope() {
 // ---- sNode ------------------------------------------------
 
 template<class T> sNode<T>::sNode():
-	word(wxEmptyString), postfix(NULL), orNodes(NULL), ancestors(NULL), targets(NULL) {};
+	word(0), postfix(NULL), orNodes(NULL), ancestors(NULL), targets(NULL) {};
 
-template<class T> sNode<T>::sNode(const wxString& word):
+template<class T> sNode<T>::sNode(unsigned int word):
 	word(word), postfix(NULL), orNodes(NULL), ancestors(NULL), targets(NULL) {};
 
 template<class T> sNode<T>::~sNode() {clear();}
@@ -2402,40 +2509,17 @@ template<class T> void sNode<T>::clear() {
 	// Delete targets vector (no need to delete contained pointers)
 	delete targets;
 	targets = NULL;
-
-	word.clear();
-}
-
-template<class T> void sNode<T>::Tokenize(const wxString& scope, wxArrayString& words) const {
-	const size_t len = scope.size();
-	size_t wordstart = 0;
-	size_t i = 0;
-
-	while (i < len) {
-		if (scope[i] == '.') {
-			words.Add(scope.substr(wordstart, i - wordstart));
-			wordstart = ++i;
-		}
-		else ++i;
-	}
-
-	if (wordstart < len) {
-		words.Add(scope.substr(wordstart));
-	}
 }
 
-static inline wxString NextWord(const wxString& scope, size_t& pos) {
-	const size_t len = scope.size();
-	const size_t wordstart = pos;
-	size_t i = pos;
-
-	while (i < len && scope[i] != '.') ++i;
+template<class T> const vector<const T*>* sNode<T>::GetMatch(const deque<const wxString*>& scopes) const {
+	if (scopes.empty() || !orNodes) return targets;
 
-	pos = i+1;
-	return scope.substr(wordstart, i-wordstart);
+	ScopeList atomScopes;
+	ScopeAtoms::Get().GetScopes(scopes, atomScopes);
+	return GetMatch(atomScopes);
 }
 
-template<class T> const vector<const T*>* sNode<T>::GetMatch(const deque<const wxString*>& scopes) const {
+template<class T> const vector<const T*>* sNode<T>::GetMatch(const ScopeList& scopes) const {
 	if (scopes.empty()) return targets;
 
 	if (orNodes) {
@@ -2445,14 +2529,12 @@ template<class T> const vector<const T*>* sNode<T>::GetMatch(const deque<const w
 		while (ndx > 0) {
 			--ndx;
 
-			// Parse the current scope
-			const wxString& scope = *scopes[ndx];
-			size_t scopePos = 0;
-			const wxString w = NextWord(scope, scopePos);
+			const AtomList& words = *scopes[ndx];
+			if (words.empty()) continue;
 
-			typename NodeMap::const_iterator p = orNodes->find(w);
+			typename NodeMap::const_iterator p = orNodes->find(words[0]);
 			if (p != orNodes->end()) {
-				const vector<const T*>* res = p->second->Match(scope, scopePos, scopes, ndx);
+				const vector<const T*>* res = p->second->Match(words, 0, scopes, ndx);
 				if (res) return res;
 			}
 
@@ -2471,19 +2553,20 @@ template<class T> void sNode<T>::GetMatches(const deque<const wxString*>& scopes
 	}
 
 	if (orNodes) {
+		ScopeList atomScopes;
+		ScopeAtoms::Get().GetScopes(scopes, atomScopes);
+
 		// We start at the bottom of the scope and we keep going a level up
-		size_t ndx = scopes.size();
+		size_t ndx = atomScopes.size();
 		while (ndx > 0) {
 			--ndx;
 
-			// Parse the current scope
-			wxArrayString words;
-			Tokenize(*scopes[ndx], words);
-			const wxString& w = words[0];
+			const AtomList& words = *atomScopes[ndx];
+			if (words.empty()) continue;
 
-			typename NodeMap::const_iterator p = orNodes->find(w);
+			typename NodeMap::const_iterator p = orNodes->find(words[0]);
 			if (p != orNodes->end()) {
-				p->second->Matches(words, 0, scopes, ndx, result);
+				p->second->Matches(words, 0, atomScopes, ndx, result);
 
 				// TODO: Add a ref to the triggering scope level
 			}
@@ -2492,73 +2575,39 @@ template<class T> void sNode<T>::GetMatches(const deque<const wxString*>& scopes
 
 	if (targets) result.insert(result.end(), targets->begin(), targets->end());
 }
-/*
-template<class T> template<class P> void sNode<T>::GetMatches(const deque<const wxString*>& scopes, vector<const T*>& result, P pred) const {
-	if (!scopes.empty()) {
-		if (orNodes) {
-			// We start at the bottom of the scope and we keep going a level up
-			for (int ndx = scopes.size()-1; ndx >= 0; --ndx) {
-				// Parse the current scope
-				wxArrayString words;
-				Tokenize(*scopes[ndx], words);
-				const wxString& w = words[0];
-
-				map<wxString,sNode*>::const_iterator p = orNodes->find(w);
-				if (p != orNodes->end()) {
-					if (p->second->MatchPredicate(words, 0, scopes, ndx, result, pred)) return;
-
-					// TODO: Add a ref to the triggering scope level
-				}
-			}
-		}
-	}
 
-	// match (but there may be no targes here)
-	if (targets) {
-		vector<const T*>::const_iterator p = targets->begin();
-		while (p != targets->end()) {
-			const T* t = *p;
-
-			if (pred(t)) {
-				result.insert(result.end(), *p);
-			}
-		}
-	}
-}
-*/
-template<class T> const vector<const T*>* sNode<T>::Match(const wxString& scope, size_t scopePos, const deque<const wxString*>& scopes, size_t level) const {
-	if (postfix && scopePos < scope.size()) {
-		const wxString w = NextWord(scope, scopePos);
-		typename NodeMap::const_iterator p = postfix->find(w);
+template<class T> const vector<const T*>* sNode<T>::Match(const AtomList& words, size_t pos, const ScopeList& scopes, size_t level) const {
+	const size_t nextPos = pos+1;
+	if (postfix && nextPos < words.size()) {
+		typename NodeMap::const_iterator p = postfix->find(words[nextPos]);
 		if (p != postfix->end()) {
-			const vector<const T*>* s = p->second->Match(scope, scopePos, scopes, level);
+			const vector<const T*>* s = p->second->Match(words, nextPos, scopes, level);
 			if (s) return s;
 		}
 	}
 
 	// If we didn't find a match look for ancestors
 	if (level && ancestors) {
-		// Parse the ancestor scope
 		const size_t ndx = level - 1;
-		const wxString& scope2 = *scopes[ndx];
-		scopePos = 0;
-		const wxString w = NextWord(scope2, scopePos);
+		const AtomList& words2 = *scopes[ndx];
 
-		typename NodeMap::const_iterator p = ancestors->find(w);
-		if (p != ancestors->end()) {
-			const vector<const T*>* s = p->second->Match(scope2, scopePos, scopes, ndx);
-			if (s) return s;
+		if (!words2.empty()) {
+			typename NodeMap::const_iterator p = ancestors->find(words2[0]);
+			if (p != ancestors->end()) {
+				const vector<const T*>* s = p->second->Match(words2, 0, scopes, ndx);
+				if (s) return s;
+			}
 		}
 	}
 
 	return targets; // match (but there may be no styles here)
 }
 
-template<class T> void sNode<T>::Matches(const wxArrayString& words, unsigned int pos, const deque<const wxString*>& scopes, size_t level, vector<const T*>& result) const {
+template<class T> void sNode<T>::Matches(const AtomList& words, size_t pos, const ScopeList& scopes, size_t level, vector<const T*>& result) const {
 	wxASSERT(word == words[pos]);
 
-	const unsigned int nextPos = pos+1;
-	if (postfix && nextPos < words.Count()) {
+	const size_t nextPos = pos+1;
+	if (postfix && nextPos < words.size()) {
 		typename NodeMap::const_iterator p = postfix->find(words[nextPos]);
 		if (p != postfix->end()) {
 			p->second->Matches(words, nextPos, scopes, level, result);
@@ -2567,62 +2616,21 @@ template<class T> void sNode<T>::Matches(const wxArrayString& words, unsigned in
 
 	// If we didn't find a match look for ancestors
 	if (level && ancestors) {
-		// Parse the ancestor scope
 		const size_t ndx = level - 1;
-		wxArrayString words2;
-		Tokenize(*scopes[ndx], words2);
-		const wxString& w = words2[0];
+		const AtomList& words2 = *scopes[ndx];
 
-		typename NodeMap::const_iterator p = ancestors->find(w);
-		if (p != ancestors->end()) {
-			p->second->Matches(words2, 0, scopes, ndx, result);
+		if (!words2.empty()) {
+			typename NodeMap::const_iterator p = ancestors->find(words2[0]);
+			if (p != ancestors->end()) {
+				p->second->Matches(words2, 0, scopes, ndx, result);
+			}
 		}
 	}
 
 	// match (but there may be no targes here)
 	if (targets) result.insert(result.end(), targets->begin(), targets->end());
 }
-/*
-template<class T> bool sNode<T>::MatchPredicate(const wxArrayString& words, unsigned int pos, const deque<const wxString*>& scopes, unsigned int level, vector<const T*>& result, const unary_function<const T*, bool>& pred) const {
-	wxASSERT(word == words[pos]);
-
-	const unsigned int nextPos = pos+1;
-	if (postfix && nextPos < words.Count()) {
-		map<wxString,sNode*>::const_iterator p = postfix->find(words[nextPos]);
-		if (p != postfix->end()) {
-			if (p->second->MatchPredicate(words, nextPos, scopes, level, result, pred)) return true;
-		}
-	}
-
-	// If we didn't find a match look for ancestors
-	if (level && ancestors) {
-		// Parse the ancestor scope
-		const unsigned int ndx = level - 1;
-		wxArrayString words2;
-		Tokenize(*scopes[ndx], words2);
-		const wxString& w = words2[0];
 
-		map<wxString,sNode*>::const_iterator p = ancestors->find(w);
-		if (p != ancestors->end()) {
-			if (p->second->MatchPredicate(words2, 0, scopes, ndx, result, pred)) return true;
-		}
-	}
-
-	// match (but there may be no targes here)
-	bool isFound = false;
-	if (targets) {
-		vector<const T*>::const_iterator p = targets->begin();
-		while (p != targets->end()) {
-			if (pred(*p)) {
-				result.insert(result.end(), p);
-				isFound = true;
-			}
-		}
-	}
-
-	return isFound;
-}
-*/
 template<class T> void sNode<T>::AddOrNode(sNode<T>* n) {
 	if (orNodes) {
 		typename NodeMap::iterator p = orNodes->find(n->word);
@@ -2634,7 +2642,7 @@ template<class T> void sNode<T>::AddOrNode(sNode<T>* n) {
 		}
 	}
 	else {
-		orNodes = new map<wxString,sNode*>;
+		orNodes = new NodeMap;
 		(*orNodes)[n->word] = n;
 	}
 }
@@ -2650,7 +2658,7 @@ template<class T> void sNode<T>::AddAncestor(sNode<T>* n) {
 		}
 	}
 	else {
-		ancestors = new map<wxString,sNode*>;
+		ancestors = new NodeMap;
 		(*ancestors)[n->word] = n;
 	}
 }
@@ -2662,7 +2670,7 @@ template<class T> void sNode<T>::Merge(sNode<T>* n) {
 	if (postfix) {
 		if (n->postfix) {
 			for (typename NodeMap::iterator p = n->postfix->begin(); p != n->postfix->end(); ++p) {
-				const wxString& w = p->second->word;
+				const unsigned int w = p->second->word;
 
 				typename NodeMap::iterator s = postfix->find(w);
 				if (s == postfix->end()) {
@@ -2682,7 +2690,7 @@ template<class T> void sNode<T>::Merge(sNode<T>* n) {
 	if (orNodes) {
 		if (n->orNodes) {
 			for (typename NodeMap::iterator p = n->orNodes->begin(); p != n->orNodes->end(); ++p) {
-				const wxString& w = p->second->word;
+				const unsigned int w = p->second->word;
 
 				typename NodeMap::iterator s = orNodes->find(w);
 				if (s == orNodes->end()) {
@@ -2702,7 +2710,7 @@ template<class T> void sNode<T>::Merge(sNode<T>* n) {
 	if (ancestors) {
 		if (n->ancestors) {
 			for (typename NodeMap::iterator p = n->ancestors->begin(); p != n->ancestors->end(); ++p) {
-				const wxString& w = p->second->word;
+				const unsigned int w = p->second->word;
 
 				typename NodeMap::iterator s = ancestors->find(w);
 				if (s == ancestors->end()) {
@@ -2735,12 +2743,12 @@ template<class T> void sNode<T>::Merge(sNode<T>* n) {
 
 template<class T> void sNode<T>::Print(size_t indent) const {
 	const wxString pre(' ', indent);
-	if (indent == 0) wxLogDebug(wxT("%s%s"), pre.c_str(), word.c_str());
+	if (indent == 0) wxLogDebug(wxT("%s%s"), pre.c_str(), ScopeAtoms::Get().GetWord(word).c_str());
 
 	if (postfix) {
 		wxLogDebug(wxT("%spostfix:"), pre.c_str());
 		for (typename NodeMap::const_iterator p = postfix->begin(); p != postfix->end(); ++p) {
-			wxLogDebug(wxT("%s  %s"), pre.c_str(), p->second->word.c_str());
+			wxLogDebug(wxT("%s  %s"), pre.c_str(), ScopeAtoms::Get().GetWord(p->second->word).c_str());
 
 			if (p->second->targets) {
 				wxLogDebug(wxT("%s    -> %d"), pre.c_str(), p->second->targets->size());
@@ -2753,7 +2761,7 @@ template<class T> void sNode<T>::Print(size_t indent) const {
 	if (orNodes) {
 		wxLogDebug(wxT("%sor:"), pre.c_str());
 		for (typename NodeMap::const_iterator p2 = orNodes->begin(); p2 != orNodes->end(); ++p2) {
-			wxLogDebug(wxT("%s  %s"), pre.c_str(), p2->second->word.c_str());
+			wxLogDebug(wxT("%s  %s"), pre.c_str(), ScopeAtoms::Get().GetWord(p2->second->word).c_str());
 
 			if (p2->second->targets) {
 				wxLogDebug(wxT("%s    -> %d"), pre.c_str(), p2->second->targets->size());
@@ -2766,7 +2774,7 @@ template<class T> void sNode<T>::Print(size_t indent) const {
 	if (ancestors) {
 		wxLogDebug(wxT("%sancestors:"), pre.c_str());
 		for (typename NodeMap::const_iterator p3 = ancestors->begin(); p3 != ancestors->end(); ++p3) {
-			wxLogDebug(wxT("%s  %s"), pre.c_str(), p3->second->word.c_str());
+			wxLogDebug(wxT("%s  %s"), pre.c_str(), ScopeAtoms::Get().GetWord(p3->second->word).c_str());
 
 			if (p3->second->targets) {
 				wxLogDebug(wxT("%s    -> %d"), pre.c_str(), p3->second->targets->size());
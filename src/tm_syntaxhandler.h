@@ -39,6 +39,7 @@
 #include "ITmLoadBundles.h"
 
 #include "Accelerators.h"
+#include "ScopeAtoms.h"
 
 
 class PListHandler;
@@ -57,6 +58,10 @@ class TiXmlElement;
 class DocumentWrapper;
 class Dispatcher;
 
+struct real_pcre;                 // This double pre-definition is needed
+typedef struct real_pcre pcre;    // because of the way it is defined in pcre.h
+struct pcre_extra;
+
 struct style;
 
 
@@ -88,30 +93,34 @@ struct tmCompletionCmd {
 template <class T> class sNode {
 public:
 	sNode();
-	sNode(const wxString& word);
+	sNode(unsigned int word);
 	~sNode();
 	void clear();
 
-	typedef std::map<wxString,sNode<T>*> NodeMap;
+	typedef std::map<unsigned int,sNode<T>*> NodeMap;
+	typedef ScopeAtoms::AtomList AtomList;
+	typedef ScopeAtoms::ScopeList ScopeList;
 
 	const std::vector<const T*>* GetMatch(const std::deque<const wxString*>& scopes) const;
+	const std::vector<const T*>* GetMatch(const ScopeList& scopes) const;
 	void GetMatches(const std::deque<const wxString*>& scopes, std::vector<const T*>& result) const;
 	template<class P> void GetMatches(const std::deque<const wxString*>& scopes, std::vector<const T*>& result, P& pred) const {
 		if (!scopes.empty()) {
 			if (orNodes) {
+				ScopeList atomScopes;
+				ScopeAtoms::Get().GetScopes(scopes, atomScopes);
+
 				// We start at the bottom of the scope and we keep going a level up
-				size_t ndx = scopes.size();
+				size_t ndx = atomScopes.size();
 				while (ndx > 0) {
 					--ndx;
 
-					// Parse the current scope
-					wxArrayString words;
-					Tokenize(*scopes[ndx], words);
-					const wxString& w = words[0];
+					const AtomList& words = *atomScopes[ndx];
+					if (words.empty()) continue;
 
-					typename NodeMap::const_iterator p = orNodes->find(w);
+					typename NodeMap::const_iterator p = orNodes->find(words[0]);
 					if (p != orNodes->end()) {
-						if (p->second->MatchPredicate(words, 0, scopes, ndx, result, pred)) return;
+						if (p->second->MatchPredicate(words, 0, atomScopes, ndx, result, pred)) return;
 
 						// TODO: Add a ref to the triggering scope level
 					}
@@ -133,13 +142,13 @@ public:
 		}
 	};
 
-	const std::vector<const T*>* Match(const wxString& scope, size_t scopePos, const std::deque<const wxString*>& scopes, size_t level) const;
-	void Matches(const wxArrayString& words, unsigned int pos, const std::deque<const wxString*>& scopes, size_t level, std::vector<const T*>& result) const;
-	template<class P> bool MatchPredicate(const wxArrayString& words, unsigned int pos, const std::deque<const wxString*>& scopes, size_t level, std::vector<const T*>& result, P& pred) const {
+	const std::vector<const T*>* Match(const AtomList& words, size_t pos, const ScopeList& scopes, size_t level) const;
+	void Matches(const AtomList& words, size_t pos, const ScopeList& scopes, size_t level, std::vector<const T*>& result) const;
+	template<class P> bool MatchPredicate(const AtomList& words, size_t pos, const ScopeList& scopes, size_t level, std::vector<const T*>& result, P& pred) const {
 		wxASSERT(word == words[pos]);
 
-		const unsigned int nextPos = pos+1;
-		if (postfix && nextPos < words.Count()) {
+		const size_t nextPos = pos+1;
+		if (postfix && nextPos < words.size()) {
 			typename NodeMap::const_iterator p = postfix->find(words[nextPos]);
 			if (p != postfix->end()) {
 				if (p->second->MatchPredicate(words, nextPos, scopes, level, result, pred)) return true;
@@ -148,15 +157,14 @@ public:
 
 		// If we didn't find a match look for ancestors
 		if (level && ancestors) {
-			// Parse the ancestor scope
 			const size_t ndx = level - 1;
-			wxArrayString words2;
-			Tokenize(*scopes[ndx], words2);
-			const wxString& w = words2[0];
+			const AtomList& words2 = *scopes[ndx];
 
-			typename NodeMap::const_iterator p = ancestors->find(w);
-			if (p != ancestors->end()) {
-				if (p->second->MatchPredicate(words2, 0, scopes, ndx, result, pred)) return true;
+			if (!words2.empty()) {
+				typename NodeMap::const_iterator p = ancestors->find(words2[0]);
+				if (p != ancestors->end()) {
+					if (p->second->MatchPredicate(words2, 0, scopes, ndx, result, pred)) return true;
+				}
 			}
 		}
 
@@ -181,16 +189,13 @@ public:
 	void Merge(sNode* n);
 
 	// Member variables
-	wxString word;
+	unsigned int word; // atom
 	NodeMap* postfix;
 	NodeMap* orNodes;
 	NodeMap* ancestors;
 	std::vector<const T*>* targets;
 
 	void Print(size_t indent=0) const;
-
-private:
-	void Tokenize(const wxString& scope, wxArrayString& words) const;
 };
 
 // Compare class for triggers
@@ -285,6 +290,9 @@ public:
 
 	// Style
 	const style* GetStyle(const std::deque<const wxString*>& scopes) const;
+	const style* GetStyle(unsigned int stackId) const; // memoized by scope stack (see ScopeAtoms)
+	unsigned int GetStyleCacheHits() const {wxCriticalSectionLocker lock(m_styleCacheCrit); return m_styleCacheHits;};
+	unsigned int GetStyleCacheMisses() const {wxCriticalSectionLocker lock(m_styleCacheCrit); return m_styleCacheMisses;};
 
 	// Actions
 	void GetAllActions(const std::deque<const wxString*>& scopes, std::vector<const tmAction*>& result) const;
@@ -313,14 +321,28 @@ public:
 
 	// Symbol
 	bool ShowSymbol(const std::deque<const wxString*>& scopes, const wxString*& transform) const;
+	bool ShowSymbol(unsigned int stackId, const wxString*& transform) const; // memoized by scope stack
 
 	// Folding
 	class cxFoldRule {
 	public:
 		cxFoldRule(unsigned int id, const char* startMarker, const char* endMarker);
+		~cxFoldRule();
+
+		// Matching a single line (patterns are compiled on grammar load,
+		// so this is safe to call from any thread)
+		bool IsStart(const char* line, unsigned int len) const {return Match(m_startPattern, m_startStudy, line, len);};
+		bool IsEnd(const char* line, unsigned int len) const {return Match(m_endPattern, m_endStudy, line, len);};
+
 		const unsigned int ruleId;
-		const std::vector<char> foldingStartMarker;
-		const std::vector<char> foldingEndMarker;
+
+	private:
+		static bool Match(const pcre* re, const pcre_extra* study, const char* line, unsigned int len);
+
+		pcre* m_startPattern;
+		pcre_extra* m_startStudy;
+		pcre* m_endPattern;
+		pcre_extra* m_endStudy;
 	};
 	const cxFoldRule* GetFoldRule(const std::deque<const wxString*>& scopes) const;
 
@@ -344,6 +366,7 @@ private:
 	// Theme parsing
 	bool GetThemeName(const wxFileName& path, wxString& name);
 	bool LoadTheme(const char* uuid);
+	void ClearStyleCache();
 	bool ParseSettings(const PListDict& dict, tmTheme& settings);
 	bool ParseStyle(const PListDict& dict, std::vector<style*>& styles, tmTheme& settings);
 	wxColour ParseColor(const wxString& color_hex, const wxColour& bgColor);
@@ -390,6 +413,13 @@ private:
 	std::vector<matcher*> m_matchers;
 	std::vector<style*> m_styles;
 	sNode<style>* m_styleNode;
+	mutable std::vector<const style*> m_styleCache;  // by stack id
+	mutable std::vector<bool> m_styleCacheValid;
+	mutable unsigned int m_styleCacheHits;
+	mutable unsigned int m_styleCacheMisses;
+	mutable wxCriticalSection m_styleCacheCrit;
+	mutable std::vector<const wxString*> m_symbolCache; // by stack id (main thread only)
+	mutable std::vector<bool> m_symbolCacheValid;
 	sNode<tmAction> m_actionNode;
 	sNode<tmDragCommand> m_dragNode;
 	std::map<const wxString, tmAction*> m_actions;